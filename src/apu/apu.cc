@@ -31,8 +31,10 @@
 
 #include "../util/util.h"
 #include "../util/data.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 #include "../memory/memory.h"
-#include "../sdl/audio_player.h"
+#include "./audio_sink.h"
 
 // These flags can be used to access the APU status.
 #define FLAG_DMC_IRQ 0x80U
@@ -165,16 +167,16 @@ static const DataWord length_table[] = { 10, 254, 20, 2, 40, 4, 80, 6, 160, 8,
                                          28, 32, 30 };
 
 /*
- * Creates an APU object. The object will not be in a valid state until
- * Connect() has been called.
+ * Creates an APU object, allocating its channels from the given arena. The
+ * object will not be in a valid state until Connect() has been called.
  */
-Apu::Apu(void) {
+Apu::Apu(Arena *arena) {
   // Allocate the channels of the APU.
-  pulse_a_ = new ApuPulse();
-  pulse_b_ = new ApuPulse();
-  triangle_ = new ApuTriangle();
-  noise_ = new ApuNoise();
-  dmc_ = new ApuDmc();
+  pulse_a_ = arena->New<ApuPulse>();
+  pulse_b_ = arena->New<ApuPulse>();
+  triangle_ = arena->New<ApuTriangle>();
+  noise_ = arena->New<ApuNoise>();
+  dmc_ = arena->New<ApuDmc>();
 
   // On power-up, the noise shifter is seeded with the value 1.
   noise_->shift = 1;
@@ -185,13 +187,22 @@ Apu::Apu(void) {
  * Connects the APU to the reset of the system.
  * This function must be called before the emulation can begin.
  */
-void Apu::Connect(Memory *memory, AudioPlayer *audio, DataWord *irq_line) {
+void Apu::Connect(Memory *memory, AudioSink *audio, DataWord *irq_line) {
   memory_ = memory;
   audio_ = audio;
   irq_line_ = irq_line;
   return;
 }
 
+/*
+ * Sets whether samples are sent to the audio sink. The filters still run
+ * while muted, so that the audio continues smoothly once unmuted.
+ */
+void Apu::SetMuted(bool muted) {
+  muted_ = muted;
+  return;
+}
+
 /*
  * Determines the number of APU cycles until the next interrupt.
  * Returns UINT_MAX if no interrupts will occur within the current state.
@@ -626,7 +637,7 @@ void Apu::PlaySample(void) {
   float sample = FilterNextSample(pulse_output + tnd_output);
 
   // Add the output to the sample buffer.
-  audio_->AddSample(sample);
+  if (!muted_) { audio_->AddSample(sample); }
 
   // Reset the sample clock.
   sample_clock_ -= 36.2869375;
@@ -888,15 +899,67 @@ DataWord Apu::Read(DoubleWord reg_addr) {
 }
 
 /*
- * Frees the APU structures.
+ * Writes the channels, frame counter, and audio filters of the APU to the
+ * given state.
  */
-Apu::~Apu(void) {
-  // Free the channels of the APU.
-  delete pulse_a_;
-  delete pulse_b_;
-  delete triangle_;
-  delete noise_;
-  delete dmc_;
+void Apu::SaveState(StateWriter *state) {
+  state->Put(*pulse_a_);
+  state->Put(*pulse_b_);
+  state->Put(*triangle_);
+  state->Put(*noise_);
+  state->Put(*dmc_);
+  state->Put(frame_control_);
+  state->Put(channel_status_);
+  state->Put(dmc_irq_);
+  state->Put(frame_irq_);
+  state->Put(frame_clock_);
+  state->Put(frame_step_);
+  state->Put(cycle_even_);
+  state->Put(sample_clock_);
+  state->Put(last_normal_sample_);
+  state->Put(last_hpf1_sample_);
+  state->Put(last_hpf2_sample_);
+  state->Put(last_lpf_sample_);
+  return;
+}
 
+/*
+ * Restores the channels, frame counter, and audio filters of the APU from
+ * the given state. Returns false if the state was too short, or held a
+ * table position outside of its table.
+ */
+bool Apu::LoadState(StateReader *state) {
+  state->Get(pulse_a_);
+  state->Get(pulse_b_);
+  state->Get(triangle_);
+  state->Get(noise_);
+  state->Get(dmc_);
+  state->Get(&frame_control_);
+  state->Get(&channel_status_);
+  state->Get(&dmc_irq_);
+  state->Get(&frame_irq_);
+  state->Get(&frame_clock_);
+  state->Get(&frame_step_);
+  state->Get(&cycle_even_);
+  state->Get(&sample_clock_);
+  state->Get(&last_normal_sample_);
+  state->Get(&last_hpf1_sample_);
+  state->Get(&last_hpf2_sample_);
+  state->Get(&last_lpf_sample_);
+
+  // The table positions are masked, so that an invalid state cannot cause
+  // an out of bounds read.
+  bool valid = !state->HasFailed() && (triangle_->pos <= 0x1FU)
+            && (dmc_->rate <= DMC_RATE_MASK);
+  triangle_->pos &= 0x1FU;
+  dmc_->rate &= DMC_RATE_MASK;
+  return valid;
+}
+
+/*
+ * Frees the APU. Its channels belong to the arena of the console, and are
+ * freed with it.
+ */
+Apu::~Apu(void) {
   return;
 }
@@ -4,9 +4,11 @@
 #include <cstdlib>
 #include <cstdint>
 
-#include "../sdl/audio_player.h"
+#include "./audio_sink.h"
 #include "../memory/memory.h"
 #include "../util/data.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 
 /*
  * This class contains all the structures, methods, and data necessary to
@@ -17,8 +19,10 @@
  */
 class Apu {
   private:
-    // Used to play the generated audio to the user.
-    AudioPlayer *audio_;
+    // Used to play the generated audio to the user. Samples are still
+    // generated while muted, but are not sent to the sink.
+    AudioSink *audio_;
+    bool muted_ = false;
 
     // Used to communicate with a memory and cpu object.
     Memory *memory_;
@@ -153,11 +157,14 @@ class Apu {
     float FilterNextSample(float sample);
 
   public:
-    // Creates a new APU.
-    Apu(void);
+    // Creates a new APU, whose channels live in the given arena.
+    Apu(Arena *arena);
 
     // Connects the APU to the rest of the console.
-    void Connect(Memory *memory, AudioPlayer *audio, DataWord *irq_line);
+    void Connect(Memory *memory, AudioSink *audio, DataWord *irq_line);
+
+    // Sets whether samples are sent to the audio sink.
+    void SetMuted(bool muted);
 
     // Returns the number of CPU cycles until the next IRQ from the APU.
     size_t Schedule(void);
@@ -172,7 +179,12 @@ class Apu {
     // Reads from a memory mapped APU register.
     DataWord Read(DoubleWord reg_add);
 
-    // Frees the APU channel structures.
+    // Saves or restores the channels, frame counter, and filters of the APU.
+    // Loading returns false if the state was invalid.
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
+    // Frees the APU. Its channels are freed with the arena.
     ~Apu(void);
 };
 
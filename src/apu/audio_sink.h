@@ -0,0 +1,24 @@
+#ifndef _NES_AUDIOSINK
+#define _NES_AUDIOSINK
+
+/*
+ * Receives the filtered samples produced by the APU. Allows the emulation
+ * to be run without an audio device.
+ */
+class AudioSink {
+  public:
+    // Adds the next sample of the audio output.
+    virtual void AddSample(float sample) = 0;
+
+    virtual ~AudioSink(void) { return; }
+};
+
+/*
+ * Discards every sample, for consoles which are run without audio.
+ */
+class NullAudioSink : public AudioSink {
+  public:
+    void AddSample(float sample) { (void)sample; return; }
+};
+
+#endif
@@ -0,0 +1,374 @@
+/*
+ * The batch runner executes many independent emulations at once, for rom
+ * compatibility checks and other bulk workloads. Every job runs headless,
+ * with no audio, and as fast as the host allows.
+ *
+ * A manifest lists one job per line:
+ *
+ *   <rom> [<movie>|-] [<frames>]
+ *
+ * The movie is a golden frame log, as written by ndb with --hash-log. Its
+ * buttons are replayed, and its hashes are checked, so a job diverges at the
+ * first frame which differs. Without a movie, no buttons are pressed and a
+ * number of frames must be given. Lines starting with '#' are comments.
+ *
+ * Every console is seeded as ndb seeds one when logging frames, so hashes
+ * logged by a batch job can be checked by ndb, and the reverse.
+ *
+ * Consecutive jobs of the same rom can be run together as the lanes of a
+ * lockstep group, which runs jobs in the same state with the same input on
+ * a single console. This pays off when many jobs replay similar movies,
+ * such as the rollouts of a search or learning agent.
+ */
+
+#include "./batch_runner.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+#include "../core/lockstep_group.h"
+#include "../emulation/frame_log.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+#include "../util/util.h"
+
+// The maximum length of a line in a manifest.
+#define MANIFEST_LINE_SIZE 1024U
+
+// The name given to the frame hash log of each job.
+#define JOB_LOG_FORMAT "%zu.log"
+#define JOB_LOG_NAME_SIZE 32U
+
+// The name of each job status in the report.
+static const char *kStatusNames[] = { "pending", "passed", "diverged",
+                                      "failed" };
+
+/*
+ * Reads the jobs from the given manifest, and creates a runner for them.
+ * Frame hashes are logged to the given directory, if it is not NULL.
+ *
+ * Returns NULL if the manifest cannot be read, is malformed, or is empty.
+ */
+BatchRunner *BatchRunner::Create(const char *manifest_path,
+                                 const char *log_dir, size_t num_workers,
+                                 size_t lanes) {
+  FILE *manifest = fopen(manifest_path, "r");
+  if (manifest == NULL) {
+    fprintf(stderr, "Error: Failed to open manifest %s.\n", manifest_path);
+    return NULL;
+  }
+
+  // Parse each job of the manifest, growing the job array as needed.
+  size_t capacity = 16;
+  size_t num_jobs = 0;
+  BatchJob *jobs = new BatchJob[capacity]();
+  char line[MANIFEST_LINE_SIZE];
+  size_t line_num = 0;
+  bool valid = true;
+  while (valid && (fgets(line, sizeof(line), manifest) != NULL)) {
+    line_num++;
+    char first[2];
+    if ((line[0] == '#') || (sscanf(line, "%1s", first) != 1)) { continue; }
+    if (num_jobs >= capacity) {
+      BatchJob *grown = new BatchJob[capacity * 2]();
+      for (size_t i = 0; i < num_jobs; i++) { grown[i] = jobs[i]; }
+      delete[] jobs;
+      jobs = grown;
+      capacity *= 2;
+    }
+    if (ParseJob(line, &(jobs[num_jobs]))) {
+      num_jobs++;
+    } else {
+      fprintf(stderr, "Error: Malformed job on line %zu of the manifest.\n",
+              line_num);
+      valid = false;
+    }
+  }
+  fclose(manifest);
+
+  if (valid && (num_jobs == 0)) {
+    fprintf(stderr, "Error: The manifest contains no jobs.\n");
+    valid = false;
+  }
+  if (!valid) {
+    for (size_t i = 0; i < num_jobs; i++) {
+      delete[] jobs[i].rom_path;
+      delete[] jobs[i].movie_path;
+    }
+    delete[] jobs;
+    return NULL;
+  }
+
+  if (num_workers == 0) {
+    num_workers = MAX(std::thread::hardware_concurrency(), 1U);
+  }
+  return new BatchRunner(jobs, num_jobs, log_dir, num_workers,
+                         MAX(lanes, 1U));
+}
+
+/*
+ * Parses a manifest line into the given job. Returns false if the line has
+ * no rom, or has neither a movie nor a number of frames.
+ */
+bool BatchRunner::ParseJob(char *line, BatchJob *job) {
+  char rom[MANIFEST_LINE_SIZE];
+  char movie[MANIFEST_LINE_SIZE];
+  size_t frames = 0;
+  int fields = sscanf(line, "%s %s %zu", rom, movie, &frames);
+  if (fields < 1) { return false; }
+
+  // A movie of "-" runs the job without one.
+  bool has_movie = (fields >= 2) && !StrEq(movie, "-");
+  if (!has_movie && (frames == 0)) { return false; }
+
+  job->rom_path = StrCpy(rom);
+  job->movie_path = (has_movie) ? StrCpy(movie) : NULL;
+  job->frames = frames;
+  job->status = JOB_PENDING;
+  return true;
+}
+
+/*
+ * Groups consecutive jobs with the same rom into units of up to the given
+ * number of lanes, then creates the queues of the workers and deals the
+ * units out to them.
+ */
+BatchRunner::BatchRunner(BatchJob *jobs, size_t num_jobs,
+                         const char *log_dir, size_t num_workers,
+                         size_t lanes) {
+  jobs_ = jobs;
+  num_jobs_ = num_jobs;
+  log_dir_ = log_dir;
+  lanes_ = lanes;
+
+  units_ = new BatchUnit[num_jobs_];
+  num_units_ = 0;
+  for (size_t i = 0; i < num_jobs_; i++) {
+    if (num_units_ > 0) {
+      BatchUnit *last = &(units_[num_units_ - 1]);
+      if ((last->num_jobs < lanes_)
+          && StrEq(jobs_[last->first_job].rom_path, jobs_[i].rom_path)) {
+        last->num_jobs++;
+        continue;
+      }
+    }
+    units_[num_units_].first_job = i;
+    units_[num_units_].num_jobs = 1;
+    num_units_++;
+  }
+
+  num_workers_ = MIN(num_workers, num_units_);
+  workers_ = new std::thread[num_workers_];
+  queues_ = new WorkQueue[num_workers_];
+  for (size_t i = 0; i < num_units_; i++) {
+    queues_[i % num_workers_].units.push_back(i);
+  }
+  return;
+}
+
+/*
+ * Runs every job on the worker threads, and waits for them to finish. The
+ * results of each job are written to the report as it finishes, followed
+ * by a summary of the whole batch.
+ *
+ * Returns true if every job passed.
+ */
+bool BatchRunner::Run(FILE *report) {
+  report_ = report;
+  fprintf(report_, "# job status frames hash ms fps rom\n");
+  fflush(report_);
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_workers_; i++) {
+    workers_[i] = std::thread(&BatchRunner::RunWorker, this, i);
+  }
+  for (size_t i = 0; i < num_workers_; i++) { workers_[i].join(); }
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now()
+                                     - start;
+
+  // Summarize the batch.
+  size_t passed = 0;
+  size_t frames = 0;
+  for (size_t i = 0; i < num_jobs_; i++) {
+    if (jobs_[i].status == JOB_PASSED) { passed++; }
+    frames += jobs_[i].frames_run;
+  }
+  fprintf(report_, "# %zu of %zu jobs passed, %zu frames in %.3f s on %zu "
+          "workers (%.1f frames/s)\n", passed, num_jobs_, frames,
+          wall.count(), num_workers_,
+          static_cast<double>(frames) / wall.count());
+  if (lanes_ > 1) {
+    fprintf(report_, "# %zu units of up to %zu lanes, %zu frames run by "
+            "consoles\n", num_units_, lanes_, console_frames_);
+  }
+  fflush(report_);
+  return passed == num_jobs_;
+}
+
+/*
+ * Runs units on the calling worker until none remain in any queue.
+ */
+void BatchRunner::RunWorker(size_t worker) {
+  size_t unit;
+  while (TakeUnit(worker, &unit)) { RunUnit(unit); }
+  return;
+}
+
+/*
+ * Takes the next unit from the front of the queue of the given worker. If
+ * the queue is empty, a unit is stolen from the back of the queue of another
+ * worker. Units are never added once the batch starts, so the batch is
+ * finished once every queue is empty.
+ */
+bool BatchRunner::TakeUnit(size_t worker, size_t *unit) {
+  // Take a unit from the worker's own queue.
+  {
+    std::lock_guard<std::mutex> guard(queues_[worker].lock);
+    if (!queues_[worker].units.empty()) {
+      *unit = queues_[worker].units.front();
+      queues_[worker].units.pop_front();
+      return true;
+    }
+  }
+
+  // Steal a unit from the other workers, starting with the next one.
+  for (size_t i = 1; i < num_workers_; i++) {
+    WorkQueue *victim = &(queues_[(worker + i) % num_workers_]);
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if (!victim->units.empty()) {
+      *unit = victim->units.back();
+      victim->units.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * Runs the jobs of the given unit in lockstep, as fast as possible, until
+ * each has run its frames or reached the end of its movie. Fills in the
+ * results of each job, then reports them.
+ */
+void BatchRunner::RunUnit(size_t index) {
+  BatchJob *jobs = &(jobs_[units_[index].first_job]);
+  size_t num_lanes = units_[index].num_jobs;
+  auto start = std::chrono::steady_clock::now();
+
+  // Open the frame hash log and movie of each job. A job whose files cannot
+  // be opened fails, and is not run.
+  FrameLog **logs = new FrameLog*[num_lanes];
+  bool *running = new bool[num_lanes];
+  for (size_t lane = 0; lane < num_lanes; lane++) {
+    char *log_path = NULL;
+    if (log_dir_ != NULL) {
+      char log_name[JOB_LOG_NAME_SIZE];
+      snprintf(log_name, sizeof(log_name), JOB_LOG_FORMAT,
+               units_[index].first_job + lane);
+      log_path = JoinPaths(log_dir_, log_name);
+    }
+    logs[lane] = FrameLog::Create(log_path, jobs[lane].movie_path, NULL);
+    running[lane] = (logs[lane] != NULL);
+    jobs[lane].status = JOB_FAILED;
+    delete[] log_path;
+  }
+
+  // Load the rom into a group of consoles, seeded just as ndb seeds one
+  // when logging frames.
+  FILE *rom = fopen(jobs[0].rom_path, "rb");
+  if (rom == NULL) {
+    fprintf(stderr, "Error: Failed to open rom %s.\n", jobs[0].rom_path);
+  }
+  LockstepGroup *group = NULL;
+  if (rom != NULL) {
+    RandSeed(FRAME_LOG_SEED);
+    group = LockstepGroup::Create(rom, num_lanes);
+    fclose(rom);
+  }
+
+  // Run the jobs, giving each lane the buttons of its movie and recording
+  // the frames it draws, until every job has finished.
+  while (group != NULL) {
+    size_t lanes_running = 0;
+    for (size_t lane = 0; lane < num_lanes; lane++) {
+      BatchJob *job = &(jobs[lane]);
+      if (running[lane] && (logs[lane]->IsDone() || ((job->frames > 0)
+                            && (job->frames_run >= job->frames)))) {
+        job->status = (logs[lane]->HasDiverged()) ? JOB_DIVERGED : JOB_PASSED;
+        running[lane] = false;
+      }
+      if (running[lane]) {
+        group->SetInput(lane, logs[lane]->Poll());
+        lanes_running++;
+      } else {
+        group->Retire(lane);
+      }
+    }
+    if (lanes_running == 0) { break; }
+
+    group->RunFrame();
+    for (size_t lane = 0; lane < num_lanes; lane++) {
+      if (!running[lane]) { continue; }
+      const NesFrame *frame = group->GetFrame(lane);
+      logs[lane]->Record(frame);
+      jobs[lane].last_hash = HashFrame(frame);
+      jobs[lane].frames_run++;
+    }
+  }
+
+  // Report the results of each job. Jobs run together share their time.
+  std::chrono::duration<double> time = std::chrono::steady_clock::now()
+                                     - start;
+  if (group != NULL) {
+    std::lock_guard<std::mutex> guard(report_lock_);
+    console_frames_ += group->GetConsoleFrames();
+  }
+  for (size_t lane = 0; lane < num_lanes; lane++) {
+    jobs[lane].seconds = time.count();
+    ReportJob(units_[index].first_job + lane);
+    delete logs[lane];
+  }
+  delete group;
+  delete[] logs;
+  delete[] running;
+  return;
+}
+
+/*
+ * Writes a line with the results of the given job to the report.
+ */
+void BatchRunner::ReportJob(size_t index) {
+  BatchJob *job = &(jobs_[index]);
+  double fps = (job->seconds > 0.0)
+             ? static_cast<double>(job->frames_run) / job->seconds : 0.0;
+
+  std::lock_guard<std::mutex> guard(report_lock_);
+  fprintf(report_, "%zu %s %zu %016" PRIx64 " %.1f %.1f %s\n", index,
+          kStatusNames[job->status], job->frames_run, job->last_hash,
+          job->seconds * 1000.0, fps, job->rom_path);
+  fflush(report_);
+  return;
+}
+
+/*
+ * Frees the jobs, queues, and worker threads.
+ */
+BatchRunner::~BatchRunner(void) {
+  for (size_t i = 0; i < num_jobs_; i++) {
+    delete[] jobs_[i].rom_path;
+    delete[] jobs_[i].movie_path;
+  }
+  delete[] jobs_;
+  delete[] units_;
+  delete[] workers_;
+  delete[] queues_;
+  return;
+}
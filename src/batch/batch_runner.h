@@ -0,0 +1,122 @@
+#ifndef _NES_BATCHRUNNER
+#define _NES_BATCHRUNNER
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <deque>
+
+// The outcomes of a batch job.
+typedef enum {JOB_PENDING, JOB_PASSED, JOB_DIVERGED, JOB_FAILED} JobStatus;
+
+/*
+ * A single headless run of a rom, and its results.
+ *
+ * A job runs for the given number of frames, or until its movie ends if the
+ * number of frames is zero. Movies are golden frame logs, whose buttons are
+ * replayed and whose hashes are checked.
+ */
+struct BatchJob {
+  // The rom to run, and the movie to replay. The movie may be NULL.
+  char *rom_path;
+  char *movie_path;
+  size_t frames;
+
+  // The results of the job, filled in by the worker which ran it.
+  JobStatus status;
+  size_t frames_run;
+  uint64_t last_hash;
+  double seconds;
+};
+
+/*
+ * A run of consecutive jobs of the manifest which share a rom, and so can
+ * be run together in lockstep.
+ */
+struct BatchUnit {
+  size_t first_job;
+  size_t num_jobs;
+};
+
+/*
+ * Runs a manifest of independent jobs on a pool of worker threads, each of
+ * which runs one unit of jobs at a time. Without lockstep lanes, each unit
+ * is a single job.
+ *
+ * Units are dealt out to the workers in turn. A worker which runs out of
+ * units steals from the back of the queue of another worker, so that the
+ * pool stays busy when jobs vary in length.
+ */
+class BatchRunner {
+  private:
+    // The queue of units held by each worker. The owner takes units from
+    // the front, and thieves take them from the back.
+    struct WorkQueue {
+      std::mutex lock;
+      std::deque<size_t> units;
+    };
+
+    // The jobs of the manifest, and the units they are run in.
+    BatchJob *jobs_;
+    size_t num_jobs_;
+    BatchUnit *units_;
+    size_t num_units_;
+
+    // The most jobs which are run in lockstep, and the number of frames
+    // which were run by consoles across the batch.
+    size_t lanes_;
+    size_t console_frames_ = 0;
+
+    // The directory the frame hashes of each job are logged to. May be NULL.
+    const char *log_dir_;
+
+    // The worker threads and their queues.
+    std::thread *workers_;
+    WorkQueue *queues_;
+    size_t num_workers_;
+
+    // Guards the report written as jobs finish, and the frame count.
+    std::mutex report_lock_;
+    FILE *report_;
+
+    // Stores the parsed manifest, and groups its jobs into units.
+    BatchRunner(BatchJob *jobs, size_t num_jobs, const char *log_dir,
+                size_t num_workers, size_t lanes);
+
+    // Parses a single line of a manifest into the given job. Returns false
+    // if the line is malformed.
+    static bool ParseJob(char *line, BatchJob *job);
+
+    // Runs units until every queue is empty.
+    void RunWorker(size_t worker);
+
+    // Takes the next unit for the given worker, stealing one if its own
+    // queue is empty. Returns false when no units remain.
+    bool TakeUnit(size_t worker, size_t *unit);
+
+    // Runs the jobs of the given unit in lockstep on a new group of
+    // consoles, filling in their results.
+    void RunUnit(size_t unit);
+
+    // Writes the results of the given job to the report.
+    void ReportJob(size_t index);
+
+  public:
+    // Loads the jobs of the given manifest. Returns NULL if the manifest
+    // cannot be read or is malformed. If the number of workers is zero, one
+    // worker is used for each hardware thread. Up to the given number of
+    // consecutive jobs with the same rom are run in lockstep.
+    static BatchRunner *Create(const char *manifest_path, const char *log_dir,
+                               size_t num_workers, size_t lanes);
+
+    // Runs every job, writing the results of each to the given report as it
+    // finishes. Returns true if every job passed.
+    bool Run(FILE *report);
+
+    // Frees the jobs and units of the manifest.
+    ~BatchRunner(void);
+};
+
+#endif
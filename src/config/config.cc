@@ -51,8 +51,9 @@ Config::Config(const char *config_file) {
   // Creates an empty dictionary to hold the configuration.
   dict_ = new DictElem*[DICT_SIZE]();
 
-  // Holds the default configuration file location.
+  // Holds the default configuration file location, and the given one.
   default_config_ = GetDefaultFile();
+  config_file_ = (config_file != NULL) ? StrCpy(config_file) : NULL;
 
   // Loads the given configuration file into the dictionary.
   Load(config_file);
@@ -104,94 +105,135 @@ void Config::Load(const char *config_file) {
   }
 
   // If the requested file did not exist, we do nothing.
-  if (errno == ENOENT) { return; }
+  if (config == NULL) { return; }
+
+  // Reads the whole file at once, so that it can be scanned from memory.
+  size_t file_size = GetFileSize(config);
+  char *text = new char[file_size];
+  size_t text_size = fread(text, 1, file_size, config);
+  fclose(config);
 
   // Scans each line of the file for a valid configuration setting.
   // Keys and values can be no larger than BUF_LIMIT characters.
   char key[BUF_LIMIT];
   char val[BUF_LIMIT];
-  int next_byte;
-  while ((next_byte = fgetc(config)) != EOF) {
-    // Undo the stream position increment from the loop guard.
-    fseek(config, -1, SEEK_CUR);
-
+  const char *pos = text;
+  const char *end = text + text_size;
+  while (pos < end) {
     // Scan the next line for a key and value, and add them to the dictionary
-    // if they're valid.
-    if (!ScanKey(key, BUF_LIMIT, config)) { continue; }
-    if (!ScanVal(val, BUF_LIMIT, config)) { continue; }
-    Set(key, val);
+    // if they're valid. Fields set for this run are not replaced.
+    if (!ScanKey(key, BUF_LIMIT, &pos, end)) { continue; }
+    if (!ScanVal(val, BUF_LIMIT, &pos, end)) { continue; }
+    if (!IsKept(key)) { Set(key, val); }
   }
 
-  // Closes the config file and returns.
-  fclose(config);
+  delete[] text;
   return;
 }
 
 /*
- * Scans the given file for a valid dictionary key on the current line.
+ * Removes every field which would be saved from the dictionary, then loads
+ * the configuration file again. This drops fields which were removed from
+ * the file, while keeping the fields set for this run, such as those given
+ * on the command line.
+ */
+void Config::Reload(void) {
+  for (size_t i = 0; i < DICT_SIZE; i++) {
+    DictElem **link = &(dict_[i]);
+    while (*link != NULL) {
+      DictElem *elem = *link;
+      if (elem->save && !(elem->keep)) {
+        *link = elem->next;
+        delete[] elem->key;
+        delete[] elem->val;
+        delete elem;
+      } else {
+        link = &(elem->next);
+      }
+    }
+  }
+
+  Load(config_file_);
+  return;
+}
+
+/*
+ * Scans the given text for a valid dictionary key on the current line,
+ * advancing the position past the assignment character "=".
  *
- * Fails if it finds and EOF or newline character before the assignment
- * character "=". Fails if the given buffer is filled before the string
- * is terminated.
+ * Fails if it finds the end of the text or a newline character before the
+ * assignment character. Fails if the given buffer is filled before the
+ * string is terminated.
  *
- * Returns false and jumps the file to the next line on failure.
+ * Returns false and moves the position to the next line on failure.
  */
-bool Config::ScanKey(char *buf, size_t buf_size, FILE *config) {
+bool Config::ScanKey(char *buf, size_t buf_size, const char **pos,
+                     const char *end) {
   // Scan the line until either a failing condition is met or the
   // entire key has been read.
   size_t i = 0;
-  int next_byte;
-  while ((next_byte = fgetc(config)) != '=') {
-    // Add the next character to the buffer if it was valid.
-    if ((next_byte == '\n') || (next_byte == EOF)) { return false; }
-    buf[i] = next_byte;
-
-    // Jump to the next line and return false if the buffer is now full.
-    if (++i >= buf_size) {
-      do {
-        next_byte = fgetc(config);
-      } while ((next_byte != '\n') && (next_byte != EOF));
-      return false;
-    }
+  const char *next = *pos;
+  while ((next < end) && (*next != '=') && (*next != '\n')
+         && (i + 1 < buf_size)) {
+    buf[i++] = *next;
+    next++;
+  }
+
+  // Fail if the line ended, or the buffer filled, before the assignment,
+  // skipping the rest of the line.
+  if ((next >= end) || (*next != '=')) {
+    *pos = SkipLine(next, end);
+    return false;
   }
 
   // Terminate the string and return success.
   buf[i] = '\0';
+  *pos = next + 1;
   return true;
 }
 
 /*
- * Fills the buffer with data from the file.
+ * Fills the buffer with the rest of the current line of the text, advancing
+ * the position to the next line.
  *
- * Assumes the file is positioned at the beginning of a key.
+ * Assumes the position is just past the assignment of a key.
  *
- * Returns success if a newline or EOF is encountered before the buffer fills.
- * Returns failure if the buffer fills.
+ * Returns success if a newline or the end of the text is encountered before
+ * the buffer fills. Returns failure if the buffer fills.
  */
-bool Config::ScanVal(char *buf, size_t buf_size, FILE *config) {
+bool Config::ScanVal(char *buf, size_t buf_size, const char **pos,
+                     const char *end) {
   // Scan the line until either a stop character is encountered or
   // the buffer has been filled.
   size_t i = 0;
-  int next_byte = fgetc(config);
-  while ((next_byte != '\n') && (next_byte != EOF)) {
-    // Add the character to the buffer and read the next character.
-    buf[i] = next_byte;
-    next_byte = fgetc(config);
-
+  const char *next = *pos;
+  while ((next < end) && (*next != '\n')) {
     // Check if the buffer has been filled.
-    if (++i >= buf_size) {
-      do {
-        next_byte = fgetc(config);
-      } while ((next_byte != '\n') && (next_byte != EOF));
+    if (i + 1 >= buf_size) {
+      *pos = SkipLine(next, end);
       return false;
     }
+
+    // Add the character to the buffer.
+    buf[i++] = *next;
+    next++;
   }
 
-  // Terminate the string and return failure.
+  // Terminate the string and return success.
   buf[i] = '\0';
+  *pos = SkipLine(next, end);
   return true;
 }
 
+/*
+ * Gets the start of the line after the given position in the text, or the
+ * end of the text if there is none.
+ */
+const char *Config::SkipLine(const char *pos, const char *end) {
+  const void *newline = memchr(pos, '\n', static_cast<size_t>(end - pos));
+  return (newline != NULL) ? static_cast<const char*>(newline) + 1 : end;
+}
+
 /*
  * Writes the current configuration to the given file.
  */
@@ -220,7 +262,7 @@ void Config::Save(const char *config_file) {
   for (size_t i = 0; i < DICT_SIZE; i++) {
     DictElem *elem = dict_[i];
     while (elem != NULL) {
-      WriteElem(elem, config);
+      if (elem->save) { WriteElem(elem, config); }
       elem = elem->next;
     }
   }
@@ -282,6 +324,7 @@ const char *Config::Get(const char *key, const char *default_value) {
     // the value.
     elem->key = StrCpy(key);
     elem->val = StrCpy(default_value);
+    elem->save = true;
     return elem->val;
   }
 
@@ -293,9 +336,13 @@ const char *Config::Get(const char *key, const char *default_value) {
  * Adds the given value to the configuration dictionary under the given key.
  * Copies of the given key and value are used in the dictionary.
  *
+ * If save is false, the field is not written back to the config file. This
+ * allows settings to be overridden for a single run, such as from the
+ * command line.
+ *
  * Assumes the given key and value are non-null and valid.
  */
-void Config::Set(const char *key, const char *val) {
+void Config::Set(const char *key, const char *val, bool save) {
   // If the key is already in the configuration dictionary, the value
   // is updated.
   size_t index = Hash(key);
@@ -305,6 +352,7 @@ void Config::Set(const char *key, const char *val) {
     if (StrEq(elem->key, key)) {
       delete[] elem->val;
       elem->val = StrCpy(val);
+      elem->save = save;
       return;
     }
     last_elem = elem;
@@ -322,10 +370,38 @@ void Config::Set(const char *key, const char *val) {
   }
   elem->key = StrCpy(key);
   elem->val = StrCpy(val);
+  elem->save = save;
 
   return;
 }
 
+/*
+ * Sets the given field, which is saved, and marks it to be kept when the
+ * configuration file is loaded again. This lets a setting given on the
+ * command line be saved for later runs without a reload undoing it.
+ *
+ * Assumes the given key and value are non-null and valid.
+ */
+void Config::Override(const char *key, const char *val) {
+  Set(key, val);
+  for (DictElem *elem = dict_[Hash(key)]; elem != NULL; elem = elem->next) {
+    if (StrEq(elem->key, key)) { elem->keep = true; }
+  }
+  return;
+}
+
+/*
+ * Checks if the given key holds a field which is kept when the
+ * configuration file is loaded again, as it will not be saved or was
+ * overridden for this run.
+ */
+bool Config::IsKept(const char *key) {
+  for (DictElem *elem = dict_[Hash(key)]; elem != NULL; elem = elem->next) {
+    if (StrEq(elem->key, key)) { return !(elem->save) || elem->keep; }
+  }
+  return false;
+}
+
 /*
  * Hashes the given string.
  *
@@ -366,6 +442,7 @@ Config::~Config(void) {
   // Delete the dict itself and the default folder path string.
   delete[] dict_;
   delete[] default_config_;
+  delete[] config_file_;
 
   return;
 }
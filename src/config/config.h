@@ -11,13 +11,70 @@ const char* const kRendererTypeKey = "renderer_type";
 const char* const kRendererHardwareVal = "hardware";
 const char* const kRendererSurfaceVal = "surface";
 
-//TODO: Unused.
 const char* const kVideoTypeKey = "video_type";
 const char* const kVideoRGBVal = "RGB";
 const char* const kVideoNTSCVal = "NTSC";
 
 const char* const kPaletteFileKey = "palette_file";
 
+const char* const kUpscalerKey = "upscaler";
+const char* const kUpscalerNoneVal = "none";
+const char* const kUpscalerScale2xVal = "scale2x";
+const char* const kUpscalerScale3xVal = "scale3x";
+const char* const kUpscalerScale4xVal = "scale4x";
+
+/* Keys/vals for frame pacing configuration */
+
+const char* const kFrameSyncKey = "frame_sync";
+const char* const kFrameSyncConsoleVal = "console";
+const char* const kFrameSyncDisplayVal = "display";
+
+const char* const kSpeedKey = "speed";
+const char* const kSpeedDefaultVal = "1.0";
+
+/* Keys/vals for audio configuration */
+
+const char* const kVolumeKey = "volume";
+const char* const kVolumeDefaultVal = "100";
+
+/* Keys/vals for frame capture configuration */
+
+const char* const kCaptureFormatKey = "capture_format";
+const char* const kCapturePpmVal = "ppm";
+const char* const kCapturePngVal = "png";
+const char* const kCaptureRawVal = "raw";
+const char* const kCaptureY4mVal = "y4m";
+
+const char* const kCapturePathKey = "capture_path";
+const char* const kCaptureFramesKey = "capture_frames";
+
+/* Keys for frame hash logging */
+
+const char* const kHashLogKey = "hash_log";
+const char* const kHashGoldenKey = "hash_golden";
+
+/* Keys for netplay */
+
+const char* const kNetLocalKey = "net_local";
+const char* const kNetRemoteKey = "net_remote";
+const char* const kNetPlayerKey = "net_player";
+const char* const kNetDelayKey = "net_delay";
+const char* const kNetLatencyKey = "net_latency_ms";
+const char* const kNetJitterKey = "net_jitter_ms";
+const char* const kNetLossKey = "net_loss_percent";
+
+/* Keys/vals for debugging */
+
+const char* const kPpuViewerKey = "ppu_viewer";
+const char* const kPpuViewerOnVal = "on";
+const char* const kPpuViewerOffVal = "off";
+const char* const kTraceLogKey = "trace_log";
+const char* const kDisasExportKey = "disassembly";
+const char* const kDebuggerKey = "debugger";
+const char* const kTermDebuggerKey = "terminal_debugger";
+const char* const kTermDebuggerOnVal = "on";
+const char* const kTermDebuggerOffVal = "off";
+
 /* Keys for controller configuration */
 
 //TODO: Unused.
@@ -48,6 +105,8 @@ class Config {
     struct DictElem {
       char *key;
       char *val;
+      bool save;
+      bool keep;
       DictElem *next;
     };
 
@@ -58,13 +117,22 @@ class Config {
     // This value is OS dependent.
     char *default_config_;
 
+    // The file the configuration was created from, or NULL for the default.
+    char *config_file_;
+
     // Determines the default configuration location should be.
     // The implementation of this function is OS dependent.
     char *GetDefaultFile(void);
 
-    // Scans a key/value from a line in the configuration file.
-    bool ScanKey(char *buf, size_t buf_size, FILE *config);
-    bool ScanVal(char *buf, size_t buf_size, FILE *config);
+    // Scans a key/value from a line of the text of the configuration file,
+    // advancing the given position.
+    bool ScanKey(char *buf, size_t buf_size, const char **pos,
+                 const char *end);
+    bool ScanVal(char *buf, size_t buf_size, const char **pos,
+                 const char *end);
+
+    // Gets the start of the next line of the configuration text.
+    const char *SkipLine(const char *pos, const char *end);
 
     // Writes an element of the config dictionary to the given file.
     void WriteElem(DictElem *elem, FILE *config);
@@ -72,6 +140,10 @@ class Config {
     // Hashes the given string.
     size_t Hash(const char *string);
 
+    // Checks if the given key holds a field which is kept when the file is
+    // loaded again, as it is not saved or was given on the command line.
+    bool IsKept(const char *key);
+
   public:
     // Creates a config structure by loading from the given file
     // (or some defined location).
@@ -80,6 +152,11 @@ class Config {
     // Completely reloads the data in the config class from the given file.
     void Load(const char *config_file = NULL);
 
+    // Discards every saved field, then loads the file the configuration was
+    // created from again. Fields which are not saved, or which were set
+    // with Override(), are kept.
+    void Reload(void);
+
     // Writes any changes back to the config file.
     void Save(const char *config_file = NULL);
 
@@ -87,8 +164,14 @@ class Config {
     // If the field does not exist, the specified default value is returned.
     const char *Get(const char* key, const char *default_value = NULL);
 
-    // Sets a field in the loaded configuration.
-    void Set(const char* key, const char *val);
+    // Sets a field in the loaded configuration. Fields which are not saved
+    // are never written back to the config file.
+    void Set(const char* key, const char *val, bool save = true);
+
+    // Sets a field which is saved to the config file, but which keeps its
+    // value when the file is loaded again, such as one given on the
+    // command line.
+    void Override(const char* key, const char *val);
 
     // Writes the config file, then deletes the config object.
     ~Config(void);
@@ -0,0 +1,135 @@
+/*
+ * Settings hold the values of the configuration which are used after the
+ * emulation starts, parsed into the types they are used as.
+ *
+ * The configuration itself is a dictionary of strings, and looking up a key
+ * means hashing it and walking a chain of elements. That is fine once at
+ * startup, but not on a path which runs every frame, and the configuration
+ * can change under a reader when it is reloaded. Settings are instead
+ * parsed from the configuration in one pass, then handed to the objects
+ * which use them. A reload parses a fresh snapshot, which replaces the old
+ * one only once it has been applied.
+ *
+ * Invalid values are reported, and replaced by their defaults, so that a
+ * mistake in a reloaded configuration never stops the emulation.
+ */
+
+#include "./settings.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+#include "./config.h"
+#include "../util/util.h"
+
+// The limits of the speed of the emulation, relative to the console.
+#define MIN_SPEED 0.1
+#define MAX_SPEED 8.0
+
+// The largest volume, which plays samples unscaled.
+#define MAX_VOLUME 100UL
+
+// The configuration key for each button, and the name of the key mapped to
+// it by default. Note that the order of these arrays must match the order
+// of the buttons in the settings.
+static const char *kButtonConfigKeys[NUM_BUTTONS] = { kButtonAKey,
+        kButtonBKey, kButtonSelectKey, kButtonStartKey, kButtonUpKey,
+        kButtonDownKey, kButtonLeftKey, kButtonRightKey };
+static const char *kDefaultButtonKeys[NUM_BUTTONS] = { "X", "Z", "Backspace",
+        "Return", "Up", "Down", "Left", "Right" };
+
+/*
+ * Copies the given string, which may be NULL.
+ */
+static char *CopyOrNull(const char *str) {
+  return (str != NULL) ? StrCpy(str) : NULL;
+}
+
+/*
+ * Checks if two strings are equal, where either may be NULL.
+ */
+static bool SameOrNull(const char *str1, const char *str2) {
+  if ((str1 == NULL) || (str2 == NULL)) { return str1 == str2; }
+  return StrEq(str1, str2);
+}
+
+/*
+ * Parses the settings of the given configuration. Settings which have
+ * defaults are added to the configuration if they are missing, so that
+ * they appear in the saved file.
+ */
+Settings::Settings(Config *config) {
+  // Video settings.
+  const char *type = config->Get(kRendererTypeKey, kRendererHardwareVal);
+  renderer = RENDERER_HARDWARE;
+  if (StrEq(type, kRendererSurfaceVal)) {
+    renderer = RENDERER_SURFACE;
+  } else if (!StrEq(type, kRendererHardwareVal)) {
+    fprintf(stderr, "Warning: Unknown renderer %s, using %s.\n", type,
+            kRendererHardwareVal);
+  }
+  ntsc = StrEq(config->Get(kVideoTypeKey, kVideoRGBVal), kVideoNTSCVal);
+  upscaler = StrCpy(config->Get(kUpscalerKey, kUpscalerNoneVal));
+  palette_file = CopyOrNull(config->Get(kPaletteFileKey));
+
+  // Capture settings, which are only given on the command line.
+  capture_format = CopyOrNull(config->Get(kCaptureFormatKey));
+  capture_path = CopyOrNull(config->Get(kCapturePathKey));
+  const char *frames = config->Get(kCaptureFramesKey);
+  capture_frames = (frames != NULL) ? strtoul(frames, NULL, 10) : 0;
+
+  // Controller settings.
+  for (size_t i = 0; i < NUM_BUTTONS; i++) {
+    button_keys[i] = StrCpy(config->Get(kButtonConfigKeys[i],
+                                        kDefaultButtonKeys[i]));
+  }
+
+  // Pacing and audio settings.
+  display_sync = StrEq(config->Get(kFrameSyncKey, kFrameSyncConsoleVal),
+                       kFrameSyncDisplayVal);
+  const char *speed_val = config->Get(kSpeedKey, kSpeedDefaultVal);
+  speed = strtod(speed_val, NULL);
+  if ((speed < MIN_SPEED) || (speed > MAX_SPEED)) {
+    fprintf(stderr, "Warning: Speed %s is not between %.1f and %.1f, "
+                    "using %s.\n", speed_val, MIN_SPEED, MAX_SPEED,
+                    kSpeedDefaultVal);
+    speed = strtod(kSpeedDefaultVal, NULL);
+  }
+  const char *volume_val = config->Get(kVolumeKey, kVolumeDefaultVal);
+  unsigned long level = strtoul(volume_val, NULL, 10);
+  if (level > MAX_VOLUME) {
+    fprintf(stderr, "Warning: Volume %s is above %lu, using %lu.\n",
+            volume_val, MAX_VOLUME, MAX_VOLUME);
+    level = MAX_VOLUME;
+  }
+  volume = static_cast<float>(level) / static_cast<float>(MAX_VOLUME);
+
+  return;
+}
+
+/*
+ * Checks if the given settings select the same renderer, filter, upscaler,
+ * palette, and capture as these, in which case the renderer drawing with
+ * these settings can be kept.
+ */
+bool Settings::SameVideo(const Settings *other) const {
+  return (renderer == other->renderer) && (ntsc == other->ntsc)
+      && StrEq(upscaler, other->upscaler)
+      && SameOrNull(palette_file, other->palette_file)
+      && SameOrNull(capture_format, other->capture_format)
+      && SameOrNull(capture_path, other->capture_path)
+      && (capture_frames == other->capture_frames);
+}
+
+/*
+ * Frees the strings copied from the configuration.
+ */
+Settings::~Settings(void) {
+  delete[] upscaler;
+  delete[] palette_file;
+  delete[] capture_format;
+  delete[] capture_path;
+  for (size_t i = 0; i < NUM_BUTTONS; i++) { delete[] button_keys[i]; }
+  return;
+}
@@ -0,0 +1,55 @@
+#ifndef _NES_SETTINGS
+#define _NES_SETTINGS
+
+#include <cstdlib>
+
+#include "./config.h"
+
+// The number of buttons on the NES controller.
+#define NUM_BUTTONS 8
+
+// The renderers which can draw to the window.
+typedef enum { RENDERER_HARDWARE, RENDERER_SURFACE } RendererType;
+
+/*
+ * A typed snapshot of the configuration, parsed once when the emulation is
+ * created and again whenever the configuration is reloaded. Everything
+ * which reads a setting after startup reads it from here, rather than
+ * searching the configuration dictionary.
+ */
+struct Settings {
+  // The renderer, the video filter, the upscaler, and the palette file used
+  // to draw frames. The palette file is NULL if the default is used.
+  RendererType renderer;
+  bool ntsc;
+  char *upscaler;
+  char *palette_file;
+
+  // The format, path, and frame limit of the capture, if frames are being
+  // captured. The format is NULL otherwise.
+  char *capture_format;
+  char *capture_path;
+  size_t capture_frames;
+
+  // The name of the key mapped to each button, in the order A, B, select,
+  // start, up, down, left, right.
+  char *button_keys[NUM_BUTTONS];
+
+  // Whether frames are paced to the display, the speed of the emulation
+  // relative to the console, and the volume of the audio, from 0 to 1.
+  bool display_sync;
+  double speed;
+  float volume;
+
+  // Parses the settings in the given configuration. Missing settings are
+  // added to the configuration with their defaults.
+  Settings(Config *config);
+
+  // Checks if the given settings draw frames the same way as these.
+  bool SameVideo(const Settings *other) const;
+
+  // Frees the strings held by the settings.
+  ~Settings(void);
+};
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * The console connects the emulated chips of the NES and runs them on a
+ * common clock. It is the core of the emulator, and is shared by the SDL
+ * frontend and the embeddable library.
+ *
+ * The chips are run out of sync with each other for as long as they can be,
+ * which keeps the working set of each chip in cache. The CPU reports when
+ * it is about to access memory which would affect the other chips, and the
+ * chips are then run in lockstep until it is safe to separate them again.
+ */
+
+#include "./console.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../memory/memory.h"
+#include "../memory/header.h"
+#include "../cpu/cpu.h"
+#include "../cpu/breakpoints.h"
+#include "../cpu/trace_log.h"
+#include "../cpu/code_data_log.h"
+#include "../ppu/ppu.h"
+#include "../apu/apu.h"
+#include "../apu/audio_sink.h"
+#include "../io/input_source.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+#include "../util/state.h"
+#include "../util/arena.h"
+#include "../util/util.h"
+#include "../util/contracts.h"
+
+/*
+ * Attempts to load the given rom file, and power on a console for it.
+ * The console polls the given input and sends its samples to the given
+ * audio sink, both of which must outlive it.
+ *
+ * Returns NULL on failure.
+ */
+Console *Console::Create(FILE *rom_file, InputSource *input,
+                         AudioSink *audio) {
+  // Read the rom into memory, and load it from there.
+  size_t rom_size = GetFileSize(rom_file);
+  DataWord *rom = new DataWord[rom_size];
+  fseek(rom_file, 0, SEEK_SET);
+  size_t rom_read = fread(rom, 1, rom_size, rom_file);
+  fseek(rom_file, 0, SEEK_SET);
+  Console *console = Create(rom, rom_read, input, audio);
+  delete[] rom;
+  return console;
+}
+
+/*
+ * Attempts to load the given rom image, and power on a console for it. The
+ * image is copied, and need not outlive the console.
+ *
+ * Returns NULL if the image is not a valid rom, or uses an unsupported
+ * mapper.
+ */
+Console *Console::Create(const DataWord *rom, size_t rom_size,
+                         InputSource *input, AudioSink *audio) {
+  // Hash the rom, so that states saved from other roms can be rejected.
+  uint64_t rom_hash = HashBytes(rom, rom_size);
+
+  // Attempt to create a Memory object with the given rom image. The ram and
+  // registers of every chip are allocated from a single arena.
+  Arena *arena = new Arena(kArenaBlockSize_);
+  Memory *memory = Memory::Create(rom, rom_size, arena);
+  if (memory == NULL) {
+    fprintf(stderr, "Error: Failed to create emulated memory for rom.\n");
+    delete arena;
+    return NULL;
+  }
+
+  return new Console(arena, memory, input, audio, rom_hash);
+}
+
+/*
+ * Creates the chips of the console in the given arena, connects them to the
+ * given memory, and powers on the CPU.
+ */
+Console::Console(Arena *arena, Memory *memory, InputSource *input,
+                 AudioSink *audio, uint64_t rom_hash) {
+  // Create the NES APU, CPU, and PPU, and the buffer the PPU will draw
+  // its frames to.
+  arena_ = arena;
+  memory_ = memory;
+  cpu_ = new Cpu(arena_);
+  ppu_ = new Ppu(arena_);
+  apu_ = new Apu(arena_);
+  frame_buffer_ = new FrameBuffer();
+  rom_hash_ = rom_hash;
+
+  // Connect all of the emulated NES systems together.
+  memory_->AddController(input);
+  memory_->Connect(cpu_, ppu_, apu_);
+  cpu_->Connect(memory_);
+  ppu_->Connect(memory_, frame_buffer_, &(cpu_->nmi_line_));
+  ppu_->SetFrameRecorder(this);
+  apu_->Connect(memory_, audio, &(cpu_->irq_line_));
+
+  // Prepare the CPU for the emulation.
+  cpu_->Power();
+
+  return;
+}
+
+/*
+ * Runs the console for the given number of CPU cycles.
+ */
+void Console::RunCycles(size_t cycles) {
+  Run(cycles, false);
+  return;
+}
+
+/*
+ * Runs the console for up to the given number of CPU cycles, stopping once
+ * a frame is completed if requested. As the PPU schedules itself to sync at
+ * the start of vblank, the console stops within a few cycles of the frame
+ * being completed.
+ *
+ * Returns the number of cycles which were run.
+ */
+size_t Console::Run(size_t cycles, bool stop_at_frame) {
+  // A console stopped on a breakpoint runs nothing until it is resumed.
+  if (cpu_->HitBreak()) { return 0; }
+
+  size_t run = (trace_ != NULL) ? RunTraced(cycles, stop_at_frame)
+                                : RunScheduled(cycles, stop_at_frame);
+  cycles_run_ += run;
+  return run;
+}
+
+/*
+ * Runs the console as Run() does, running each chip apart from the others
+ * for as long as it can without affecting them.
+ */
+size_t Console::RunScheduled(size_t cycles, bool stop_at_frame) {
+  size_t cycles_remaining = cycles;
+  size_t sync_cycles = 0;
+  size_t scheduled_cycles = 0;
+  size_t cpu_cycles = 0;
+  size_t apu_cycles = 0;
+  size_t ppu_cycles = 0;
+
+  /*
+   * In order to increase cache hits during emulation, some math is done to
+   * determine how long the individual chips can be run in isolation. Running
+   * them this way prevents the memory systems of the other chips from causing
+   * cache misses as often.
+   */
+  while (cycles_remaining > 0) {
+    // Emulate the system with all cycles synced.
+    sync_cycles = MIN(sync_cycles, cycles_remaining);
+    for (size_t i = 0; i < sync_cycles; i++) {
+      // The PPU is clocked at 3x the rate of the CPU.
+      cpu_->RunCycle();
+      apu_->RunCycle();
+      ppu_->RunSchedule(3U);
+      if (cpu_->HitBreak()) { return cycles - cycles_remaining + i + 1; }
+    }
+    cycles_remaining -= sync_cycles;
+
+    // Check if the synchronized execution finished the requested cycles.
+    if ((cycles_remaining <= 0) || (stop_at_frame && frame_done_)) {
+      return cycles - cycles_remaining;
+    }
+
+    // Determine how long the emulation can run out of sync.
+    ppu_cycles = ppu_->Schedule();
+    apu_cycles = apu_->Schedule();
+    scheduled_cycles = MIN(ppu_cycles, apu_cycles);
+
+    // Run the CPU, then catch up the APU and PPU.
+    cpu_cycles = cpu_->RunSchedule(MIN(scheduled_cycles, cycles_remaining),
+                                   sync_cycles);
+    for (size_t i = 0; i < cpu_cycles; i++) { apu_->RunCycle(); }
+    ppu_->RunSchedule(cpu_cycles * 3U);
+    cycles_remaining -= cpu_cycles;
+    if ((stop_at_frame && frame_done_) || cpu_->HitBreak()) { break; }
+  }
+
+  return cycles - cycles_remaining;
+}
+
+/*
+ * Runs the console as Run() does, with every cycle synced, so that each
+ * instruction traced is stamped with its cycle and the position of the PPU
+ * when it was fetched.
+ */
+size_t Console::RunTraced(size_t cycles, bool stop_at_frame) {
+  for (size_t i = 0; i < cycles; i++) {
+    trace_->SetCycle(cycles_run_ + i);
+    cpu_->RunCycle();
+    apu_->RunCycle();
+    ppu_->RunSchedule(3U);
+    if (cpu_->HitBreak() || (stop_at_frame && frame_done_)) { return i + 1; }
+  }
+  return cycles;
+}
+
+/*
+ * Runs the console until the PPU completes a frame, stopping shortly after
+ * the start of vblank.
+ *
+ * Takes the completed frame from the frame buffer, and so must not be used
+ * while the frame buffer is presented by another thread.
+ */
+const NesFrame *Console::RunFrame(void) {
+  StepFrame();
+  return frame_buffer_->SwapPresentFrame(0);
+}
+
+/*
+ * Runs the console until the PPU completes a frame, stopping shortly after
+ * the start of vblank, or until a breakpoint stops the CPU. The frame is
+ * left for the presenter.
+ */
+void Console::StepFrame(void) {
+  frame_done_ = false;
+  while (!frame_done_ && !cpu_->HitBreak()) { Run(kFrameStepCycles_, true); }
+  return;
+}
+
+/*
+ * Enables or disables the frames and audio output by the console. The
+ * emulation itself is unaffected.
+ */
+void Console::SetOutput(bool enabled) {
+  output_ = enabled;
+  ppu_->SetFrameOutput(enabled);
+  apu_->SetMuted(!enabled);
+  return;
+}
+
+/*
+ * Connects the given input to the second controller port, which reads no
+ * buttons while it has no input.
+ */
+void Console::SetSecondInput(InputSource *input) {
+  memory_->AddSecondInput(input);
+  return;
+}
+
+/*
+ * Sends each frame completed by the PPU to the given recorder, before it
+ * is made available to the frame buffer. The recorder may be NULL.
+ */
+void Console::SetFrameRecorder(FrameRecorder *recorder) {
+  recorder_ = recorder;
+  return;
+}
+
+/*
+ * Marks that a frame has been completed, so that a running frame can stop,
+ * then forwards the frame to the recorder of the console while output is
+ * enabled.
+ */
+void Console::Record(const NesFrame *frame) {
+  frame_done_ = true;
+  if (output_ && (recorder_ != NULL)) { recorder_->Record(frame); }
+  return;
+}
+
+/*
+ * Gets the frame buffer completed frames are sent to.
+ */
+FrameBuffer *Console::GetFrameBuffer(void) {
+  return frame_buffer_;
+}
+
+/*
+ * Gets the memory of the console.
+ */
+Memory *Console::GetMemory(void) {
+  return memory_;
+}
+
+/*
+ * Gets the CPU of the console.
+ */
+Cpu *Console::GetCpu(void) {
+  return cpu_;
+}
+
+/*
+ * Gets the PPU of the console.
+ */
+Ppu *Console::GetPpu(void) {
+  return ppu_;
+}
+
+/*
+ * Gets the cpu/ppu timing expected by the loaded rom.
+ */
+NesTimingType Console::GetTimingMode(void) {
+  return memory_->GetTimingMode();
+}
+
+/*
+ * Checks if the CPU of the console has been jammed.
+ */
+bool Console::IsJammed(void) {
+  return cpu_->IsJammed();
+}
+
+/*
+ * Sets the breakpoints checked by the CPU of the console.
+ */
+void Console::SetBreakpoints(Breakpoints *breakpoints) {
+  cpu_->SetBreakpoints(breakpoints);
+  return;
+}
+
+/*
+ * Sets the watchpoints checked by the CPU of the console.
+ */
+void Console::SetWatchpoints(Breakpoints *watchpoints) {
+  cpu_->SetWatchpoints(watchpoints);
+  return;
+}
+
+/*
+ * Checks if the CPU of the console has stopped on a breakpoint.
+ */
+bool Console::IsPaused(void) {
+  return cpu_->HitBreak();
+}
+
+/*
+ * Resumes a console stopped on a breakpoint, from the instruction it
+ * stopped on.
+ */
+void Console::Resume(void) {
+  cpu_->Resume();
+  return;
+}
+
+/*
+ * Sets the trace log each instruction run by the console is recorded to.
+ * While tracing, the chips of the console are run in sync, which is slower.
+ */
+void Console::SetTraceLog(TraceLog *trace) {
+  trace_ = trace;
+  if (trace_ != NULL) { trace_->Connect(ppu_); }
+  cpu_->SetTraceLog(trace);
+  return;
+}
+
+/*
+ * Sets the code/data log each instruction run by the console is marked in.
+ */
+void Console::SetCodeDataLog(CodeDataLog *code_log) {
+  cpu_->SetCodeDataLog(code_log);
+  return;
+}
+
+/*
+ * Writes the state of the console to the given state. The state begins
+ * with a header identifying its format and rom, followed by each chip.
+ */
+void Console::SaveState(StateWriter *state) {
+  uint32_t magic = kStateMagic_;
+  uint32_t version = kStateVersion_;
+  state->Put(magic);
+  state->Put(version);
+  state->Put(rom_hash_);
+  memory_->SaveState(state);
+  cpu_->SaveState(state);
+  ppu_->SaveState(state);
+  apu_->SaveState(state);
+  return;
+}
+
+/*
+ * Restores the state of the console from the given state. If the state
+ * is invalid, the previous state of the console is restored.
+ *
+ * Returns false if the state was invalid, or saved from another rom.
+ */
+bool Console::LoadState(StateReader *state) {
+  // Check that the state was saved by this version, from this rom, before
+  // modifying the console.
+  if (!LoadHeader(state)) { return false; }
+
+  // Keep the current state, so that it can be restored if the given state
+  // turns out to be invalid.
+  StateWriter backup;
+  SaveState(&backup);
+  if (LoadChips(state) && state->IsDone()) { return true; }
+
+  StateReader restore(backup.GetData(), backup.GetSize());
+  LoadHeader(&restore);
+  LoadChips(&restore);
+  return false;
+}
+
+/*
+ * Restores a state which was saved by a console of this rom, as a fork of
+ * its state. Such states are always valid, so no backup is kept, and
+ * restoring them does not allocate.
+ *
+ * Returns false if the state was saved from another rom.
+ */
+bool Console::RestoreState(StateReader *state) {
+  if (!LoadHeader(state)) { return false; }
+  bool valid = LoadChips(state);
+  CONTRACT(valid && state->IsDone());
+  (void)valid;
+  return true;
+}
+
+/*
+ * Reads the header of the given state. Returns false if the state was not
+ * saved by this version, from this rom.
+ */
+bool Console::LoadHeader(StateReader *state) {
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t rom_hash = 0;
+  state->Get(&magic);
+  state->Get(&version);
+  state->Get(&rom_hash);
+  return !state->HasFailed() && (magic == kStateMagic_)
+                             && (version == kStateVersion_)
+                             && (rom_hash == rom_hash_);
+}
+
+/*
+ * Restores each chip of the console from the given state, in the order
+ * they were saved. Returns false if any chip was given an invalid state.
+ */
+bool Console::LoadChips(StateReader *state) {
+  bool valid = memory_->LoadState(state);
+  valid = cpu_->LoadState(state) && valid;
+  valid = ppu_->LoadState(state) && valid;
+  valid = apu_->LoadState(state) && valid;
+  return valid;
+}
+
+/*
+ * Frees the chips and frame buffer of the console, and then the arena
+ * holding their state.
+ */
+Console::~Console(void) {
+  delete apu_;
+  delete ppu_;
+  delete cpu_;
+  delete memory_;
+  delete frame_buffer_;
+  delete arena_;
+  return;
+}
@@ -0,0 +1,183 @@
+#ifndef _NES_CONSOLE
+#define _NES_CONSOLE
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../memory/memory.h"
+#include "../memory/header.h"
+#include "../cpu/cpu.h"
+#include "../cpu/breakpoints.h"
+#include "../cpu/trace_log.h"
+#include "../cpu/code_data_log.h"
+#include "../ppu/ppu.h"
+#include "../apu/apu.h"
+#include "../apu/audio_sink.h"
+#include "../io/input_source.h"
+#include "../video/frame_buffer.h"
+#include "../util/state.h"
+#include "../util/arena.h"
+
+/*
+ * The emulated NES itself: the CPU, PPU, APU, and the memory of the
+ * cartridge, connected together and driven by a common clock.
+ *
+ * Does not depend on SDL or on any global state, so any number of consoles
+ * can be run at once, on any threads. Input, audio, and completed frames
+ * are exchanged through the given input source, audio sink, and frame buffer.
+ */
+class Console : public FrameRecorder {
+  private:
+    // Identifies the saved states of this console.
+    static const uint32_t kStateMagic_ = 0x5342444EU;
+    static const uint32_t kStateVersion_ = 3U;
+
+    // The number of CPU cycles run at a time while waiting for a frame to be
+    // completed. About a frame.
+    static const size_t kFrameStepCycles_ = 29781;
+
+    // The size of the first block of the arena, which holds the ram and
+    // registers of every chip for the supported mappers.
+    static const size_t kArenaBlockSize_ = 0x10000;
+
+    // Holds the mutable state of the chips, which is freed with the console.
+    Arena *arena_;
+
+    // The emulated chips of the console.
+    Memory *memory_;
+    Cpu *cpu_;
+    Ppu *ppu_;
+    Apu *apu_;
+
+    // Receives the frames completed by the PPU.
+    FrameBuffer *frame_buffer_;
+
+    // The recorder completed frames are forwarded to, and whether a frame
+    // has been completed since a frame was last run. May be NULL.
+    FrameRecorder *recorder_ = NULL;
+    bool frame_done_ = false;
+
+    // Cleared while the console is run without output.
+    bool output_ = true;
+
+    // The number of CPU cycles the console has run, which stamps each
+    // instruction in the trace log. The log is NULL while not tracing.
+    uint64_t cycles_run_ = 0;
+    TraceLog *trace_ = NULL;
+
+    // A hash of the rom file, used to reject states saved from other roms.
+    uint64_t rom_hash_;
+
+    // Connects the chips of the console together.
+    Console(Arena *arena, Memory *memory, InputSource *input,
+            AudioSink *audio, uint64_t rom_hash);
+
+    // Reads the header of the given state, and checks that it was saved by
+    // this version from this rom.
+    bool LoadHeader(StateReader *state);
+
+    // Restores each chip from the given state, after its header.
+    bool LoadChips(StateReader *state);
+
+    // Runs the console for up to the given number of CPU cycles. If asked
+    // to, stops early once a frame is completed. Returns the cycles run.
+    size_t Run(size_t cycles, bool stop_at_frame);
+
+    // Implement Run() by scheduling the chips to run apart for as long as
+    // possible, or by running them in sync while tracing.
+    size_t RunScheduled(size_t cycles, bool stop_at_frame);
+    size_t RunTraced(size_t cycles, bool stop_at_frame);
+
+  public:
+    // Attempts to load the given rom and power on a console for it.
+    // Returns NULL on failure.
+    static Console *Create(FILE *rom_file, InputSource *input,
+                           AudioSink *audio);
+
+    // Loads the given rom image, as the above does with a rom file. The
+    // image is copied, so it need not outlive the console.
+    static Console *Create(const DataWord *rom, size_t rom_size,
+                           InputSource *input, AudioSink *audio);
+
+    // Runs the console for the given number of CPU cycles.
+    void RunCycles(size_t cycles);
+
+    // Runs the console until the PPU completes a frame, and returns it.
+    // Must not be used while another thread presents the frame buffer.
+    const NesFrame *RunFrame(void);
+
+    // Runs the console until the PPU completes a frame, leaving the frame
+    // in the frame buffer.
+    void StepFrame(void);
+
+    // Sets whether the console outputs frames and audio. While it does not,
+    // completed frames are neither recorded nor sent to the frame buffer,
+    // and audio samples are dropped, so that frames can be simulated again
+    // without being seen or heard twice.
+    void SetOutput(bool enabled);
+
+    // Connects the given input to the second controller port. May be NULL.
+    void SetSecondInput(InputSource *input);
+
+    // Sends each completed frame to the given recorder. May be NULL.
+    void SetFrameRecorder(FrameRecorder *recorder);
+
+    // Notes that the PPU has completed a frame, and forwards it to the
+    // recorder of the console. Called by the PPU.
+    void Record(const NesFrame *frame);
+
+    // Gets the frame buffer completed frames are sent to.
+    FrameBuffer *GetFrameBuffer(void);
+
+    // Gets the memory, CPU, and PPU of the console, so that they can be
+    // inspected.
+    Memory *GetMemory(void);
+    Cpu *GetCpu(void);
+    Ppu *GetPpu(void);
+
+    // Gets the cpu/ppu timing expected by the loaded rom.
+    NesTimingType GetTimingMode(void);
+
+    // Checks if the CPU has stopped on an unimplemented instruction. The
+    // rest of the console keeps running.
+    bool IsJammed(void);
+
+    // Sets the breakpoints checked by the CPU. May be NULL. The console does
+    // not take ownership of them.
+    void SetBreakpoints(Breakpoints *breakpoints);
+
+    // Sets the watchpoints checked by the CPU on each access to memory. May
+    // be NULL, which should be given while none are enabled.
+    void SetWatchpoints(Breakpoints *watchpoints);
+
+    // Checks if the console has stopped on a breakpoint. A stopped console
+    // runs no cycles, and returns from running frames early, until it is
+    // resumed.
+    bool IsPaused(void);
+    void Resume(void);
+
+    // Records each instruction run by the console to the given trace log.
+    // May be NULL. The console does not take ownership of it.
+    void SetTraceLog(TraceLog *trace);
+
+    // Marks each instruction run by the console in the given code/data log.
+    // May be NULL. The console does not take ownership of it.
+    void SetCodeDataLog(CodeDataLog *code_log);
+
+    // Saves or restores the state of every chip in the console. Loading
+    // returns false if the state is invalid, or was saved from another rom,
+    // in which case the console is left unchanged.
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
+    // Restores a state saved by a console of the same rom in this process,
+    // without keeping a backup of the current state. Returns false if the
+    // state is from another rom, in which case the console is unchanged.
+    bool RestoreState(StateReader *state);
+
+    // Frees the chips, their arena, and the frame buffer of the console.
+    ~Console(void);
+};
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * A lockstep group runs many instances of one rom together, such as the
+ * rollouts of a reinforcement learning agent, without running the same
+ * emulation more than once.
+ *
+ * The emulated chips branch on nearly every cycle, and memory mapped
+ * registers make the instances diverge as soon as their input does, so the
+ * instances are not vectorized across consoles. Instead, the group keeps one
+ * console for each distinct state and input among its lanes. Before each
+ * frame, consoles which have reached identical states are merged, and
+ * consoles whose lanes were given different input are copied. The group
+ * then runs each of its distinct consoles once.
+ */
+
+#include "./lockstep_group.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "./console.h"
+#include "../io/input_source.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+#include "../util/data.h"
+#include "../util/state.h"
+#include "../util/contracts.h"
+
+/*
+ * Loads the given rom into a console for each lane. Only the first console
+ * is run at first; the others hold copies of it once lanes diverge, so the
+ * caller need only seed the first.
+ *
+ * Returns NULL on failure.
+ */
+LockstepGroup *LockstepGroup::Create(FILE *rom_file, size_t num_lanes) {
+  if (num_lanes == 0) {
+    fprintf(stderr, "Error: A lockstep group must have at least one lane.\n");
+    return NULL;
+  }
+
+  Slot *slots = new Slot[num_lanes]();
+  for (size_t i = 0; i < num_lanes; i++) {
+    slots[i].console = Console::Create(rom_file, &(slots[i].input),
+                                       &(slots[i].audio));
+    if (slots[i].console == NULL) {
+      for (size_t j = 0; j < i; j++) { delete slots[j].console; }
+      delete[] slots;
+      return NULL;
+    }
+  }
+
+  return new LockstepGroup(slots, num_lanes);
+}
+
+/*
+ * Places every lane on the first slot.
+ */
+LockstepGroup::LockstepGroup(Slot *slots, size_t num_lanes) {
+  slots_ = slots;
+  num_slots_ = num_lanes;
+  num_lanes_ = num_lanes;
+  lane_slots_ = new size_t[num_lanes_];
+  lane_buttons_ = new DataWord[num_lanes_];
+  for (size_t i = 0; i < num_lanes_; i++) {
+    lane_slots_[i] = 0;
+    lane_buttons_[i] = 0;
+    slots_[i].state = new StateWriter();
+    slots_[i].frame = NULL;
+  }
+  slots_[0].lanes = num_lanes_;
+  return;
+}
+
+/*
+ * Sets the buttons the given lane holds during the next frame.
+ */
+void LockstepGroup::SetInput(size_t lane, DataWord buttons) {
+  lane_buttons_[lane] = buttons;
+  return;
+}
+
+/*
+ * Runs each lane which has not been retired for a frame, running each
+ * distinct console among the lanes once.
+ */
+void LockstepGroup::RunFrame(void) {
+  MergeSlots();
+  SplitSlots();
+  for (size_t i = 0; i < num_slots_; i++) {
+    if (slots_[i].lanes == 0) { continue; }
+    slots_[i].frame = slots_[i].console->RunFrame();
+    console_frames_++;
+  }
+  return;
+}
+
+/*
+ * Compares the states of each console in use, and moves the lanes of
+ * consoles in identical states onto the first of them. Identical consoles
+ * given the same input draw the same frames, so only one need be run.
+ *
+ * Nothing is compared while every lane shares one console.
+ */
+void LockstepGroup::MergeSlots(void) {
+  // Save and hash the state of each console in use.
+  size_t slots_used = 0;
+  for (size_t i = 0; i < num_slots_; i++) {
+    if (slots_[i].lanes > 0) { slots_used++; }
+  }
+  if (slots_used < 2) { return; }
+  for (size_t i = 0; i < num_slots_; i++) {
+    if (slots_[i].lanes == 0) { continue; }
+    slots_[i].state->Clear();
+    slots_[i].console->SaveState(slots_[i].state);
+    slots_[i].state_hash = HashBytes(slots_[i].state->GetData(),
+                                     slots_[i].state->GetSize());
+  }
+
+  // Merge the consoles whose states match, confirming each hash match.
+  for (size_t i = 0; i < num_slots_; i++) {
+    if (slots_[i].lanes == 0) { continue; }
+    for (size_t j = i + 1; j < num_slots_; j++) {
+      if ((slots_[j].lanes == 0)
+          || (slots_[j].state_hash != slots_[i].state_hash)
+          || (slots_[j].state->GetSize() != slots_[i].state->GetSize())
+          || (memcmp(slots_[j].state->GetData(), slots_[i].state->GetData(),
+                     slots_[i].state->GetSize()) != 0)) {
+        continue;
+      }
+      for (size_t lane = 0; lane < num_lanes_; lane++) {
+        if (lane_slots_[lane] == j) { lane_slots_[lane] = i; }
+      }
+      slots_[i].lanes += slots_[j].lanes;
+      slots_[j].lanes = 0;
+    }
+  }
+
+  return;
+}
+
+/*
+ * Gives each slot the input of its first lane. Any other lane of the slot
+ * which is given different input is moved to a copy of the slot, which is
+ * shared by every lane of the original given the same input.
+ */
+void LockstepGroup::SplitSlots(void) {
+  for (size_t i = 0; i < num_slots_; i++) {
+    slots_[i].assigned = false;
+    slots_[i].split_from = i;
+  }
+
+  for (size_t lane = 0; lane < num_lanes_; lane++) {
+    size_t slot = lane_slots_[lane];
+    DataWord buttons = lane_buttons_[lane];
+    if (slot == kNoSlot_) { continue; }
+
+    // The first lane of each slot decides its input.
+    if (!slots_[slot].assigned) {
+      slots_[slot].input.Set(buttons);
+      slots_[slot].assigned = true;
+      continue;
+    }
+    if (slots_[slot].input.Get() == buttons) { continue; }
+
+    // Otherwise, find or make a copy of the slot with the input of the lane.
+    size_t copy = kNoSlot_;
+    for (size_t i = 0; i < num_slots_; i++) {
+      if ((i != slot) && (slots_[i].split_from == slot)
+                      && (slots_[i].input.Get() == buttons)) {
+        copy = i;
+        break;
+      }
+    }
+    if (copy == kNoSlot_) {
+      copy = CopySlot(slot);
+      slots_[copy].input.Set(buttons);
+      slots_[copy].assigned = true;
+      slots_[copy].split_from = slot;
+    }
+
+    slots_[slot].lanes--;
+    slots_[copy].lanes++;
+    lane_slots_[lane] = copy;
+  }
+
+  return;
+}
+
+/*
+ * Copies the state of the console of the given slot into the console of an
+ * unused slot. As there is a slot for each lane, an unused slot always
+ * exists while a slot is shared by more than one lane.
+ *
+ * Returns the slot which was copied into.
+ */
+size_t LockstepGroup::CopySlot(size_t src) {
+  size_t dest = 0;
+  while ((dest < num_slots_) && ((slots_[dest].lanes > 0)
+                              || slots_[dest].assigned)) {
+    dest++;
+  }
+  CONTRACT(dest < num_slots_);
+
+  slots_[src].state->Clear();
+  slots_[src].console->SaveState(slots_[src].state);
+  StateReader state(slots_[src].state->GetData(),
+                    slots_[src].state->GetSize());
+  bool loaded = slots_[dest].console->RestoreState(&state);
+  CONTRACT(loaded);
+  (void)loaded;
+
+  return dest;
+}
+
+/*
+ * Stops running the given lane. The console of the lane is freed for reuse
+ * once no other lane runs on it.
+ */
+void LockstepGroup::Retire(size_t lane) {
+  if (lane_slots_[lane] == kNoSlot_) { return; }
+  slots_[lane_slots_[lane]].lanes--;
+  lane_slots_[lane] = kNoSlot_;
+  return;
+}
+
+/*
+ * Gets the frame last drawn by the given lane, or NULL if it has been
+ * retired or has not run.
+ */
+const NesFrame *LockstepGroup::GetFrame(size_t lane) {
+  if (lane_slots_[lane] == kNoSlot_) { return NULL; }
+  return slots_[lane_slots_[lane]].frame;
+}
+
+/*
+ * Gets the console the given lane runs on, or NULL if it has been retired.
+ */
+Console *LockstepGroup::GetConsole(size_t lane) {
+  if (lane_slots_[lane] == kNoSlot_) { return NULL; }
+  return slots_[lane_slots_[lane]].console;
+}
+
+/*
+ * Gets the number of consoles which are running lanes.
+ */
+size_t LockstepGroup::GetNumConsoles(void) {
+  size_t consoles = 0;
+  for (size_t i = 0; i < num_slots_; i++) {
+    if (slots_[i].lanes > 0) { consoles++; }
+  }
+  return consoles;
+}
+
+/*
+ * Gets the number of frames run by the consoles of the group.
+ */
+size_t LockstepGroup::GetConsoleFrames(void) {
+  return console_frames_;
+}
+
+/*
+ * Frees the consoles and states of every slot.
+ */
+LockstepGroup::~LockstepGroup(void) {
+  for (size_t i = 0; i < num_slots_; i++) {
+    delete slots_[i].console;
+    delete slots_[i].state;
+  }
+  delete[] slots_;
+  delete[] lane_slots_;
+  delete[] lane_buttons_;
+  return;
+}
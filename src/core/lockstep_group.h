@@ -0,0 +1,114 @@
+#ifndef _NES_LOCKSTEPGROUP
+#define _NES_LOCKSTEPGROUP
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "./console.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../video/frame_buffer.h"
+#include "../util/data.h"
+#include "../util/state.h"
+
+/*
+ * Runs many instances of the same rom a frame at a time, in lockstep. Each
+ * instance is a lane, with its own input.
+ *
+ * Lanes which are in the same state and are given the same input would
+ * draw the same frames, so they share a single console, which is run once
+ * for all of them. When the input of the lanes sharing a console differs,
+ * the console is copied for each new input. When the states of two consoles
+ * become identical again, their lanes are merged back onto one of them.
+ *
+ * Lanes are run without audio.
+ */
+class LockstepGroup {
+  private:
+    // A console which is shared by some number of lanes, along with the
+    // input and audio it is connected to.
+    struct Slot {
+      Console *console;
+      HeldInput input;
+      NullAudioSink audio;
+      size_t lanes;
+
+      // The last frame drawn by the console, and its state when it is
+      // compared to the other consoles.
+      const NesFrame *frame;
+      StateWriter *state;
+      uint64_t state_hash;
+
+      // Set once the input of the slot is chosen for the next frame. Slots
+      // copied for the next frame also hold the slot they were copied from,
+      // so that they can be shared by other lanes of the original.
+      bool assigned;
+      size_t split_from;
+    };
+
+    // Every lane can be given its own console, so there is one slot for
+    // each lane.
+    Slot *slots_;
+    size_t num_slots_;
+
+    // The slot each lane runs on, and the buttons each lane is given.
+    // Lanes which have been retired run on no slot.
+    size_t *lane_slots_;
+    DataWord *lane_buttons_;
+    size_t num_lanes_;
+
+    // The number of frames run by consoles, which is less than the number
+    // of frames run by lanes when lanes share consoles.
+    size_t console_frames_ = 0;
+
+    // Marks a lane which no longer runs on any slot.
+    static const size_t kNoSlot_ = SIZE_MAX;
+
+    // Stores the slots, with every lane on the first.
+    LockstepGroup(Slot *slots, size_t num_lanes);
+
+    // Moves the lanes of consoles which are in identical states onto one
+    // of those consoles.
+    void MergeSlots(void);
+
+    // Gives each lane a slot whose console is in the state of the lane, and
+    // is given the input of the lane.
+    void SplitSlots(void);
+
+    // Copies the state of one slot into an unused slot. Returns the slot
+    // the state was copied into.
+    size_t CopySlot(size_t src);
+
+  public:
+    // Loads the given rom into a console for each lane, with every lane
+    // sharing the state of the first. Returns NULL on failure.
+    static LockstepGroup *Create(FILE *rom_file, size_t num_lanes);
+
+    // Sets the buttons the given lane holds during the next frame.
+    void SetInput(size_t lane, DataWord buttons);
+
+    // Runs each lane which has not been retired for a frame.
+    void RunFrame(void);
+
+    // Stops running the given lane.
+    void Retire(size_t lane);
+
+    // Gets the frame last drawn by the given lane. Remains valid until the
+    // next frame is run.
+    const NesFrame *GetFrame(size_t lane);
+
+    // Gets the console the given lane runs on, so that it can be inspected.
+    // The console may be shared by other lanes, and must not be modified.
+    Console *GetConsole(size_t lane);
+
+    // Gets the number of consoles currently running lanes, and the number of
+    // frames run by consoles in total.
+    size_t GetNumConsoles(void);
+    size_t GetConsoleFrames(void);
+
+    // Frees the consoles of every lane.
+    ~LockstepGroup(void);
+};
+
+#endif
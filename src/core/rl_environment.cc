@@ -0,0 +1,236 @@
+/*
+ * The reinforcement learning environment wraps a console in the step and
+ * reset interface expected by learning agents.
+ *
+ * Agents run millions of steps, so nothing is copied on the path of a step.
+ * The frame and system ram are observed in place, and rewards are computed
+ * by a hook which reads the ram directly. Only the greyscale observation
+ * does any work, and only when it is asked for.
+ */
+
+#include "./rl_environment.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "./console.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../memory/memory.h"
+#include "../memory/palette.h"
+#include "../video/frame_buffer.h"
+#include "../util/data.h"
+#include "../util/state.h"
+#include "../util/util.h"
+
+// The weights used to find the brightness of a color, out of 256.
+#define LUMA_RED_WEIGHT 77U
+#define LUMA_GREEN_WEIGHT 150U
+#define LUMA_BLUE_WEIGHT 29U
+
+/*
+ * Loads the given rom image into a new console for the environment. The
+ * caller should seed the generator of the calling thread first, as the power
+ * on state becomes the reset state.
+ *
+ * Returns NULL on failure.
+ */
+RlEnvironment *RlEnvironment::Create(const DataWord *rom, size_t rom_size) {
+  HeldInput *input = new HeldInput();
+  NullAudioSink *audio = new NullAudioSink();
+  Console *console = Console::Create(rom, rom_size, input, audio);
+  if (console == NULL) {
+    delete audio;
+    delete input;
+    return NULL;
+  }
+
+  return new RlEnvironment(console, input, audio);
+}
+
+/*
+ * Builds the brightness table of the default palette, and stores the power
+ * on state of the console as the reset state.
+ */
+RlEnvironment::RlEnvironment(Console *console, HeldInput *input,
+                             NullAudioSink *audio) {
+  console_ = console;
+  input_ = input;
+  audio_ = audio;
+  ram_ = console_->GetMemory()->RamExpose();
+  frame_ = console_->GetFrameBuffer()->GetPresentFrame();
+
+  // Decode every color with every mask, and keep the brightness of each.
+  NesPalette *palette = new NesPalette(NULL);
+  DataWord colors[MASK_TABLE_SIZE];
+  Pixel pixels[MASK_TABLE_SIZE];
+  for (size_t i = 0; i < MASK_TABLE_SIZE; i++) {
+    colors[i] = static_cast<DataWord>(i);
+  }
+  for (size_t mask = 0; mask <= UINT8_MAX; mask++) {
+    DataWord *luma = luma_[NesPalette::MaskIndex(static_cast<DataWord>(mask))];
+    palette->DecodeRow(colors, static_cast<DataWord>(mask), pixels,
+                       MASK_TABLE_SIZE);
+    for (size_t i = 0; i < MASK_TABLE_SIZE; i++) {
+      uint32_t red = (pixels[i] & PALETTE_RMASK) >> 16U;
+      uint32_t green = (pixels[i] & PALETTE_GMASK) >> 8U;
+      uint32_t blue = pixels[i] & PALETTE_BMASK;
+      luma[i] = static_cast<DataWord>((red * LUMA_RED_WEIGHT
+                                     + green * LUMA_GREEN_WEIGHT
+                                     + blue * LUMA_BLUE_WEIGHT) >> 8U);
+    }
+  }
+  delete palette;
+  greyscale_ = new DataWord[NES_WIDTH * NES_HEIGHT];
+
+  reset_state_ = new StateWriter();
+  reset_frame_ = new NesFrame();
+  StoreResetState();
+
+  return;
+}
+
+/*
+ * Sets the hook used to score each frame, and the data given to it.
+ * The hook may be NULL.
+ */
+void RlEnvironment::SetRewardHook(RlRewardHook hook, void *data) {
+  reward_hook_ = hook;
+  reward_data_ = data;
+  return;
+}
+
+/*
+ * Stores the current state of the console, and its last frame, so that
+ * they can be restored by a reset.
+ */
+void RlEnvironment::StoreResetState(void) {
+  reset_state_->Clear();
+  console_->SaveState(reset_state_);
+  memcpy(reset_frame_, frame_, sizeof(NesFrame));
+  return;
+}
+
+/*
+ * Loads the given state into the console, then stores it as the reset
+ * state. The last frame drawn before the state was loaded is observed
+ * after each reset, as states do not hold completed frames.
+ *
+ * Returns false if the state was invalid, in which case the reset state
+ * is unchanged.
+ */
+bool RlEnvironment::LoadResetState(StateReader *state) {
+  if (!console_->LoadState(state)) { return false; }
+  StoreResetState();
+  return true;
+}
+
+/*
+ * Restores the reset state of the console, and the frame observed with it.
+ */
+void RlEnvironment::Reset(void) {
+  StateReader state(reset_state_->GetData(), reset_state_->GetSize());
+  console_->RestoreState(&state);
+  frame_ = reset_frame_;
+  return;
+}
+
+/*
+ * Holds the given buttons on the controller for the given number of frames,
+ * which is at least one. The reward hook scores each frame, and may end the
+ * step early by marking the episode as done.
+ *
+ * Returns the sum of the rewards of the frames which were run.
+ */
+float RlEnvironment::Step(DataWord action, size_t frames, bool *done) {
+  input_->Set(action);
+  float reward = 0.0f;
+  int ended = 0;
+  for (size_t i = 0; (i < MAX(frames, 1U)) && (ended == 0); i++) {
+    frame_ = console_->RunFrame();
+    if (reward_hook_ != NULL) {
+      reward += reward_hook_(ram_, &ended, reward_data_);
+    }
+  }
+
+  if (done != NULL) { *done = (ended != 0); }
+  return reward;
+}
+
+/*
+ * Gets the last frame drawn by the console, as NES colors.
+ */
+const NesFrame *RlEnvironment::GetFrame(void) {
+  return frame_;
+}
+
+/*
+ * Gets the system ram of the console.
+ */
+const DataWord *RlEnvironment::GetRam(void) {
+  return ram_;
+}
+
+/*
+ * Converts the last frame to greyscale, with each output pixel holding the
+ * average brightness of a square block of the frame. The emphasis and
+ * greyscale settings of each row are applied. The result holds
+ * (NES_WIDTH / block) by (NES_HEIGHT / block) pixels, stored one row after
+ * another.
+ *
+ * Returns NULL if the block size does not divide the dimensions of a frame.
+ */
+const DataWord *RlEnvironment::GetGreyscale(size_t block) {
+  if ((block == 0) || ((NES_WIDTH % block) != 0)
+                   || ((NES_HEIGHT % block) != 0)) {
+    return NULL;
+  }
+
+  size_t width = NES_WIDTH / block;
+  size_t height = NES_HEIGHT / block;
+  uint32_t sums[NES_WIDTH];
+  for (size_t y = 0; y < height; y++) {
+    // Sum the brightness of each block in this row of blocks.
+    for (size_t x = 0; x < width; x++) { sums[x] = 0; }
+    for (size_t row = y * block; row < (y + 1) * block; row++) {
+      const DataWord *luma = luma_[NesPalette::MaskIndex(frame_->masks[row])];
+      const DataWord *colors = &(frame_->pixels[row * NES_WIDTH]);
+      for (size_t x = 0; x < width; x++) {
+        for (size_t i = 0; i < block; i++) {
+          sums[x] += luma[colors[x * block + i]];
+        }
+      }
+    }
+
+    // Average each block.
+    for (size_t x = 0; x < width; x++) {
+      greyscale_[y * width + x] = static_cast<DataWord>(sums[x]
+                                                      / (block * block));
+    }
+  }
+
+  return greyscale_;
+}
+
+/*
+ * Gets the console of the environment.
+ */
+Console *RlEnvironment::GetConsole(void) {
+  return console_;
+}
+
+/*
+ * Frees the console, its input and audio, and the reset state.
+ */
+RlEnvironment::~RlEnvironment(void) {
+  delete console_;
+  delete audio_;
+  delete input_;
+  delete reset_state_;
+  delete reset_frame_;
+  delete[] greyscale_;
+  return;
+}
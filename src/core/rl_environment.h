@@ -0,0 +1,104 @@
+#ifndef _NES_RLENVIRONMENT
+#define _NES_RLENVIRONMENT
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "./console.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../memory/palette.h"
+#include "../video/frame_buffer.h"
+#include "../util/data.h"
+#include "../util/state.h"
+
+/*
+ * Scores the state of the console after each frame of a step, from its
+ * system ram. May set done to a nonzero value to end the episode. The data
+ * is the pointer given with the hook.
+ */
+typedef float (*RlRewardHook)(const DataWord *ram, int *done, void *data);
+
+/*
+ * A reinforcement learning environment around a console: each step holds
+ * an action on the controller for some number of frames, and scores the
+ * frames with a reward hook. Resetting the environment restores a stored
+ * state.
+ *
+ * Observations are read directly from the console; the frame and system ram
+ * are exposed without copying, and the downsampled greyscale frame is only
+ * computed when it is requested. The console runs without audio.
+ */
+class RlEnvironment {
+  private:
+    // The console, and the input its actions are held on.
+    Console *console_;
+    HeldInput *input_;
+    NullAudioSink *audio_;
+
+    // The system ram of the console, and the last frame it drew.
+    const DataWord *ram_;
+    const NesFrame *frame_;
+
+    // The state restored by a reset, and the frame which was last drawn
+    // when it was stored, which is observed after a reset.
+    StateWriter *reset_state_;
+    NesFrame *reset_frame_;
+
+    // Scores each frame. May be NULL, in which case every reward is zero.
+    RlRewardHook reward_hook_ = NULL;
+    void *reward_data_ = NULL;
+
+    // The brightness of each NES color, indexed as the palette indexes its
+    // tables, and the buffer the greyscale frame is computed into.
+    DataWord luma_[NUM_MASK_TABLES][MASK_TABLE_SIZE];
+    DataWord *greyscale_;
+
+    // Stores the console, and the power on state as the reset state.
+    RlEnvironment(Console *console, HeldInput *input, NullAudioSink *audio);
+
+  public:
+    // Loads the given rom image into a new environment. Returns NULL on
+    // failure.
+    static RlEnvironment *Create(const DataWord *rom, size_t rom_size);
+
+    // Sets the hook used to score each frame. May be NULL.
+    void SetRewardHook(RlRewardHook hook, void *data);
+
+    // Stores the current state of the console as the reset state.
+    void StoreResetState(void);
+
+    // Loads the given state into the console, and stores it as the reset
+    // state. Returns false if the state is invalid.
+    bool LoadResetState(StateReader *state);
+
+    // Restores the reset state.
+    void Reset(void);
+
+    // Holds the given buttons for the given number of frames, and returns
+    // the total reward of those frames. The step ends early if the reward
+    // hook marks the episode as done.
+    float Step(DataWord action, size_t frames, bool *done);
+
+    // Gets the last frame drawn by the console. Remains valid until the
+    // next step or reset.
+    const NesFrame *GetFrame(void);
+
+    // Gets the system ram of the console, which holds RAM_SIZE bytes and
+    // is updated in place by each step.
+    const DataWord *GetRam(void);
+
+    // Gets the last frame as greyscale, averaged over square blocks of the
+    // given size. Returns NULL if the size does not divide the frame.
+    // Remains valid until the next request for a greyscale frame.
+    const DataWord *GetGreyscale(size_t block);
+
+    // Gets the console, so that its state can be saved or inspected.
+    Console *GetConsole(void);
+
+    // Frees the console and the reset state.
+    ~RlEnvironment(void);
+};
+
+#endif
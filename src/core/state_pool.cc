@@ -0,0 +1,134 @@
+/*
+ * The state pool holds forks of the state of a console for tree searches,
+ * fuzzers, and other tools which restore the same states many times.
+ *
+ * Saved states only hold the mutable parts of a console, and skip the rows
+ * of the frame which have not been drawn yet, so a fork taken between frames
+ * is a few kilobytes. Each fork is written into a fixed slot of a single
+ * arena, and restored without the backup kept by Console::LoadState().
+ */
+
+#include "./state_pool.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "./console.h"
+#include "../video/frame_buffer.h"
+#include "../util/data.h"
+#include "../util/state.h"
+
+// The size of each slot is rounded up to a multiple of a cache line.
+#define STATE_POOL_ALIGN 64U
+
+/*
+ * Creates a pool of the given number of slots, sized for forks of the
+ * given console.
+ *
+ * Returns NULL if no slots are asked for.
+ */
+StatePool *StatePool::Create(Console *console, size_t num_slots) {
+  if (num_slots == 0) {
+    fprintf(stderr, "Error: A state pool must have at least one slot.\n");
+    return NULL;
+  }
+
+  // A state is largest when a whole frame has been drawn, so size the slots
+  // as if the current state held an entire frame.
+  StateWriter state;
+  console->SaveState(&state);
+  size_t slot_size = state.GetSize() + sizeof(NesFrame);
+  slot_size = (slot_size + STATE_POOL_ALIGN - 1) & ~(STATE_POOL_ALIGN - 1);
+
+  return new StatePool(num_slots, slot_size);
+}
+
+/*
+ * Allocates the arena, and gives each of its slots a writer. Every slot
+ * starts free.
+ */
+StatePool::StatePool(size_t num_slots, size_t slot_size) {
+  slot_size_ = slot_size;
+  num_slots_ = num_slots;
+  arena_ = new DataWord[num_slots_ * slot_size_];
+  slots_ = new StateWriter*[num_slots_];
+  held_ = new bool[num_slots_]();
+  free_slots_ = new size_t[num_slots_];
+  for (size_t i = 0; i < num_slots_; i++) {
+    slots_[i] = new StateWriter(&(arena_[i * slot_size_]), slot_size_);
+    free_slots_[i] = num_slots_ - i - 1;
+  }
+  num_free_ = num_slots_;
+  return;
+}
+
+/*
+ * Saves the state of the given console into the most recently freed slot,
+ * which is the most likely to still be in cache.
+ *
+ * Returns false if every slot is in use.
+ */
+bool StatePool::Fork(Console *console, size_t *slot) {
+  if (num_free_ == 0) { return false; }
+  num_free_--;
+  *slot = free_slots_[num_free_];
+  held_[*slot] = true;
+  slots_[*slot]->Clear();
+  console->SaveState(slots_[*slot]);
+  return true;
+}
+
+/*
+ * Checks if the given slot is in the pool, and holds a fork which has not
+ * been released.
+ */
+bool StatePool::IsHeld(size_t slot) {
+  return (slot < num_slots_) && held_[slot];
+}
+
+/*
+ * Restores the fork in the given slot into the given console.
+ *
+ * Returns false if the slot holds no fork, or if the console runs a
+ * different rom than the one forked.
+ */
+bool StatePool::Restore(size_t slot, Console *console) {
+  if (!IsHeld(slot)) { return false; }
+  StateReader state(slots_[slot]->GetData(), slots_[slot]->GetSize());
+  return console->RestoreState(&state);
+}
+
+/*
+ * Returns the given slot to the free list. A slot which holds no fork is
+ * already free, and so is left alone.
+ *
+ * Returns false if the slot holds no fork.
+ */
+bool StatePool::Release(size_t slot) {
+  if (!IsHeld(slot)) { return false; }
+  held_[slot] = false;
+  free_slots_[num_free_] = slot;
+  num_free_++;
+  return true;
+}
+
+/*
+ * Gets the number of slots which are free.
+ */
+size_t StatePool::GetNumFree(void) {
+  return num_free_;
+}
+
+/*
+ * Frees the writers and the arena they write into.
+ */
+StatePool::~StatePool(void) {
+  for (size_t i = 0; i < num_slots_; i++) { delete slots_[i]; }
+  delete[] slots_;
+  delete[] held_;
+  delete[] free_slots_;
+  delete[] arena_;
+  return;
+}
@@ -0,0 +1,68 @@
+#ifndef _NES_STATEPOOL
+#define _NES_STATEPOOL
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "./console.h"
+#include "../util/data.h"
+#include "../util/state.h"
+
+/*
+ * A fixed pool of forks of the state of a console, for searches which
+ * branch from the same state many times.
+ *
+ * A fork holds only the mutable state of the console: its ram, registers,
+ * and the rows of the frame drawn so far. The rom itself is never copied,
+ * as every console of the rom already holds it, so a fork can be restored
+ * into any console of the same rom. Every fork lives in one arena allocated
+ * up front, so forking and restoring never allocate.
+ */
+class StatePool {
+  private:
+    // The arena holding the forks, and the size of each slot in it.
+    DataWord *arena_;
+    size_t slot_size_;
+
+    // The writer of each slot, whether each slot holds a fork, and the
+    // slots which are not holding one.
+    StateWriter **slots_;
+    bool *held_;
+    size_t num_slots_;
+    size_t *free_slots_;
+    size_t num_free_;
+
+    // Checks if the given slot exists and holds a fork.
+    bool IsHeld(size_t slot);
+
+    // Divides the arena into slots of the given size.
+    StatePool(size_t num_slots, size_t slot_size);
+
+  public:
+    // Creates a pool with the given number of slots, each large enough to
+    // hold a fork of the given console. Returns NULL if no slots are asked
+    // for.
+    static StatePool *Create(Console *console, size_t num_slots);
+
+    // Saves the state of the given console into a free slot, and returns the
+    // slot. Returns false if every slot is in use.
+    bool Fork(Console *console, size_t *slot);
+
+    // Restores the fork in the given slot into the given console, which must
+    // have the same rom as the forked console. The fork remains in the
+    // slot. Returns false if the slot holds no fork, or if the console runs
+    // another rom.
+    bool Restore(size_t slot, Console *console);
+
+    // Frees the given slot for another fork. Returns false, and does
+    // nothing, if the slot holds no fork.
+    bool Release(size_t slot);
+
+    // Gets the number of slots which are not holding a fork.
+    size_t GetNumFree(void);
+
+    // Frees the arena, and every fork in it.
+    ~StatePool(void);
+};
+
+#endif
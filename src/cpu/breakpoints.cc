@@ -0,0 +1,328 @@
+/*
+ * Breakpoints stop the CPU before it runs the instruction at a given
+ * address. They are checked by the CPU when it fetches an instruction,
+ * rather than on every cycle, and so cost nothing until the fetch.
+ *
+ * Since a breakpoint is only ever set on a handful of addresses, most
+ * fetches can be rejected by the page of their address alone. A bitmap of
+ * the 256 pages of CPU memory is kept, with a bit set for each page holding
+ * an enabled breakpoint. The list of breakpoints is only searched when the
+ * bit of a fetch is set, which is where their banks and conditions are
+ * tested.
+ *
+ * Watchpoints are kept in the same list, with a bitmap of their own which
+ * the CPU tests on each access to memory. Since the instruction which made
+ * the access must finish before the CPU can stop, a watchpoint which
+ * matches marks the next fetch to stop the CPU, as stepping does.
+ */
+
+#include "./breakpoints.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../memory/memory.h"
+#include "../util/data.h"
+#include "./cpu.h"
+
+// Splits an address into the word and bit of its page in the bitmap.
+#define PAGE_WORD(addr) ((addr) >> 14U)
+#define PAGE_BIT(addr) (((addr) >> 8U) & 0x3FU)
+
+/*
+ * Creates an empty set of breakpoints.
+ */
+Breakpoints::Breakpoints(void) {
+  return;
+}
+
+/*
+ * Adds an enabled breakpoint on the instruction at the given address. If
+ * the bank is not BREAK_ANY_BANK, the breakpoint only matches while that
+ * PRG-ROM bank is mapped to the address. The condition is copied, and may
+ * be NULL for a breakpoint which always matches.
+ *
+ * Returns the id of the breakpoint, which is never zero.
+ */
+size_t Breakpoints::Add(DoubleWord addr, int bank,
+                        const BreakCondition *cond) {
+  Breakpoint point;
+  point.id = next_id_++;
+  point.kind = BREAK_EXEC;
+  point.addr = addr;
+  point.size = 1;
+  point.bank = bank;
+  point.cond = { BREAK_ALWAYS, 0, BREAK_EQ, 0 };
+  if (cond != NULL) { point.cond = *cond; }
+  point.enabled = true;
+  point.hits = 0;
+  points_.push_back(point);
+  UpdatePages();
+  return point.id;
+}
+
+/*
+ * Adds an enabled watchpoint on the given number of bytes from the given
+ * address, which matches the given kind of access in any bank. The number
+ * of bytes is clamped to the size of CPU memory, as the range wraps around
+ * it, so that updating the pages stays bounded.
+ *
+ * Returns the id of the watchpoint, which is never zero.
+ */
+size_t Breakpoints::AddWatch(DoubleWord addr, size_t size, BreakKind kind) {
+  Breakpoint point;
+  point.id = next_id_++;
+  point.kind = kind;
+  point.addr = addr;
+  point.size = (size > 0) ? size : 1;
+  if (point.size > kMaxWatchSize_) { point.size = kMaxWatchSize_; }
+  point.bank = BREAK_ANY_BANK;
+  point.cond = { BREAK_ALWAYS, 0, BREAK_EQ, 0 };
+  point.enabled = true;
+  point.hits = 0;
+  points_.push_back(point);
+  UpdatePages();
+  return point.id;
+}
+
+/*
+ * Removes the breakpoint or watchpoint with the given id.
+ */
+bool Breakpoints::Remove(size_t id) {
+  size_t index;
+  if (!Find(id, &index)) { return false; }
+  points_.erase(points_.begin() + static_cast<ptrdiff_t>(index));
+  UpdatePages();
+  return true;
+}
+
+/*
+ * Enables or disables the breakpoint with the given id. Disabled
+ * breakpoints are kept, but never match.
+ */
+bool Breakpoints::SetEnabled(size_t id, bool enabled) {
+  size_t index;
+  if (!Find(id, &index)) { return false; }
+  points_[index].enabled = enabled;
+  UpdatePages();
+  return true;
+}
+
+/*
+ * Finds the index of the breakpoint with the given id.
+ */
+bool Breakpoints::Find(size_t id, size_t *index) {
+  for (size_t i = 0; i < points_.size(); i++) {
+    if (points_[i].id == id) {
+      *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Sets the bit of each page holding an enabled breakpoint, and of each page
+ * covered by an enabled watchpoint, clearing the rest.
+ */
+void Breakpoints::UpdatePages(void) {
+  for (size_t i = 0; i < (kNumPages_ / kPagesPerWord_); i++) {
+    pages_[i] = 0;
+    watch_pages_[i] = 0;
+  }
+  for (size_t i = 0; i < points_.size(); i++) {
+    if (!points_[i].enabled) { continue; }
+    uint64_t *pages = (points_[i].kind == BREAK_EXEC) ? pages_ : watch_pages_;
+    for (size_t j = 0; j < points_[i].size; j++) {
+      DoubleWord addr = static_cast<DoubleWord>(points_[i].addr + j);
+      pages[PAGE_WORD(addr)] |= 1ULL << PAGE_BIT(addr);
+    }
+  }
+  return;
+}
+
+/*
+ * Checks if the page of the given address holds an enabled breakpoint, or
+ * if the next fetch has been marked to stop the CPU.
+ */
+bool Breakpoints::MayBreak(DoubleWord addr) {
+  return step_ || watch_hit_ || ((pages_[PAGE_WORD(addr)] >> PAGE_BIT(addr))
+                                 & 1U);
+}
+
+/*
+ * Checks each enabled breakpoint on the given address against the bank the
+ * instruction was fetched from and the state of the CPU. Every breakpoint
+ * which matches counts a hit, and the first is remembered as the last hit.
+ *
+ * Returns true if any breakpoint matched, or if the fetch was marked to
+ * stop the CPU.
+ */
+bool Breakpoints::Check(DoubleWord addr, size_t bank, const CpuState *cpu,
+                        Memory *memory) {
+  // A watchpoint stops the CPU at any address. Its hit was counted when it
+  // matched.
+  bool hit = watch_hit_;
+  watch_hit_ = false;
+  for (size_t i = 0; i < points_.size(); i++) {
+    Breakpoint *point = &(points_[i]);
+    if (!point->enabled || (point->kind != BREAK_EXEC)
+                        || (point->addr != addr)) {
+      continue;
+    }
+    if ((point->bank != BREAK_ANY_BANK)
+        && (static_cast<size_t>(point->bank) != bank)) {
+      continue;
+    }
+    if (!Test(&(point->cond), cpu, memory)) { continue; }
+
+    point->hits++;
+    if (!hit) { hit_id_ = point->id; }
+    hit = true;
+  }
+
+  // A step stops the CPU at any address, without a breakpoint.
+  if (!hit && step_) {
+    hit_id_ = 0;
+    hit = true;
+  }
+  return hit;
+}
+
+/*
+ * Reads the operand of the given condition, and compares it to the value
+ * of the condition.
+ */
+bool Breakpoints::Test(const BreakCondition *cond, const CpuState *cpu,
+                       Memory *memory) {
+  DataWord operand;
+  switch (cond->operand) {
+    case BREAK_REG_A:
+      operand = cpu->a;
+      break;
+    case BREAK_REG_X:
+      operand = cpu->x;
+      break;
+    case BREAK_REG_Y:
+      operand = cpu->y;
+      break;
+    case BREAK_REG_P:
+      operand = cpu->p;
+      break;
+    case BREAK_REG_S:
+      operand = cpu->s;
+      break;
+    case BREAK_MEMORY:
+      operand = memory->Inspect(cond->addr);
+      break;
+    case BREAK_ALWAYS:
+    default:
+      return true;
+  }
+
+  switch (cond->compare) {
+    case BREAK_NE:
+      return operand != cond->value;
+    case BREAK_LT:
+      return operand < cond->value;
+    case BREAK_GT:
+      return operand > cond->value;
+    case BREAK_AND:
+      return (operand & cond->value) != 0;
+    case BREAK_EQ:
+    default:
+      return operand == cond->value;
+  }
+}
+
+/*
+ * Checks if any watchpoint is enabled, in which case the CPU must check
+ * each access to memory.
+ */
+bool Breakpoints::HasWatches(void) {
+  for (size_t i = 0; i < (kNumPages_ / kPagesPerWord_); i++) {
+    if (watch_pages_[i] != 0) { return true; }
+  }
+  return false;
+}
+
+/*
+ * Checks if the page of the given address is covered by an enabled
+ * watchpoint.
+ */
+bool Breakpoints::MayWatch(DoubleWord addr) {
+  return (watch_pages_[PAGE_WORD(addr)] >> PAGE_BIT(addr)) & 1U;
+}
+
+/*
+ * Checks each enabled watchpoint against an access to the given address.
+ * Every watchpoint whose range and kind match counts a hit, and the first
+ * marks the next fetch to stop the CPU.
+ */
+void Breakpoints::CheckAccess(DoubleWord addr, bool write) {
+  for (size_t i = 0; i < points_.size(); i++) {
+    Breakpoint *point = &(points_[i]);
+    if (!point->enabled || (point->kind == BREAK_EXEC)) { continue; }
+    if ((point->kind == BREAK_READ) && write) { continue; }
+    if ((point->kind == BREAK_WRITE) && !write) { continue; }
+    if (static_cast<DoubleWord>(addr - point->addr) >= point->size) {
+      continue;
+    }
+
+    point->hits++;
+    if (!watch_hit_) {
+      hit_id_ = point->id;
+      hit_addr_ = addr;
+    }
+    watch_hit_ = true;
+  }
+  return;
+}
+
+/*
+ * Sets whether every fetch stops the CPU.
+ */
+void Breakpoints::SetStep(bool step) {
+  step_ = step;
+  return;
+}
+
+/*
+ * Gets the id of the last breakpoint which matched a fetch, or watchpoint
+ * which matched an access. A step which stopped without either gives zero.
+ */
+size_t Breakpoints::GetHit(void) {
+  return hit_id_;
+}
+
+/*
+ * Gets the address of the access which last matched a watchpoint.
+ */
+DoubleWord Breakpoints::GetHitAddr(void) {
+  return hit_addr_;
+}
+
+/*
+ * Gets the number of breakpoints in the set.
+ */
+size_t Breakpoints::GetCount(void) {
+  return points_.size();
+}
+
+/*
+ * Gets the breakpoint at the given index, which must be less than the
+ * count. The breakpoint is valid until the set is next modified.
+ */
+const Breakpoint *Breakpoints::Get(size_t index) {
+  return &(points_[index]);
+}
+
+/*
+ * Frees the breakpoints.
+ */
+Breakpoints::~Breakpoints(void) {
+  return;
+}
@@ -0,0 +1,167 @@
+#ifndef _NES_BREAK
+#define _NES_BREAK
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "../memory/memory.h"
+#include "../util/data.h"
+#include "./cpu.h"
+
+// Given as the bank of a breakpoint to match its address in any bank.
+#define BREAK_ANY_BANK (-1)
+
+// The accesses a breakpoint stops on. Execution breakpoints stop the CPU
+// before the instruction at their address runs. Watchpoints stop it after
+// the instruction which read or wrote their range of memory.
+typedef enum {
+  BREAK_EXEC, BREAK_READ, BREAK_WRITE, BREAK_ACCESS
+} BreakKind;
+
+// The value a breakpoint condition tests. Breakpoints without a condition
+// use BREAK_ALWAYS.
+typedef enum {
+  BREAK_ALWAYS, BREAK_REG_A, BREAK_REG_X, BREAK_REG_Y, BREAK_REG_P,
+  BREAK_REG_S, BREAK_MEMORY
+} BreakOperand;
+
+// How a condition compares its operand to its value. BREAK_AND holds when
+// any of the bits of the value are set in the operand.
+typedef enum {
+  BREAK_EQ, BREAK_NE, BREAK_LT, BREAK_GT, BREAK_AND
+} BreakCompare;
+
+/*
+ * A test of the registers or memory which must hold for a breakpoint to
+ * stop the CPU. Memory is read without side effects.
+ */
+struct BreakCondition {
+  BreakOperand operand;
+  DoubleWord addr;
+  BreakCompare compare;
+  DataWord value;
+};
+
+/*
+ * A breakpoint on the instruction at an address of CPU memory, which can be
+ * limited to the PRG-ROM bank mapped there and to a condition, or a
+ * watchpoint on the accesses to a range of CPU memory.
+ */
+struct Breakpoint {
+  size_t id;
+  BreakKind kind;
+  DoubleWord addr;
+  size_t size;
+  int bank;
+  BreakCondition cond;
+  bool enabled;
+  size_t hits;
+};
+
+/*
+ * The execution breakpoints of a CPU, which are checked each time it
+ * fetches an instruction.
+ *
+ * Every fetch first tests a bitmap of the pages of CPU memory holding an
+ * enabled breakpoint, and only compares the breakpoints themselves when
+ * the page of the instruction is set. Fetches from other pages cost a
+ * single bit test.
+ *
+ * Watchpoints are kept in a second bitmap, which the CPU tests on each
+ * memory access while it has been given watchpoints. A watchpoint which
+ * matches stops the CPU at the next fetch, once the instruction which made
+ * the access has finished.
+ */
+class Breakpoints {
+  private:
+    // The number of pages in CPU memory, and the pages held by each word of
+    // the page bitmap.
+    static const size_t kNumPages_ = 256;
+    static const size_t kPagesPerWord_ = 64;
+
+    // The number of addresses in CPU memory, which no watchpoint can cover
+    // more of.
+    static const size_t kMaxWatchSize_ = 0x10000;
+
+    // One bit for each page of memory, set while it holds an enabled
+    // breakpoint.
+    uint64_t pages_[kNumPages_ / kPagesPerWord_] = { 0 };
+    uint64_t watch_pages_[kNumPages_ / kPagesPerWord_] = { 0 };
+
+    // Set to stop the CPU at the next fetch, either to step a single
+    // instruction or because a watchpoint matched.
+    bool step_ = false;
+    bool watch_hit_ = false;
+
+    // The breakpoints, in the order they were added.
+    std::vector<Breakpoint> points_;
+    size_t next_id_ = 1;
+
+    // The id of the last breakpoint which stopped the CPU, or zero, and the
+    // address accessed if it was a watchpoint.
+    size_t hit_id_ = 0;
+    DoubleWord hit_addr_ = 0;
+
+    // Rebuilds the page bitmap from the enabled breakpoints.
+    void UpdatePages(void);
+
+    // Finds the index of the breakpoint with the given id.
+    bool Find(size_t id, size_t *index);
+
+    // Checks if the condition of a breakpoint holds.
+    bool Test(const BreakCondition *cond, const CpuState *cpu,
+              Memory *memory);
+
+  public:
+    // Creates an empty set of breakpoints.
+    Breakpoints(void);
+
+    // Adds an enabled breakpoint on the given address, in the given bank or
+    // BREAK_ANY_BANK, with the given condition or NULL. Returns its id.
+    size_t Add(DoubleWord addr, int bank, const BreakCondition *cond);
+
+    // Adds an enabled watchpoint on the given range of memory, which stops
+    // on the given kind of access. The range is clamped to the size of CPU
+    // memory. Returns its id.
+    size_t AddWatch(DoubleWord addr, size_t size, BreakKind kind);
+
+    // Removes, enables, or disables the breakpoint with the given id.
+    // Returns false if there is no such breakpoint.
+    bool Remove(size_t id);
+    bool SetEnabled(size_t id, bool enabled);
+
+    // Checks if any enabled breakpoint is in the page of the given address,
+    // or if the next fetch stops the CPU.
+    bool MayBreak(DoubleWord addr);
+
+    // Checks if any enabled breakpoint matches the instruction fetched from
+    // the given address and bank, counting a hit on each which does.
+    bool Check(DoubleWord addr, size_t bank, const CpuState *cpu,
+               Memory *memory);
+
+    // Checks if any watchpoint is enabled, or covers the page of the given
+    // address, and checks the watchpoints on an access to the address.
+    bool HasWatches(void);
+    bool MayWatch(DoubleWord addr);
+    void CheckAccess(DoubleWord addr, bool write);
+
+    // Stops the CPU at every fetch while set, so that it runs a single
+    // instruction each time it is resumed.
+    void SetStep(bool step);
+
+    // Gets the id of the last breakpoint which matched, or zero if none has,
+    // and the address accessed if it was a watchpoint.
+    size_t GetHit(void);
+    DoubleWord GetHitAddr(void);
+
+    // Gets the number of breakpoints and watchpoints, and the one at the
+    // given index.
+    size_t GetCount(void);
+    const Breakpoint *Get(size_t index);
+
+    // Frees the breakpoints.
+    ~Breakpoints(void);
+};
+
+#endif
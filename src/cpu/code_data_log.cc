@@ -0,0 +1,107 @@
+/*
+ * The code/data log marks each byte of PRG-ROM the CPU runs as an opcode or
+ * an operand, as an instruction is fetched. A rom never marks which of its
+ * bytes are code, and a linear disassembly of it decodes its data tables as
+ * instructions, losing track of where the real instructions start. Once a
+ * rom has been played for a while, the log holds most of its code, which
+ * lets it be disassembled accurately.
+ *
+ * The log is kept by the offset of each byte in PRG-ROM, rather than by
+ * address, so that the code of every bank is logged separately.
+ */
+
+#include "./code_data_log.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "../memory/memory.h"
+#include "../debug/disas.h"
+#include "../util/data.h"
+
+/*
+ * Creates an empty log for the PRG-ROM of the given memory. Until a bank is
+ * run, it is assumed to be mapped as at power on, with the last bank at the
+ * top of memory.
+ */
+CodeDataLog::CodeDataLog(Memory *memory) {
+  size_t num_banks = memory->GetPrgRomSize() / PRG_BANK_SIZE;
+  flags_.resize(num_banks * PRG_BANK_SIZE, 0);
+  bank_addrs_.resize(num_banks, PRG_ROM_OFFSET);
+  if (num_banks > 0) {
+    bank_addrs_[num_banks - 1] = PRG_ROM_OFFSET + PRG_BANK_SIZE;
+  }
+  for (size_t i = 0; i < 256; i++) {
+    inst_sizes_[i] = static_cast<DataWord>(InstructionSize(
+                                           static_cast<DataWord>(i)));
+  }
+  return;
+}
+
+/*
+ * Gets the offset in PRG-ROM of the given address, in the given bank.
+ *
+ * Returns false if the address is not in PRG-ROM.
+ */
+bool CodeDataLog::GetOffset(DoubleWord addr, size_t bank, size_t *offset) {
+  if ((addr < PRG_ROM_OFFSET) || (bank >= bank_addrs_.size())) {
+    return false;
+  }
+  *offset = (bank * PRG_BANK_SIZE) + (addr & (PRG_BANK_SIZE - 1U));
+  return true;
+}
+
+/*
+ * Marks the opcode fetched from the given address and bank, and the
+ * operands after it. The operands of an instruction at the end of a bank
+ * are in the bank mapped after it, which is found with the given memory.
+ */
+void CodeDataLog::LogFetch(DoubleWord addr, size_t bank, DataWord opcode,
+                           Memory *memory) {
+  size_t offset;
+  if (!GetOffset(addr, bank, &offset)) { return; }
+  flags_[offset] |= CDL_OPCODE;
+  bank_addrs_[bank] = static_cast<DoubleWord>(addr & ~(PRG_BANK_SIZE - 1U));
+
+  for (size_t i = 1; i < inst_sizes_[opcode]; i++) {
+    DoubleWord operand = static_cast<DoubleWord>(addr + i);
+    if ((operand & (PRG_BANK_SIZE - 1U)) == 0) {
+      bank = memory->GetPrgBank(operand);
+    }
+    if (GetOffset(operand, bank, &offset)) { flags_[offset] |= CDL_OPERAND; }
+  }
+  return;
+}
+
+/*
+ * Gets the flags logged for the given address in the given bank. Addresses
+ * outside of PRG-ROM are never logged.
+ */
+DataWord CodeDataLog::GetFlags(DoubleWord addr, size_t bank) {
+  size_t offset;
+  return GetOffset(addr, bank, &offset) ? flags_[offset] : 0;
+}
+
+/*
+ * Gets the number of banks of PRG-ROM in the log.
+ */
+size_t CodeDataLog::GetBankCount(void) {
+  return bank_addrs_.size();
+}
+
+/*
+ * Gets the CPU address of the start of the given bank, when it was last
+ * run.
+ */
+DoubleWord CodeDataLog::GetBankAddr(size_t bank) {
+  return bank_addrs_[bank];
+}
+
+/*
+ * Frees the log.
+ */
+CodeDataLog::~CodeDataLog(void) {
+  return;
+}
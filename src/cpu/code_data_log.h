@@ -0,0 +1,59 @@
+#ifndef _NES_CDL
+#define _NES_CDL
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "../memory/memory.h"
+#include "../util/data.h"
+
+// The flags logged for each byte of PRG-ROM. Bytes with neither flag set
+// were never run, and may be data.
+#define CDL_OPCODE 0x01U
+#define CDL_OPERAND 0x02U
+
+/*
+ * Logs which bytes of PRG-ROM the CPU has run, and whether each was the
+ * opcode or an operand of an instruction. Used to tell code from data when
+ * disassembling a rom.
+ */
+class CodeDataLog {
+  private:
+    // The flags of each byte of PRG-ROM.
+    std::vector<DataWord> flags_;
+
+    // The CPU address each bank of PRG-ROM was last run from, so that it can
+    // be disassembled at the same address.
+    std::vector<DoubleWord> bank_addrs_;
+
+    // The size of the instruction of each opcode, decoded once.
+    DataWord inst_sizes_[256];
+
+    // Gets the offset in PRG-ROM of the given address in the given bank.
+    // Returns false if the address is not in PRG-ROM.
+    bool GetOffset(DoubleWord addr, size_t bank, size_t *offset);
+
+  public:
+    // Creates an empty log for the PRG-ROM of the given memory.
+    CodeDataLog(Memory *memory);
+
+    // Logs the instruction fetched from the given address and bank, with the
+    // given opcode.
+    void LogFetch(DoubleWord addr, size_t bank, DataWord opcode,
+                  Memory *memory);
+
+    // Gets the flags of the given address in the given bank. Addresses
+    // outside of PRG-ROM have none.
+    DataWord GetFlags(DoubleWord addr, size_t bank);
+
+    // Gets the number of PRG-ROM banks in the log, and the CPU address the
+    // given bank was last run from.
+    size_t GetBankCount(void);
+    DoubleWord GetBankAddr(size_t bank);
+
+    // Frees the log.
+    ~CodeDataLog(void);
+};
+
+#endif
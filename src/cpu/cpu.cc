@@ -39,8 +39,13 @@
 #include "../memory/memory.h"
 #include "../memory/header.h"
 #include "../util/util.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 #include "./machinecode.h"
 #include "./cpu_operation.h"
+#include "./breakpoints.h"
+#include "./trace_log.h"
+#include "./code_data_log.h"
 
 // DMA transfers take at least 513 cycles.
 #define DMA_CYCLE_LENGTH 513U
@@ -70,13 +75,14 @@
 #define P_UPDATE_C(b) (regs_->p = ((static_cast<bool>(b)) | (regs_->p & 0xFE)))
 
 /*
- * Creates a new CPU object. The CPU object will not be in a usable state
- * until Connect() and Power() have been called.
+ * Creates a new CPU object, allocating its structures from the given arena.
+ * The CPU object will not be in a usable state until Connect() and Power()
+ * have been called.
  */
-Cpu::Cpu(void) {
+Cpu::Cpu(Arena *arena) {
   // Prepares the CPU's internal structures.
-  code_table_ = LoadCodeTable();
-  regs_ = new CpuRegFile();
+  code_table_ = LoadCodeTable(arena);
+  regs_ = arena->New<CpuRegFile>();
   return;
 }
 
@@ -84,11 +90,11 @@ Cpu::Cpu(void) {
  * Loads the microcode table from the linked binary into ram, and
  * returns it to the CPU.
  */
-CpuOperation *Cpu::LoadCodeTable(void) {
+CpuOperation *Cpu::LoadCodeTable(Arena *arena) {
   extern const CpuOperation _binary_bins_inst_table_bin_start[];
   const size_t table_size = NUM_DEFINED_INSTRUCTION * kInstSequenceSize_;
 
-  CpuOperation *table = new CpuOperation[table_size];
+  CpuOperation *table = arena->NewArray<CpuOperation>(table_size);
   for (size_t i = 0; i < table_size; i++) {
     table[i] = _binary_bins_inst_table_bin_start[i];
   }
@@ -134,7 +140,7 @@ size_t Cpu::RunSchedule(size_t cycles, size_t &syncs) {
   // Execute the CPU until it must be synced.
   size_t execs = 0;
   while (CheckNextCycle() && (execs < cycles)
-                          && (dma_cycles_remaining_ == 0)) {
+                          && (dma_cycles_remaining_ == 0) && !break_hit_) {
     RunCycle();
     execs++;
   }
@@ -176,6 +182,12 @@ bool Cpu::CheckNextCycle(void) {
  * Assumes that there is at least one cycle in the state queue.
  */
 void Cpu::RunCycle(void) {
+  // A jammed CPU does nothing until it is reset.
+  if (jammed_) {
+    cycle_even_ = !cycle_even_;
+    return;
+  }
+
   // Check if the CPU is suspended and executing a DMA.
   if (dma_cycles_remaining_ > 0) {
     ExecuteDma();
@@ -277,6 +289,9 @@ void Cpu::RunOperation(void) {
   regs_->pc_lo = GET_WORD_LO(pc_update);
   regs_->pc_hi = GET_WORD_HI(pc_update);
 
+  // Finish a fetch which must be traced or checked for breakpoints.
+  if (fetch_hooked_) { FinishFetch(); }
+
   return;
 }
 
@@ -309,7 +324,9 @@ void Cpu::RunMemoryOperation(CpuOperation &op) {
      * plus the offset into the register specified by mem_op1.
      */
     case MEM_READ: {
-      regfile[mem_op1] = memory_->Read(READ_ADDR_REG(mem_addr, mem_offset));
+      DoubleWord addr = READ_ADDR_REG(mem_addr, mem_offset);
+      regfile[mem_op1] = memory_->Read(addr);
+      if (watchpoints_ != NULL) { CheckWatch(addr, false); }
       break;
     }
 
@@ -318,7 +335,9 @@ void Cpu::RunMemoryOperation(CpuOperation &op) {
      * given from the addressing register.
      */
     case MEM_WRITE: {
-      memory_->Write(READ_ADDR_REG(mem_addr, 0), regfile[mem_op1]);
+      DoubleWord addr = READ_ADDR_REG(mem_addr, 0);
+      memory_->Write(addr, regfile[mem_op1]);
+      if (watchpoints_ != NULL) { CheckWatch(addr, true); }
       break;
     }
 
@@ -707,15 +726,26 @@ void Cpu::Fetch(CpuOperation &op) {
   // Fetch the next instruction to the instruction register.
   if (!nmi_edge_ && !irq_ready_) {
     // Read the inst from the PC, then decode it using the code table.
-    regs_->inst = memory_->Read(READ_ADDR_REG(REG_PCL, 0));
+    DoubleWord addr = READ_ADDR_REG(REG_PCL, 0);
+    regs_->inst = memory_->Read(addr);
     current_sequence_ = &code_table_[regs_->inst * kInstSequenceSize_];
 
+    // Finish the fetch at the end of the cycle if it is logged or may have a
+    // breakpoint. Fetches from pages without any breakpoints are rejected
+    // before the breakpoints are compared.
+    if (fetch_logged_
+        || ((breakpoints_ != NULL) && breakpoints_->MayBreak(addr))) {
+      fetch_hooked_ = true;
+      fetch_addr_ = addr;
+    }
+
     // Ensure that the instruction loaded was not illegal.
-    // In the code table, no valid instruction begins with a NOP.
+    // In the code table, no valid instruction begins with a NOP. Illegal
+    // instructions jam the CPU, as the KIL instructions of the 6502 do.
     if (current_sequence_[0] == 0) {
-      fprintf(stderr, "Error: Fetch obtained unimplemented instruction %02x",
-              regs_->inst);
-      abort();
+      fprintf(stderr, "Error: Fetch obtained unimplemented instruction %02x, "
+                      "halting the CPU\n", regs_->inst);
+      jammed_ = true;
     }
   } else {
     // All interrupts fill the instruction register with 0x00 (BRK).
@@ -740,6 +770,70 @@ void Cpu::Fetch(CpuOperation &op) {
   return;
 }
 
+/*
+ * Logs the instruction fetched this cycle, and checks its breakpoints.
+ * The registers are read after the data operation of the cycle, which
+ * finishes the previous instruction, so that they hold the values the
+ * fetched instruction starts with.
+ */
+void Cpu::FinishFetch(void) {
+  fetch_hooked_ = false;
+  CpuState state;
+  Inspect(&state);
+  state.pc = fetch_addr_;
+  size_t bank = memory_->GetPrgBank(fetch_addr_);
+  if (trace_ != NULL) { TraceFetch(fetch_addr_, bank, &state); }
+  if (code_log_ != NULL) {
+    code_log_->LogFetch(fetch_addr_, bank, state.inst, memory_);
+  }
+  if ((breakpoints_ != NULL) && breakpoints_->MayBreak(fetch_addr_)) {
+    CheckBreak(fetch_addr_, bank, &state);
+  }
+  return;
+}
+
+/*
+ * Checks the breakpoints on the instruction fetched from the given address
+ * against the bank it came from and the registers, stopping the CPU if any
+ * match.
+ */
+void Cpu::CheckBreak(DoubleWord addr, size_t bank, const CpuState *state) {
+  if (breakpoints_->Check(addr, bank, state, memory_)) { break_hit_ = true; }
+  return;
+}
+
+/*
+ * Checks the watchpoints on an access to the given address. Accesses to
+ * pages without any watchpoints are rejected before the watchpoints are
+ * compared.
+ */
+void Cpu::CheckWatch(DoubleWord addr, bool write) {
+  if (watchpoints_->MayWatch(addr)) { watchpoints_->CheckAccess(addr, write); }
+  return;
+}
+
+/*
+ * Records the instruction fetched from the given address and bank to the
+ * trace log. The bytes after the opcode are inspected, so that reading
+ * them has no side effects.
+ */
+void Cpu::TraceFetch(DoubleWord addr, size_t bank, const CpuState *state) {
+  TraceEntry entry;
+  entry.pc = addr;
+  entry.bank = static_cast<DataWord>(bank);
+  entry.bytes[0] = state->inst;
+  for (size_t i = 1; i < TRACE_INST_BYTES; i++) {
+    entry.bytes[i] = memory_->Inspect(static_cast<DoubleWord>(addr + i));
+  }
+  entry.a = state->a;
+  entry.x = state->x;
+  entry.y = state->y;
+  entry.p = state->p;
+  entry.s = state->s;
+  trace_->Record(&entry);
+  return;
+}
+
 /*
  * Checks if the global nmi line has signaled for an interrupt using an
  * edge detector.
@@ -764,9 +858,189 @@ void Cpu::PollIrqLine(void) {
 }
 
 /*
- * Frees the register file, memory, and state.
+ * Writes the registers and execution state of the CPU to the given state.
+ * The current microcode sequence is saved as its position in the code
+ * table, or as the instruction buffer.
+ */
+void Cpu::SaveState(StateWriter *state) {
+  state->Put(*regs_);
+  state->Put(nmi_prev_);
+  state->Put(nmi_edge_);
+  state->Put(irq_level_);
+  state->Put(irq_ready_);
+  state->Put(cycle_even_);
+  state->Put(jammed_);
+  state->Put(dma_mdr_);
+  state->Put(dma_cycles_remaining_);
+  state->Put(dma_addr_);
+  state->Write(inst_buffer_, sizeof(inst_buffer_));
+  size_t sequence = (current_sequence_ == inst_buffer_) ? kInstBufferSequence_
+                  : static_cast<size_t>(current_sequence_ - code_table_);
+  state->Put(sequence);
+  state->Put(current_operation_);
+  state->Put(inst_pointer_);
+  state->Put(irq_line_);
+  state->Put(nmi_line_);
+  return;
+}
+
+/*
+ * Restores the registers and execution state of the CPU from the given
+ * state. Returns false if the state was too short, or held a microcode
+ * position outside the code table.
+ */
+bool Cpu::LoadState(StateReader *state) {
+  const size_t kTableSize = NUM_DEFINED_INSTRUCTION * kInstSequenceSize_;
+
+  state->Get(regs_);
+  state->Get(&nmi_prev_);
+  state->Get(&nmi_edge_);
+  state->Get(&irq_level_);
+  state->Get(&irq_ready_);
+  state->Get(&cycle_even_);
+  state->Get(&jammed_);
+  state->Get(&dma_mdr_);
+  state->Get(&dma_cycles_remaining_);
+  state->Get(&dma_addr_);
+  state->Read(inst_buffer_, sizeof(inst_buffer_));
+  size_t sequence = kInstBufferSequence_;
+  state->Get(&sequence);
+  state->Get(&current_operation_);
+  state->Get(&inst_pointer_);
+  state->Get(&irq_line_);
+  state->Get(&nmi_line_);
+
+  // Restore the microcode sequence, falling back to the instruction buffer
+  // if the state was invalid.
+  bool valid = !state->HasFailed() && (inst_pointer_ < kInstSequenceSize_)
+            && ((sequence == kInstBufferSequence_)
+            || (sequence <= kTableSize - kInstSequenceSize_));
+  current_sequence_ = (valid && (sequence != kInstBufferSequence_))
+                    ? &code_table_[sequence] : inst_buffer_;
+  if (!valid) { inst_pointer_ = 0; }
+  return valid;
+}
+
+/*
+ * Checks if the CPU has been jammed by an unimplemented instruction.
+ */
+bool Cpu::IsJammed(void) {
+  return jammed_;
+}
+
+/*
+ * Sets the breakpoints which are checked each time the CPU fetches an
+ * instruction. The CPU does not take ownership of them.
+ */
+void Cpu::SetBreakpoints(Breakpoints *breakpoints) {
+  breakpoints_ = breakpoints;
+  return;
+}
+
+/*
+ * Checks if a breakpoint stopped the CPU. A stopped CPU has fetched the
+ * opcode of the instruction with the breakpoint, but run none of it.
+ */
+bool Cpu::HitBreak(void) {
+  return break_hit_;
+}
+
+/*
+ * Resumes a CPU stopped by a breakpoint. The instruction it stopped on has
+ * been fetched, and so its breakpoint does not stop the CPU again.
+ */
+void Cpu::Resume(void) {
+  break_hit_ = false;
+  return;
+}
+
+/*
+ * Sets the watchpoints which are checked each time the CPU accesses memory.
+ * The CPU does not take ownership of them.
+ */
+void Cpu::SetWatchpoints(Breakpoints *watchpoints) {
+  watchpoints_ = watchpoints;
+  return;
+}
+
+/*
+ * Sets the trace log each instruction the CPU fetches is recorded to. The
+ * CPU does not take ownership of it.
+ */
+void Cpu::SetTraceLog(TraceLog *trace) {
+  trace_ = trace;
+  fetch_logged_ = (trace_ != NULL) || (code_log_ != NULL);
+  return;
+}
+
+/*
+ * Sets the code/data log each instruction the CPU fetches is marked in. The
+ * CPU does not take ownership of it.
+ */
+void Cpu::SetCodeDataLog(CodeDataLog *code_log) {
+  code_log_ = code_log;
+  fetch_logged_ = (trace_ != NULL) || (code_log_ != NULL);
+  return;
+}
+
+/*
+ * Copies the registers of the CPU to the given structure. After a
+ * breakpoint, the program counter is that of the opcode which was fetched,
+ * rather than the one past it, so that it names the instruction stopped on.
+ */
+void Cpu::Inspect(CpuState *state) {
+  state->pc = break_hit_ ? fetch_addr_
+                         : GET_DOUBLE_WORD(regs_->pc_lo, regs_->pc_hi);
+  state->a = regs_->a;
+  state->x = regs_->x;
+  state->y = regs_->y;
+  state->p = regs_->p;
+  state->s = regs_->s_lo;
+  state->inst = regs_->inst;
+  return;
+}
+
+/*
+ * Writes the given registers to the CPU.
+ *
+ * A CPU stopped by a breakpoint has already fetched the instruction it
+ * stopped on, and so a new PC replaces that instruction with the one at the
+ * new address, which is inspected to avoid side effects. Otherwise, the
+ * rest of the current instruction is dropped, and the CPU fetches from the
+ * new PC on its next cycle.
+ */
+void Cpu::SetRegisters(const CpuState *state) {
+  CpuState current;
+  Inspect(&current);
+  regs_->a = state->a;
+  regs_->x = state->x;
+  regs_->y = state->y;
+  regs_->p = state->p & P_MASK;
+  regs_->s_lo = state->s;
+  if (state->pc == current.pc) { return; }
+
+  inst_pointer_ = 0;
+  if (break_hit_) {
+    DoubleWord pc = state->pc + 1U;
+    regs_->pc_lo = GET_WORD_LO(pc);
+    regs_->pc_hi = GET_WORD_HI(pc);
+    fetch_addr_ = state->pc;
+    regs_->inst = memory_->Inspect(state->pc);
+    current_sequence_ = &code_table_[regs_->inst * kInstSequenceSize_];
+    jammed_ = (current_sequence_[0] == 0);
+  } else {
+    regs_->pc_lo = GET_WORD_LO(state->pc);
+    regs_->pc_hi = GET_WORD_HI(state->pc);
+    inst_buffer_[0] = MEM_FETCH | PC_INC;
+    current_sequence_ = inst_buffer_;
+  }
+  return;
+}
+
+/*
+ * The register file and code table belong to the arena of the console, and
+ * are freed with it.
  */
 Cpu::~Cpu(void) {
-  delete regs_;
-  delete[] code_table_;
+  return;
 }
@@ -7,11 +7,35 @@
 
 #include "../memory/memory.h"
 #include "../util/data.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 #include "./cpu_operation.h"
 
 // The CPU has a memory mapped register to start a DMA to OAM at this address.
 #define CPU_DMA_ADDR 0x4014U
 
+// Defined in the breakpoints, trace log, and code/data log headers, which
+// depend on this one.
+class Breakpoints;
+class TraceLog;
+class CodeDataLog;
+
+/*
+ * A copy of the registers of the CPU, used to inspect the CPU without
+ * affecting it.
+ */
+struct CpuState {
+  DoubleWord pc;
+  DataWord a;
+  DataWord x;
+  DataWord y;
+  DataWord p;
+  DataWord s;
+
+  // The opcode of the last instruction fetched.
+  DataWord inst;
+};
+
 /*
  * Represents an emulated 6502 CPU. The state of the CPU is managed
  * using a CPU state queue. The CPU must be given a memory object to use
@@ -22,6 +46,9 @@ class Cpu {
     // The size of each microcode sequence in the code table.
     static const size_t kInstSequenceSize_ = 8;
 
+    // Marks a saved microcode sequence as being in the instruction buffer.
+    static const size_t kInstBufferSequence_ = SIZE_MAX;
+
     /*
      * This structure represents the register file for the 6502 CPU, and
      * is used in the CPU emulation. The order of the fields in this file
@@ -58,6 +85,30 @@ class Cpu {
     // This variable is used to facilitate that.
     bool irq_ready_ = false;
 
+    // Set when an unimplemented instruction is fetched, which stops the CPU.
+    bool jammed_ = false;
+
+    // The breakpoints checked on each fetch, if any. Set when a breakpoint
+    // stops the CPU after fetching an instruction, and cleared to resume.
+    Breakpoints *breakpoints_ = NULL;
+    bool break_hit_ = false;
+
+    // The watchpoints checked on each access to memory, if any. Only set
+    // while some are enabled, as every access must then be checked.
+    Breakpoints *watchpoints_ = NULL;
+
+    // The trace log and code/data log each instruction is recorded to, if
+    // any. Set while either is, in which case every fetch is hooked.
+    TraceLog *trace_ = NULL;
+    CodeDataLog *code_log_ = NULL;
+    bool fetch_logged_ = false;
+
+    // Set when a fetch must be logged or checked against the breakpoints.
+    // This is done at the end of the cycle of the fetch, once the previous
+    // instruction has written its result to the registers.
+    bool fetch_hooked_ = false;
+    DoubleWord fetch_addr_ = 0;
+
     // Used for DMA transfers to PPU OAM.
     bool cycle_even_ = false;
     DataWord dma_mdr_ = 0;
@@ -84,7 +135,7 @@ class Cpu {
     size_t inst_pointer_ = 0;
 
     /* Helper functions for the CPU emulation */
-    CpuOperation *LoadCodeTable(void);
+    CpuOperation *LoadCodeTable(Arena *arena);
     bool CheckNextCycle(void);
     void ExecuteDma(void);
     bool CanPoll(void);
@@ -92,6 +143,10 @@ class Cpu {
     void RunMemoryOperation(CpuOperation &op);
     void RunDataOperation(CpuOperation &op);
     void Fetch(CpuOperation &op);
+    void FinishFetch(void);
+    void CheckBreak(DoubleWord addr, size_t bank, const CpuState *state);
+    void CheckWatch(DoubleWord addr, bool write);
+    void TraceFetch(DoubleWord addr, size_t bank, const CpuState *state);
     void PollNmiLine(void);
     void PollIrqLine(void);
 
@@ -100,8 +155,8 @@ class Cpu {
     DataWord irq_line_ = 0;
     bool nmi_line_ = false;
 
-    // Creates a new CPU object.
-    Cpu(void);
+    // Creates a new CPU object, whose structures live in the given arena.
+    Cpu(Arena *arena);
 
     // Connects a Memory object to the calling CPU object.
     void Connect(Memory *memory);
@@ -121,6 +176,39 @@ class Cpu {
     // Starts a DMA transfer from CPU memory to PPU OAM.
     void StartDma(DataWord addr);
 
+    // Saves or restores the registers and execution state of the CPU.
+    // Loading returns false if the state was invalid.
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
+    // Checks if the CPU has stopped on an unimplemented instruction.
+    bool IsJammed(void);
+
+    // Sets the breakpoints checked on each fetch. May be NULL.
+    void SetBreakpoints(Breakpoints *breakpoints);
+
+    // Checks if a breakpoint has stopped the CPU, which then runs no more
+    // cycles until it is resumed.
+    bool HitBreak(void);
+    void Resume(void);
+
+    // Sets the watchpoints checked on each access to memory. May be NULL,
+    // which should be given while none are enabled.
+    void SetWatchpoints(Breakpoints *watchpoints);
+
+    // Records each instruction to the given trace log or code/data log.
+    // Either may be NULL.
+    void SetTraceLog(TraceLog *trace);
+    void SetCodeDataLog(CodeDataLog *code_log);
+
+    // Copies the registers of the CPU to the given structure. A CPU stopped
+    // by a breakpoint gives the address of the instruction it stopped on.
+    void Inspect(CpuState *state);
+
+    // Changes the registers of the CPU to those in the given structure. The
+    // instruction at the new PC is fetched again, if it changed.
+    void SetRegisters(const CpuState *state);
+
     // Deletes the CPU object. The associated memory object is not deleted.
     ~Cpu(void);
 };
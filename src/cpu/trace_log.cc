@@ -0,0 +1,368 @@
+/*
+ * A trace log records every instruction the CPU executes, along with the
+ * registers it started with, the bank it was fetched from, and the cycle
+ * and PPU position of its fetch. Traces of a few seconds of emulation hold
+ * millions of instructions, so they are kept as binary rather than text,
+ * and formatted offline by ndb-trace.
+ *
+ * The emulation thread only copies each instruction into a block of
+ * entries. Full blocks are handed to a writer thread, which encodes and
+ * writes them, so that neither the encoding nor the I/O delays emulation.
+ * If the writer falls behind by every block, the emulation waits for it
+ * rather than losing instructions.
+ *
+ * A trace begins with the magic "NDBT" and a version byte. Each instruction
+ * is then stored as the number of cycles since the previous instruction,
+ * as a little endian base 128 varint, followed by the PC and bank, the
+ * instruction bytes, A, X, Y, P, and S, and the scanline and dot, with
+ * 16-bit values stored little endian. Most instructions take 16 bytes.
+ *
+ * Traces whose path ends in ".zst" are piped through the zstd tool, which
+ * must be installed to write or read them.
+ */
+
+#include "./trace_log.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../ppu/ppu.h"
+#include "../util/data.h"
+
+// The header which starts each trace.
+#define TRACE_MAGIC "NDBT"
+#define TRACE_MAGIC_SIZE 4U
+#define TRACE_VERSION 1U
+
+// The size of the fields stored after the cycle of each instruction, and
+// the largest size of an encoded instruction.
+#define TRACE_FIELDS_SIZE 15U
+#define TRACE_MAX_VARINT_SIZE 10U
+#define TRACE_MAX_RECORD_SIZE (TRACE_MAX_VARINT_SIZE + TRACE_FIELDS_SIZE)
+
+// Traces with this suffix are compressed with zstd.
+#define TRACE_ZSTD_SUFFIX ".zst"
+
+// The commands which compress and decompress a trace, given its path.
+#define TRACE_ZSTD_WRITE "zstd -q -f -o '%s'"
+#define TRACE_ZSTD_READ "zstd -q -d -c '%s'"
+
+/*
+ * Checks if the given trace path names a compressed trace.
+ */
+static bool IsCompressed(const char *path) {
+  size_t len = strlen(path);
+  size_t suffix_len = strlen(TRACE_ZSTD_SUFFIX);
+  return (len > suffix_len)
+      && (strcmp(&(path[len - suffix_len]), TRACE_ZSTD_SUFFIX) == 0);
+}
+
+/*
+ * Opens a pipe to or from a zstd process for the trace at the given path.
+ * The path is quoted for the shell, and so cannot itself hold a quote.
+ *
+ * Returns NULL on failure.
+ */
+static FILE *OpenZstd(const char *command, const char *path,
+                      const char *mode) {
+  if (strchr(path, '\'') != NULL) {
+    fprintf(stderr, "Error: Compressed trace path %s cannot contain a "
+                    "quote.\n", path);
+    return NULL;
+  }
+  size_t size = strlen(command) + strlen(path) + 1;
+  char *line = new char[size];
+  snprintf(line, size, command, path);
+  FILE *pipe = popen(line, mode);
+  delete[] line;
+  return pipe;
+}
+
+/*
+ * Opens a trace log at the given path, and writes its header. Traces with
+ * paths ending in ".zst" are compressed by a zstd process.
+ *
+ * Returns NULL on failure.
+ */
+TraceLog *TraceLog::Create(const char *path) {
+  bool piped = IsCompressed(path);
+  FILE *file = piped ? OpenZstd(TRACE_ZSTD_WRITE, path, "w")
+                     : fopen(path, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Failed to open trace log %s\n", path);
+    return NULL;
+  }
+
+  DataWord header[TRACE_MAGIC_SIZE + 1];
+  memcpy(header, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+  header[TRACE_MAGIC_SIZE] = TRACE_VERSION;
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+    fprintf(stderr, "Error: Failed to write trace log %s\n", path);
+    if (piped) { pclose(file); } else { fclose(file); }
+    return NULL;
+  }
+
+  return new TraceLog(file, piped);
+}
+
+/*
+ * Creates a trace log writing to the given stream, then starts the writer
+ * thread.
+ */
+TraceLog::TraceLog(FILE *file, bool piped) {
+  file_ = file;
+  piped_ = piped;
+  for (size_t i = 0; i < kNumBlocks_; i++) {
+    blocks_[i] = new TraceEntry[kBlockSize_];
+    block_sizes_[i] = 0;
+  }
+  fill_block_ = blocks_[0];
+  writer_thread_ = std::thread(&TraceLog::RunWriter, this);
+  return;
+}
+
+/*
+ * Sets the PPU whose position is recorded with each instruction.
+ */
+void TraceLog::Connect(Ppu *ppu) {
+  ppu_ = ppu;
+  return;
+}
+
+/*
+ * Sets the cycle the console is about to run. Instructions fetched during
+ * it are stamped with it.
+ */
+void TraceLog::SetCycle(uint64_t cycle) {
+  cycle_ = cycle;
+  return;
+}
+
+/*
+ * Adds the given instruction to the block being filled, stamped with the
+ * current cycle and PPU position. Full blocks are queued to be written.
+ */
+void TraceLog::Record(TraceEntry *entry) {
+  size_t scanline = 0;
+  size_t dot = 0;
+  if (ppu_ != NULL) { ppu_->GetPosition(&scanline, &dot); }
+  entry->cycle = cycle_;
+  entry->scanline = static_cast<uint16_t>(scanline);
+  entry->dot = static_cast<uint16_t>(dot);
+
+  fill_block_[fill_size_] = *entry;
+  fill_size_++;
+  if (fill_size_ >= kBlockSize_) { Submit(); }
+  return;
+}
+
+/*
+ * Queues the block being filled for the writer, then waits for a free block
+ * to fill next. The block at the end of the queue is only accessed by the
+ * emulation thread until it is queued.
+ */
+void TraceLog::Submit(void) {
+  std::unique_lock<std::mutex> guard(lock_);
+  block_sizes_[(queue_head_ + queue_size_) % kNumBlocks_] = fill_size_;
+  queue_size_++;
+  queue_signal_.notify_all();
+  queue_signal_.wait(guard, [this] { return queue_size_ < kNumBlocks_; });
+  fill_block_ = blocks_[(queue_head_ + queue_size_) % kNumBlocks_];
+  fill_size_ = 0;
+  return;
+}
+
+/*
+ * Writes each queued block in order. Returns once the log is closing and
+ * every queued block has been written.
+ *
+ * If a block cannot be written, the error is reported once and the rest of
+ * the trace is discarded, so that the emulation is never stopped by it.
+ */
+void TraceLog::RunWriter(void) {
+  DataWord *encoded = new DataWord[kBlockSize_ * TRACE_MAX_RECORD_SIZE];
+  bool failed = false;
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    // Wait for a block to be queued.
+    queue_signal_.wait(guard, [this] { return (queue_size_ > 0) || closing_; });
+    if (queue_size_ == 0) { break; }
+
+    // Write the block at the start of the queue without holding the lock.
+    TraceEntry *block = blocks_[queue_head_];
+    size_t size = block_sizes_[queue_head_];
+    guard.unlock();
+    if (!failed && !WriteBlock(block, size, encoded)) {
+      fprintf(stderr, "Error: Failed to write the trace log.\n");
+      failed = true;
+    }
+    guard.lock();
+
+    // Free the block for the emulation thread.
+    queue_head_ = (queue_head_ + 1) % kNumBlocks_;
+    queue_size_--;
+    queue_signal_.notify_all();
+  }
+
+  delete[] encoded;
+  return;
+}
+
+/*
+ * Encodes the given block of instructions into the given buffer, which must
+ * hold the largest encoding of a full block, then writes it to the trace.
+ *
+ * Returns false if the block could not be written.
+ */
+bool TraceLog::WriteBlock(const TraceEntry *block, size_t size,
+                          DataWord *encoded) {
+  size_t pos = 0;
+  for (size_t i = 0; i < size; i++) {
+    const TraceEntry *entry = &(block[i]);
+
+    // The cycle is stored as the cycles since the last instruction, seven
+    // bits at a time, with the top bit set on every byte but the last.
+    uint64_t delta = entry->cycle - last_cycle_;
+    last_cycle_ = entry->cycle;
+    while (delta >= 0x80U) {
+      encoded[pos++] = static_cast<DataWord>(delta | 0x80U);
+      delta >>= 7U;
+    }
+    encoded[pos++] = static_cast<DataWord>(delta);
+
+    encoded[pos++] = GET_WORD_LO(entry->pc);
+    encoded[pos++] = GET_WORD_HI(entry->pc);
+    encoded[pos++] = entry->bank;
+    for (size_t j = 0; j < TRACE_INST_BYTES; j++) {
+      encoded[pos++] = entry->bytes[j];
+    }
+    encoded[pos++] = entry->a;
+    encoded[pos++] = entry->x;
+    encoded[pos++] = entry->y;
+    encoded[pos++] = entry->p;
+    encoded[pos++] = entry->s;
+    encoded[pos++] = GET_WORD_LO(entry->scanline);
+    encoded[pos++] = GET_WORD_HI(entry->scanline);
+    encoded[pos++] = GET_WORD_LO(entry->dot);
+    encoded[pos++] = GET_WORD_HI(entry->dot);
+  }
+  return fwrite(encoded, 1, pos, file_) == pos;
+}
+
+/*
+ * Writes the partially filled block and any queued blocks, then closes the
+ * trace. A failure of zstd is reported.
+ */
+TraceLog::~TraceLog(void) {
+  if (fill_size_ > 0) { Submit(); }
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    closing_ = true;
+  }
+  queue_signal_.notify_all();
+  writer_thread_.join();
+
+  int status = piped_ ? pclose(file_) : fclose(file_);
+  if (status != 0) {
+    fprintf(stderr, "Error: Failed to close the trace log.\n");
+  }
+  for (size_t i = 0; i < kNumBlocks_; i++) { delete[] blocks_[i]; }
+  return;
+}
+
+/*
+ * Opens the trace at the given path, and checks its header. Traces whose
+ * path ends in ".zst" are decompressed by a zstd process.
+ *
+ * Returns NULL on failure.
+ */
+TraceReader *TraceReader::Create(const char *path) {
+  bool piped = IsCompressed(path);
+  FILE *file = piped ? OpenZstd(TRACE_ZSTD_READ, path, "r")
+                     : fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Failed to open trace %s\n", path);
+    return NULL;
+  }
+
+  DataWord header[TRACE_MAGIC_SIZE + 1];
+  if ((fread(header, 1, sizeof(header), file) != sizeof(header))
+      || (memcmp(header, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0)
+      || (header[TRACE_MAGIC_SIZE] != TRACE_VERSION)) {
+    fprintf(stderr, "Error: %s is not a trace of this version.\n", path);
+    if (piped) { pclose(file); } else { fclose(file); }
+    return NULL;
+  }
+
+  return new TraceReader(file, piped);
+}
+
+/*
+ * Creates a trace reader from the given stream, which has had its header
+ * read.
+ */
+TraceReader::TraceReader(FILE *file, bool piped) {
+  file_ = file;
+  piped_ = piped;
+  return;
+}
+
+/*
+ * Reads and decodes the next instruction of the trace.
+ *
+ * Returns false once the trace has ended. A truncated instruction is
+ * reported, and ends the trace.
+ */
+bool TraceReader::Next(TraceEntry *entry) {
+  // Decode the cycles since the last instruction.
+  uint64_t delta = 0;
+  size_t shift = 0;
+  int byte = getc(file_);
+  if (byte == EOF) { return false; }
+  while ((byte & 0x80) && (byte != EOF) && (shift < 64U)) {
+    delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    shift += 7U;
+    byte = getc(file_);
+  }
+
+  // Read the rest of the instruction.
+  DataWord fields[TRACE_FIELDS_SIZE];
+  if ((byte == EOF) || (shift >= 64U)
+      || (fread(fields, 1, sizeof(fields), file_) != sizeof(fields))) {
+    fprintf(stderr, "Error: The trace ends in the middle of an "
+                    "instruction.\n");
+    return false;
+  }
+  delta |= static_cast<uint64_t>(byte) << shift;
+  last_cycle_ += delta;
+
+  entry->cycle = last_cycle_;
+  entry->pc = GET_DOUBLE_WORD(fields[0], fields[1]);
+  entry->bank = fields[2];
+  for (size_t i = 0; i < TRACE_INST_BYTES; i++) {
+    entry->bytes[i] = fields[3 + i];
+  }
+  entry->a = fields[6];
+  entry->x = fields[7];
+  entry->y = fields[8];
+  entry->p = fields[9];
+  entry->s = fields[10];
+  entry->scanline = GET_DOUBLE_WORD(fields[11], fields[12]);
+  entry->dot = GET_DOUBLE_WORD(fields[13], fields[14]);
+  return true;
+}
+
+/*
+ * Closes the trace, reporting a failure of zstd.
+ */
+TraceReader::~TraceReader(void) {
+  int status = piped_ ? pclose(file_) : fclose(file_);
+  if (status != 0) { fprintf(stderr, "Error: Failed to read the trace.\n"); }
+  return;
+}
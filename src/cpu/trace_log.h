@@ -0,0 +1,140 @@
+#ifndef _NES_TRACE
+#define _NES_TRACE
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../ppu/ppu.h"
+#include "../util/data.h"
+
+// The number of bytes of each instruction which are traced. Shorter
+// instructions are followed by the bytes after them.
+#define TRACE_INST_BYTES 3U
+
+/*
+ * An instruction executed by the CPU, with the registers it started with
+ * and the cycle and PPU position of its fetch.
+ */
+struct TraceEntry {
+  uint64_t cycle;
+  DoubleWord pc;
+  DataWord bank;
+  DataWord bytes[TRACE_INST_BYTES];
+  DataWord a;
+  DataWord x;
+  DataWord y;
+  DataWord p;
+  DataWord s;
+  uint16_t scanline;
+  uint16_t dot;
+};
+
+/*
+ * Records each instruction the CPU executes to a file, in a compact binary
+ * format which can be printed with ndb-trace.
+ *
+ * Instructions are collected in blocks by the emulation thread, and only
+ * encoded and written by a writer thread, so tracing never waits on I/O
+ * unless the writer falls a full queue of blocks behind.
+ */
+class TraceLog {
+  private:
+    // The number of instructions in a block, and the number of blocks which
+    // can wait to be written.
+    static const size_t kBlockSize_ = 8192;
+    static const size_t kNumBlocks_ = 4;
+
+    // The stream the trace is written to, which is a pipe to zstd when the
+    // trace is compressed.
+    FILE *file_;
+    bool piped_;
+
+    // Gives the position of the PPU for each instruction. May be NULL.
+    Ppu *ppu_ = NULL;
+
+    // The cycle being run by the console.
+    uint64_t cycle_ = 0;
+
+    // Blocks of instructions waiting to be written, stored as a queue. The
+    // block after the end of the queue is filled by the emulation thread.
+    TraceEntry *blocks_[kNumBlocks_];
+    size_t block_sizes_[kNumBlocks_];
+    size_t queue_head_ = 0;
+    size_t queue_size_ = 0;
+    TraceEntry *fill_block_;
+    size_t fill_size_ = 0;
+
+    // The cycle of the last instruction written, which later cycles are
+    // encoded relative to. Only used by the writer thread.
+    uint64_t last_cycle_ = 0;
+
+    // Guards the queue, which is shared with the writer thread.
+    std::mutex lock_;
+    std::condition_variable queue_signal_;
+    bool closing_ = false;
+    std::thread writer_thread_;
+
+    // Uses the given stream to create a trace log, then starts the writer.
+    TraceLog(FILE *file, bool piped);
+
+    // Queues the filled block to be written, then waits for a free block.
+    void Submit(void);
+
+    // Encodes and writes queued blocks until the log is deleted.
+    void RunWriter(void);
+    bool WriteBlock(const TraceEntry *block, size_t size,
+                    DataWord *encoded);
+
+  public:
+    // Opens a trace log at the given path. Paths ending in ".zst" are
+    // compressed with zstd. Returns NULL on failure.
+    static TraceLog *Create(const char *path);
+
+    // Reads the position of each instruction from the given PPU.
+    void Connect(Ppu *ppu);
+
+    // Sets the cycle the console is running, which stamps the instructions
+    // fetched in it.
+    void SetCycle(uint64_t cycle);
+
+    // Adds the given instruction to the trace, stamping it with the cycle
+    // and PPU position.
+    void Record(TraceEntry *entry);
+
+    // Writes the rest of the trace, then closes it.
+    ~TraceLog(void);
+};
+
+/*
+ * Reads back the instructions of a trace written by a trace log.
+ */
+class TraceReader {
+  private:
+    // The stream the trace is read from, and whether it is a pipe from zstd.
+    FILE *file_;
+    bool piped_;
+
+    // The cycle of the last instruction read.
+    uint64_t last_cycle_ = 0;
+
+    // Uses the given stream, positioned after the header of the trace.
+    TraceReader(FILE *file, bool piped);
+
+  public:
+    // Opens the trace at the given path, decompressing it with zstd if its
+    // path ends in ".zst". Returns NULL on failure.
+    static TraceReader *Create(const char *path);
+
+    // Reads the next instruction of the trace. Returns false at the end of
+    // the trace, or if it is truncated.
+    bool Next(TraceEntry *entry);
+
+    // Closes the trace.
+    ~TraceReader(void);
+};
+
+#endif
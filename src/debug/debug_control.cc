@@ -0,0 +1,127 @@
+/*
+ * The debug controller holds the console for the GDB stub and the terminal
+ * debugger, which share how the console is stopped and stepped.
+ *
+ * The CPU can only be stopped by a breakpoint, and so the console is
+ * stopped at an instruction by having the breakpoints stop it on the next
+ * one, then running it until they do. A console stopped in the middle of an
+ * instruction, as after running it a cycle at a time, finishes it first.
+ */
+
+#include "./debug_control.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+
+#include "../core/console.h"
+#include "../cpu/breakpoints.h"
+
+/*
+ * Creates the breakpoints of the front end. They are not given to the
+ * console until it is stopped.
+ */
+DebugControl::DebugControl(Console *console) {
+  console_ = console;
+  breakpoints_ = new Breakpoints();
+  return;
+}
+
+/*
+ * Returns the breakpoints of the front end.
+ */
+Breakpoints *DebugControl::GetBreakpoints(void) {
+  return breakpoints_;
+}
+
+/*
+ * Checks if the front end holds the console stopped.
+ */
+bool DebugControl::IsHalted(void) {
+  return halted_;
+}
+
+/*
+ * Holds the running console if a breakpoint stopped it, or it was jammed.
+ *
+ * Returns true if the console was held by this call.
+ */
+bool DebugControl::CatchStop(void) {
+  if (halted_ || (!console_->IsPaused() && !console_->IsJammed())) {
+    return false;
+  }
+  halted_ = true;
+  return true;
+}
+
+/*
+ * Stops the console before the next instruction it runs. A console which
+ * has been jammed never runs another instruction, and so is stopped where
+ * it is.
+ */
+void DebugControl::Halt(void) {
+  if (!console_->IsPaused()) {
+    console_->SetBreakpoints(breakpoints_);
+    breakpoints_->SetStep(true);
+    RunToStop();
+    breakpoints_->SetStep(false);
+  }
+  halted_ = true;
+  return;
+}
+
+/*
+ * Runs a single instruction of the console, then holds it.
+ *
+ * Returns false if the console stopped on a breakpoint, or was jammed.
+ */
+bool DebugControl::Step(void) {
+  console_->SetBreakpoints(breakpoints_);
+  breakpoints_->SetStep(true);
+  console_->Resume();
+  RunToStop();
+  breakpoints_->SetStep(false);
+  halted_ = true;
+  return (breakpoints_->GetHit() == 0) && !console_->IsJammed();
+}
+
+/*
+ * Runs the console until a breakpoint stops it, or until it is jammed.
+ */
+void DebugControl::RunToStop(void) {
+  while (!console_->IsPaused() && !console_->IsJammed()) {
+    console_->RunCycles(kStopCycles_);
+  }
+  return;
+}
+
+/*
+ * Lets the held console run until a breakpoint stops it.
+ */
+void DebugControl::Continue(void) {
+  console_->Resume();
+  halted_ = false;
+  return;
+}
+
+/*
+ * Removes the breakpoints and watchpoints from the console, and replaces
+ * them with an empty set, then lets the console run.
+ */
+void DebugControl::Release(void) {
+  console_->SetBreakpoints(NULL);
+  console_->SetWatchpoints(NULL);
+  delete breakpoints_;
+  breakpoints_ = new Breakpoints();
+  console_->Resume();
+  halted_ = false;
+  return;
+}
+
+/*
+ * Deletes the breakpoints, which the console must no longer hold.
+ */
+DebugControl::~DebugControl(void) {
+  delete breakpoints_;
+  return;
+}
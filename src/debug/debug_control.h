@@ -0,0 +1,127 @@
+#ifndef _NES_DEBUGCTRL
+#define _NES_DEBUGCTRL
+
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <utility>
+
+#include "../core/console.h"
+#include "../cpu/breakpoints.h"
+
+/*
+ * Stops, steps, and runs the console for a debugger front end, which only
+ * decides when to do so and how to show it. The breakpoints of the front
+ * end are held here, so that the console can be stopped and stepped with
+ * them.
+ *
+ * Only used by the emulation thread, between frames.
+ */
+class DebugControl {
+  private:
+    // The number of cycles run at a time while stopping the console at the
+    // next instruction.
+    static const size_t kStopCycles_ = 1024;
+
+    // The console being debugged.
+    Console *console_;
+
+    // The breakpoints and watchpoints of the front end.
+    Breakpoints *breakpoints_;
+
+    // Set while the front end holds the console stopped, in which case
+    // frames must not be run.
+    bool halted_ = false;
+
+    // Runs the console until a breakpoint stops it, or until it is jammed.
+    void RunToStop(void);
+
+  public:
+    // Creates a controller for the given console, which is left running.
+    DebugControl(Console *console);
+
+    // Returns the breakpoints of the front end, which are replaced when
+    // the console is released.
+    Breakpoints *GetBreakpoints(void);
+
+    // Checks if the front end holds the console stopped.
+    bool IsHalted(void);
+
+    // Holds a running console which a breakpoint or jam has stopped.
+    // Returns true if the console was held by this call.
+    bool CatchStop(void);
+
+    // Stops the console before its next instruction, or runs a single
+    // instruction, then holds it. Step returns false if the console
+    // stopped on a breakpoint or was jammed instead.
+    void Halt(void);
+    bool Step(void);
+
+    // Lets the held console run.
+    void Continue(void);
+
+    // Removes every breakpoint and watchpoint from the console, and lets
+    // it run without the front end.
+    void Release(void);
+
+    // Deletes the breakpoints. The console must be released first.
+    ~DebugControl(void);
+};
+
+/*
+ * Passes requests from the thread of a front end which reads them to the
+ * emulation thread. The flag is set while the queue holds any, so that the
+ * emulation thread can test it each frame without the lock.
+ */
+template<typename T> class DebugQueue {
+  private:
+    std::deque<T> queue_;
+    std::mutex lock_;
+    std::condition_variable signal_;
+    std::atomic<bool> pending_;
+
+  public:
+    DebugQueue(void) : pending_(false) { }
+
+    // Queues a request, and wakes a waiting emulation thread.
+    void Post(T &&request) {
+      std::lock_guard<std::mutex> lock(lock_);
+      queue_.push_back(std::move(request));
+      pending_.store(true);
+      signal_.notify_one();
+      return;
+    }
+
+    // Checks if any requests are queued, without the lock.
+    bool IsPending(void) {
+      return pending_.load(std::memory_order_acquire);
+    }
+
+    // Waits up to the given time for a request, if none are queued.
+    void Wait(int ms) {
+      std::unique_lock<std::mutex> lock(lock_);
+      if (queue_.empty()) {
+        signal_.wait_for(lock, std::chrono::milliseconds(ms));
+      }
+      return;
+    }
+
+    // Takes the oldest request. Returns false, and clears the flag, if the
+    // queue is empty.
+    bool Take(T *request) {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (queue_.empty()) {
+        pending_.store(false);
+        return false;
+      }
+      *request = std::move(queue_.front());
+      queue_.pop_front();
+      return true;
+    }
+};
+
+#endif
@@ -1,36 +1,61 @@
 /*
- * TODO
+ * The disassembler turns the instructions in CPU memory into text, one line
+ * per instruction, in the style of gdb.
+ *
+ * Instructions are decoded from the fields of their opcode. Most opcodes are
+ * of the form aaabbbcc, where cc picks a group of instructions, aaa picks an
+ * instruction from the group, and bbb picks its addressing mode. The
+ * instructions which do not fit this pattern are decoded individually.
+ * Opcodes which are not documented instructions are shown as data bytes.
+ *
+ * Listings of memory are built by the disassembly cache, which keeps the
+ * instructions it has decoded.
  */
 
 #include "./disas.h"
 
 #include <new>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
 
 #include "../util/data.h"
 #include "../util/util.h"
 #include "../memory/memory.h"
 #include "./mnemonics.h"
-
-// Stores the information used to disassemble the program.
-struct DisasMemory {
-  Memory *memory;
-  size_t bank;
-  DoubleWord pc;
-  DoubleWord offset;
-};
+#include "./disas_cache.h"
 
 // Instructions are classified under several different types to aid in
 // disassembly.
 enum InstType { UNKNOWN, TYPE_0, TYPE_1, TYPE_2, TYPE_8, BRANCH };
 
+// The addressing modes of the instructions. Implied instructions have no
+// operand.
+enum AddrMode {
+  MODE_IMPL, MODE_A, MODE_IMM, MODE_ZP, MODE_ZPX, MODE_ZPY, MODE_ABS,
+  MODE_ABSX, MODE_ABSY, MODE_IND, MODE_IZPX, MODE_IZPY, MODE_REL
+};
+
+// The size of an instruction using each addressing mode, in bytes.
+static const size_t kModeSizes[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2 };
+
+// The addressing mode of a type 1 instruction, indexed by its bbb field.
+static const AddrMode kType1Modes[8] = {
+  MODE_IZPX, MODE_ZP, MODE_IMM, MODE_ABS,
+  MODE_IZPY, MODE_ZPX, MODE_ABSY, MODE_ABSX
+};
+
 /* Helper Functions */
-static size_t DisassembleInstruction(DisasMemory *ref, char *buf,
-                                     size_t buf_len);
-static size_t InsertAddrPreamble(DisasMemory *ref, char *buf, size_t buf_len);
+static bool Decode(DataWord inst, const char **mnemonic, AddrMode *mode);
 static InstType GetInstructionType(DataWord inst);
-static size_t DisassembleType8(DataWord inst, char *inst_buf, size_t
-                               inst_buf_len);
+static bool DecodeType0(DataWord inst, const char **mnemonic, AddrMode *mode);
+static bool DecodeType1(DataWord inst, const char **mnemonic, AddrMode *mode);
+static bool DecodeType2(DataWord inst, const char **mnemonic, AddrMode *mode);
+static void DecodeType8(DataWord inst, const char **mnemonic, AddrMode *mode);
+static void DecodeBranch(DataWord inst, const char **mnemonic,
+                         AddrMode *mode);
+static size_t FormatOperand(AddrMode mode, const DataWord *bytes,
+                            DoubleWord addr, char *buf, size_t buf_len);
 
 /*
  * Uses the given memory object, pc, and bank to disassemble the given number
@@ -40,116 +65,93 @@ static size_t DisassembleType8(DataWord inst, char *inst_buf, size_t
  * Assumes the provided memory object is valid.
  */
 char *Disassemble(Memory *mem, DoubleWord pc, size_t bank, size_t num_inst) {
-  // Store the given information to make tracking it easier.
-  DisasMemory ref = { mem, bank, pc, 0 };
-
-  // Disassemble the program into a fixed size buffer.
-  const size_t buf_max = 256;
-  char buf[buf_max];
-  size_t buf_size = 0;
-  char *disas = NULL;
-  char *disas_temp = NULL;
-  size_t disas_size = 0;
-  size_t inst_size = 0;
-  for (size_t i = 0; i < num_inst; i++) {
-    inst_size = DisassembleInstruction(&ref, &(buf[buf_size]),
-                                       buf_max - buf_size);
-    buf_size += inst_size;
-
-    // Since the buffer is too small, we empty it into a string.
-    if (!inst_size) {
-      // If the instruction could not be disassembled into an empty buffer,
-      // we fail and return NULL.
-      if (buf_size == 0) {
-        if (disas != NULL) { delete[] disas; }
-        return NULL;
-      }
-
-      // Copy the contents of the buffer to our disassembly string.
-      disas_temp = disas;
-      disas = StrCat(disas_temp, disas_size, buf, buf_size);
-      delete[] disas_temp;
-      disas_size += buf_size;
-
-      // Reset the buffer. Dec i to prevent early termination.
-      buf_size = 0;
-      i--;
-    }
-  }
+  DisasCache cache(mem, NULL);
+  return cache.Disassemble(pc, bank, num_inst);
+}
 
-  // Check if theres any data in the buffer that needs to be copied over.
-  if (buf_size) {
-    disas_temp = disas;
-    disas = StrCat(disas_temp, disas_size, buf, buf_size);
-    delete[] disas_temp;
-    disas_size += buf_size;
+/*
+ * Disassembles the instruction held in the given bytes into the buffer,
+ * which is always terminated. The address the instruction was read from is
+ * used to find the target of branches. Three bytes must be given, even if
+ * the instruction is shorter.
+ *
+ * Returns the size of the instruction, in bytes. Opcodes which are not
+ * instructions are shown as a single data byte.
+ */
+size_t DisassembleBytes(const DataWord *bytes, DoubleWord addr, char *buf,
+                        size_t buf_len) {
+  if (buf_len == 0) { return 1; }
+
+  // Undocumented opcodes are shown as their byte.
+  const char *mnemonic;
+  AddrMode mode;
+  if (!Decode(bytes[0], &mnemonic, &mode)) {
+    snprintf(buf, buf_len, "%s $%02x", kDataMnemonic, bytes[0]);
+    return 1;
   }
 
-  return disas;
+  // Add the operand after the mnemonic.
+  buf[0] = '\0';
+  size_t len = StrAppend(buf, buf_len, mnemonic);
+  FormatOperand(mode, bytes, addr, &(buf[len]), buf_len - len);
+  return kModeSizes[mode];
+}
+
+/*
+ * Gets the size of the instruction with the given opcode, in bytes.
+ * Opcodes which are not instructions are a single byte.
+ */
+size_t InstructionSize(DataWord opcode) {
+  const char *mnemonic;
+  AddrMode mode;
+  return Decode(opcode, &mnemonic, &mode) ? kModeSizes[mode] : 1;
 }
 
 /*
- * Attempts to disassemble the instruction pointed to by the memory reference.
+ * Gets the address the given instruction transfers control to, if it is a
+ * branch, an absolute jump, or a call. Indirect jumps and returns have no
+ * fixed target.
  *
- * If the buffer is too small to hold the disassembled string, 0 is returned
- * and the buffer and refernce are not modified.
+ * Returns false if the instruction has no fixed target.
  */
-size_t DisassembleInstruction(DisasMemory *ref, char *buf, size_t buf_len) {
-  // Read the instruction and prepare the buffer.
-  const size_t line_buf_len = 256U;
-  char line_buf[line_buf_len];
-  DataWord inst = ref->memory->Inspect(ref->pc, ref->bank);
-
-  // Add the address and function information to the disassembly line.
-  size_t preamble_size = InsertAddrPreamble(ref, line_buf, line_buf_len);
-
-  // Determine the instruction type, and disassemble the instruction.
-  size_t mnemonic_len = 0;
-  size_t mnemonic_buf_len = line_buf_len - preamble_size;
-  char *mnemonic_buf = &(line_buf[preamble_size]);
-  switch(GetInstructionType(inst)) {
-    case TYPE_8:
-      mnemonic_len = DisassembleType8(inst, mnemonic_buf, mnemonic_buf_len);
-      break;
-    case TYPE_1:
-    case TYPE_2:
-    case TYPE_0:
-    case BRANCH:
-    case UNKNOWN:
-    default:
-      return 0;
+bool GetInstructionTarget(const DataWord *bytes, DoubleWord addr,
+                          DoubleWord *target) {
+  const DataWord kCallOpcode = 0x20;
+  const DataWord kJumpOpcode = 0x4C;
+  if (GetInstructionType(bytes[0]) == BRANCH) {
+    *target = static_cast<DoubleWord>(addr + kModeSizes[MODE_REL]
+                                    + static_cast<int8_t>(bytes[1]));
+    return true;
+  } else if ((bytes[0] == kCallOpcode) || (bytes[0] == kJumpOpcode)) {
+    *target = GET_DOUBLE_WORD(bytes[1], bytes[2]);
+    return true;
   }
-
-  // TODO: Append current PC indication, write line buffer to returned buffer.
-  (void)buf;
-  (void)buf_len;
-  (void)mnemonic_len;
-
-  return 0;
+  return false;
 }
 
 /*
- * Inserts the address preamble for a disassembly line in the given buffer.
- * Returns the size of the preamble.
+ * Decodes the mnemonic and addressing mode of the given opcode.
  *
- * Assumes the buffer is large enough to hold the preamble.
+ * Returns false if the opcode is not an instruction.
  */
-static size_t InsertAddrPreamble(DisasMemory *ref, char *buf, size_t buf_len) {
-  // The string format for the address preamble.
-  const char* const preamble = "   0x%02x%02x,%d <+%d>: ";
-  const size_t min_preamble_size = 24U;
-
-  // Get the address of the instruction from the reference, and create
-  // the preamble string.
-  DoubleWord addr = ref->pc + ref->offset;
-  DataWord addr_hi = GET_WORD_HI(addr);
-  DataWord addr_lo = GET_WORD_LO(addr);
-  size_t preamble_size = snprintf(buf, buf_len, preamble, addr_hi, addr_lo,
-                                  static_cast<int>(ref->bank), ref->offset);
-
-  // Pad the preamble with spaces, if it did not reach the minimum size.
-  for (size_t i = preamble_size; i < min_preamble_size; i++) { buf[i] = ' '; }
-  return MAX(preamble_size, min_preamble_size);
+static bool Decode(DataWord inst, const char **mnemonic, AddrMode *mode) {
+  switch (GetInstructionType(inst)) {
+    case TYPE_8:
+      DecodeType8(inst, mnemonic, mode);
+      return true;
+    case BRANCH:
+      DecodeBranch(inst, mnemonic, mode);
+      return true;
+    case TYPE_0:
+      return DecodeType0(inst, mnemonic, mode);
+    case TYPE_1:
+      return DecodeType1(inst, mnemonic, mode);
+    case TYPE_2:
+      return DecodeType2(inst, mnemonic, mode);
+    case UNKNOWN:
+    default:
+      return false;
+  }
 }
 
 /*
@@ -168,32 +170,227 @@ static InstType GetInstructionType(DataWord inst) {
     // Type 8 instructions have their low nyble set to 8 and are all
     // implied opperand instructions.
     return TYPE_8;
-  } else if ((inst & 0x3) == 0x0) {
-    // Type 0 instructions encode 0 with their low two bits and are more
-    // varied in opperation.
-    return TYPE_0;
   } else if ((inst & 0x1F) == 0x10) {
     // All branch instructions are of the form xxy10000, where xx is the flag
     // to be branched on and y is the value the flag must equal for the branch
-    // to be taken.
+    // to be taken. They must be checked before type 0, which they overlap.
     return BRANCH;
+  } else if ((inst & 0x3) == 0x0) {
+    // Type 0 instructions encode 0 with their low two bits and are more
+    // varied in opperation.
+    return TYPE_0;
   } else {
     return UNKNOWN;
   }
 }
 
 /*
- * Fills the given buffer with the mnemonic for the given instruction.
+ * Decodes the mnemonic and addressing mode of a type 0 instruction. The
+ * control flow instructions are decoded individually.
  *
- * Assumes the given instruction is type 8.
+ * Returns false if the opcode is not an instruction.
  */
-size_t DisassembleType8(DataWord inst, char *buf, size_t buf_len) {
+static bool DecodeType0(DataWord inst, const char **mnemonic,
+                        AddrMode *mode) {
+  switch (inst) {
+    case 0x00: *mnemonic = kBreakpointMnemonic; *mode = MODE_IMPL; return true;
+    case 0x20: *mnemonic = kCallMnemonic; *mode = MODE_ABS; return true;
+    case 0x40:
+      *mnemonic = kReturnInterruptMnemonic;
+      *mode = MODE_IMPL;
+      return true;
+    case 0x60: *mnemonic = kReturnMnemonic; *mode = MODE_IMPL; return true;
+    case 0x4C: *mnemonic = kJumpMnemonic; *mode = MODE_ABS; return true;
+    case 0x6C: *mnemonic = kJumpMnemonic; *mode = MODE_IND; return true;
+    default:
+      break;
+  }
+
+  // The rest follow the aaabbbcc pattern, with a few modes each.
+  const char* const kType0Mnemonics[8] = {
+    NULL, kTestMnemonic, NULL, NULL, kStoreYMnemonic, kLoadYMnemonic,
+    kCompareYMnemonic, kCompareXMnemonic
+  };
+  DataWord op = inst >> 5;
+  *mnemonic = kType0Mnemonics[op];
+  if (*mnemonic == NULL) { return false; }
+  switch ((inst >> 2) & 0x7) {
+    case 0:
+      *mode = MODE_IMM;
+      return op >= 5;
+    case 1:
+      *mode = MODE_ZP;
+      return true;
+    case 3:
+      *mode = MODE_ABS;
+      return true;
+    case 5:
+      *mode = MODE_ZPX;
+      return (op == 4) || (op == 5);
+    case 7:
+      *mode = MODE_ABSX;
+      return op == 5;
+    default:
+      return false;
+  }
+}
+
+/*
+ * Decodes the mnemonic and addressing mode of a type 1 instruction. Every
+ * combination is an instruction, except storing to an immediate.
+ *
+ * Returns false if the opcode is not an instruction.
+ */
+static bool DecodeType1(DataWord inst, const char **mnemonic,
+                        AddrMode *mode) {
+  const char* const kType1Mnemonics[8] = {
+    kOrMnemonic, kAndMnemonic, kXorMnemonic, kAddMnemonic,
+    kStoreAMnemonic, kLoadAMnemonic, kCompareAMnemonic, kSubtractMnemonic
+  };
+  *mnemonic = kType1Mnemonics[inst >> 5];
+  *mode = kType1Modes[(inst >> 2) & 0x7];
+  return inst != 0x89;
+}
+
+/*
+ * Decodes the mnemonic and addressing mode of a type 2 instruction. The
+ * register transfers and nop share the accumulator mode of the shifts, and
+ * the indexed modes of stx and ldx use Y in place of X.
+ *
+ * Returns false if the opcode is not an instruction.
+ */
+static bool DecodeType2(DataWord inst, const char **mnemonic,
+                        AddrMode *mode) {
+  switch (inst) {
+    case 0x8A: *mnemonic = kMovXAMnemonic; *mode = MODE_IMPL; return true;
+    case 0x9A: *mnemonic = kMovXSMnemonic; *mode = MODE_IMPL; return true;
+    case 0xAA: *mnemonic = kMovAXMnemonic; *mode = MODE_IMPL; return true;
+    case 0xBA: *mnemonic = kMovSXMnemonic; *mode = MODE_IMPL; return true;
+    case 0xCA: *mnemonic = kDecXMnemonic; *mode = MODE_IMPL; return true;
+    case 0xEA: *mnemonic = kNopMnemonic; *mode = MODE_IMPL; return true;
+    default:
+      break;
+  }
+
+  const char* const kType2Mnemonics[8] = {
+    kShiftLeftMnemonic, kRotateLeftMnemonic, kShiftRightMnemonic,
+    kRotateRightMnemonic, kStoreXMnemonic, kLoadXMnemonic, kDecMnemonic,
+    kIncMnemonic
+  };
+  DataWord op = inst >> 5;
+  bool uses_x = (op == 4) || (op == 5);
+  *mnemonic = kType2Mnemonics[op];
+  switch ((inst >> 2) & 0x7) {
+    case 0:
+      *mode = MODE_IMM;
+      return inst == 0xA2;
+    case 1:
+      *mode = MODE_ZP;
+      return true;
+    case 2:
+      *mode = MODE_A;
+      return op < 4;
+    case 3:
+      *mode = MODE_ABS;
+      return true;
+    case 5:
+      *mode = uses_x ? MODE_ZPY : MODE_ZPX;
+      return true;
+    case 7:
+      *mode = uses_x ? MODE_ABSY : MODE_ABSX;
+      return inst != 0x9E;
+    default:
+      return false;
+  }
+}
+
+/*
+ * Decodes the mnemonic of the given type 8 instruction, all of which have
+ * implied operands.
+ */
+static void DecodeType8(DataWord inst, const char **mnemonic,
+                        AddrMode *mode) {
   const char* const kType8Mnemonics[16] = {
     kPushPMnemonic, kClearCMnemonic, kPullPMnemonic, kSetCMnemonic,
     kPushAMnemonic, kClearIMnemonic, kPullAMnemonic, kSetIMnemonic,
     kDecYMnemonic,  kMovYAMnemonic,  kMovAYMnemonic, kClearVMnemonic,
     kIncYMnemonic,  kClearDMnemonic, kIncXMnemonic,  kSetDMnemonic
   };
-  // TODO: Instruction offset must also be changed after disassembly.
-  return StrAppend(buf, buf_len, kType8Mnemonics[inst >> 4]);
+  *mnemonic = kType8Mnemonics[inst >> 4];
+  *mode = MODE_IMPL;
+  return;
+}
+
+/*
+ * Decodes the mnemonic of the given branch, which is picked by the flag it
+ * tests and the value it branches on.
+ */
+static void DecodeBranch(DataWord inst, const char **mnemonic,
+                         AddrMode *mode) {
+  const char* const kBranchMnemonics[8] = {
+    kBranchPlusMnemonic, kBranchMinusMnemonic, kBranchVClearMnemonic,
+    kBranchVSetMnemonic, kBranchCClearMnemonic, kBranchCSetMnemonic,
+    kBranchNotEqualMnemonic, kBranchEqualMnemonic
+  };
+  *mnemonic = kBranchMnemonics[inst >> 5];
+  *mode = MODE_REL;
+  return;
+}
+
+/*
+ * Prints the operand of an instruction in the given addressing mode to the
+ * buffer. Branches are printed with the address they branch to, which is
+ * relative to the instruction after them.
+ *
+ * Returns the length of the operand.
+ */
+static size_t FormatOperand(AddrMode mode, const DataWord *bytes,
+                            DoubleWord addr, char *buf, size_t buf_len) {
+  DataWord lo = bytes[1];
+  DataWord hi = bytes[2];
+  int len = 0;
+  switch (mode) {
+    case MODE_A:
+      len = snprintf(buf, buf_len, "%s", kAddrModeA);
+      break;
+    case MODE_IMM:
+      len = snprintf(buf, buf_len, kAddrModeImm, lo);
+      break;
+    case MODE_ZP:
+      len = snprintf(buf, buf_len, kAddrModeZp, lo);
+      break;
+    case MODE_ZPX:
+      len = snprintf(buf, buf_len, kAddrModeZpX, lo);
+      break;
+    case MODE_ZPY:
+      len = snprintf(buf, buf_len, kAddrModeZpY, lo);
+      break;
+    case MODE_ABS:
+      len = snprintf(buf, buf_len, kAddrModeAbs, hi, lo);
+      break;
+    case MODE_ABSX:
+      len = snprintf(buf, buf_len, kAddrModeAbsX, hi, lo);
+      break;
+    case MODE_ABSY:
+      len = snprintf(buf, buf_len, kAddrModeAbsY, hi, lo);
+      break;
+    case MODE_IND:
+      len = snprintf(buf, buf_len, kAddrModeInd, hi, lo);
+      break;
+    case MODE_IZPX:
+      len = snprintf(buf, buf_len, kAddrModeIzpx, lo);
+      break;
+    case MODE_IZPY:
+      len = snprintf(buf, buf_len, kAddrModeIzpY, lo);
+      break;
+    case MODE_REL:
+      len = snprintf(buf, buf_len, kAddrModeRel, static_cast<DoubleWord>(
+                     addr + kModeSizes[MODE_REL]
+                          + static_cast<int8_t>(lo)));
+      break;
+    case MODE_IMPL:
+    default:
+      break;
+  }
+  return (len > 0) ? static_cast<size_t>(len) : 0;
 }
@@ -1,12 +1,34 @@
 #ifndef _NES_DISAS
 #define _NES_DISAS
 
+#include <cstdlib>
+
 #include "../util/data.h"
 #include "../memory/memory.h"
 
+// The most bytes a single instruction can take.
+#define DISAS_MAX_INST_SIZE 3U
+
+// A buffer of this size holds the text of any instruction.
+#define DISAS_TEXT_SIZE 24U
+
 // Disassembles the requested number of instructions from the program counter
 // on. The disassmbly always uses the requested bank. The returned string
 // must be deleted after use.
 char *Disassemble(Memory *mem, DoubleWord pc, size_t bank, size_t num_inst);
 
+// Disassembles the instruction in the given bytes, which were read from the
+// given address, into the buffer. Returns the size of the instruction.
+size_t DisassembleBytes(const DataWord *bytes, DoubleWord addr, char *buf,
+                        size_t buf_len);
+
+// Gets the size of the instruction with the given opcode, in bytes.
+size_t InstructionSize(DataWord opcode);
+
+// Gets the address the instruction in the given bytes, read from the given
+// address, branches, jumps, or calls to. Returns false if it has no fixed
+// target.
+bool GetInstructionTarget(const DataWord *bytes, DoubleWord addr,
+                          DoubleWord *target);
+
 #endif
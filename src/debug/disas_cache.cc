@@ -0,0 +1,383 @@
+/*
+ * The disassembly cache keeps each instruction it decodes, by its bank and
+ * address, so that a debugger redrawing the code around the PC after every
+ * step only decodes the instructions it has not seen before.
+ *
+ * Writes to memory are never watched, as doing so would slow down the
+ * emulation even when no listing is shown. Instead, a kept instruction is
+ * checked against the bytes under it each time it is used, and is decoded
+ * again if they have changed. Reading those bytes is far cheaper than
+ * decoding them.
+ *
+ * Instructions are kept by bank only in PRG-ROM. Everything below it is
+ * kept by address alone, as the same bytes are seen from every bank.
+ */
+
+#include "./disas_cache.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+
+#include "../util/data.h"
+#include "../util/util.h"
+#include "../memory/memory.h"
+#include "../cpu/code_data_log.h"
+#include "./disas.h"
+
+// The padded width of the address preamble of each line of a listing.
+#define DISAS_PREAMBLE_SIZE 24U
+
+// The padded width of the bytes and text of an instruction in an export.
+#define DISAS_EXPORT_BYTES_SIZE 10U
+#define DISAS_EXPORT_TEXT_SIZE 16U
+
+// The interrupt vectors, which are labeled by name in an export.
+static const DoubleWord kVectorAddrs[] = { 0xFFFA, 0xFFFC, 0xFFFE };
+static const char* const kVectorNames[] = { "NMI", "RESET", "IRQ" };
+static const size_t kNumVectors = 3;
+
+/* Helper Functions */
+static uint32_t GetKey(DoubleWord addr, size_t bank);
+static void FillLine(const DataWord *bytes, DoubleWord addr,
+                     DisasLine *line);
+
+/*
+ * Creates an empty cache. The code/data log may be NULL, in which case
+ * every byte is assumed to be code.
+ */
+DisasCache::DisasCache(Memory *memory, CodeDataLog *code_log) {
+  memory_ = memory;
+  code_log_ = code_log;
+  return;
+}
+
+/*
+ * Gets the key an instruction is kept under. Only PRG-ROM is banked.
+ */
+static uint32_t GetKey(DoubleWord addr, size_t bank) {
+  if (addr < PRG_ROM_OFFSET) { return addr; }
+  return (static_cast<uint32_t>(bank + 1) << 16) | addr;
+}
+
+/*
+ * Decodes the instruction held in the given bytes, which were read from the
+ * given address, into the line.
+ */
+static void FillLine(const DataWord *bytes, DoubleWord addr,
+                     DisasLine *line) {
+  for (size_t i = 0; i < DISAS_MAX_INST_SIZE; i++) {
+    line->bytes[i] = bytes[i];
+  }
+  line->size = DisassembleBytes(bytes, addr, line->text, sizeof(line->text));
+  line->has_target = GetInstructionTarget(bytes, addr, &(line->target));
+  return;
+}
+
+/*
+ * Reads the instruction at the given address in the given bank from memory,
+ * then decodes it into the line. Memory is only inspected, so this never
+ * has side effects.
+ */
+void DisasCache::Decode(DoubleWord addr, size_t bank, DisasLine *line) {
+  DataWord bytes[DISAS_MAX_INST_SIZE];
+  for (size_t i = 0; i < DISAS_MAX_INST_SIZE; i++) {
+    bytes[i] = memory_->Inspect(static_cast<DoubleWord>(addr + i),
+                                static_cast<int>(bank));
+  }
+  FillLine(bytes, addr, line);
+  return;
+}
+
+/*
+ * Gets the instruction at the given address in the given bank, decoding it
+ * if it has not been seen or if the bytes under it have changed.
+ *
+ * The returned line is owned by the cache, and is valid until the cache is
+ * next used.
+ */
+const DisasLine *DisasCache::Get(DoubleWord addr, size_t bank) {
+  auto found = lines_.find(GetKey(addr, bank));
+  if (found == lines_.end()) {
+    DisasLine *line = &(lines_[GetKey(addr, bank)]);
+    Decode(addr, bank, line);
+    return line;
+  }
+
+  // Only the bytes the instruction uses can change its text.
+  DisasLine *line = &(found->second);
+  for (size_t i = 0; i < line->size; i++) {
+    DataWord byte = memory_->Inspect(static_cast<DoubleWord>(addr + i),
+                                     static_cast<int>(bank));
+    if (byte != line->bytes[i]) {
+      Decode(addr, bank, line);
+      break;
+    }
+  }
+  return line;
+}
+
+/*
+ * Checks if the given address should be disassembled as an instruction.
+ * Without a code/data log, every address is.
+ */
+bool DisasCache::IsCode(DoubleWord addr, size_t bank) {
+  if (code_log_ == NULL) { return true; }
+  return (code_log_->GetFlags(addr, bank) & CDL_OPCODE) != 0;
+}
+
+/*
+ * Finds the start of the instruction which ends at the given address, so
+ * that a listing can be scrolled back. Instructions logged as run are
+ * preferred, followed by the longest instruction which ends at the address.
+ * If nothing does, the previous byte is used.
+ */
+DoubleWord DisasCache::GetPrev(DoubleWord addr, size_t bank) {
+  if (code_log_ != NULL) {
+    for (size_t size = 1; size <= DISAS_MAX_INST_SIZE; size++) {
+      DoubleWord prev = static_cast<DoubleWord>(addr - size);
+      if (((code_log_->GetFlags(prev, bank) & CDL_OPCODE) != 0)
+          && (Get(prev, bank)->size == size)) {
+        return prev;
+      }
+    }
+  }
+
+  for (size_t size = DISAS_MAX_INST_SIZE; size > 1; size--) {
+    DoubleWord prev = static_cast<DoubleWord>(addr - size);
+    if (Get(prev, bank)->size == size) { return prev; }
+  }
+  return static_cast<DoubleWord>(addr - 1U);
+}
+
+/*
+ * Lists the given number of instructions from the program counter on, in
+ * the given bank. The line of the instruction at the PC is marked with an
+ * arrow.
+ *
+ * Returns a string which must be deleted after use.
+ */
+char *DisasCache::Disassemble(DoubleWord pc, size_t bank, size_t num_inst) {
+  return List(pc, pc, bank, num_inst);
+}
+
+/*
+ * Lists the given number of instructions in the given bank, starting the
+ * given number of instructions before the program counter, so that the
+ * code leading to the PC is shown with it. Without a code/data log, scrolling
+ * back can land inside an instruction, so fewer instructions are shown
+ * before the PC when decoding from the start would step over it.
+ *
+ * Returns a string which must be deleted after use.
+ */
+char *DisasCache::DisassembleAround(DoubleWord pc, size_t bank,
+                                    size_t num_before, size_t num_inst) {
+  DoubleWord start = pc;
+  for (size_t before = num_before; before > 0; before--) {
+    start = pc;
+    for (size_t i = 0; i < before; i++) { start = GetPrev(start, bank); }
+
+    // Decode forward from the start, to check that it lands on the PC.
+    DoubleWord addr = start;
+    for (size_t i = 0; (i < before) && (addr != pc); i++) {
+      addr = static_cast<DoubleWord>(addr + Get(addr, bank)->size);
+    }
+    if (addr == pc) { break; }
+    start = pc;
+  }
+  return List(start, pc, bank, num_inst);
+}
+
+/*
+ * Lists the given number of instructions from the given address on. Each
+ * line gives its offset from the program counter, and the line of the
+ * instruction at the PC is marked with an arrow.
+ */
+char *DisasCache::List(DoubleWord start, DoubleWord pc, size_t bank,
+                       size_t num_inst) {
+  size_t buf_len = (num_inst * kListingLineSize_) + 1;
+  char *buf = new char[buf_len];
+  buf[0] = '\0';
+
+  size_t len = 0;
+  DoubleWord addr = start;
+  for (size_t i = 0; i < num_inst; i++) {
+    const DisasLine *line = Get(addr, bank);
+
+    // Add the address and function information, padded to a fixed width.
+    char preamble[kListingLineSize_];
+    int offset = static_cast<int16_t>(addr - pc);
+    snprintf(preamble, sizeof(preamble), "%s0x%04x,%d <%+d>: ",
+             (addr == pc) ? "=> " : "   ", addr, static_cast<int>(bank),
+             offset);
+    int line_len = snprintf(&(buf[len]), buf_len - len, "%-*s%s\n",
+                            static_cast<int>(DISAS_PREAMBLE_SIZE), preamble,
+                            line->text);
+    if ((line_len < 0) || (static_cast<size_t>(line_len) >= buf_len - len)) {
+      buf[len] = '\0';
+      break;
+    }
+    len += line_len;
+    addr = static_cast<DoubleWord>(addr + line->size);
+  }
+
+  return buf;
+}
+
+/*
+ * Writes a disassembly of every bank of PRG-ROM to the given file. Each bank
+ * is shown at the address it was last run from, if it is in the code/data
+ * log, and only the bytes logged as instructions are decoded. Without a log,
+ * each bank is decoded from start to end.
+ *
+ * The targets of branches, jumps, calls, and the interrupt vectors are
+ * labeled, and each instruction with a target names its label.
+ *
+ * Returns false if the file could not be written.
+ */
+bool DisasCache::Export(FILE *file) {
+  size_t num_banks = memory_->GetPrgRomSize() / PRG_BANK_SIZE;
+  fprintf(file, "; Disassembly of %zu bank(s) of PRG-ROM%s\n", num_banks,
+          (code_log_ == NULL) ? "" : ", from the code/data log");
+
+  // Name the interrupt vectors, as they are mapped now.
+  labels_.clear();
+  for (size_t i = 0; i < kNumVectors; i++) {
+    DoubleWord target = GET_DOUBLE_WORD(memory_->Inspect(kVectorAddrs[i]),
+                                    memory_->Inspect(kVectorAddrs[i] + 1U));
+    if (target < PRG_ROM_OFFSET) { continue; }
+    labels_[GetKey(target, memory_->GetPrgBank(target))] = kVectorNames[i];
+  }
+
+  // Label the targets of every instruction before any bank is written, as
+  // the targets may be in other banks.
+  for (size_t bank = 0; bank < num_banks; bank++) {
+    ExportBank(NULL, bank);
+  }
+  for (size_t bank = 0; bank < num_banks; bank++) {
+    ExportBank(file, bank);
+  }
+
+  labels_.clear();
+  fflush(file);
+  return !ferror(file);
+}
+
+/*
+ * Gets the address the given bank of PRG-ROM is exported at.
+ */
+DoubleWord DisasCache::GetExportAddr(size_t bank) {
+  if (code_log_ != NULL) { return code_log_->GetBankAddr(bank); }
+  size_t num_banks = memory_->GetPrgRomSize() / PRG_BANK_SIZE;
+  return (bank + 1 == num_banks) ? PRG_ROM_OFFSET + PRG_BANK_SIZE
+                                 : PRG_ROM_OFFSET;
+}
+
+/*
+ * Writes the given bank of PRG-ROM to an export. When no file is given,
+ * the targets of its instructions are labeled instead.
+ *
+ * The bank is read through the switchable window of PRG-ROM, as the fixed
+ * window ignores the requested bank.
+ */
+void DisasCache::ExportBank(FILE *file, size_t bank) {
+  DoubleWord base = GetExportAddr(bank);
+  if (file != NULL) {
+    fprintf(file, "\n; Bank %zu, at $%04x\n", bank, base);
+  }
+
+  size_t offset = 0;
+  while (offset < PRG_BANK_SIZE) {
+    DoubleWord addr = static_cast<DoubleWord>(base + offset);
+    uint32_t key = GetKey(addr, bank);
+    auto label = labels_.find(key);
+    if ((file != NULL) && (label != labels_.end())) {
+      fprintf(file, "L%02zx_%04x:%s%s\n", bank, addr,
+              (label->second == NULL) ? "" : "  ; ",
+              (label->second == NULL) ? "" : label->second);
+    }
+
+    // Bytes which were never run are shown as runs of data, which end at
+    // the next instruction or label.
+    if (!IsCode(addr, bank)) {
+      size_t size = 0;
+      do {
+        size++;
+      } while ((size < kExportDataBytes_) && (offset + size < PRG_BANK_SIZE)
+            && !IsCode(static_cast<DoubleWord>(addr + size), bank)
+            && (labels_.count(GetKey(static_cast<DoubleWord>(addr + size),
+                                     bank)) == 0));
+      if (file != NULL) {
+        fprintf(file, "  %02zx:%04x  .db", bank, addr);
+        for (size_t i = 0; i < size; i++) {
+          fprintf(file, "%s$%02x", (i == 0) ? " " : ",", memory_->Inspect(
+                  static_cast<DoubleWord>(PRG_ROM_OFFSET + offset + i),
+                  static_cast<int>(bank)));
+        }
+        fprintf(file, "\n");
+      }
+      offset += size;
+      continue;
+    }
+
+    // Decode the instruction at its address in the bank.
+    DataWord bytes[DISAS_MAX_INST_SIZE];
+    for (size_t i = 0; i < DISAS_MAX_INST_SIZE; i++) {
+      bytes[i] = memory_->Inspect(static_cast<DoubleWord>(PRG_ROM_OFFSET
+                                  + offset + i), static_cast<int>(bank));
+    }
+    DisasLine line;
+    FillLine(bytes, addr, &line);
+
+    // Targets outside of the window of the bank are in whichever bank is
+    // mapped there now.
+    uint32_t target_key = 0;
+    if (line.has_target && (line.target >= PRG_ROM_OFFSET)) {
+      bool same_bank = (line.target & ~(PRG_BANK_SIZE - 1U)) == base;
+      target_key = GetKey(line.target, same_bank ? bank
+                                     : memory_->GetPrgBank(line.target));
+    }
+
+    if ((file == NULL) && (target_key != 0)
+                       && (labels_.count(target_key) == 0)) {
+      labels_[target_key] = NULL;
+    } else if (file != NULL) {
+      char byte_text[DISAS_EXPORT_BYTES_SIZE];
+      size_t byte_len = 0;
+      for (size_t i = 0; i < line.size; i++) {
+        byte_len += snprintf(&(byte_text[byte_len]),
+                             sizeof(byte_text) - byte_len, "%02x ",
+                             line.bytes[i]);
+      }
+      fprintf(file, "  %02zx:%04x  %-*s ", bank, addr,
+              static_cast<int>(DISAS_EXPORT_BYTES_SIZE - 1), byte_text);
+      if (target_key != 0) {
+        fprintf(file, "%-*s  ; L%02x_%04x\n",
+                static_cast<int>(DISAS_EXPORT_TEXT_SIZE), line.text,
+                (target_key >> 16) - 1U, line.target);
+      } else {
+        fprintf(file, "%s\n", line.text);
+      }
+    }
+    offset += line.size;
+  }
+  return;
+}
+
+/*
+ * Drops every decoded instruction, so that the next use of each decodes it
+ * again.
+ */
+void DisasCache::Clear(void) {
+  lines_.clear();
+  return;
+}
+
+/*
+ * Frees the decoded instructions.
+ */
+DisasCache::~DisasCache(void) {
+  return;
+}
@@ -0,0 +1,106 @@
+#ifndef _NES_DISCACHE
+#define _NES_DISCACHE
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+
+#include "../memory/memory.h"
+#include "../cpu/code_data_log.h"
+#include "../util/data.h"
+#include "./disas.h"
+
+/*
+ * An instruction decoded by the disassembly cache, along with the bytes it
+ * was decoded from.
+ */
+struct DisasLine {
+  DataWord bytes[DISAS_MAX_INST_SIZE];
+  size_t size;
+  char text[DISAS_TEXT_SIZE];
+
+  // The address the instruction branches, jumps, or calls to, if any.
+  bool has_target;
+  DoubleWord target;
+};
+
+/*
+ * Disassembles CPU memory, keeping each instruction it decodes by its bank
+ * and address so that listings can be redrawn without decoding them again.
+ * A kept instruction is decoded again once the bytes under it change.
+ *
+ * When given a code/data log, the cache uses it to tell the instructions of
+ * a rom from its data.
+ */
+class DisasCache {
+  private:
+    // The longest line of a listing, with its newline.
+    static const size_t kListingLineSize_ = 64;
+
+    // The number of data bytes shown on each line of an export.
+    static const size_t kExportDataBytes_ = 8;
+
+    // The memory which is disassembled, and the log of its code. The log
+    // may be NULL.
+    Memory *memory_;
+    CodeDataLog *code_log_;
+
+    // The decoded instructions, by bank and address.
+    std::unordered_map<uint32_t, DisasLine> lines_;
+
+    // The labels of an export being written, by bank and address. Labels
+    // without a name are given one from their address.
+    std::unordered_map<uint32_t, const char*> labels_;
+
+    // Reads the bytes at the given address in the given bank, and decodes
+    // them.
+    void Decode(DoubleWord addr, size_t bank, DisasLine *line);
+
+    // Checks if the instruction at the given address in the given bank
+    // should be shown as code, rather than data.
+    bool IsCode(DoubleWord addr, size_t bank);
+
+    // Gets the address a bank of PRG-ROM is exported at, and writes it to
+    // an export.
+    DoubleWord GetExportAddr(size_t bank);
+    void ExportBank(FILE *file, size_t bank);
+
+    // Lists instructions from the given address on, marking the PC.
+    char *List(DoubleWord start, DoubleWord pc, size_t bank, size_t num_inst);
+
+  public:
+    // Creates an empty cache for the given memory and code/data log, which
+    // may be NULL.
+    DisasCache(Memory *memory, CodeDataLog *code_log);
+
+    // Gets the instruction at the given address in the given bank. Valid
+    // until the cache is next used.
+    const DisasLine *Get(DoubleWord addr, size_t bank);
+
+    // Finds the start of the instruction before the one at the given
+    // address, for scrolling a listing back.
+    DoubleWord GetPrev(DoubleWord addr, size_t bank);
+
+    // Lists the given number of instructions from the given address on,
+    // marking the first. The returned string must be deleted after use.
+    char *Disassemble(DoubleWord pc, size_t bank, size_t num_inst);
+
+    // Lists the given number of instructions, starting the given number
+    // before the PC. The returned string must be deleted after use.
+    char *DisassembleAround(DoubleWord pc, size_t bank, size_t num_before,
+                            size_t num_inst);
+
+    // Writes a disassembly of every bank of PRG-ROM, annotated with labels
+    // on the targets of branches, jumps, calls, and the interrupt vectors.
+    // Returns false if it could not be written.
+    bool Export(FILE *file);
+
+    // Drops every decoded instruction.
+    void Clear(void);
+
+    // Frees the decoded instructions.
+    ~DisasCache(void);
+};
+
+#endif
@@ -0,0 +1,852 @@
+/*
+ * The GDB stub lets a debugger which speaks the GDB remote serial protocol
+ * attach to the console over a socket. The debugger can read and write the
+ * registers and memory of the CPU, set breakpoints and watchpoints, and
+ * step a single instruction. As GDB has no command to step a cycle, the
+ * stub adds "monitor cycle [count]" for it.
+ *
+ * The 6502 is described to the debugger with a target description of six
+ * registers, A, X, Y, P, and S of a byte each and the PC of two bytes, sent
+ * in that order. Memory is read with Memory::Inspect(), and so reading it
+ * never has side effects. Writes are refused at addresses where writing
+ * would have side effects outside of the CPU.
+ *
+ * The socket is only ever touched by the server thread, which checks the
+ * framing and checksum of each packet before queueing it. The emulation
+ * thread tests a flag between frames, and only takes the queue once the
+ * flag is set, so a stub without a debugger costs the emulation nothing.
+ */
+
+#include "./gdb_stub.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "../core/console.h"
+#include "../cpu/cpu.h"
+#include "../cpu/breakpoints.h"
+#include "../memory/memory.h"
+#include "../ppu/ppu.h"
+#include "../util/data.h"
+#include "../util/socket_addr.h"
+
+// The characters which frame a packet, and the interrupt the debugger sends
+// to stop the console.
+#define GDB_PACKET_START '$'
+#define GDB_PACKET_END '#'
+#define GDB_ACK '+'
+#define GDB_NACK '-'
+#define GDB_INTERRUPT_CHAR 0x03
+
+// The number of registers described to the debugger, and the number of
+// bytes they take together.
+#define GDB_NUM_REGS 6U
+#define GDB_REGS_SIZE 7U
+
+// The signals stops are reported with.
+#define GDB_SIGINT 2
+#define GDB_SIGILL 4
+#define GDB_SIGTRAP 5
+
+// The registers of the 6502, as described to the debugger.
+static const char* const kTargetXml =
+  "<?xml version=\"1.0\"?>"
+  "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+  "<target version=\"1.0\">"
+  "<feature name=\"org.gnu.gdb.m6502.core\">"
+  "<reg name=\"a\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>"
+  "<reg name=\"x\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"y\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"p\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>"
+  "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+  "</feature>"
+  "</target>";
+
+// The offset of each register in the register packet, and its size.
+static const size_t kRegOffsets[GDB_NUM_REGS] = { 0, 1, 2, 3, 4, 5 };
+static const size_t kRegSizes[GDB_NUM_REGS] = { 1, 1, 1, 1, 1, 2 };
+
+// Printed for "monitor help", and for unknown monitor commands.
+static const char* const kMonitorHelp =
+  "Commands:\n"
+  "  monitor cycle [count]  Run the given number of CPU cycles, or one,\n"
+  "                         up to a frame of cycles.\n"
+  "Run \"flushregs\" after a command, as GDB does not know it ran.\n";
+
+/* Helper Functions */
+static int HexValue(char c);
+static bool DecodeHex(const char *text, DataWord *bytes, size_t size);
+static void EncodeHex(const DataWord *bytes, size_t size, char *text);
+static void PackRegisters(const CpuState *state, DataWord *regs);
+static void UnpackRegisters(const DataWord *regs, CpuState *state);
+
+/*
+ * Binds a socket to the given address, and listens on it for a debugger.
+ * A TCP address may leave out its host, as in ":2345", to listen on every
+ * local address.
+ *
+ * Returns NULL if the address is invalid or cannot be bound.
+ */
+GdbStub *GdbStub::Create(const char *addr, Console *console) {
+  struct sockaddr_storage listen_addr;
+  socklen_t listen_size;
+  if (!ResolveSocketAddr(addr, SOCK_STREAM, true, "debugger", &listen_addr,
+                         &listen_size)) {
+    return NULL;
+  }
+
+  // Open the socket, claiming the path of a UNIX socket. A TCP port may be
+  // bound again while connections from a previous run wait to close.
+  int sock = socket(listen_addr.ss_family, SOCK_STREAM, 0);
+  if (sock < 0) {
+    fprintf(stderr, "Error: failed to open a debugger socket.\n");
+    return NULL;
+  }
+  char *unix_path = ClaimUnixPath(addr);
+  if (unix_path == NULL) {
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
+  if ((bind(sock, reinterpret_cast<struct sockaddr*>(&listen_addr),
+            listen_size) != 0) || (listen(sock, 1) != 0)) {
+    fprintf(stderr, "Error: failed to listen for a debugger on %s.\n", addr);
+    close(sock);
+    delete[] unix_path;
+    return NULL;
+  }
+
+  return new GdbStub(sock, unix_path, console);
+}
+
+/*
+ * Stores the listening socket and console, then starts the server thread.
+ */
+GdbStub::GdbStub(int listen_socket, char *unix_path, Console *console)
+    : closing_(false) {
+  listen_socket_ = listen_socket;
+  unix_path_ = unix_path;
+  console_ = console;
+  control_ = new DebugControl(console);
+  snprintf(last_stop_, sizeof(last_stop_), "S%02x", GDB_SIGTRAP);
+  server_thread_ = std::thread(&GdbStub::RunServer, this);
+  return;
+}
+
+/*
+ * Accepts one debugger at a time, and reads its packets until it
+ * disconnects or the stub is deleted. The emulation thread is told when
+ * a debugger attaches and detaches.
+ */
+void GdbStub::RunServer(void) {
+  while (!closing_.load()) {
+    struct pollfd listen_poll = { listen_socket_, POLLIN, 0 };
+    if (poll(&listen_poll, 1, kPollMs_) <= 0) { continue; }
+    int client = accept(listen_socket_, NULL, NULL);
+    if (client < 0) { continue; }
+
+    // Packets are small and wait on their replies, so they are sent at once.
+    // This fails harmlessly on UNIX sockets.
+    int no_delay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+               sizeof(no_delay));
+
+    send_lock_.lock();
+    client_ = client;
+    last_packet_.clear();
+    send_lock_.unlock();
+
+    Post(GDB_ATTACH, NULL, 0);
+    ReadClient(client);
+    Post(GDB_DETACH, NULL, 0);
+
+    send_lock_.lock();
+    client_ = -1;
+    send_lock_.unlock();
+    close(client);
+  }
+  return;
+}
+
+/*
+ * Reads packets from the given debugger until it disconnects. Each packet
+ * is acknowledged once its checksum is verified, then queued. Packets
+ * which are too long to be held are queued empty, which the stub replies
+ * to as unsupported.
+ */
+void GdbStub::ReadClient(int client) {
+  std::vector<char> packet;
+  bool in_packet = false;
+  bool overflow = false;
+  size_t checksum_left = 0;
+  DataWord sum = 0;
+  char checksum[3] = { 0 };
+
+  while (!closing_.load()) {
+    struct pollfd client_poll = { client, POLLIN, 0 };
+    if (poll(&client_poll, 1, kPollMs_) <= 0) { continue; }
+    char buf[256];
+    ssize_t size = recv(client, buf, sizeof(buf), 0);
+    if (size <= 0) { return; }
+
+    for (ssize_t i = 0; i < size; i++) {
+      char c = buf[i];
+      if (checksum_left > 0) {
+        // Check the two digit checksum which ends the packet.
+        checksum[2 - checksum_left] = c;
+        checksum_left--;
+        if (checksum_left > 0) { continue; }
+        DataWord expected;
+        bool valid = DecodeHex(checksum, &expected, 1) && (expected == sum);
+        char ack = valid ? GDB_ACK : GDB_NACK;
+        send_lock_.lock();
+        ssize_t sent = send(client, &ack, 1, MSG_NOSIGNAL);
+        send_lock_.unlock();
+        (void)sent;
+        if (valid) {
+          Post(GDB_PACKET, overflow ? NULL : packet.data(),
+               overflow ? 0 : packet.size());
+        }
+      } else if (in_packet) {
+        // Collect the body of the packet, and sum it.
+        if (c == GDB_PACKET_END) {
+          in_packet = false;
+          checksum_left = 2;
+        } else {
+          sum = static_cast<DataWord>(sum + static_cast<DataWord>(c));
+          if (packet.size() < kPacketSize_) {
+            packet.push_back(c);
+          } else {
+            overflow = true;
+          }
+        }
+      } else if (c == GDB_PACKET_START) {
+        in_packet = true;
+        overflow = false;
+        packet.clear();
+        sum = 0;
+      } else if (c == GDB_INTERRUPT_CHAR) {
+        Post(GDB_INTERRUPT, NULL, 0);
+      } else if (c == GDB_NACK) {
+        Resend();
+      }
+    }
+  }
+  return;
+}
+
+/*
+ * Queues an event for the emulation thread, with the given packet, which
+ * may be NULL. The packet is terminated, so that it can be parsed as a
+ * string.
+ */
+void GdbStub::Post(GdbEvent event, const char *packet, size_t size) {
+  GdbRequest request;
+  request.event = event;
+  if (packet != NULL) { request.packet.assign(packet, packet + size); }
+  request.packet.push_back('\0');
+  queue_.Post(std::move(request));
+  return;
+}
+
+/*
+ * Frames the given packet with its checksum, and sends it to the attached
+ * debugger. The packet is kept, in case the debugger asks for it again.
+ */
+void GdbStub::Send(const char *packet) {
+  DataWord sum = 0;
+  for (size_t i = 0; packet[i] != '\0'; i++) {
+    sum = static_cast<DataWord>(sum + static_cast<DataWord>(packet[i]));
+  }
+
+  char checksum[3];
+  EncodeHex(&sum, 1, checksum);
+
+  std::lock_guard<std::mutex> lock(send_lock_);
+  size_t size = strlen(packet);
+  last_packet_.resize(size + 4);
+  last_packet_[0] = GDB_PACKET_START;
+  memcpy(&(last_packet_[1]), packet, size);
+  last_packet_[size + 1] = GDB_PACKET_END;
+  memcpy(&(last_packet_[size + 2]), checksum, 2);
+  if (client_ >= 0) {
+    ssize_t sent = send(client_, last_packet_.data(), last_packet_.size(),
+                        MSG_NOSIGNAL);
+    (void)sent;
+  }
+  return;
+}
+
+/*
+ * Sends the given text to the console of the debugger.
+ */
+void GdbStub::SendHex(const char *text) {
+  size_t size = strlen(text);
+  std::vector<char> packet(2 * size + 2);
+  packet[0] = 'O';
+  EncodeHex(reinterpret_cast<const DataWord*>(text), size, &(packet[1]));
+  Send(packet.data());
+  return;
+}
+
+/*
+ * Sends the last packet again, after the debugger failed to receive it.
+ */
+void GdbStub::Resend(void) {
+  std::lock_guard<std::mutex> lock(send_lock_);
+  if ((client_ >= 0) && !last_packet_.empty()) {
+    ssize_t sent = send(client_, last_packet_.data(), last_packet_.size(),
+                        MSG_NOSIGNAL);
+    (void)sent;
+  }
+  return;
+}
+
+/*
+ * Serves the requests queued by the server thread. A running console is
+ * first checked for a breakpoint which stopped it. While the debugger holds
+ * the console stopped, waits a short time for a request to arrive, so that
+ * the emulation thread does not spin.
+ *
+ * Returns true if the console is stopped, and so must not be run.
+ */
+bool GdbStub::Service(void) {
+  // Without a debugger, the stub waits for a request to attach one.
+  if (!attached_ && !queue_.IsPending()) { return false; }
+
+  // Report a breakpoint or jam which stopped the running console.
+  if (attached_ && control_->CatchStop()) { Stop(); }
+
+  if (control_->IsHalted()) { queue_.Wait(kWaitMs_); }
+  GdbRequest request;
+  while (queue_.Take(&request)) { Handle(&request); }
+  return control_->IsHalted();
+}
+
+/*
+ * Handles a single event from the server thread.
+ */
+void GdbStub::Handle(GdbRequest *request) {
+  switch (request->event) {
+    case GDB_ATTACH:
+      Attach();
+      break;
+    case GDB_DETACH:
+      Detach();
+      break;
+    case GDB_INTERRUPT:
+      if (attached_ && !control_->IsHalted()) {
+        control_->Halt();
+        snprintf(last_stop_, sizeof(last_stop_), "S%02x", GDB_SIGINT);
+        Send(last_stop_);
+      }
+      break;
+    case GDB_PACKET:
+      if (attached_) { HandlePacket(request->packet.data()); }
+      break;
+    default:
+      break;
+  }
+  return;
+}
+
+/*
+ * Gives the breakpoints to the console, then stops it before its next
+ * instruction, as the debugger expects to find it stopped.
+ */
+void GdbStub::Attach(void) {
+  if (attached_) { Detach(); }
+  attached_ = true;
+  console_->SetBreakpoints(control_->GetBreakpoints());
+  control_->Halt();
+  snprintf(last_stop_, sizeof(last_stop_), "S%02x", GDB_SIGTRAP);
+  return;
+}
+
+/*
+ * Removes every breakpoint and watchpoint of the debugger from the console,
+ * then lets it run.
+ */
+void GdbStub::Detach(void) {
+  if (!attached_) { return; }
+  control_->Release();
+  attached_ = false;
+  return;
+}
+
+/*
+ * Runs a single instruction of the console, then reports the stop. A
+ * console stopped in the middle of an instruction finishes it.
+ */
+void GdbStub::Step(void) {
+  control_->Step();
+  Stop();
+  return;
+}
+
+/*
+ * Holds the stopped console, and tells the debugger why it stopped. A
+ * watchpoint is reported with the address whose access matched it.
+ */
+void GdbStub::Stop(void) {
+  snprintf(last_stop_, sizeof(last_stop_), "S%02x", GDB_SIGTRAP);
+  if (!console_->IsPaused()) {
+    snprintf(last_stop_, sizeof(last_stop_), "S%02x", GDB_SIGILL);
+  }
+
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  size_t hit = breakpoints->GetHit();
+  for (size_t i = 0; (hit != 0) && (i < breakpoints->GetCount()); i++) {
+    const Breakpoint *point = breakpoints->Get(i);
+    if ((point->id != hit) || (point->kind == BREAK_EXEC)) { continue; }
+    const char *kind = (point->kind == BREAK_READ) ? "r"
+                     : (point->kind == BREAK_ACCESS) ? "a" : "";
+    snprintf(last_stop_, sizeof(last_stop_), "T%02x%swatch:%04x;",
+             GDB_SIGTRAP, kind, breakpoints->GetHitAddr());
+  }
+  Send(last_stop_);
+  return;
+}
+
+/*
+ * Handles a packet from the debugger. Packets which are not supported are
+ * given an empty reply, as the protocol requires.
+ */
+void GdbStub::HandlePacket(char *packet) {
+  switch (packet[0]) {
+    case '?':
+      Send(last_stop_);
+      break;
+    case 'g':
+    case 'G':
+    case 'p':
+    case 'P':
+      HandleRegisters(packet);
+      break;
+    case 'm':
+    case 'M':
+      HandleMemory(packet);
+      break;
+    case 'Z':
+    case 'z':
+      HandleBreakpoint(packet);
+      break;
+    case 'c':
+    case 's':
+      // Both may give an address to resume from.
+      if (packet[1] != '\0') {
+        CpuState state;
+        console_->GetCpu()->Inspect(&state);
+        state.pc = static_cast<DoubleWord>(strtoul(&(packet[1]), NULL, 16));
+        console_->GetCpu()->SetRegisters(&state);
+      }
+      if (packet[0] == 's') {
+        Step();
+      } else {
+        control_->Continue();
+      }
+      break;
+    case 'v':
+      if (strcmp(packet, "vCont?") == 0) {
+        Send("vCont;c;C;s;S");
+      } else if (strncmp(packet, "vCont;", strlen("vCont;")) == 0) {
+        // Only a single thread runs, and so only the first action is used.
+        // Signals can not be delivered to the CPU, and are dropped.
+        char action = packet[strlen("vCont;")];
+        if ((action == 's') || (action == 'S')) {
+          Step();
+        } else {
+          control_->Continue();
+        }
+      } else {
+        Send("");
+      }
+      break;
+    case 'q':
+      HandleQuery(packet);
+      break;
+    case 'H':
+    case 'T':
+      Send("OK");
+      break;
+    case 'D':
+      Send("OK");
+      Detach();
+      break;
+    case 'k':
+      Detach();
+      break;
+    default:
+      Send("");
+      break;
+  }
+  return;
+}
+
+/*
+ * Handles the queries the stub supports, which describe the target and
+ * its single thread, and carry monitor commands.
+ */
+void GdbStub::HandleQuery(char *packet) {
+  const char *kXferPrefix = "qXfer:features:read:target.xml:";
+  const char *kRcmdPrefix = "qRcmd,";
+  if (strncmp(packet, "qSupported", strlen("qSupported")) == 0) {
+    char reply[64];
+    snprintf(reply, sizeof(reply), "PacketSize=%zx;qXfer:features:read+",
+             kPacketSize_);
+    Send(reply);
+  } else if (strncmp(packet, kXferPrefix, strlen(kXferPrefix)) == 0) {
+    // Send the part of the target description which was asked for.
+    char *len_text = NULL;
+    size_t offset = strtoul(packet + strlen(kXferPrefix), &len_text, 16);
+    size_t len = (*len_text == ',') ? strtoul(len_text + 1, NULL, 16) : 0;
+    size_t size = strlen(kTargetXml);
+    offset = (offset < size) ? offset : size;
+    len = (len < size - offset) ? len : size - offset;
+    len = (len < kPacketSize_ - 2) ? len : kPacketSize_ - 2;
+    std::vector<char> reply(len + 2);
+    reply[0] = (offset + len < size) ? 'm' : 'l';
+    memcpy(&(reply[1]), kTargetXml + offset, len);
+    reply[len + 1] = '\0';
+    Send(reply.data());
+  } else if (strncmp(packet, kRcmdPrefix, strlen(kRcmdPrefix)) == 0) {
+    // Monitor commands are sent as hex.
+    const char *hex = packet + strlen(kRcmdPrefix);
+    size_t size = strlen(hex) / 2;
+    std::vector<char> command(size + 1);
+    if (!DecodeHex(hex, reinterpret_cast<DataWord*>(command.data()), size)) {
+      Send("E01");
+      return;
+    }
+    command[size] = '\0';
+    HandleCommand(command.data());
+  } else if (strcmp(packet, "qAttached") == 0) {
+    Send("1");
+  } else if (strcmp(packet, "qC") == 0) {
+    Send("QC1");
+  } else if (strcmp(packet, "qfThreadInfo") == 0) {
+    Send("m1");
+  } else if (strcmp(packet, "qsThreadInfo") == 0) {
+    Send("l");
+  } else {
+    Send("");
+  }
+  return;
+}
+
+/*
+ * Runs a monitor command. The only command runs the console for a number
+ * of CPU cycles, which leaves it between instructions if it does not stop
+ * on a breakpoint first. Counts above a frame of cycles are refused, as
+ * nothing can interrupt the command once it runs.
+ */
+void GdbStub::HandleCommand(const char *command) {
+  const char *kCycleCommand = "cycle";
+  size_t cycle_size = strlen(kCycleCommand);
+  if ((strncmp(command, kCycleCommand, cycle_size) != 0)
+      || ((command[cycle_size] != '\0') && (command[cycle_size] != ' '))) {
+    SendHex(kMonitorHelp);
+    Send("OK");
+    return;
+  }
+
+  size_t cycles = strtoul(command + cycle_size, NULL, 0);
+  if (cycles > kMaxCommandCycles_) {
+    Send("E01");
+    return;
+  }
+  if (cycles == 0) { cycles = 1; }
+  console_->Resume();
+  size_t run = 0;
+  while ((run < cycles) && !console_->IsPaused()) {
+    console_->RunCycles(1);
+    run++;
+  }
+
+  CpuState state;
+  console_->GetCpu()->Inspect(&state);
+  size_t scanline, dot;
+  console_->GetPpu()->GetPosition(&scanline, &dot);
+  char text[128];
+  snprintf(text, sizeof(text), "Ran %zu cycles%s. PC is $%04x, at scanline "
+           "%zu, dot %zu.\n", run, console_->IsPaused()
+           ? ", stopping on a breakpoint" : "", state.pc, scanline, dot);
+  SendHex(text);
+  Send("OK");
+  return;
+}
+
+/*
+ * Reads or writes all of the registers, or a single register.
+ */
+void GdbStub::HandleRegisters(char *packet) {
+  Cpu *cpu = console_->GetCpu();
+  CpuState state;
+  cpu->Inspect(&state);
+  DataWord regs[GDB_REGS_SIZE];
+  PackRegisters(&state, regs);
+  char reply[2 * GDB_REGS_SIZE + 1];
+
+  switch (packet[0]) {
+    case 'g':
+      EncodeHex(regs, GDB_REGS_SIZE, reply);
+      Send(reply);
+      return;
+    case 'G':
+      if (!DecodeHex(&(packet[1]), regs, GDB_REGS_SIZE)) { break; }
+      UnpackRegisters(regs, &state);
+      cpu->SetRegisters(&state);
+      Send("OK");
+      return;
+    case 'p': {
+      size_t reg = strtoul(&(packet[1]), NULL, 16);
+      if (reg >= GDB_NUM_REGS) { break; }
+      EncodeHex(&(regs[kRegOffsets[reg]]), kRegSizes[reg], reply);
+      Send(reply);
+      return;
+    }
+    case 'P': {
+      char *value = NULL;
+      size_t reg = strtoul(&(packet[1]), &value, 16);
+      if ((reg >= GDB_NUM_REGS) || (*value != '=')
+          || !DecodeHex(value + 1, &(regs[kRegOffsets[reg]]),
+                        kRegSizes[reg])) {
+        break;
+      }
+      UnpackRegisters(regs, &state);
+      cpu->SetRegisters(&state);
+      Send("OK");
+      return;
+    }
+    default:
+      break;
+  }
+  Send("E01");
+  return;
+}
+
+/*
+ * Reads or writes CPU memory. Reads are inspected, and so have no side
+ * effects. Writes are refused, without writing anything, if any of their
+ * addresses would have side effects.
+ */
+void GdbStub::HandleMemory(char *packet) {
+  Memory *memory = console_->GetMemory();
+  char *len_text = NULL;
+  size_t addr = strtoul(&(packet[1]), &len_text, 16);
+  char *data = NULL;
+  size_t len = (*len_text == ',') ? strtoul(len_text + 1, &data, 16) : 0;
+  if ((*len_text != ',') || (addr > 0xFFFFU)) {
+    Send("E01");
+    return;
+  }
+
+  if (packet[0] == 'm') {
+    // Replies are limited to the size of a packet.
+    len = (len < (kPacketSize_ - 1) / 2) ? len : (kPacketSize_ - 1) / 2;
+    std::vector<DataWord> bytes(len);
+    for (size_t i = 0; i < len; i++) {
+      bytes[i] = memory->Inspect(static_cast<DoubleWord>(addr + i));
+    }
+    std::vector<char> reply(2 * len + 1);
+    EncodeHex(bytes.data(), len, reply.data());
+    Send(reply.data());
+    return;
+  }
+
+  // The length comes from the debugger, and so is checked against the data
+  // which was sent before anything is allocated for it.
+  if ((len > kPacketSize_ / 2) || (*data != ':')
+      || (strlen(data + 1) != 2 * len)) {
+    Send("E01");
+    return;
+  }
+  std::vector<DataWord> bytes(len);
+  if (!DecodeHex(data + 1, bytes.data(), len)) {
+    Send("E01");
+    return;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (!memory->CheckWrite(static_cast<DoubleWord>(addr + i))) {
+      Send("E02");
+      return;
+    }
+  }
+  for (size_t i = 0; i < len; i++) {
+    memory->Write(static_cast<DoubleWord>(addr + i), bytes[i]);
+  }
+  Send("OK");
+  return;
+}
+
+/*
+ * Inserts or removes a breakpoint or watchpoint. Software and hardware
+ * breakpoints are the same to the stub, as neither changes memory.
+ */
+void GdbStub::HandleBreakpoint(char *packet) {
+  const BreakKind kKinds[] = {
+    BREAK_EXEC, BREAK_EXEC, BREAK_WRITE, BREAK_READ, BREAK_ACCESS
+  };
+  const size_t kNumKinds = 5;
+
+  // The type must be a single known digit, followed by the address. The
+  // packet is checked before it is parsed, as it may end anywhere.
+  if ((packet[1] < '0') || (packet[1] >= static_cast<char>('0' + kNumKinds))
+      || (packet[2] != ',')) {
+    Send("");
+    return;
+  }
+  size_t type = static_cast<size_t>(packet[1] - '0');
+  char *size_text = NULL;
+  size_t addr = strtoul(&(packet[3]), &size_text, 16);
+  if (*size_text != ',') {
+    Send("");
+    return;
+  }
+  size_t size = strtoul(size_text + 1, NULL, 16);
+  if ((addr > 0xFFFFU) || (size > 0x10000U)) {
+    Send("E01");
+    return;
+  }
+
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  BreakKind kind = kKinds[type];
+  DoubleWord point_addr = static_cast<DoubleWord>(addr);
+  if (packet[0] == 'Z') {
+    if (kind == BREAK_EXEC) {
+      breakpoints->Add(point_addr, BREAK_ANY_BANK, NULL);
+    } else {
+      breakpoints->AddWatch(point_addr, size, kind);
+    }
+  } else {
+    // Remove the first matching point, as the debugger may insert the same
+    // one more than once.
+    size_t id = 0;
+    for (size_t i = 0; (id == 0) && (i < breakpoints->GetCount()); i++) {
+      const Breakpoint *point = breakpoints->Get(i);
+      if ((point->kind == kind) && (point->addr == point_addr)
+          && ((kind == BREAK_EXEC) || (point->size == size))) {
+        id = point->id;
+      }
+    }
+    if (id == 0) {
+      Send("E01");
+      return;
+    }
+    breakpoints->Remove(id);
+  }
+  UpdateWatchpoints();
+  Send("OK");
+  return;
+}
+
+/*
+ * Gives the watchpoints to the console while any are enabled, so that the
+ * CPU only checks its accesses while they could match.
+ */
+void GdbStub::UpdateWatchpoints(void) {
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  bool watching = attached_ && breakpoints->HasWatches();
+  console_->SetWatchpoints(watching ? breakpoints : NULL);
+  return;
+}
+
+/*
+ * Gets the value of the given hex digit, or -1 if it is not one.
+ */
+static int HexValue(char c) {
+  if ((c >= '0') && (c <= '9')) { return c - '0'; }
+  if ((c >= 'a') && (c <= 'f')) { return c - 'a' + 10; }
+  if ((c >= 'A') && (c <= 'F')) { return c - 'A' + 10; }
+  return -1;
+}
+
+/*
+ * Decodes the given number of bytes from pairs of hex digits.
+ *
+ * Returns false if the text is too short, or holds anything else.
+ */
+static bool DecodeHex(const char *text, DataWord *bytes, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    int hi = HexValue(text[2 * i]);
+    if (hi < 0) { return false; }
+    int lo = HexValue(text[2 * i + 1]);
+    if (lo < 0) { return false; }
+    bytes[i] = static_cast<DataWord>((hi << 4) | lo);
+  }
+  return true;
+}
+
+/*
+ * Encodes the given bytes as pairs of hex digits, then terminates the text.
+ */
+static void EncodeHex(const DataWord *bytes, size_t size, char *text) {
+  const char* const kDigits = "0123456789abcdef";
+  for (size_t i = 0; i < size; i++) {
+    text[2 * i] = kDigits[bytes[i] >> 4];
+    text[2 * i + 1] = kDigits[bytes[i] & 0xF];
+  }
+  text[2 * size] = '\0';
+  return;
+}
+
+/*
+ * Packs the registers of the CPU in the order they are described to the
+ * debugger. The PC is little endian, as it is in memory.
+ */
+static void PackRegisters(const CpuState *state, DataWord *regs) {
+  regs[0] = state->a;
+  regs[1] = state->x;
+  regs[2] = state->y;
+  regs[3] = state->p;
+  regs[4] = state->s;
+  regs[5] = GET_WORD_LO(state->pc);
+  regs[6] = GET_WORD_HI(state->pc);
+  return;
+}
+
+/*
+ * Unpacks registers given by the debugger into the state of the CPU.
+ */
+static void UnpackRegisters(const DataWord *regs, CpuState *state) {
+  state->a = regs[0];
+  state->x = regs[1];
+  state->y = regs[2];
+  state->p = regs[3];
+  state->s = regs[4];
+  state->pc = GET_DOUBLE_WORD(regs[5], regs[6]);
+  return;
+}
+
+/*
+ * Tells an attached debugger that the emulation has exited, then stops the
+ * server thread and closes the sockets. The breakpoints are removed from
+ * the console, which must outlive the stub.
+ */
+GdbStub::~GdbStub(void) {
+  if (attached_) { Send("W00"); }
+  closing_.store(true);
+  server_thread_.join();
+  Detach();
+  close(listen_socket_);
+  if (unix_path_ != NULL) {
+    unlink(unix_path_);
+    delete[] unix_path_;
+  }
+  delete control_;
+  return;
+}
@@ -0,0 +1,136 @@
+#ifndef _NES_GDBSTUB
+#define _NES_GDBSTUB
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+#include "../core/console.h"
+#include "./debug_control.h"
+#include "../util/data.h"
+
+// The events the server thread of the stub passes to the emulation thread.
+typedef enum {
+  GDB_ATTACH, GDB_DETACH, GDB_INTERRUPT, GDB_PACKET
+} GdbEvent;
+
+/*
+ * An event from the debugger, with the body of its packet if it has one.
+ */
+struct GdbRequest {
+  GdbEvent event;
+  std::vector<char> packet;
+};
+
+/*
+ * Serves the GDB remote serial protocol to a single debugger at a time,
+ * over a TCP or UNIX socket, letting it stop, step, and inspect the
+ * console.
+ *
+ * The socket is read by a server thread, which checks each packet and
+ * queues it for the emulation thread. The emulation thread serves the
+ * queue once a frame while the console runs, which costs a single flag
+ * test until a debugger attaches. While the debugger holds the console
+ * stopped, the emulation thread waits on the queue instead of running it.
+ */
+class GdbStub {
+  private:
+    // The largest packet the stub accepts, in bytes.
+    static const size_t kPacketSize_ = 0x1000;
+
+    // The most cycles a monitor command runs at once, which is more than a
+    // frame of any console. The emulation thread serves no requests while
+    // the command runs.
+    static const size_t kMaxCommandCycles_ = 40000;
+
+    // The longest the server thread waits on its sockets, and the longest
+    // a stopped emulation thread waits for a request, in milliseconds.
+    static const int kPollMs_ = 100;
+    static const int kWaitMs_ = 16;
+
+    // The console being debugged.
+    Console *console_;
+
+    // Stops and steps the console, and holds the breakpoints and
+    // watchpoints set by the debugger. The breakpoints are only given to
+    // the console while a debugger is attached.
+    DebugControl *control_;
+
+    // The socket debuggers connect to, and the path it was bound to if it
+    // is a UNIX socket.
+    int listen_socket_;
+    char *unix_path_;
+
+    // The socket of the attached debugger, or -1. Guarded by the send lock,
+    // as both threads send packets to it.
+    int client_ = -1;
+    std::mutex send_lock_;
+    std::vector<char> last_packet_;
+
+    // Requests waiting for the emulation thread.
+    DebugQueue<GdbRequest> queue_;
+
+    // The state of the debugger, which is only used by the emulation
+    // thread.
+    bool attached_ = false;
+    char last_stop_[32];
+
+    // Reads the socket until the stub is deleted.
+    std::atomic<bool> closing_;
+    std::thread server_thread_;
+
+    // Uses the given listening socket to create a stub for the console,
+    // then starts the server thread.
+    GdbStub(int listen_socket, char *unix_path, Console *console);
+
+    // Accepts debuggers and reads their packets. Executed on its own thread.
+    void RunServer(void);
+    void ReadClient(int client);
+    void Post(GdbEvent event, const char *packet, size_t size);
+
+    // Sends a packet to the attached debugger, or sends the last packet
+    // again.
+    void Send(const char *packet);
+    void SendHex(const char *text);
+    void Resend(void);
+
+    // Handles requests on the emulation thread.
+    void Handle(GdbRequest *request);
+    void HandlePacket(char *packet);
+    void HandleQuery(char *packet);
+    void HandleCommand(const char *command);
+    void HandleRegisters(char *packet);
+    void HandleMemory(char *packet);
+    void HandleBreakpoint(char *packet);
+
+    // Attaches or detaches the debugger, giving it the breakpoints.
+    void Attach(void);
+    void Detach(void);
+
+    // Runs a single instruction, and reports why the console stopped.
+    void Step(void);
+    void Stop(void);
+
+    // Gives the watchpoints to the CPU while any are enabled.
+    void UpdateWatchpoints(void);
+
+  public:
+    // Listens for debuggers on the given "host:port" or "unix:<path>"
+    // address. Returns NULL if the address cannot be bound.
+    static GdbStub *Create(const char *addr, Console *console);
+
+    // Serves the requests of the debugger. Called by the emulation thread
+    // between frames. Returns true while the debugger holds the console
+    // stopped, in which case the frame must not be run.
+    bool Service(void);
+
+    // Tells an attached debugger the emulation has ended, then closes the
+    // sockets.
+    ~GdbStub(void);
+};
+
+#endif
@@ -90,6 +90,9 @@ const char* const kClearDMnemonic = "cld";
 const char* const kIncXMnemonic = "inx";
 const char* const kSetDMnemonic = "sed";
 
+// The bytes of an opcode which is not a documented instruction.
+const char* const kDataMnemonic = ".db";
+
 /* ########################### */
 /* # Addressing mode formats # */
 /* ########################### */
@@ -102,7 +105,8 @@ const char* const kAddrModeImm = " #$%02x";
 const char* const kAddrModeInd = " ($%02x%02x)";
 const char* const kAddrModeIzpx = " ($%02x,X)";
 const char* const kAddrModeIzpY = " ($%02x),Y";
-const char* const kAddrModeRel = " $%02x";
+// Branches are printed with the address they branch to.
+const char* const kAddrModeRel = " $%04x";
 const char* const kAddrModeZp = " $%02x";
 const char* const kAddrModeZpX = " $%02x,X";
 const char* const kAddrModeZpY = " $%02x,Y";
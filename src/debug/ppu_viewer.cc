@@ -0,0 +1,441 @@
+/*
+ * The PPU viewer draws the contents of PPU memory for debugging: both pattern
+ * tables, all four nametables with the scroll window of the next frame
+ * outlined, the sprites in OAM, and the palette.
+ *
+ * Drawing these views takes far longer than copying the memory they show, so
+ * the emulation thread only copies PPU memory into a snapshot, using the side
+ * effect free inspection reads of the memory and PPU. The views are drawn on
+ * the viewer's own thread. Each part of a snapshot is hashed, and a view is
+ * only redrawn when a part of memory it shows has changed.
+ *
+ * The viewer only asks for a new snapshot once the window has taken every
+ * redrawn view, so that it never runs faster than the views are shown.
+ */
+
+#include "./ppu_viewer.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../util/data.h"
+#include "../memory/memory.h"
+#include "../memory/palette.h"
+#include "../ppu/ppu.h"
+#include "../video/frame_hash.h"
+
+// The flags of PPUCTRL which change how tiles are drawn.
+#define CTRL_SPRITE_SIZE 0x20U
+#define CTRL_BG_TABLE 0x10U
+#define CTRL_SPRITE_TABLE 0x08U
+
+// The flags of the attribute byte of each sprite.
+#define SPRITE_VFLIP 0x80U
+#define SPRITE_HFLIP 0x40U
+#define SPRITE_PALETTE 0x03U
+
+// The layout of tiles in memory.
+#define TILE_SIZE 8U
+#define TILE_BYTES 16U
+#define TILE_PLANE_OFFSET 8U
+#define PATTERN_TABLE_BYTES 0x1000U
+#define PATTERN_TABLE_TILES 16U
+
+// The layout of each nametable.
+#define NAMETABLE_TILES_WIDE 32U
+#define NAMETABLE_TILES_HIGH 30U
+#define ATTRIBUTE_OFFSET 0x3C0U
+
+// The fields of the scroll address.
+#define SCROLL_COARSE_X(addr) ((addr) & 0x1FU)
+#define SCROLL_COARSE_Y(addr) (((addr) >> 5) & 0x1FU)
+#define SCROLL_NT_X(addr) (((addr) >> 10) & 0x01U)
+#define SCROLL_NT_Y(addr) (((addr) >> 11) & 0x01U)
+#define SCROLL_FINE_Y(addr) (((addr) >> 12) & 0x07U)
+
+// The NES color the scroll window is outlined with.
+#define SCROLL_WINDOW_COLOR 0x16U
+
+// The number of sprites in OAM, and the bytes each one takes.
+#define NUM_SPRITES 64U
+#define SPRITE_BYTES 4U
+#define SPRITES_PER_ROW 8U
+
+// The size each palette entry is drawn at.
+#define PALETTE_SWATCH_SIZE 16U
+#define PALETTE_SWATCHES_PER_ROW 16U
+
+// The offset of the sprite palettes in palette memory.
+#define SPRITE_PALETTE_OFFSET 0x10U
+
+// The dimensions of each view.
+const size_t PpuViewer::kViewWidths_[NUM_VIEWS] = { 256U, 512U, 64U, 256U };
+const size_t PpuViewer::kViewHeights_[NUM_VIEWS] = { 128U, 480U, 128U, 32U };
+
+/*
+ * Allocates the snapshot and views, then starts the viewer thread.
+ */
+PpuViewer::PpuViewer(const char *palette_file) {
+  palette_ = new NesPalette(palette_file);
+  snapshot_ = new PpuSnapshot();
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    size_t size = kViewWidths_[i] * kViewHeights_[i];
+    view_colors_[i] = new DataWord[size]();
+    view_pixels_[i] = new Pixel[size]();
+    ready_pixels_[i] = new Pixel[size]();
+  }
+  thread_ = std::thread(&PpuViewer::RunViewer, this);
+  return;
+}
+
+/*
+ * Gets the width of the given view, in pixels.
+ */
+size_t PpuViewer::GetViewWidth(PpuViewType view) {
+  return kViewWidths_[view];
+}
+
+/*
+ * Gets the height of the given view, in pixels.
+ */
+size_t PpuViewer::GetViewHeight(PpuViewType view) {
+  return kViewHeights_[view];
+}
+
+/*
+ * Copies the pattern tables, nametables, palette, and registers of the PPU
+ * into the snapshot, if the viewer is waiting for one. Only inspection reads
+ * are used, so the emulation is not affected.
+ */
+void PpuViewer::Capture(Memory *memory, Ppu *ppu) {
+  if (!snapshot_wanted_) { return; }
+
+  // Copy the memory of the PPU.
+  for (size_t i = 0; i < VIEWER_CHR_SIZE; i++) {
+    snapshot_->chr[i] = memory->VramInspect(static_cast<DoubleWord>(i));
+  }
+  for (size_t table = 0; table < VIEWER_NUM_NAMETABLES; table++) {
+    size_t base = NAMETABLE_OFFSET + table * NAMETABLE_SIZE;
+    for (size_t i = 0; i < NAMETABLE_SIZE; i++) {
+      snapshot_->nametables[table][i] =
+          memory->VramInspect(static_cast<DoubleWord>(base + i));
+    }
+  }
+  for (size_t i = 0; i < ACTIVE_PALETTE_SIZE; i++) {
+    snapshot_->palette[i] =
+        memory->VramInspect(static_cast<DoubleWord>(PALETTE_OFFSET + i));
+  }
+  ppu->Inspect(&(snapshot_->ppu));
+
+  // Hand the snapshot to the viewer thread.
+  snapshot_wanted_ = false;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    snapshot_ready_ = true;
+  }
+  signal_.notify_one();
+  return;
+}
+
+/*
+ * Copies the given view into the pixel buffer, if it has been redrawn since
+ * it was last taken.
+ *
+ * Assumes the buffer can hold the view with the given pitch.
+ */
+bool PpuViewer::TakeView(PpuViewType view, Pixel *pixels, size_t pitch) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!ready_[view]) { return false; }
+    size_t width = kViewWidths_[view];
+    for (size_t row = 0; row < kViewHeights_[view]; row++) {
+      const Pixel *src = &(ready_pixels_[view][row * width]);
+      for (size_t x = 0; x < width; x++) { pixels[row * pitch + x] = src[x]; }
+    }
+    ready_[view] = false;
+  }
+
+  // Wake the viewer, which may be waiting for the views to be taken.
+  signal_.notify_one();
+  return true;
+}
+
+/*
+ * Waits for snapshots from the emulation thread, and redraws the views
+ * they change. Runs until the viewer is deleted.
+ */
+void PpuViewer::RunViewer(void) {
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    // Wait for the next snapshot.
+    signal_.wait(guard, [this] { return snapshot_ready_ || closing_; });
+    if (closing_) { break; }
+    snapshot_ready_ = false;
+    guard.unlock();
+
+    // Redraw the views changed by the snapshot.
+    bool dirty[NUM_VIEWS];
+    FindDirtyViews(dirty);
+    if (dirty[VIEW_PATTERN]) { DrawPatternTables(view_colors_[VIEW_PATTERN]); }
+    if (dirty[VIEW_NAMETABLE]) { DrawNametables(view_colors_[VIEW_NAMETABLE]); }
+    if (dirty[VIEW_OAM]) { DrawSprites(view_colors_[VIEW_OAM]); }
+    if (dirty[VIEW_PALETTE]) { DrawPalette(view_colors_[VIEW_PALETTE]); }
+    for (size_t i = 0; i < NUM_VIEWS; i++) {
+      if (!dirty[i]) { continue; }
+      palette_->DecodeRow(view_colors_[i], 0, view_pixels_[i],
+                          kViewWidths_[i] * kViewHeights_[i]);
+    }
+
+    // Publish the redrawn views, then wait for the window to take them
+    // before asking for another snapshot.
+    guard.lock();
+    for (size_t i = 0; i < NUM_VIEWS; i++) {
+      if (!dirty[i]) { continue; }
+      Pixel *drawn = view_pixels_[i];
+      view_pixels_[i] = ready_pixels_[i];
+      ready_pixels_[i] = drawn;
+      ready_[i] = true;
+    }
+    signal_.wait(guard, [this] {
+      return closing_ || !(ready_[VIEW_PATTERN] || ready_[VIEW_NAMETABLE]
+                           || ready_[VIEW_OAM] || ready_[VIEW_PALETTE]);
+    });
+    if (closing_) { break; }
+    snapshot_wanted_ = true;
+  }
+  return;
+}
+
+/*
+ * Hashes each part of the snapshot, and marks the views which show a part
+ * that changed since the last snapshot. Every view is marked for the first
+ * snapshot.
+ */
+void PpuViewer::FindDirtyViews(bool *dirty) {
+  // Hash each part of the snapshot. The bits of PPUCTRL which select
+  // pattern tables are included with the parts they affect.
+  const PpuState *ppu = &(snapshot_->ppu);
+  uint64_t chr = HashBytes(snapshot_->chr, sizeof(snapshot_->chr));
+  uint64_t nametable = HashBytes(snapshot_->nametables,
+                                 sizeof(snapshot_->nametables));
+  uint64_t palette = HashBytes(snapshot_->palette, sizeof(snapshot_->palette));
+  uint64_t oam = HashBytes(ppu->oam, sizeof(ppu->oam),
+                           ppu->ctrl & (CTRL_SPRITE_SIZE | CTRL_SPRITE_TABLE));
+  uint64_t scroll = static_cast<uint64_t>(ppu->scroll_addr)
+                  | (static_cast<uint64_t>(ppu->fine_x) << 16)
+                  | (static_cast<uint64_t>(ppu->ctrl & CTRL_BG_TABLE) << 24);
+
+  // Determine which parts changed.
+  bool chr_dirty = !hashes_valid_ || (chr != chr_hash_);
+  bool nametable_dirty = !hashes_valid_ || (nametable != nametable_hash_);
+  bool palette_dirty = !hashes_valid_ || (palette != palette_hash_);
+  bool oam_dirty = !hashes_valid_ || (oam != oam_hash_);
+  bool scroll_dirty = !hashes_valid_ || (scroll != scroll_hash_);
+  chr_hash_ = chr;
+  nametable_hash_ = nametable;
+  palette_hash_ = palette;
+  oam_hash_ = oam;
+  scroll_hash_ = scroll;
+  hashes_valid_ = true;
+
+  // Every view is colored by the palette, and all but the palette view
+  // show tiles from the pattern tables.
+  dirty[VIEW_PATTERN] = chr_dirty || palette_dirty;
+  dirty[VIEW_NAMETABLE] = chr_dirty || nametable_dirty || palette_dirty
+                       || scroll_dirty;
+  dirty[VIEW_OAM] = chr_dirty || oam_dirty || palette_dirty;
+  dirty[VIEW_PALETTE] = palette_dirty;
+  return;
+}
+
+/*
+ * Draws both pattern tables side by side, using the first background palette.
+ */
+void PpuViewer::DrawPatternTables(DataWord *colors) {
+  size_t pitch = kViewWidths_[VIEW_PATTERN];
+  const DataWord *palette = snapshot_->palette;
+  for (size_t table = 0; table < 2; table++) {
+    for (size_t tile = 0; tile < (PATTERN_TABLE_TILES * PATTERN_TABLE_TILES);
+                          tile++) {
+      size_t x = table * PATTERN_TABLE_TILES * TILE_SIZE
+               + (tile % PATTERN_TABLE_TILES) * TILE_SIZE;
+      size_t y = (tile / PATTERN_TABLE_TILES) * TILE_SIZE;
+      DrawTile(table * PATTERN_TABLE_BYTES + tile * TILE_BYTES, palette,
+               false, false, false, &(colors[y * pitch + x]), pitch);
+    }
+  }
+  return;
+}
+
+/*
+ * Draws the four nametables in a square, using the background pattern table
+ * and the attribute table of each nametable. The area the next frame will
+ * start drawing from is outlined, wrapping around the edges of the view.
+ */
+void PpuViewer::DrawNametables(DataWord *colors) {
+  const PpuState *ppu = &(snapshot_->ppu);
+  size_t width = kViewWidths_[VIEW_NAMETABLE];
+  size_t height = kViewHeights_[VIEW_NAMETABLE];
+  size_t table_addr = (ppu->ctrl & CTRL_BG_TABLE) ? PATTERN_TABLE_BYTES : 0;
+
+  // Draw each tile of each nametable.
+  for (size_t table = 0; table < VIEWER_NUM_NAMETABLES; table++) {
+    const DataWord *nametable = snapshot_->nametables[table];
+    size_t base_x = (table & 1U) * NAMETABLE_TILES_WIDE * TILE_SIZE;
+    size_t base_y = (table >> 1) * NAMETABLE_TILES_HIGH * TILE_SIZE;
+    for (size_t ty = 0; ty < NAMETABLE_TILES_HIGH; ty++) {
+      for (size_t tx = 0; tx < NAMETABLE_TILES_WIDE; tx++) {
+        // Find the palette of the tile from the attribute table.
+        DataWord attribute = nametable[ATTRIBUTE_OFFSET
+                           + (ty / 4U) * (NAMETABLE_TILES_WIDE / 4U) + tx / 4U];
+        size_t shift = ((ty & 2U) << 1) | (tx & 2U);
+        size_t palette = (attribute >> shift) & 3U;
+        DataWord tile_colors[4] = { snapshot_->palette[0],
+                                    snapshot_->palette[palette * 4U + 1U],
+                                    snapshot_->palette[palette * 4U + 2U],
+                                    snapshot_->palette[palette * 4U + 3U] };
+
+        // Draw the tile.
+        size_t tile = nametable[ty * NAMETABLE_TILES_WIDE + tx];
+        size_t x = base_x + tx * TILE_SIZE;
+        size_t y = base_y + ty * TILE_SIZE;
+        DrawTile(table_addr + tile * TILE_BYTES, tile_colors, false, false,
+                 false, &(colors[y * width + x]), width);
+      }
+    }
+  }
+
+  // Outline the scroll window of the next frame.
+  DoubleWord addr = ppu->scroll_addr;
+  size_t left = SCROLL_NT_X(addr) * NAMETABLE_TILES_WIDE * TILE_SIZE
+              + SCROLL_COARSE_X(addr) * TILE_SIZE + ppu->fine_x;
+  size_t top = SCROLL_NT_Y(addr) * NAMETABLE_TILES_HIGH * TILE_SIZE
+             + SCROLL_COARSE_Y(addr) * TILE_SIZE + SCROLL_FINE_Y(addr);
+  size_t right = left + NES_WIDTH - 1U;
+  size_t bottom = top + NES_HEIGHT - 1U;
+  for (size_t x = left; x <= right; x++) {
+    colors[(top % height) * width + (x % width)] = SCROLL_WINDOW_COLOR;
+    colors[(bottom % height) * width + (x % width)] = SCROLL_WINDOW_COLOR;
+  }
+  for (size_t y = top; y <= bottom; y++) {
+    colors[(y % height) * width + (left % width)] = SCROLL_WINDOW_COLOR;
+    colors[(y % height) * width + (right % width)] = SCROLL_WINDOW_COLOR;
+  }
+
+  return;
+}
+
+/*
+ * Draws each sprite in OAM, in order, on the background color. Each sprite
+ * is given room for a tall sprite, and is drawn with its palette and flips.
+ */
+void PpuViewer::DrawSprites(DataWord *colors) {
+  const PpuState *ppu = &(snapshot_->ppu);
+  size_t width = kViewWidths_[VIEW_OAM];
+  size_t size = width * kViewHeights_[VIEW_OAM];
+  for (size_t i = 0; i < size; i++) { colors[i] = snapshot_->palette[0]; }
+
+  bool tall = (ppu->ctrl & CTRL_SPRITE_SIZE) != 0;
+  size_t table_addr = (ppu->ctrl & CTRL_SPRITE_TABLE) ? PATTERN_TABLE_BYTES : 0;
+  for (size_t sprite = 0; sprite < NUM_SPRITES; sprite++) {
+    // Get the tile, palette, and flips of the sprite.
+    size_t tile = ppu->oam[sprite * SPRITE_BYTES + 1U];
+    DataWord attributes = ppu->oam[sprite * SPRITE_BYTES + 2U];
+    const DataWord *palette = &(snapshot_->palette[SPRITE_PALETTE_OFFSET
+                            + (attributes & SPRITE_PALETTE) * 4U]);
+    bool hflip = (attributes & SPRITE_HFLIP) != 0;
+    bool vflip = (attributes & SPRITE_VFLIP) != 0;
+
+    // Draw the sprite in its cell. Tall sprites select their pattern table
+    // with the low bit of the tile, and are made of two tiles, which swap
+    // places when the sprite is flipped vertically.
+    size_t x = (sprite % SPRITES_PER_ROW) * TILE_SIZE;
+    size_t y = (sprite / SPRITES_PER_ROW) * TILE_SIZE * 2U;
+    DataWord *dst = &(colors[y * width + x]);
+    if (tall) {
+      size_t top_addr = (tile & 1U) * PATTERN_TABLE_BYTES
+                      + (tile & ~static_cast<size_t>(1U)) * TILE_BYTES;
+      size_t bottom_addr = top_addr + TILE_BYTES;
+      if (vflip) {
+        size_t swap = top_addr;
+        top_addr = bottom_addr;
+        bottom_addr = swap;
+      }
+      DrawTile(top_addr, palette, true, hflip, vflip, dst, width);
+      DrawTile(bottom_addr, palette, true, hflip, vflip,
+               &(dst[TILE_SIZE * width]), width);
+    } else {
+      DrawTile(table_addr + tile * TILE_BYTES, palette, true, hflip, vflip,
+               dst, width);
+    }
+  }
+
+  return;
+}
+
+/*
+ * Draws each entry of palette memory as a square, with the background
+ * palettes on the first row and the sprite palettes on the second.
+ */
+void PpuViewer::DrawPalette(DataWord *colors) {
+  size_t width = kViewWidths_[VIEW_PALETTE];
+  for (size_t entry = 0; entry < ACTIVE_PALETTE_SIZE; entry++) {
+    size_t x = (entry % PALETTE_SWATCHES_PER_ROW) * PALETTE_SWATCH_SIZE;
+    size_t y = (entry / PALETTE_SWATCHES_PER_ROW) * PALETTE_SWATCH_SIZE;
+    for (size_t row = y; row < y + PALETTE_SWATCH_SIZE; row++) {
+      for (size_t col = x; col < x + PALETTE_SWATCH_SIZE; col++) {
+        colors[row * width + col] = snapshot_->palette[entry];
+      }
+    }
+  }
+  return;
+}
+
+/*
+ * Draws the tile at the given pattern table address using the given four
+ * colors. Transparent tiles skip pixels of color zero.
+ */
+void PpuViewer::DrawTile(size_t tile_addr, const DataWord *colors,
+                         bool transparent, bool hflip, bool vflip,
+                         DataWord *dst, size_t pitch) {
+  for (size_t y = 0; y < TILE_SIZE; y++) {
+    size_t row = vflip ? (TILE_SIZE - 1U - y) : y;
+    size_t addr = (tile_addr + row) % VIEWER_CHR_SIZE;
+    DataWord low = snapshot_->chr[addr];
+    DataWord high = snapshot_->chr[(addr + TILE_PLANE_OFFSET)
+                                   % VIEWER_CHR_SIZE];
+    for (size_t x = 0; x < TILE_SIZE; x++) {
+      size_t bit = hflip ? x : (TILE_SIZE - 1U - x);
+      size_t color = ((low >> bit) & 1U) | (((high >> bit) & 1U) << 1);
+      if (transparent && (color == 0)) { continue; }
+      dst[y * pitch + x] = colors[color];
+    }
+  }
+  return;
+}
+
+/*
+ * Stops the viewer thread, then frees the snapshot and views.
+ */
+PpuViewer::~PpuViewer(void) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    closing_ = true;
+  }
+  signal_.notify_all();
+  thread_.join();
+
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    delete[] view_colors_[i];
+    delete[] view_pixels_[i];
+    delete[] ready_pixels_[i];
+  }
+  delete snapshot_;
+  delete palette_;
+  return;
+}
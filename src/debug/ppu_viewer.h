@@ -0,0 +1,121 @@
+#ifndef _NES_PPUVIEWER
+#define _NES_PPUVIEWER
+
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../util/data.h"
+#include "../memory/memory.h"
+#include "../memory/palette.h"
+#include "../ppu/ppu.h"
+
+// The size of the pattern tables, and the number of nametables.
+#define VIEWER_CHR_SIZE 0x2000U
+#define VIEWER_NUM_NAMETABLES 4U
+
+// The views of PPU memory which can be drawn.
+typedef enum {VIEW_PATTERN, VIEW_NAMETABLE, VIEW_OAM, VIEW_PALETTE,
+              NUM_VIEWS} PpuViewType;
+
+/*
+ * A copy of the memory and registers of the PPU, which the views are
+ * drawn from.
+ */
+struct PpuSnapshot {
+  DataWord chr[VIEWER_CHR_SIZE];
+  DataWord nametables[VIEWER_NUM_NAMETABLES][NAMETABLE_SIZE];
+  DataWord palette[ACTIVE_PALETTE_SIZE];
+  PpuState ppu;
+};
+
+/*
+ * Draws views of the pattern tables, nametables, sprites, and palette of the
+ * PPU for debugging. Views are drawn on their own thread from snapshots of
+ * PPU memory, and each view is only redrawn when the memory it shows changes.
+ *
+ * Does not depend on SDL. The drawn views are taken by a debug window.
+ */
+class PpuViewer {
+  private:
+    // The dimensions of each view.
+    static const size_t kViewWidths_[NUM_VIEWS];
+    static const size_t kViewHeights_[NUM_VIEWS];
+
+    // Decodes the NES colors of each view.
+    NesPalette *palette_;
+
+    // The snapshot taken by the emulation thread. Only written while a
+    // snapshot is wanted, and only read by the viewer while one is not.
+    PpuSnapshot *snapshot_;
+    std::atomic<bool> snapshot_wanted_{true};
+
+    // The views as they are drawn by the viewer thread, in NES colors and
+    // then in pixels.
+    DataWord *view_colors_[NUM_VIEWS];
+    Pixel *view_pixels_[NUM_VIEWS];
+
+    // The most recently drawn views, waiting to be taken by the window.
+    Pixel *ready_pixels_[NUM_VIEWS];
+    bool ready_[NUM_VIEWS] = { false };
+
+    // The hashes of each part of the last snapshot, used to determine
+    // which views must be redrawn.
+    uint64_t chr_hash_ = 0;
+    uint64_t nametable_hash_ = 0;
+    uint64_t palette_hash_ = 0;
+    uint64_t oam_hash_ = 0;
+    uint64_t scroll_hash_ = 0;
+    bool hashes_valid_ = false;
+
+    // Guards the ready views and the exchange of snapshots.
+    std::mutex lock_;
+    std::condition_variable signal_;
+    bool snapshot_ready_ = false;
+    bool closing_ = false;
+
+    // The thread the views are drawn on.
+    std::thread thread_;
+
+    // Draws views from each snapshot until the viewer is deleted.
+    void RunViewer(void);
+
+    // Determines which views are changed by the current snapshot.
+    void FindDirtyViews(bool *dirty);
+
+    // Draws the given view from the current snapshot.
+    void DrawPatternTables(DataWord *colors);
+    void DrawNametables(DataWord *colors);
+    void DrawSprites(DataWord *colors);
+    void DrawPalette(DataWord *colors);
+
+    // Draws a single tile from the pattern tables into a view.
+    void DrawTile(size_t tile_addr, const DataWord *colors, bool transparent,
+                  bool hflip, bool vflip, DataWord *dst, size_t pitch);
+
+  public:
+    // Creates the viewer and starts its thread. Views are decoded with the
+    // given palette file, or the default palette if it is NULL.
+    PpuViewer(const char *palette_file);
+
+    // Gets the dimensions of the given view.
+    static size_t GetViewWidth(PpuViewType view);
+    static size_t GetViewHeight(PpuViewType view);
+
+    // Copies the memory of the PPU into a snapshot, if the viewer wants one.
+    // Called by the emulation thread, and never blocks.
+    void Capture(Memory *memory, Ppu *ppu);
+
+    // Copies the given view into the pixel buffer, if it has been redrawn
+    // since it was last taken. Pitch is in pixels. Returns false if the
+    // view has not changed.
+    bool TakeView(PpuViewType view, Pixel *pixels, size_t pitch);
+
+    // Stops the viewer thread and frees the views.
+    ~PpuViewer(void);
+};
+
+#endif
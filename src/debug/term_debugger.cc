@@ -0,0 +1,558 @@
+/*
+ * The terminal debugger reads commands from standard input, one line at a
+ * time, and prints what they show to standard output. It starts with the
+ * console stopped before its first instruction, so that breakpoints can be
+ * set before the game runs.
+ *
+ * Commands are run by the emulation thread between frames, so that the
+ * console is never read or changed while it runs. Standard input is read by
+ * a thread of its own, which only wakes the emulation thread once a line
+ * has been entered. While the console runs freely, the emulation thread
+ * tests a flag each frame, and the breakpoints are only given to the CPU
+ * while any are set, so an idle debugger costs the emulation nothing.
+ *
+ * Everything the debugger shows is read with the inspection functions of
+ * the chips, and so never has side effects. Addresses are given in hex,
+ * with or without a leading "$" or "0x", and counts in decimal.
+ */
+
+#include "./term_debugger.h"
+
+#include <new>
+#include <cctype>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "../core/console.h"
+#include "../cpu/cpu.h"
+#include "../cpu/breakpoints.h"
+#include "./debug_control.h"
+#include "../memory/memory.h"
+#include "../ppu/ppu.h"
+#include "../emulation/signals.h"
+#include "../util/data.h"
+#include "../util/util.h"
+#include "./disas_cache.h"
+
+// The opcode of JSR, which stepping over a call sets a breakpoint after.
+#define OPCODE_JSR 0x20U
+#define JSR_SIZE 3U
+
+// The names of the bits of the status register, from bit 7 down.
+#define P_FLAG_NAMES "NV-BDIZC"
+
+// The scanlines the PPU is in vblank during, on an NTSC console.
+#define VBLANK_FIRST_LINE 241U
+#define VBLANK_LAST_LINE 260U
+
+// Printed by the help command.
+static const char* const kHelpText =
+  "Commands:\n"
+  "  break|b [addr]      Stop the console, or break at an address.\n"
+  "  delete|d <id>       Delete a breakpoint.\n"
+  "  breaks|bl           List the breakpoints.\n"
+  "  continue|c          Run the console until it stops.\n"
+  "  step|s [count]      Run one instruction, or the given number.\n"
+  "  next|n              Run one instruction, stepping over calls.\n"
+  "  scanline|sl <line>  Run until the PPU starts the given scanline.\n"
+  "  regs|r              Show the CPU registers.\n"
+  "  list|l [addr]       List the code around the PC, or at an address.\n"
+  "  mem|x <addr> [len]  Dump CPU memory.\n"
+  "  ppu|p               Show the position and registers of the PPU.\n"
+  "  quit|q              Exit ndb.\n";
+
+/* Helper Functions */
+static bool IsCommand(const char *cmd, const char *name, const char *alias);
+static bool ParseAddr(const char *text, DoubleWord *addr);
+static bool ParseCount(const char *text, size_t *count);
+
+/*
+ * Starts reading commands from standard input. The console is stopped before
+ * it runs its first instruction, as if the user had asked to break.
+ */
+TermDebugger::TermDebugger(Console *console)
+    : closing_(false) {
+  console_ = console;
+  control_ = new DebugControl(console);
+  disas_ = new DisasCache(console->GetMemory(), NULL);
+  printf("Debugging from the terminal. Type \"help\" for the commands.\n");
+  Post("break");
+  input_thread_ = std::thread(&TermDebugger::RunInput, this);
+  return;
+}
+
+/*
+ * Reads lines from standard input until it is closed, or the debugger is
+ * deleted. Lines too long to be held are cut short. Standard input is
+ * polled, so that the thread notices when the debugger is deleted.
+ */
+void TermDebugger::RunInput(void) {
+  std::vector<char> line;
+  while (!closing_.load()) {
+    struct pollfd input_poll = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&input_poll, 1, kPollMs_) <= 0) { continue; }
+    char buf[kLineSize_];
+    ssize_t size = read(STDIN_FILENO, buf, sizeof(buf));
+    if (size <= 0) { break; }
+
+    for (ssize_t i = 0; i < size; i++) {
+      if (buf[i] == '\n') {
+        line.push_back('\0');
+        Post(line.data());
+        line.clear();
+      } else if (line.size() < kLineSize_ - 1) {
+        line.push_back(buf[i]);
+      }
+    }
+  }
+
+  // Tell the emulation thread that no more commands will come.
+  queue_.Post(std::vector<char>());
+  return;
+}
+
+/*
+ * Queues a line for the emulation thread.
+ */
+void TermDebugger::Post(const char *line) {
+  queue_.Post(std::vector<char>(line, line + strlen(line) + 1));
+  return;
+}
+
+/*
+ * Runs the commands entered by the user. A running console is first checked
+ * for a breakpoint which stopped it. While the console is stopped, waits a
+ * short time for a command to arrive, so that the emulation thread does not
+ * spin.
+ *
+ * Returns true if the console is stopped, and so must not be run.
+ */
+bool TermDebugger::Service(void) {
+  if (!attached_) { return false; }
+
+  // Report a breakpoint or jam which stopped the running console.
+  if (control_->CatchStop()) {
+    Stop();
+    Prompt();
+  }
+  if (!control_->IsHalted() && !queue_.IsPending()) { return false; }
+
+  if (control_->IsHalted()) { queue_.Wait(kWaitMs_); }
+  std::vector<char> line;
+  while (attached_ && queue_.Take(&line)) {
+    if (line.empty()) {
+      printf("\nStandard input closed. Detaching the debugger.\n");
+      Detach();
+    } else {
+      HandleLine(line.data());
+      if (control_->IsHalted() && ndb_running) { Prompt(); }
+    }
+  }
+  return control_->IsHalted();
+}
+
+/*
+ * Runs a single line, which holds a command and up to two arguments.
+ */
+void TermDebugger::HandleLine(char *line) {
+  char *save = NULL;
+  const char *kSpace = " \t\r";
+  const char *cmd = strtok_r(line, kSpace, &save);
+  if (cmd == NULL) { return; }
+  const char *arg = strtok_r(NULL, kSpace, &save);
+  const char *arg2 = (arg != NULL) ? strtok_r(NULL, kSpace, &save) : NULL;
+
+  // Commands which show the console can be run at any time, as they run
+  // between frames.
+  if (IsCommand(cmd, "help", "h")) {
+    ShowHelp();
+  } else if (IsCommand(cmd, "regs", "r")) {
+    ShowRegisters();
+  } else if (IsCommand(cmd, "list", "l")) {
+    ShowCode(arg);
+  } else if (IsCommand(cmd, "mem", "x")) {
+    ShowMemory(arg, arg2);
+  } else if (IsCommand(cmd, "ppu", "p")) {
+    ShowPpu();
+  } else if (IsCommand(cmd, "breaks", "bl")) {
+    ShowBreakpoints();
+  } else if (IsCommand(cmd, "break", "b")) {
+    HandleBreak(arg);
+  } else if (IsCommand(cmd, "delete", "d")) {
+    HandleDelete(arg);
+  } else if (IsCommand(cmd, "continue", "c")) {
+    HandleContinue();
+  } else if (IsCommand(cmd, "quit", "q")) {
+    ndb_running = false;
+  } else if (!IsCommand(cmd, "step", "s") && !IsCommand(cmd, "next", "n")
+             && !IsCommand(cmd, "scanline", "sl")) {
+    printf("Unknown command \"%s\". Type \"help\" for the commands.\n", cmd);
+  } else if (!control_->IsHalted()) {
+    // The rest run the console, and so need it to be stopped.
+    printf("The console is running. Stop it with \"break\" first.\n");
+  } else if (IsCommand(cmd, "step", "s")) {
+    HandleStep(arg);
+  } else if (IsCommand(cmd, "next", "n")) {
+    HandleNext();
+  } else {
+    HandleScanline(arg);
+  }
+  return;
+}
+
+/*
+ * Runs the given number of instructions, or one, stopping early on a
+ * breakpoint.
+ */
+void TermDebugger::HandleStep(const char *arg) {
+  size_t count = 1;
+  if ((arg != NULL) && (!ParseCount(arg, &count)
+                        || (count > kMaxStepCount_))) {
+    printf("Usage: step [count], with count at most %zu\n", kMaxStepCount_);
+    return;
+  }
+  for (size_t i = 0; (i < count) && control_->Step(); i++) { }
+  Stop();
+  return;
+}
+
+/*
+ * Runs the instruction at the PC. A call is run until it returns, by
+ * setting a breakpoint after it and running the console, so that the user
+ * can stop a call which never returns.
+ */
+void TermDebugger::HandleNext(void) {
+  CpuState state;
+  console_->GetCpu()->Inspect(&state);
+  if (console_->GetMemory()->Inspect(state.pc) != OPCODE_JSR) {
+    HandleStep(NULL);
+    return;
+  }
+
+  DoubleWord ret = static_cast<DoubleWord>(state.pc + JSR_SIZE);
+  step_over_id_ = control_->GetBreakpoints()->Add(ret, BREAK_ANY_BANK, NULL);
+  HandleContinue();
+  return;
+}
+
+/*
+ * Runs the console until the PPU starts the given scanline, then stops it
+ * at the next instruction. If the PPU is on the scanline already, it runs
+ * until the scanline comes around again.
+ */
+void TermDebugger::HandleScanline(const char *arg) {
+  size_t target;
+  if ((arg == NULL) || !ParseCount(arg, &target)) {
+    printf("Usage: scanline <line>\n");
+    return;
+  }
+
+  // Breakpoints may stop the console before it reaches the scanline.
+  console_->SetBreakpoints(control_->GetBreakpoints());
+  console_->Resume();
+  size_t scanline, dot;
+  console_->GetPpu()->GetPosition(&scanline, &dot);
+  bool left = (scanline != target);
+  bool reached = false;
+  for (size_t i = 0; (i < kMaxScanlineCycles_) && !reached; i++) {
+    console_->RunCycles(1);
+    if (console_->IsPaused() || console_->IsJammed()) { break; }
+    console_->GetPpu()->GetPosition(&scanline, &dot);
+    reached = left && (scanline == target);
+    left = left || (scanline != target);
+  }
+
+  if (!reached && !console_->IsPaused() && !console_->IsJammed()) {
+    printf("Scanline %zu was not reached in a frame.\n", target);
+  }
+  control_->Halt();
+  Stop();
+  return;
+}
+
+/*
+ * Runs the console until a breakpoint stops it, or the user does.
+ */
+void TermDebugger::HandleContinue(void) {
+  if (!control_->IsHalted()) {
+    printf("The console is already running.\n");
+    return;
+  }
+  control_->Continue();
+  UpdateBreakpoints();
+  return;
+}
+
+/*
+ * Stops the running console, or sets a breakpoint at the given address in
+ * any bank.
+ */
+void TermDebugger::HandleBreak(const char *arg) {
+  if (arg == NULL) {
+    if (control_->IsHalted()) {
+      printf("The console is already stopped.\n");
+    } else {
+      control_->Halt();
+      Stop();
+    }
+    return;
+  }
+
+  DoubleWord addr;
+  if (!ParseAddr(arg, &addr)) {
+    printf("Invalid address \"%s\".\n", arg);
+    return;
+  }
+  size_t id = control_->GetBreakpoints()->Add(addr, BREAK_ANY_BANK, NULL);
+  printf("Breakpoint %zu at $%04x.\n", id, addr);
+  UpdateBreakpoints();
+  return;
+}
+
+/*
+ * Deletes the breakpoint with the given id.
+ */
+void TermDebugger::HandleDelete(const char *arg) {
+  size_t id;
+  if ((arg == NULL) || !ParseCount(arg, &id)) {
+    printf("Usage: delete <id>\n");
+    return;
+  }
+  if ((id == step_over_id_) || !control_->GetBreakpoints()->Remove(id)) {
+    printf("There is no breakpoint %zu.\n", id);
+    return;
+  }
+  UpdateBreakpoints();
+  return;
+}
+
+/*
+ * Removes the breakpoints from the console, and lets it run without the
+ * debugger.
+ */
+void TermDebugger::Detach(void) {
+  if (!attached_) { return; }
+  control_->Release();
+  attached_ = false;
+  return;
+}
+
+/*
+ * Shows the registers of the CPU, with each flag of the status register
+ * named in upper case when set.
+ */
+void TermDebugger::ShowRegisters(void) {
+  CpuState state;
+  console_->GetCpu()->Inspect(&state);
+  char flags[sizeof(P_FLAG_NAMES)];
+  for (size_t i = 0; i < sizeof(flags) - 1; i++) {
+    bool set = (state.p >> (7U - i)) & 1U;
+    char name = P_FLAG_NAMES[i];
+    flags[i] = set ? name : static_cast<char>(tolower(name));
+  }
+  flags[sizeof(flags) - 1] = '\0';
+  printf("PC $%04x  A $%02x  X $%02x  Y $%02x  S $%02x  P $%02x [%s]\n",
+         state.pc, state.a, state.x, state.y, state.s, state.p, flags);
+  return;
+}
+
+/*
+ * Lists the code around the PC, or from the given address.
+ */
+void TermDebugger::ShowCode(const char *arg) {
+  CpuState state;
+  console_->GetCpu()->Inspect(&state);
+  DoubleWord addr = state.pc;
+  if ((arg != NULL) && !ParseAddr(arg, &addr)) {
+    printf("Invalid address \"%s\".\n", arg);
+    return;
+  }
+
+  size_t bank = console_->GetMemory()->GetPrgBank(addr);
+  char *text = (arg == NULL)
+             ? disas_->DisassembleAround(addr, bank, kListBefore_, kListSize_)
+             : disas_->Disassemble(addr, bank, kListSize_);
+  fputs(text, stdout);
+  delete[] text;
+  return;
+}
+
+/*
+ * Dumps the given number of bytes of CPU memory from the given address,
+ * wrapping around the end of memory. No more than all of memory is dumped.
+ */
+void TermDebugger::ShowMemory(const char *addr_arg, const char *count_arg) {
+  DoubleWord addr;
+  size_t count = kDumpSize_;
+  if ((addr_arg == NULL) || !ParseAddr(addr_arg, &addr)
+      || ((count_arg != NULL) && !ParseCount(count_arg, &count))
+      || (count > kMaxDumpSize_)) {
+    printf("Usage: mem <addr> [len], with len at most %zu\n", kMaxDumpSize_);
+    return;
+  }
+
+  Memory *memory = console_->GetMemory();
+  for (size_t i = 0; i < count; i++) {
+    DoubleWord byte_addr = static_cast<DoubleWord>(addr + i);
+    if ((i % kDumpLineSize_) == 0) {
+      printf("%s$%04x:", (i > 0) ? "\n" : "", byte_addr);
+    }
+    printf(" %02x", memory->Inspect(byte_addr));
+  }
+  printf("\n");
+  return;
+}
+
+/*
+ * Shows the position of the PPU, and the registers which control what it
+ * draws.
+ */
+void TermDebugger::ShowPpu(void) {
+  Ppu *ppu = console_->GetPpu();
+  size_t scanline, dot;
+  ppu->GetPosition(&scanline, &dot);
+  PpuState state;
+  ppu->Inspect(&state);
+  bool vblank = (scanline >= VBLANK_FIRST_LINE)
+             && (scanline <= VBLANK_LAST_LINE);
+  printf("Scanline %zu, dot %zu%s\n", scanline, dot,
+         vblank ? " (vblank)" : "");
+  printf("PPUCTRL $%02x  PPUMASK $%02x  Scroll $%04x  Fine X %d\n",
+         state.ctrl, state.mask, state.scroll_addr, state.fine_x);
+  printf("NMI %s, background %s, sprites %s\n",
+         (state.ctrl & 0x80U) ? "on" : "off",
+         (state.mask & 0x08U) ? "on" : "off",
+         (state.mask & 0x10U) ? "on" : "off");
+  return;
+}
+
+/*
+ * Lists the breakpoints set by the user.
+ */
+void TermDebugger::ShowBreakpoints(void) {
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  size_t shown = 0;
+  for (size_t i = 0; i < breakpoints->GetCount(); i++) {
+    const Breakpoint *point = breakpoints->Get(i);
+    if (point->id == step_over_id_) { continue; }
+    printf("%zu: $%04x, hit %zu times\n", point->id, point->addr,
+           point->hits);
+    shown++;
+  }
+  if (shown == 0) { printf("No breakpoints are set.\n"); }
+  return;
+}
+
+/*
+ * Lists the commands.
+ */
+void TermDebugger::ShowHelp(void) {
+  fputs(kHelpText, stdout);
+  return;
+}
+
+/*
+ * Shows where the held console stopped and why. The breakpoint set to step
+ * over a call is removed once anything stops the console.
+ */
+void TermDebugger::Stop(void) {
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  size_t hit = breakpoints->GetHit();
+  if (console_->IsJammed()) {
+    printf("The CPU is jammed, and cannot run further.\n");
+  } else if (console_->IsPaused() && (hit != 0) && (hit != step_over_id_)) {
+    printf("Breakpoint %zu.\n", hit);
+  }
+  if (step_over_id_ != 0) {
+    breakpoints->Remove(step_over_id_);
+    step_over_id_ = 0;
+  }
+
+  CpuState state;
+  console_->GetCpu()->Inspect(&state);
+  char *text = disas_->Disassemble(state.pc,
+                   console_->GetMemory()->GetPrgBank(state.pc), 1);
+  fputs(text, stdout);
+  delete[] text;
+  ShowRegisters();
+  return;
+}
+
+/*
+ * Gives the breakpoints to the console while any are set, or while the
+ * console is stopped, and takes them away otherwise, so that the CPU never
+ * checks an empty set.
+ */
+void TermDebugger::UpdateBreakpoints(void) {
+  Breakpoints *breakpoints = control_->GetBreakpoints();
+  bool needed = control_->IsHalted() || (breakpoints->GetCount() > 0);
+  console_->SetBreakpoints(needed ? breakpoints : NULL);
+  return;
+}
+
+/*
+ * Prints the prompt for the next command. The prompt is only shown while the
+ * console is stopped, though commands are read while it runs.
+ */
+void TermDebugger::Prompt(void) {
+  printf("(ndb) ");
+  fflush(stdout);
+  return;
+}
+
+/*
+ * Checks if the given command is the given name, or its alias.
+ */
+static bool IsCommand(const char *cmd, const char *name, const char *alias) {
+  return StrEq(cmd, name) || StrEq(cmd, alias);
+}
+
+/*
+ * Parses an address of CPU memory, in hex. A leading "$" or "0x" is
+ * allowed.
+ *
+ * Returns false if the text is not an address.
+ */
+static bool ParseAddr(const char *text, DoubleWord *addr) {
+  if (*text == '$') { text++; }
+  char *end = NULL;
+  unsigned long val = strtoul(text, &end, 16);
+  if ((end == text) || (*end != '\0') || (val > 0xFFFFUL)) { return false; }
+  *addr = static_cast<DoubleWord>(val);
+  return true;
+}
+
+/*
+ * Parses a count, in decimal.
+ *
+ * Returns false if the text is not a count.
+ */
+static bool ParseCount(const char *text, size_t *count) {
+  char *end = NULL;
+  unsigned long val = strtoul(text, &end, 10);
+  if ((end == text) || (*end != '\0') || (*text == '-')) { return false; }
+  *count = static_cast<size_t>(val);
+  return true;
+}
+
+/*
+ * Stops reading standard input, then removes the breakpoints from the
+ * console, which must outlive the debugger.
+ */
+TermDebugger::~TermDebugger(void) {
+  closing_.store(true);
+  input_thread_.join();
+  Detach();
+  delete control_;
+  delete disas_;
+  return;
+}
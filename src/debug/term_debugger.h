@@ -0,0 +1,127 @@
+#ifndef _NES_TERMDEBUG
+#define _NES_TERMDEBUG
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../core/console.h"
+#include "./debug_control.h"
+#include "./disas_cache.h"
+#include "../util/data.h"
+
+/*
+ * Debugs the console from the terminal, with a line of commands at a time
+ * read from standard input. The console can be stopped, stepped over and
+ * into calls, run to a scanline, and given breakpoints, and its registers,
+ * code, memory, and PPU can be shown.
+ *
+ * Standard input is read by a thread of its own, which queues each line for
+ * the emulation thread. The emulation thread serves the queue between
+ * frames, and so commands are run while no frame is. While the console is
+ * stopped, the emulation thread waits on the queue instead of running it.
+ */
+class TermDebugger {
+  private:
+    // The longest line the debugger reads, in bytes.
+    static const size_t kLineSize_ = 256;
+
+    // The longest the input thread waits on standard input, and the longest
+    // a stopped emulation thread waits for a command, in milliseconds.
+    static const int kPollMs_ = 100;
+    static const int kWaitMs_ = 16;
+
+    // The most cycles run while waiting for a scanline, which is more than
+    // a frame of any console.
+    static const size_t kMaxScanlineCycles_ = 40000;
+
+    // The most instructions a single step command runs, as nothing can
+    // interrupt the command once it runs.
+    static const size_t kMaxStepCount_ = 0x10000;
+
+    // The number of instructions listed around the PC, and how many of them
+    // come before it.
+    static const size_t kListSize_ = 10;
+    static const size_t kListBefore_ = 3;
+
+    // The number of bytes dumped when no count is given, the most dumped
+    // at once, which is all of CPU memory, and the number on each line.
+    static const size_t kDumpSize_ = 64;
+    static const size_t kMaxDumpSize_ = 0x10000;
+    static const size_t kDumpLineSize_ = 16;
+
+    // The console being debugged.
+    Console *console_;
+
+    // Stops and steps the console, and holds the breakpoints of the user.
+    // The breakpoints are only given to the console while any are set, or
+    // while it is stopped.
+    DebugControl *control_;
+
+    // The id of the breakpoint stepping over a call sets after it, or zero.
+    size_t step_over_id_ = 0;
+
+    // Decodes the instructions listed around the PC.
+    DisasCache *disas_;
+
+    // Lines waiting for the emulation thread. A line without even a
+    // terminator marks the end of standard input.
+    DebugQueue<std::vector<char>> queue_;
+
+    // Cleared once standard input is closed. Only used by the emulation
+    // thread.
+    bool attached_ = true;
+
+    // Reads standard input until the debugger is deleted.
+    std::atomic<bool> closing_;
+    std::thread input_thread_;
+
+    // Reads lines from standard input. Executed on its own thread.
+    void RunInput(void);
+    void Post(const char *line);
+
+    // Runs a line of commands on the emulation thread.
+    void HandleLine(char *line);
+    void HandleStep(const char *arg);
+    void HandleNext(void);
+    void HandleScanline(const char *arg);
+    void HandleContinue(void);
+    void HandleBreak(const char *arg);
+    void HandleDelete(const char *arg);
+    void Detach(void);
+
+    // Shows the state of the console.
+    void ShowRegisters(void);
+    void ShowCode(const char *arg);
+    void ShowMemory(const char *addr_arg, const char *count_arg);
+    void ShowPpu(void);
+    void ShowBreakpoints(void);
+    void ShowHelp(void);
+
+    // Reports why the console stopped, and where.
+    void Stop(void);
+
+    // Gives the breakpoints to the console while they are needed.
+    void UpdateBreakpoints(void);
+
+    // Prints the prompt for the next command.
+    void Prompt(void);
+
+  public:
+    // Starts reading commands for the given console, which is stopped
+    // before it runs its first instruction.
+    TermDebugger(Console *console);
+
+    // Runs the commands of the user. Called by the emulation thread between
+    // frames. Returns true while the console is stopped, in which case the
+    // frame must not be run.
+    bool Service(void);
+
+    // Stops reading commands, and removes the breakpoints from the console.
+    ~TermDebugger(void);
+};
+
+#endif
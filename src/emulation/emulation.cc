@@ -9,30 +9,59 @@
 #include <cstdint>
 #include <cstdio>
 #include <ctime>
+#include <thread>
 
 #include "../config/config.h"
 #include "../sdl/window.h"
 #include "../sdl/renderer.h"
 #include "../sdl/audio_player.h"
 #include "../sdl/input.h"
-#include "../memory/memory.h"
-#include "../cpu/cpu.h"
-#include "../ppu/ppu.h"
-#include "../apu/apu.h"
+#include "../core/console.h"
+#include "../cpu/trace_log.h"
+#include "../cpu/code_data_log.h"
+#include "../debug/disas_cache.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_writer.h"
+#include "./frame_log.h"
+#include "./frame_pacer.h"
+#include "../debug/ppu_viewer.h"
+#include "../debug/gdb_stub.h"
+#include "../debug/term_debugger.h"
+#include "../netplay/net_transport.h"
+#include "../netplay/rollback_session.h"
 #include "../util/contracts.h"
 #include "../util/util.h"
 #include "./signals.h"
 
-// The frame rate of the NES.
+// The nominal frame rate of the NES, used to update the frame counter.
 #define NES_FRAME_RATE 60L
 
+// The CPU clock rate of each console timing, in Hz, and its frame rate as
+// a fraction, which recorded videos are stamped with.
+#define NTSC_CPU_CLOCK 1789772.7272
+#define NTSC_FRAME_RATE_NUM 39375000U
+#define NTSC_FRAME_RATE_DEN 655171U
+#define PAL_CPU_CLOCK 1662607.0
+#define PAL_FRAME_RATE_NUM 50007U
+#define PAL_FRAME_RATE_DEN 1000U
+#define DENDY_CPU_CLOCK 1773447.5
+#define DENDY_FRAME_RATE_NUM 50007U
+#define DENDY_FRAME_RATE_DEN 1000U
+
+// The largest difference between the refresh rate of the display and the
+// frame rate of the console which can be corrected by syncing to the display.
+#define MAX_DISPLAY_SYNC_ERROR 0.02
+
 // The number of nanoseconds in a second.
 #define NSECS_PER_SEC (1000000000L)
 
-// The number of CPU cycles that will be emulated per emulation cycle.
-// With the current timing system, this must be set to one 60th of the
-// 2A03 clock rate.
-#define EMU_CYCLE_SIZE 29830
+// The number of milliseconds the presenter waits for a new frame before
+// presenting the previous frame again. Two frames of the NES.
+#define PRESENT_TIMEOUT_MS 33U
+
+// The frames of input delay used by netplay when none is configured. A frame
+// of delay hides a frame of latency without rolling back.
+#define NET_DEFAULT_DELAY "1"
 
 /*
  * Attempts to create an emulation object using the given configuration object
@@ -42,116 +71,396 @@
  * emulation cannot be created.
  */
 Emulation *Emulation::Create(FILE *rom, Config *config) {
-  // Attempt to create the SDL window.
-  Window *window = Window::Create(config);
+  // Parse the settings used after startup, then attempt to create the SDL
+  // window with them.
+  Settings *settings = new Settings(config);
+  Window *window = Window::Create(settings);
   if (window == NULL) {
     fprintf(stderr, "Error: failed to create SDL window.\n");
+    delete settings;
     return NULL;
   }
 
-  // Attempt to create a Memory object with the given rom file.
-  Memory *memory = Memory::Create(rom, config);
-  if (memory == NULL) {
-    fprintf(stderr, "Error: Failed to create emulated memory for rom.\n");
+  // Only one debugger can hold the console, and neither can during netplay,
+  // as the peer would not wait on it.
+  bool netplay = (config->Get(kNetRemoteKey) != NULL);
+  bool terminal = StrEq(config->Get(kTermDebuggerKey, kTermDebuggerOffVal),
+                        kTermDebuggerOnVal);
+  const char *debugger_addr = config->Get(kDebuggerKey);
+  if (netplay && (terminal || (debugger_addr != NULL))) {
+    fprintf(stderr, "Error: a debugger cannot be used during netplay.\n");
+    delete window;
+    delete settings;
+    return NULL;
+  } else if (terminal && (debugger_addr != NULL)) {
+    fprintf(stderr, "Error: the terminal debugger cannot be used with a "
+                    "remote debugger.\n");
     delete window;
+    delete settings;
     return NULL;
   }
 
-  // Create the NES APU, CPU, and PPU.
-  Cpu *cpu = new Cpu();
-  Ppu *ppu = new Ppu();
-  Apu *apu = new Apu();
+  // Attempt to create the frame log, if frames are being logged. Frame logs
+  // cannot be checked during netplay, as the inputs depend on the peer.
+  FrameLog *frame_log = NULL;
+  const char *log_path = config->Get(kHashLogKey);
+  const char *golden_path = config->Get(kHashGoldenKey);
+  if (netplay && ((log_path != NULL) || (golden_path != NULL))) {
+    fprintf(stderr, "Error: frame logs cannot be used during netplay.\n");
+    delete window;
+    delete settings;
+    return NULL;
+  } else if ((log_path != NULL) || (golden_path != NULL)) {
+    frame_log = FrameLog::Create(log_path, golden_path, window->GetInput());
+    if (frame_log == NULL) {
+      delete window;
+      delete settings;
+      return NULL;
+    }
+    RandSeed(FRAME_LOG_SEED);
+  }
 
-  // Connect all of the emulated NES systems together.
-  window->GetRenderer()->SetPalette(memory->PaletteExpose());
-  memory->AddController(window->GetInput());
-  memory->Connect(cpu, ppu, apu);
-  cpu->Connect(memory);
-  ppu->Connect(memory, window->GetRenderer(), &(cpu->nmi_line_));
-  apu->Connect(memory, window->GetAudioPlayer(), &(cpu->irq_line_));
+  // Attempt to load the rom into an emulated console. When frames are
+  // logged, the console polls the buttons latched by the log. During
+  // netplay, the console is created and owned by the session.
+  RollbackSession *session = NULL;
+  Console *console = NULL;
+  if (netplay) {
+    session = CreateSession(rom, config, window);
+    if (session != NULL) { console = session->GetConsole(); }
+  } else {
+    InputSource *input = window->GetInput();
+    if (frame_log != NULL) { input = frame_log; }
+    console = Console::Create(rom, input, window->GetAudioPlayer());
+  }
+  if (console == NULL) {
+    delete frame_log;
+    delete window;
+    delete settings;
+    return NULL;
+  }
+  console->SetFrameRecorder(frame_log);
+
+  // Attempt to open the trace log, if instructions are being traced.
+  TraceLog *trace_log = NULL;
+  const char *trace_path = config->Get(kTraceLogKey);
+  if (trace_path != NULL) {
+    trace_log = TraceLog::Create(trace_path);
+    if (trace_log == NULL) {
+      if (session != NULL) { delete session; } else { delete console; }
+      delete frame_log;
+      delete window;
+      delete settings;
+      return NULL;
+    }
+    console->SetTraceLog(trace_log);
+  }
 
-  // Prepare the CPU for the emulation.
-  cpu->Power();
+  // Mark the code the console runs, if the rom is disassembled once the
+  // emulation ends.
+  CodeDataLog *code_log = NULL;
+  if (config->Get(kDisasExportKey) != NULL) {
+    code_log = new CodeDataLog(console->GetMemory());
+    console->SetCodeDataLog(code_log);
+  }
+
+  // Listen for a remote debugger, if one was requested.
+  GdbStub *debugger = NULL;
+  if (debugger_addr != NULL) {
+    debugger = GdbStub::Create(debugger_addr, console);
+    if (debugger == NULL) {
+      if (session != NULL) { delete session; } else { delete console; }
+      delete frame_log;
+      delete trace_log;
+      delete code_log;
+      delete window;
+      delete settings;
+      return NULL;
+    }
+    fprintf(GetStatusStream(settings), "Waiting for a debugger on %s.\n",
+            debugger_addr);
+  }
+
+  // Read debugging commands from the terminal, if requested.
+  TermDebugger *term_debugger = NULL;
+  if (terminal) { term_debugger = new TermDebugger(console); }
+
+  // Determine the clock and frame rate of the console the rom expects.
+  double cpu_clock = NTSC_CPU_CLOCK;
+  uint32_t rate_num = NTSC_FRAME_RATE_NUM;
+  uint32_t rate_den = NTSC_FRAME_RATE_DEN;
+  switch (console->GetTimingMode()) {
+    case PAL:
+      cpu_clock = PAL_CPU_CLOCK;
+      rate_num = PAL_FRAME_RATE_NUM;
+      rate_den = PAL_FRAME_RATE_DEN;
+      break;
+    case DENDY:
+      cpu_clock = DENDY_CPU_CLOCK;
+      rate_num = DENDY_FRAME_RATE_NUM;
+      rate_den = DENDY_FRAME_RATE_DEN;
+      break;
+    default:
+      break;
+  }
+  double frame_rate = static_cast<double>(rate_num) / rate_den;
+  window->GetRenderer()->SetFrameRate(rate_num, rate_den);
+
+  // The pacer is set to the speed in the settings by the emulation object.
+  FramePacer *pacer = new FramePacer(frame_rate);
+
+  // Open the PPU viewer, if it was requested.
+  PpuViewer *viewer = NULL;
+  if (StrEq(config->Get(kPpuViewerKey, kPpuViewerOffVal), kPpuViewerOnVal)) {
+    viewer = new PpuViewer(settings->palette_file);
+    if (!window->OpenDebugWindow(viewer)) {
+      fprintf(stderr, "Warning: Failed to open the PPU viewer.\n");
+      delete viewer;
+      viewer = NULL;
+    }
+  }
 
   // Create and return an emulation object.
-  return new Emulation(window, memory, cpu, ppu, apu);
+  return new Emulation(window, console, frame_log, trace_log, code_log,
+                       debugger, term_debugger, viewer, pacer, session,
+                       config, settings, cpu_clock, frame_rate);
 }
 
 /*
- * Uses the provided objects to create an emulation object.
+ * Returns the stream messages about the emulation are printed to, which is
+ * standard error if frames are captured to standard output.
  */
-Emulation::Emulation(Window *window, Memory *memory,
-                     Cpu *cpu, Ppu *ppu, Apu *apu) {
+FILE *Emulation::GetStatusStream(const Settings *settings) {
+  bool captured = FrameWriter::WritesToStdout(settings->capture_format,
+                                              settings->capture_path);
+  return captured ? stderr : stdout;
+}
+
+/*
+ * Creates a netplay session from the addresses, player, input delay, and
+ * simulated network conditions in the configuration. The window provides
+ * the local input and plays the audio.
+ *
+ * Returns NULL on failure.
+ */
+RollbackSession *Emulation::CreateSession(FILE *rom, Config *config,
+                                          Window *window) {
+  const char *local = config->Get(kNetLocalKey);
+  if (local == NULL) {
+    fprintf(stderr, "Error: netplay needs a local address to bind to.\n");
+    return NULL;
+  }
+
+  NetConditions conditions;
+  conditions.latency_ms = strtoul(config->Get(kNetLatencyKey, "0"), NULL, 10);
+  conditions.jitter_ms = strtoul(config->Get(kNetJitterKey, "0"), NULL, 10);
+  conditions.loss_percent = strtoul(config->Get(kNetLossKey, "0"), NULL, 10);
+  NetTransport *transport = NetTransport::Create(local,
+                                config->Get(kNetRemoteKey), &conditions);
+  if (transport == NULL) { return NULL; }
+
+  // Players are numbered from one by the user.
+  size_t player = strtoul(config->Get(kNetPlayerKey, "1"), NULL, 10);
+  size_t delay = strtoul(config->Get(kNetDelayKey, NET_DEFAULT_DELAY),
+                         NULL, 10);
+  return RollbackSession::Create(rom, window->GetInput(),
+                                 window->GetAudioPlayer(), transport,
+                                 player - 1, delay);
+}
+
+/*
+ * Uses the provided objects to create an emulation object, then paces it
+ * as given by the settings.
+ */
+Emulation::Emulation(Window *window, Console *console, FrameLog *frame_log,
+                     TraceLog *trace_log, CodeDataLog *code_log,
+                     GdbStub *debugger, TermDebugger *terminal,
+                     PpuViewer *viewer, FramePacer *pacer,
+                     RollbackSession *session, Config *config,
+                     Settings *settings, double cpu_clock,
+                     double frame_rate) {
   window_ = window;
-  memory_ = memory;
-  cpu_ = cpu;
-  ppu_ = ppu;
-  apu_ = apu;
+  console_ = console;
+  frame_buffer_ = console->GetFrameBuffer();
+  frame_log_ = frame_log;
+  trace_log_ = trace_log;
+  code_log_ = code_log;
+  debugger_ = debugger;
+  terminal_ = terminal;
+  viewer_ = viewer;
+  pacer_ = pacer;
+  session_ = session;
+  config_ = config;
+  settings_ = settings;
+  frame_rate_ = frame_rate;
+  status_ = GetStatusStream(settings);
+
+  // Captured frames must never be dropped, so the emulation waits for the
+  // presenter to take each one.
+  if (settings->capture_format != NULL) { frame_buffer_->SetBlocking(true); }
+  cycles_per_frame_ = cpu_clock / frame_rate;
+  ApplySpeed();
   return;
 }
 
 /*
- * Runs the main emulation loop.
- * Returns when a termination signal is received.
+ * Paces the emulation to the speed in the settings. When syncing to the
+ * display, frames are paced to its refresh rate if it is close to that of
+ * the console. The audio is resampled to match the pace.
+ */
+void Emulation::ApplySpeed(void) {
+  double pace_rate = frame_rate_;
+  if (settings_->display_sync) {
+    double refresh_rate = window_->GetRefreshRate();
+    double error = (refresh_rate - frame_rate_) / frame_rate_;
+    if ((error <= MAX_DISPLAY_SYNC_ERROR)
+        && (error >= -MAX_DISPLAY_SYNC_ERROR)) {
+      pace_rate = refresh_rate;
+    } else {
+      fprintf(stderr, "Warning: Display refresh rate is too far from the "
+                      "console frame rate to sync to it.\n");
+    }
+  }
+  pace_rate *= settings_->speed;
+  pacer_->SetFrameRate(pace_rate);
+  window_->GetAudioPlayer()->SetSpeed(pace_rate / frame_rate_);
+  return;
+}
+
+/*
+ * Reloads the configuration file, and applies its settings to the running
+ * emulation. The emulation thread is never stopped; the settings it uses
+ * are changed atomically.
+ *
+ * Must be called from the presenter thread.
+ */
+void Emulation::ReloadConfig(void) {
+  config_->Reload();
+  Settings *settings = new Settings(config_);
+  window_->ApplySettings(settings, settings_);
+  delete settings_;
+  settings_ = settings;
+  ApplySpeed();
+  return;
+}
+
+/*
+ * Runs the emulation on its own thread, and presents the frames it
+ * produces on the calling thread. Returns when a termination signal is
+ * received.
+ *
+ * SDL requires events to be processed and frames to be rendered on the
+ * thread which created the window, so this must be called from that thread.
  *
  * Assumes signals have been initialized.
  */
 void Emulation::Run(void) {
-  while (ndb_running) {
-    // Syncs the emulation to 60 FPS, when possible.
-    SyncFrameRate();
+  std::thread emulation_thread(&Emulation::RunEmulation, this);
+  RunPresenter();
+
+  // The presenter takes no more frames, so the emulation must not wait for
+  // it to.
+  frame_buffer_->SetBlocking(false);
+  emulation_thread.join();
+
+  // Report a golden frame log which was checked to its end.
+  if ((frame_log_ != NULL) && frame_log_->IsDone()
+                           && !frame_log_->HasDiverged()) {
+    fprintf(status_, "Matched all %zu frames of the golden file.\n",
+            frame_log_->GetFramesChecked());
+  }
 
-    // Updates the frame rate display.
-    UpdateFrameCounter();
+  // Report how much work netplay did to hide the latency of the peer.
+  if (session_ != NULL) {
+    NetplayStats stats;
+    session_->GetStats(&stats);
+    fprintf(status_, "Netplay ran %zu frames, with %zu rollbacks simulating "
+            "%zu frames again, and waited on the peer for %zu frames.\n",
+            stats.frames, stats.rollbacks, stats.frames_resimulated,
+            stats.stalls);
+  }
+  return;
+}
 
-    // Processes any events on the SDL queue.
-    window_->ProcessEvents();
+/*
+ * Checks if the frame log stopped the emulation because a frame differed
+ * from its golden file.
+ */
+bool Emulation::HasDiverged(void) {
+  return (frame_log_ != NULL) && frame_log_->HasDiverged();
+}
+
+/*
+ * Runs the main emulation loop. Only waits on the presenter while frames
+ * are captured.
+ * When frames are being logged, the emulation is not paced, so that
+ * logs can be checked as quickly as possible. During netplay, the session
+ * runs the console a frame at a time. While a debugger holds the console
+ * stopped, no frames are run.
+ */
+void Emulation::RunEmulation(void) {
+  while (ndb_running) {
+    // Serves the debuggers, which may hold the console stopped.
+    if ((debugger_ != NULL) && debugger_->Service()) { continue; }
+    if ((terminal_ != NULL) && terminal_->Service()) { continue; }
+
+    // Syncs the emulation to the frame rate of the console, when possible.
+    if (frame_log_ == NULL) { pacer_->Wait(); }
 
     // Executes the next frame of emulation.
-    RunEmulationCycle();
+    if (session_ != NULL) {
+      session_->AdvanceFrame();
+    } else {
+      RunEmulationCycle();
+    }
+
+    // Stops the emulation once a golden frame log has been checked.
+    if ((frame_log_ != NULL) && frame_log_->IsDone()) { ndb_running = false; }
+
+    // Hands the PPU memory to the viewer, if it is waiting for it.
+    if (viewer_ != NULL) {
+      viewer_->Capture(console_->GetMemory(), console_->GetPpu());
+    }
   }
   return;
 }
 
 /*
- * Ensures that the program waits at least 1/60 seconds between calls
- * to this function. Used to time emulation.
+ * Runs the main presentation loop. Each completed frame is presented once.
+ * If the emulation fails to complete a frame in time, the previous frame
+ * is presented again so that the window continues to update. Reloads of
+ * the configuration are applied between frames.
  */
-void Emulation::SyncFrameRate(void) {
-  // Determine the minimum time at which this function can return.
-  EmuTime wait_spec = { 0, NSECS_PER_SEC / NES_FRAME_RATE };
-  wait_spec.tv_sec = last_sync_time_.tv_sec;
-  wait_spec.tv_nsec += last_sync_time_.tv_nsec;
-  if (wait_spec.tv_nsec >= NSECS_PER_SEC) {
-    wait_spec.tv_nsec -= NSECS_PER_SEC;
-    wait_spec.tv_sec++;
-  }
+void Emulation::RunPresenter(void) {
+  while (ndb_running) {
+    // Applies the configuration file again, if a reload was signaled.
+    if (reload_config.exchange(false)) { ReloadConfig(); }
 
-  // Pause the program until the minimum time has been reached.
-  EmuTime current_time, diff;
-  TimeGet(&current_time);
-  if (TimeGt(&wait_spec, &current_time)) {
-    TimeDiff(&wait_spec, &current_time, &diff);
-    nanosleep(&diff, NULL);
-
-    // Update the last call time with the target of the wait spec.
-    last_sync_time_.tv_sec = wait_spec.tv_sec;
-    last_sync_time_.tv_nsec = wait_spec.tv_nsec;
-  } else {
-    // If we didn't meet timing, we just update the time and return.
-    last_sync_time_.tv_sec = current_time.tv_sec;
-    last_sync_time_.tv_nsec = current_time.tv_nsec;
-  }
+    // Processes any events on the SDL queue.
+    window_->ProcessEvents();
+
+    // Wait for the next frame, and present it.
+    const NesFrame *frame = frame_buffer_->SwapPresentFrame(PRESENT_TIMEOUT_MS);
+    if (frame == NULL) {
+      frame = frame_buffer_->GetPresentFrame();
+      frames_repeated_++;
+    }
+    window_->GetRenderer()->DrawFrame(frame);
+    window_->DrawDebugWindow();
 
+    // Updates the frame rate display.
+    UpdateFrameCounter(frame);
+  }
   return;
 }
 
 /*
  * Updates the SDL window with the current running frame rate every
- * 60 frames.
+ * 60 presented frames. The frame rate is measured from the number of
+ * frames completed by the emulation, rather than the number presented.
  */
-void Emulation::UpdateFrameCounter(void) {
-  // Counts how many frames have been run.
+void Emulation::UpdateFrameCounter(const NesFrame *frame) {
+  // Counts how many frames have been presented.
   frames_counted_++;
 
   // Determine if it is time to update the frame rate display.
@@ -163,8 +472,19 @@ void Emulation::UpdateFrameCounter(void) {
     float secs_passed = (static_cast<float>(diff.tv_sec))
                       + ((static_cast<float>(diff.tv_nsec))
                       / (static_cast<float>(NSECS_PER_SEC)));
-    window_->DisplayFps((static_cast<float>(frames_counted_)) / secs_passed);
+    float frames_run = static_cast<float>(frame->number - last_frame_number_);
+    size_t frames_dropped = frame_buffer_->GetDroppedFrames();
+    PacingStats pacing;
+    pacer_->GetStats(&pacing);
+    FrameStats stats = { frames_run / secs_passed,
+                         frames_dropped - last_frames_dropped_,
+                         frames_repeated_, pacing.mean_jitter_us,
+                         pacing.max_jitter_us };
+    window_->DisplayStats(&stats);
     frames_counted_ = 0;
+    last_frame_number_ = frame->number;
+    last_frames_dropped_ = frames_dropped;
+    frames_repeated_ = 0;
 
     // Update the last called time.
     last_frame_time_.tv_sec = current_time.tv_sec;
@@ -218,49 +538,36 @@ void Emulation::TimeDiff(EmuTime *time1, EmuTime *time2, EmuTime *res) {
 }
 
 /*
- * Runs the NES emulation for 1/60th of its clock rate.
+ * Runs the NES emulation for a single frame of its clock rate.
  */
 void Emulation::RunEmulationCycle(void) {
-  size_t cycles_remaining = EMU_CYCLE_SIZE;
-  size_t sync_cycles = 0;
-  size_t scheduled_cycles = 0;
-  size_t cpu_cycles = 0;
-  size_t apu_cycles = 0;
-  size_t ppu_cycles = 0;
-
-  /*
-   * In order to increase cache hits during emulation, some math is done to
-   * determine how long the individual chips can be run in isolation. Running
-   * them this way prevents the memory systems of the other chips from causing
-   * cache misses as often.
-   */
-  while (cycles_remaining > 0) {
-    // Emulate the system with all cycles synced.
-    sync_cycles = MIN(sync_cycles, cycles_remaining);
-    for (size_t i = 0; i < sync_cycles; i++) {
-      // The PPU is clocked at 3x the rate of the CPU.
-      cpu_->RunCycle();
-      apu_->RunCycle();
-      ppu_->RunSchedule(3U);
-    }
-    cycles_remaining -= sync_cycles;
-
-    // Check if the synchronized execution finished this emulation cycle.
-    if (cycles_remaining <= 0) { return; }
-
-    // Determine how long the emulation can run out of sync.
-    ppu_cycles = ppu_->Schedule();
-    apu_cycles = apu_->Schedule();
-    scheduled_cycles = MIN(ppu_cycles, apu_cycles);
-
-    // Run the CPU, then catch up the APU and PPU.
-    cpu_cycles = cpu_->RunSchedule(MIN(scheduled_cycles, cycles_remaining),
-                                   sync_cycles);
-    for (size_t i = 0; i < cpu_cycles; i++) { apu_->RunCycle(); }
-    ppu_->RunSchedule(cpu_cycles * 3U);
-    cycles_remaining -= cpu_cycles;
+  // Carry the fraction of a cycle left over by each frame into the next.
+  double frame_cycles = cycles_per_frame_ + cycle_remainder_;
+  size_t cycles = static_cast<size_t>(frame_cycles);
+  cycle_remainder_ = frame_cycles - static_cast<double>(cycles);
+  console_->RunCycles(cycles);
+  return;
+}
+
+/*
+ * Writes a disassembly of the rom to the path in the configuration. The
+ * code/data log tells the code the console ran from its data.
+ */
+void Emulation::ExportDisassembly(void) {
+  const char *path = config_->Get(kDisasExportKey);
+  if (path == NULL) { return; }
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Failed to open %s to write the disassembly.\n",
+            path);
+    return;
   }
 
+  DisasCache cache(console_->GetMemory(), code_log_);
+  if (!cache.Export(file)) {
+    fprintf(stderr, "Error: Failed to write the disassembly to %s.\n", path);
+  }
+  fclose(file);
   return;
 }
 
@@ -268,10 +575,20 @@ void Emulation::RunEmulationCycle(void) {
  * Deletes the calling Emulation object.
  */
 Emulation::~Emulation(void) {
-  delete apu_;
-  delete ppu_;
-  delete cpu_;
-  delete memory_;
+  if (debugger_ != NULL) { delete debugger_; }
+  if (terminal_ != NULL) { delete terminal_; }
+  if (code_log_ != NULL) { ExportDisassembly(); }
+  if (session_ != NULL) {
+    delete session_;
+  } else {
+    delete console_;
+  }
+  delete frame_log_;
+  delete trace_log_;
+  delete code_log_;
+  delete pacer_;
   delete window_;
+  delete settings_;
+  if (viewer_ != NULL) { delete viewer_; }
   return;
 }
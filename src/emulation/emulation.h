@@ -5,12 +5,21 @@
 #include <cstdint>
 #include <cstdio>
 #include <ctime>
+#include <thread>
 
 #include "../config/config.h"
+#include "../config/settings.h"
 #include "../sdl/window.h"
-#include "../cpu/cpu.h"
-#include "../ppu/ppu.h"
-#include "../apu/apu.h"
+#include "../core/console.h"
+#include "../cpu/trace_log.h"
+#include "../cpu/code_data_log.h"
+#include "../video/frame_buffer.h"
+#include "./frame_log.h"
+#include "./frame_pacer.h"
+#include "../debug/ppu_viewer.h"
+#include "../debug/gdb_stub.h"
+#include "../debug/term_debugger.h"
+#include "../netplay/rollback_session.h"
 
 /*
  * Manages the emulation of the NES by creating and managing
@@ -22,28 +31,103 @@ class Emulation {
     // Stores the SDL window used by the emulation.
     Window *window_;
 
-    // Stores the objects for the NES emulation.
-    Memory *memory_;
-    Cpu *cpu_;
-    Ppu *ppu_;
-    Apu *apu_;
+    // The emulated NES.
+    Console *console_;
+
+    // Passes the frames completed by the PPU to the presenter.
+    FrameBuffer *frame_buffer_;
+
+    // Records the frames completed by the PPU, if they are being logged.
+    // When set, the emulation runs as fast as possible.
+    FrameLog *frame_log_;
+
+    // Records each instruction run by the console, if it is being traced.
+    TraceLog *trace_log_;
+
+    // Marks the code run by the console, if the rom is being disassembled
+    // when the emulation ends.
+    CodeDataLog *code_log_;
+
+    // Serves a remote debugger, if one was requested. While the debugger
+    // holds the console stopped, no frames are run.
+    GdbStub *debugger_;
+
+    // Debugs the console from the terminal, if requested. While the user
+    // holds the console stopped, no frames are run.
+    TermDebugger *terminal_;
+
+    // Draws views of PPU memory for debugging, if they are open.
+    PpuViewer *viewer_;
+
+    // Paces the emulation thread to the frame rate of the console.
+    FramePacer *pacer_;
+
+    // Plays the console with a peer, if netplay was requested. The session
+    // owns the console, and runs it a frame at a time.
+    RollbackSession *session_;
+
+    // The configuration, which is owned by the caller, and the settings
+    // parsed from it. Both are only used by the presenter thread.
+    Config *config_;
+    Settings *settings_;
+
+    // The frame rate of the console, in Hz.
+    double frame_rate_;
+
+    // Where messages about the emulation are printed, which is standard
+    // error while frames are captured to standard output.
+    FILE *status_;
+
+    // The number of CPU cycles in each frame. Frames alternate between
+    // whole numbers of cycles, with the remainder carried between them.
+    double cycles_per_frame_;
+    double cycle_remainder_ = 0.0;
 
     // Redefinition of the structure used for timing.
     typedef struct timespec EmuTime;
 
-    // Used to time the emulator and calculate the frame rate.
-    EmuTime last_sync_time_ = { 0, 0 };
+    // Used by the presenter to calculate the frame rate, and to count the
+    // frames which were dropped or presented more than once.
     EmuTime last_frame_time_ = { 0, 0 };
     long frames_counted_ = 0;
+    size_t last_frame_number_ = 0;
+    size_t last_frames_dropped_ = 0;
+    size_t frames_repeated_ = 0;
 
     // Stores the objects provided by the factory create function.
-    Emulation(Window *window, Memory *memory, Cpu *cpu, Ppu *ppu, Apu *apu);
+    Emulation(Window *window, Console *console, FrameLog *frame_log,
+              TraceLog *trace_log, CodeDataLog *code_log,
+              GdbStub *debugger, TermDebugger *terminal, PpuViewer *viewer,
+              FramePacer *pacer, RollbackSession *session, Config *config,
+              Settings *settings, double cpu_clock, double frame_rate);
+
+    // Writes the disassembly of the rom, from the code it ran.
+    void ExportDisassembly(void);
+
+    // Paces the emulation and its audio to the speed in the settings.
+    void ApplySpeed(void);
 
-    // Syncs the emulation to the given frame rate.
-    void SyncFrameRate(void);
+    // Reloads the configuration, and applies the settings in it.
+    void ReloadConfig(void);
+
+    // Returns the stream messages about the emulation are printed to.
+    static FILE *GetStatusStream(const Settings *settings);
+
+    // Creates a netplay session for the given rom from the configuration.
+    // Returns NULL on failure.
+    static RollbackSession *CreateSession(FILE *rom, Config *config,
+                                          Window *window);
+
+    // Runs the NES emulation until the program is closed.
+    // Executed on its own thread.
+    void RunEmulation(void);
+
+    // Processes events and presents completed frames until the program
+    // is closed. Executed on the main thread, as required by SDL.
+    void RunPresenter(void);
 
     // Updates the frame rate displayed in the SDL window title.
-    void UpdateFrameCounter(void);
+    void UpdateFrameCounter(const NesFrame *frame);
 
     // Gets the current time.
     void TimeGet(EmuTime *time);
@@ -54,17 +138,22 @@ class Emulation {
     // Subtracts the first time from the second time, storing the result.
     void TimeDiff(EmuTime *time1, EmuTime *time2, EmuTime *res);
 
-    // Runs the NES emulation for 1/60th of its clock rate.
+    // Runs the NES emulation for a single frame.
     void RunEmulationCycle(void);
 
   public:
-    // Attempts to create the object used to manage the emulation.
+    // Attempts to create the object used to manage the emulation. The
+    // configuration is reloaded on SIGUSR1, and so must outlive it.
     static Emulation *Create(FILE *rom, Config *config);
 
-    // Starts the main emulation loop. This function does not
-    // return until the user or OS closes the emulation window.
+    // Starts the emulation thread, then presents frames. This function does
+    // not return until the user or OS closes the emulation window.
     void Run(void);
 
+    // Checks if the emulation was stopped because a frame differed from
+    // the golden frame log.
+    bool HasDiverged(void);
+
     // Deletes the Emulation object.
     ~Emulation(void);
 };
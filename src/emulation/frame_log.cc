@@ -0,0 +1,210 @@
+/*
+ * The frame log fingerprints every frame the PPU completes, so that changes
+ * to the hot paths of the emulation can be checked for regressions at full
+ * speed.
+ *
+ * Each frame is written to the log as a line holding the frame number, the
+ * controller buttons latched while it was drawn, and the hash of the frame:
+ *
+ *   <frame> <buttons> <hash>
+ *
+ * The buttons and hash are in hex. Lines starting with '#' are comments.
+ *
+ * A log can then be used as a golden file. The buttons of each golden frame
+ * are replayed in place of the keyboard, and the hash of each completed frame
+ * is compared against the golden hash. The log finishes at the first frame
+ * that differs, or once every golden frame has been matched, and the owner
+ * of the log then stops the emulation.
+ *
+ * Controller input is latched once per frame, and so is the same for every
+ * poll made while a frame is drawn. Combined with a fixed seed for the
+ * power up state of memory, this makes every run of a log deterministic.
+ */
+
+#include "./frame_log.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cinttypes>
+
+#include "../util/data.h"
+#include "../io/input_source.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+
+// The maximum length of a line in a golden file.
+#define LINE_SIZE 128U
+
+/*
+ * Opens the given log and golden files. Either path may be NULL, in which
+ * case that file is not used. The input may also be NULL, in which case
+ * no buttons are pressed outside of the golden file.
+ *
+ * Returns NULL if a file cannot be opened.
+ */
+FrameLog *FrameLog::Create(const char *log_path, const char *golden_path,
+                           InputSource *input) {
+  // Open the golden file, if one was given.
+  FILE *golden = NULL;
+  if (golden_path != NULL) {
+    golden = fopen(golden_path, "r");
+    if (golden == NULL) {
+      fprintf(stderr, "Error: Failed to open golden file %s.\n", golden_path);
+      return NULL;
+    }
+  }
+
+  // Open the log file, if one was given.
+  FILE *log = NULL;
+  if (log_path != NULL) {
+    log = fopen(log_path, "w");
+    if (log == NULL) {
+      fprintf(stderr, "Error: Failed to open frame log %s.\n", log_path);
+      if (golden != NULL) { fclose(golden); }
+      return NULL;
+    }
+    fprintf(log, "# frame buttons hash\n");
+  }
+
+  return new FrameLog(log, golden, input);
+}
+
+/*
+ * Stores the given files, and latches the input for the first frame.
+ */
+FrameLog::FrameLog(FILE *log, FILE *golden, InputSource *input) {
+  log_ = log;
+  golden_ = golden;
+  input_ = input;
+  LatchNext();
+  return;
+}
+
+/*
+ * Hashes the given frame and writes it to the log. If a golden file is in
+ * use, the hash is checked against it and the log finishes if they differ.
+ * Latches the input for the next frame.
+ *
+ * Does nothing once the log has finished.
+ */
+void FrameLog::Record(const NesFrame *frame) {
+  if (done_) { return; }
+  frames_checked_++;
+
+  // Hash and log the frame.
+  uint64_t hash = HashFrame(frame);
+  if (log_ != NULL) {
+    fprintf(log_, "%zu %02x %016" PRIx64 "\n", frames_checked_,
+            static_cast<unsigned int>(buttons_), hash);
+  }
+
+  // Compare the frame against the golden file.
+  if ((golden_ != NULL) && ((golden_frame_ != frames_checked_)
+                        || (golden_hash_ != hash))) {
+    fprintf(stderr, "Error: Frame %zu differs from the golden file "
+            "(expected %016" PRIx64 ", got %016" PRIx64 ").\n",
+            frames_checked_, golden_hash_, hash);
+    diverged_ = true;
+    Stop();
+    return;
+  }
+
+  LatchNext();
+  return;
+}
+
+/*
+ * Latches the buttons used to draw the next frame. The buttons come from the
+ * golden file, if one is in use, and from the input otherwise.
+ *
+ * Finishes the log if the golden file has no more frames.
+ */
+void FrameLog::LatchNext(void) {
+  if (golden_ == NULL) {
+    buttons_ = (input_ != NULL) ? input_->Poll() : 0;
+  } else if (ReadGolden()) {
+    buttons_ = golden_buttons_;
+  } else {
+    // The golden file has ended, so the run either passed or the file
+    // could not be used.
+    if ((frames_checked_ == 0) && !diverged_) {
+      fprintf(stderr, "Error: The golden file contains no frames.\n");
+      diverged_ = true;
+    }
+    Stop();
+  }
+  return;
+}
+
+/*
+ * Reads the next frame from the golden file, skipping comments.
+ *
+ * Returns false at the end of the file, or if the next line is malformed,
+ * in which case the log is marked as diverged.
+ */
+bool FrameLog::ReadGolden(void) {
+  char line[LINE_SIZE];
+  while (fgets(line, sizeof(line), golden_) != NULL) {
+    if (line[0] == '#') { continue; }
+    unsigned int buttons;
+    if (sscanf(line, "%zu %x %" SCNx64, &golden_frame_, &buttons,
+                                        &golden_hash_) != 3) {
+      fprintf(stderr, "Error: Malformed golden file line: %s", line);
+      diverged_ = true;
+      return false;
+    }
+    golden_buttons_ = static_cast<DataWord>(buttons);
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Finishes the log, preventing any further frames from being recorded.
+ */
+void FrameLog::Stop(void) {
+  done_ = true;
+  return;
+}
+
+/*
+ * Returns the buttons latched for the frame currently being drawn, so that
+ * every poll made during a frame sees the same input.
+ */
+DataWord FrameLog::Poll(void) {
+  return buttons_;
+}
+
+/*
+ * Checks if the log has finished, either because the golden file ended or
+ * because a frame differed from it.
+ */
+bool FrameLog::IsDone(void) {
+  return done_;
+}
+
+/*
+ * Checks if the log finished because a frame differed from the golden
+ * file, or because the golden file could not be used.
+ */
+bool FrameLog::HasDiverged(void) {
+  return diverged_;
+}
+
+/*
+ * Gets the number of frames which have been recorded.
+ */
+size_t FrameLog::GetFramesChecked(void) {
+  return frames_checked_;
+}
+
+/*
+ * Closes the log and golden files.
+ */
+FrameLog::~FrameLog(void) {
+  if (log_ != NULL) { fclose(log_); }
+  if (golden_ != NULL) { fclose(golden_); }
+  return;
+}
@@ -0,0 +1,95 @@
+#ifndef _NES_FRAMELOG
+#define _NES_FRAMELOG
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../util/data.h"
+#include "../io/input_source.h"
+#include "../video/frame_buffer.h"
+
+// The seed used for the power up state of memory when frames are logged,
+// so that every run of a log starts from the same state.
+#define FRAME_LOG_SEED 0x4E4442U
+
+/*
+ * Records a hash of every frame completed by the PPU, along with the
+ * controller input used to draw it. Frames can be written to a log, and
+ * can be checked against a golden log, whose input is replayed so that the
+ * emulation draws the same frames.
+ *
+ * The log is the input source of the console it records, and holds the
+ * buttons it latches for each frame. Does not depend on SDL.
+ *
+ * Used to verify that changes to the emulation do not change its output.
+ */
+class FrameLog : public FrameRecorder, public InputSource {
+  private:
+    // The file hashes are logged to, and the golden file they are checked
+    // against. Either may be NULL.
+    FILE *log_;
+    FILE *golden_;
+
+    // The input whose buttons are latched at the start of each frame, when
+    // no golden file is in use. May be NULL, in which case no buttons are
+    // pressed.
+    InputSource *input_;
+
+    // The number of frames checked so far, and the buttons latched for the
+    // frame currently being drawn.
+    size_t frames_checked_ = 0;
+    DataWord buttons_ = 0;
+
+    // The next frame of the golden file.
+    size_t golden_frame_ = 0;
+    DataWord golden_buttons_ = 0;
+    uint64_t golden_hash_ = 0;
+
+    // Set once the log has finished, and set if it finished because a frame
+    // differed from the golden file.
+    bool done_ = false;
+    bool diverged_ = false;
+
+    // Stores the files and latches the input for the first frame.
+    FrameLog(FILE *log, FILE *golden, InputSource *input);
+
+    // Reads the next frame from the golden file. Returns false at the
+    // end of the file.
+    bool ReadGolden(void);
+
+    // Latches the input for the next frame.
+    void LatchNext(void);
+
+    // Stops recording frames.
+    void Stop(void);
+
+  public:
+    // Opens the given log and golden files, either of which may be NULL.
+    // Returns NULL if either file cannot be opened.
+    static FrameLog *Create(const char *log_path, const char *golden_path,
+                            InputSource *input);
+
+    // Records the given frame, which the PPU has just completed, then
+    // latches the input for the next frame. The log finishes at the first
+    // frame which differs from the golden file, or at its end.
+    void Record(const NesFrame *frame);
+
+    // Returns the buttons latched for the frame being drawn.
+    DataWord Poll(void);
+
+    // Checks if the log has finished, and so the emulation should be
+    // stopped. Only golden logs finish.
+    bool IsDone(void);
+
+    // Checks if a frame differed from the golden file.
+    bool HasDiverged(void);
+
+    // Gets the number of frames recorded.
+    size_t GetFramesChecked(void);
+
+    // Closes the files of the log.
+    ~FrameLog(void);
+};
+
+#endif
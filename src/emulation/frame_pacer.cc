@@ -0,0 +1,133 @@
+/*
+ * The frame pacer keeps the emulation running at the frame rate of the
+ * console. Deadlines are advanced by exactly one frame period each frame,
+ * rather than measured from when the last frame finished, so small errors
+ * in each wait do not accumulate into drift.
+ *
+ * Sleeping can overshoot its target by up to a scheduler tick, so the pacer
+ * only sleeps until a margin before each deadline, then spins for the rest.
+ * The margin follows the overshoot measured on recent sleeps, keeping the
+ * spin as short as the host allows. If the emulation falls more than a frame
+ * behind, the deadlines are reset instead of trying to catch up.
+ */
+
+#include "./frame_pacer.h"
+
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <mutex>
+
+// The number of nanoseconds in a second.
+#define NSECS_PER_SEC 1000000000L
+
+// The limits, and initial value, of the spin margin in nanoseconds.
+#define MIN_SPIN_MARGIN_NS 200000L
+#define MAX_SPIN_MARGIN_NS 4000000L
+#define INITIAL_SPIN_MARGIN_NS 2000000L
+
+// The spin margin moves 1/SPIN_MARGIN_WEIGHT of the way toward twice the
+// overshoot of each sleep.
+#define SPIN_MARGIN_WEIGHT 8L
+
+/*
+ * Creates a pacer for the given frame rate.
+ */
+FramePacer::FramePacer(double frame_rate) {
+  SetFrameRate(frame_rate);
+  spin_margin_ns_ = INITIAL_SPIN_MARGIN_NS;
+  return;
+}
+
+/*
+ * Sets the length of each frame from the given frame rate. The deadline
+ * already set is kept, so the new rate applies from the frame after it.
+ */
+void FramePacer::SetFrameRate(double frame_rate) {
+  frame_period_ns_ = static_cast<int64_t>(static_cast<double>(NSECS_PER_SEC)
+                                        / frame_rate);
+  return;
+}
+
+/*
+ * Gets the current time in nanoseconds, from a monotonic clock.
+ */
+int64_t FramePacer::TimeNow(void) {
+  struct timespec time;
+#ifdef _NES_OSLIN
+  clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &time);
+#endif
+  return static_cast<int64_t>(time.tv_sec) * NSECS_PER_SEC + time.tv_nsec;
+}
+
+/*
+ * Waits until the next frame is due, then advances the deadline by one frame.
+ * Returns immediately if the deadline has already passed.
+ */
+void FramePacer::Wait(void) {
+  // Start a new series of deadlines on the first frame, or if the emulation
+  // has fallen too far behind.
+  int64_t now = TimeNow();
+  int64_t period = frame_period_ns_.load(std::memory_order_relaxed);
+  if ((deadline_ns_ == 0) || ((now - deadline_ns_) > period)) {
+    deadline_ns_ = now;
+  }
+
+  // Sleep until shortly before the deadline, then adapt the margin to how
+  // far the sleep overshot.
+  int64_t sleep_target = deadline_ns_ - spin_margin_ns_;
+  if (now < sleep_target) {
+    int64_t sleep_ns = sleep_target - now;
+    struct timespec sleep_time;
+    sleep_time.tv_sec = static_cast<time_t>(sleep_ns / NSECS_PER_SEC);
+    sleep_time.tv_nsec = static_cast<long>(sleep_ns % NSECS_PER_SEC);
+    nanosleep(&sleep_time, NULL);
+    int64_t overshoot = TimeNow() - sleep_target;
+    spin_margin_ns_ += (2 * overshoot - spin_margin_ns_) / SPIN_MARGIN_WEIGHT;
+    if (spin_margin_ns_ < MIN_SPIN_MARGIN_NS) {
+      spin_margin_ns_ = MIN_SPIN_MARGIN_NS;
+    } else if (spin_margin_ns_ > MAX_SPIN_MARGIN_NS) {
+      spin_margin_ns_ = MAX_SPIN_MARGIN_NS;
+    }
+  }
+
+  // Spin for the rest of the wait.
+  do {
+    now = TimeNow();
+  } while (now < deadline_ns_);
+
+  RecordJitter(now - deadline_ns_);
+  deadline_ns_ += period;
+  return;
+}
+
+/*
+ * Adds the lateness of a frame to the statistics.
+ */
+void FramePacer::RecordJitter(int64_t jitter_ns) {
+  std::lock_guard<std::mutex> guard(stats_lock_);
+  stats_frames_++;
+  stats_jitter_sum_ns_ += jitter_ns;
+  if (jitter_ns > stats_jitter_max_ns_) { stats_jitter_max_ns_ = jitter_ns; }
+  return;
+}
+
+/*
+ * Gets the jitter statistics collected since they were last read, then
+ * resets them.
+ */
+void FramePacer::GetStats(PacingStats *stats) {
+  std::lock_guard<std::mutex> guard(stats_lock_);
+  stats->frames = stats_frames_;
+  stats->mean_jitter_us = (stats_frames_ > 0)
+                        ? (static_cast<double>(stats_jitter_sum_ns_)
+                        / static_cast<double>(stats_frames_) / 1000.0) : 0.0;
+  stats->max_jitter_us = static_cast<double>(stats_jitter_max_ns_) / 1000.0;
+  stats_frames_ = 0;
+  stats_jitter_sum_ns_ = 0;
+  stats_jitter_max_ns_ = 0;
+  return;
+}
@@ -0,0 +1,66 @@
+#ifndef _NES_PACER
+#define _NES_PACER
+
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+/*
+ * Statistics on how closely the pacer met its deadlines.
+ */
+struct PacingStats {
+  // The number of frames paced since the statistics were last read.
+  size_t frames;
+
+  // How late the pacer woke up for each frame, in microseconds.
+  double mean_jitter_us;
+  double max_jitter_us;
+};
+
+/*
+ * Paces the emulation to a fixed frame rate. Sleeps until shortly before
+ * each deadline, then spins until the deadline is reached, which avoids
+ * the overshoot of sleeping for the whole wait.
+ */
+class FramePacer {
+  private:
+    // The length of each frame, in nanoseconds. Can be changed by another
+    // thread while the pacer is waiting.
+    std::atomic<int64_t> frame_period_ns_;
+
+    // The time the next frame is due. Zero until the first frame.
+    int64_t deadline_ns_ = 0;
+
+    // How long before each deadline the pacer stops sleeping and starts
+    // spinning. Adapted to the overshoot of recent sleeps.
+    int64_t spin_margin_ns_;
+
+    // Jitter statistics collected since they were last read. Read by the
+    // presenter thread.
+    std::mutex stats_lock_;
+    size_t stats_frames_ = 0;
+    int64_t stats_jitter_sum_ns_ = 0;
+    int64_t stats_jitter_max_ns_ = 0;
+
+    // Gets the current time, in nanoseconds.
+    static int64_t TimeNow(void);
+
+    // Adds the lateness of a frame to the statistics.
+    void RecordJitter(int64_t jitter_ns);
+
+  public:
+    // Creates a pacer for the given frame rate, in Hz.
+    FramePacer(double frame_rate);
+
+    // Waits until the next frame is due.
+    void Wait(void);
+
+    // Changes the frame rate, in Hz, from the next frame on.
+    void SetFrameRate(double frame_rate);
+
+    // Gets the jitter statistics, then resets them.
+    void GetStats(PacingStats *stats);
+};
+
+#endif
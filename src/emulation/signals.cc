@@ -5,12 +5,13 @@
 #include "./signals.h"
 
 #include <cstdlib>
+#include <atomic>
 
 #include <signal.h>
 
 // Signal variables, used to respond to signals at a pre-determined time.
-bool ndb_running = true;
-bool reload_config = false;
+std::atomic<bool> ndb_running(true);
+std::atomic<bool> reload_config(false);
 
 /* Signal handler function declaration */
 void HandleStopSignal(int sig);
@@ -37,6 +38,11 @@ void RegisterSignalHandlers(void) {
   action.sa_handler = &HandleReloadSignal;
   sigaction(SIGUSR1, &action, NULL);
 
+  // Ignore SIGPIPE, so that a closed capture pipe is reported as a
+  // failed write instead of killing the program.
+  action.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &action, NULL);
+
   return;
 }
 
@@ -0,0 +1,60 @@
+/*
+ * The rom fuzzer loads arbitrary data as a rom image, then runs it for a
+ * bounded number of frames. This exercises the header decoder, the loaders
+ * of each mapper, and whatever the loaded program does to the chips.
+ *
+ * Each input is loaded straight from memory, and the generator used to fill
+ * uninitialized memory is reseeded, so that an input always runs the same
+ * way. Invalid roms are rejected by the loaders, and unimplemented
+ * instructions jam the CPU, so only real bugs crash the harness.
+ */
+
+#include "./rom_fuzzer.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../core/console.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../util/data.h"
+#include "../util/state.h"
+#include "../util/util.h"
+
+// The number of frames each input is run for. Enough for a rom to set up
+// the PPU and start rendering, while keeping each run short.
+#define FUZZ_FRAMES 8U
+
+// The seed used to fill uninitialized memory for every input.
+#define FUZZ_SEED 1U
+
+/*
+ * Loads the given rom image and runs it until it has drawn FUZZ_FRAMES
+ * frames, or its CPU has jammed. The state of the console is then saved
+ * and loaded again, which must succeed.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  RandSeed(FUZZ_SEED);
+  HeldInput input;
+  NullAudioSink audio;
+  Console *console = Console::Create(data, size, &input, &audio);
+  if (console == NULL) { return 0; }
+
+  for (size_t i = 0; (i < FUZZ_FRAMES) && !console->IsJammed(); i++) {
+    console->RunFrame();
+  }
+
+  // A console must always accept its own state.
+  StateWriter state;
+  console->SaveState(&state);
+  StateReader reader(state.GetData(), state.GetSize());
+  if (!console->LoadState(&reader)) {
+    fprintf(stderr, "Error: The console rejected its own state.\n");
+    abort();
+  }
+
+  delete console;
+  return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _NES_ROMFUZZER
+#define _NES_ROMFUZZER
+
+#include <cstdlib>
+#include <cstdint>
+
+/*
+ * Loads the given data as a rom image, and runs it for a few frames. Follows
+ * the interface of libFuzzer, so that the harness can be linked with it, or
+ * driven by the replay main of ndb-fuzz. Always returns zero.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
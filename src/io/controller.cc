@@ -7,13 +7,14 @@
 
 #include <cstdlib>
 
-#include "../sdl/input.h"
 #include "../util/data.h"
+#include "../util/state.h"
+#include "./input_source.h"
 
 /*
  * Creates a controller object.
  */
-Controller::Controller(Input *input) {
+Controller::Controller(InputSource *input) {
   // Initializes the shift registers for the controllers.
   joy1_shift_ = 0xFF;
   joy2_shift_ = 0xFF;
@@ -24,14 +25,23 @@ Controller::Controller(Input *input) {
   return;
 }
 
+/*
+ * Connects the given input to the second controller port. The port reads
+ * no buttons while the input is NULL.
+ */
+void Controller::SetSecondInput(InputSource *input) {
+  input2_ = input;
+  return;
+}
+
 /*
  * Reads from the specified controller port, shifting it.
  */
 DataWord Controller::Read(DoubleWord addr) {
-  // Poll for SDL inputs, if strobe is active.
+  // Poll for inputs, if strobe is active.
   if (joy_strobe_) {
     joy1_shift_ = input_->Poll();
-    joy2_shift_ = 0x00U; // No P2 Emulation.
+    joy2_shift_ = (input2_ != NULL) ? input2_->Poll() : 0x00U;
   }
 
   // Get the button being pressed for the requested controller and shift
@@ -57,15 +67,36 @@ void Controller::Write(DoubleWord addr, DataWord val) {
   // Update the strobe register if its address was written to.
   if (addr == IO_JOY1_ADDR) { joy_strobe_ = (val & 1); }
 
-  // Poll for SDL inputs, if strobe is active.
+  // Poll for inputs, if strobe is active.
   if (joy_strobe_) {
     joy1_shift_ = input_->Poll();
-    joy2_shift_ = 0x00U; // No P2 Emulation.
+    joy2_shift_ = (input2_ != NULL) ? input2_->Poll() : 0x00U;
   }
 
   return;
 }
 
+/*
+ * Writes the shift registers and strobe of the controller to the given state.
+ */
+void Controller::SaveState(StateWriter *state) {
+  state->Put(joy1_shift_);
+  state->Put(joy2_shift_);
+  state->Put(joy_strobe_);
+  return;
+}
+
+/*
+ * Restores the shift registers and strobe of the controller from the given
+ * state. Returns false if the state was too short.
+ */
+bool Controller::LoadState(StateReader *state) {
+  state->Get(&joy1_shift_);
+  state->Get(&joy2_shift_);
+  state->Get(&joy_strobe_);
+  return !state->HasFailed();
+}
+
 /*
  * Deletes the controller object.
  */
@@ -4,7 +4,8 @@
 #include <cstdlib>
 
 #include "../util/data.h"
-#include "../sdl/input.h"
+#include "../util/state.h"
+#include "./input_source.h"
 
 // The memory mapped addresses controller data can be accessed from.
 #define IO_JOY1_ADDR 0x4016U
@@ -23,12 +24,17 @@ class Controller {
     // Standard controllers are probed whenever the strobe bit is set.
     DataWord joy_strobe_ = 0;
 
-    // Holds the input object associated with this controller.
-    Input *input_;
+    // Holds the input objects of the first and second controllers. The
+    // second controller reads no buttons when it has no input.
+    InputSource *input_;
+    InputSource *input2_ = NULL;
 
   public:
     // Creates a controller object.
-    Controller(Input *input);
+    Controller(InputSource *input);
+
+    // Connects an input object to the second controller. May be NULL.
+    void SetSecondInput(InputSource *input);
 
     // Reads from a controller mmio address.
     DataWord Read(DoubleWord addr);
@@ -36,6 +42,10 @@ class Controller {
     // Writes to a controller mmio address.
     void Write(DoubleWord addr, DataWord val);
 
+    // Saves or restores the shift registers and strobe of the controller.
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
     // Frees the controller object.
     ~Controller(void);
 };
@@ -0,0 +1,33 @@
+#ifndef _NES_INPUTSOURCE
+#define _NES_INPUTSOURCE
+
+#include "../util/data.h"
+
+/*
+ * A source of controller button presses, which is polled by the emulated
+ * controller. Allows the emulation to be driven without SDL.
+ */
+class InputSource {
+  public:
+    // Returns a byte containing the buttons currently pressed, with the
+    // A button in the lowest bit.
+    virtual DataWord Poll(void) = 0;
+
+    virtual ~InputSource(void) { return; }
+};
+
+/*
+ * An input source which holds the buttons it was last given, for consoles
+ * driven by a program rather than a user.
+ */
+class HeldInput : public InputSource {
+  private:
+    DataWord buttons_ = 0;
+
+  public:
+    void Set(DataWord buttons) { buttons_ = buttons; return; }
+    DataWord Get(void) { return buttons_; }
+    DataWord Poll(void) { return buttons_; }
+};
+
+#endif
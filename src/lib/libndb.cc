@@ -0,0 +1,449 @@
+/*
+ * Implements the C interface of libndb on top of the emulation core.
+ *
+ * Each handle owns a console, along with the input source and audio sink it
+ * is connected to. Input is set directly by the caller, and the samples of
+ * each frame are collected into a buffer, which is emptied whenever the
+ * next frame is run. Nothing here depends on SDL or on global state.
+ *
+ * Environment handles wrap the reinforcement learning environment of the
+ * core, which observes its console in place.
+ *
+ * The core allocates with plain new, so every call into it which may
+ * allocate catches std::bad_alloc, as no exception may unwind into a C
+ * caller. Running a frame does not allocate, and so is not guarded.
+ */
+
+#include "./libndb.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "../core/console.h"
+#include "../core/rl_environment.h"
+#include "../core/state_pool.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+#include "../util/data.h"
+#include "../util/state.h"
+#include "../util/util.h"
+
+// The number of samples the audio buffer can hold before it grows.
+// About two frames of audio.
+#define AUDIO_INITIAL_CAPACITY 2048U
+
+/*
+ * Collects the samples produced by the console during a frame.
+ */
+class SampleBuffer : public AudioSink {
+  private:
+    float *samples_;
+    size_t size_ = 0;
+    size_t capacity_;
+
+    SampleBuffer(float *samples, size_t capacity);
+
+  public:
+    static SampleBuffer *Create(void);
+    void AddSample(float sample);
+    void Clear(void);
+    const float *GetSamples(size_t *num_samples);
+    ~SampleBuffer(void);
+};
+
+/*
+ * A console, and the input and audio it is connected to.
+ */
+struct ndb_console {
+  Console *console;
+  HeldInput *input;
+  SampleBuffer *audio;
+  const NesFrame *frame;
+};
+
+/*
+ * A pool of forked states.
+ */
+struct ndb_pool {
+  StatePool *pool;
+};
+
+/*
+ * A reinforcement learning environment.
+ */
+struct ndb_env {
+  RlEnvironment *env;
+};
+
+/*
+ * Allocates a sample buffer with the initial capacity.
+ *
+ * Returns NULL if the buffer could not be allocated.
+ */
+SampleBuffer *SampleBuffer::Create(void) {
+  float *samples = new (std::nothrow) float[AUDIO_INITIAL_CAPACITY];
+  if (samples == NULL) { return NULL; }
+  SampleBuffer *buffer = new (std::nothrow)
+                         SampleBuffer(samples, AUDIO_INITIAL_CAPACITY);
+  if (buffer == NULL) { delete[] samples; }
+  return buffer;
+}
+
+/*
+ * Takes ownership of the given samples.
+ */
+SampleBuffer::SampleBuffer(float *samples, size_t capacity) {
+  samples_ = samples;
+  capacity_ = capacity;
+  return;
+}
+
+/*
+ * Adds a sample to the buffer, doubling its size when it is full.
+ * The sample is dropped if the buffer cannot grow, as this is called
+ * while the console runs a frame.
+ */
+void SampleBuffer::AddSample(float sample) {
+  if (size_ >= capacity_) {
+    float *grown = new (std::nothrow) float[capacity_ * 2];
+    if (grown == NULL) { return; }
+    for (size_t i = 0; i < size_; i++) { grown[i] = samples_[i]; }
+    delete[] samples_;
+    samples_ = grown;
+    capacity_ *= 2;
+  }
+
+  samples_[size_] = sample;
+  size_++;
+  return;
+}
+
+/*
+ * Discards the samples in the buffer.
+ */
+void SampleBuffer::Clear(void) {
+  size_ = 0;
+  return;
+}
+
+/*
+ * Gets the samples in the buffer.
+ */
+const float *SampleBuffer::GetSamples(size_t *num_samples) {
+  *num_samples = size_;
+  return samples_;
+}
+
+/*
+ * Frees the sample buffer.
+ */
+SampleBuffer::~SampleBuffer(void) {
+  delete[] samples_;
+  return;
+}
+
+/*
+ * Loads the given rom image into a new console, whose uninitialized memory
+ * is filled from the given seed.
+ *
+ * Returns NULL if the rom could not be loaded.
+ */
+ndb_console *ndb_create(const void *rom, size_t rom_size, unsigned int seed) {
+  if ((rom == NULL) || (rom_size == 0)) { return NULL; }
+
+  // The generator used to fill memory belongs to this thread, so other
+  // consoles cannot change the power up state of this one.
+  RandSeed(seed);
+  HeldInput *input = new (std::nothrow) HeldInput();
+  SampleBuffer *audio = SampleBuffer::Create();
+  ndb_console *handle = new (std::nothrow) ndb_console();
+  Console *console = NULL;
+  if ((input != NULL) && (audio != NULL) && (handle != NULL)) {
+    try {
+      console = Console::Create(static_cast<const DataWord*>(rom), rom_size,
+                                input, audio);
+    } catch (const std::bad_alloc&) {
+      console = NULL;
+    }
+  }
+  if (console == NULL) {
+    delete handle;
+    delete audio;
+    delete input;
+    return NULL;
+  }
+
+  handle->console = console;
+  handle->input = input;
+  handle->audio = audio;
+  handle->frame = console->GetFrameBuffer()->GetPresentFrame();
+  return handle;
+}
+
+/*
+ * Frees the given console, and its input and audio.
+ */
+void ndb_destroy(ndb_console *console) {
+  if (console == NULL) { return; }
+  delete console->console;
+  delete console->audio;
+  delete console->input;
+  delete console;
+  return;
+}
+
+/*
+ * Sets the buttons held on the first controller.
+ */
+void ndb_set_input(ndb_console *console, uint8_t buttons) {
+  console->input->Set(buttons);
+  return;
+}
+
+/*
+ * Runs the console until it completes its next frame, collecting the audio
+ * produced while doing so.
+ */
+void ndb_step_frame(ndb_console *console) {
+  console->audio->Clear();
+  console->frame = console->console->RunFrame();
+  return;
+}
+
+/*
+ * Gets the NES colors of the last completed frame.
+ */
+const uint8_t *ndb_get_frame(ndb_console *console) {
+  return console->frame->pixels;
+}
+
+/*
+ * Gets the PPUMASK value of each row of the last completed frame.
+ */
+const uint8_t *ndb_get_frame_masks(ndb_console *console) {
+  return console->frame->masks;
+}
+
+/*
+ * Gets the hash of the last completed frame, as used by frame logs.
+ */
+uint64_t ndb_get_frame_hash(ndb_console *console) {
+  return HashFrame(console->frame);
+}
+
+/*
+ * Gets the number of frames the console has completed.
+ */
+uint64_t ndb_get_frame_number(ndb_console *console) {
+  return static_cast<uint64_t>(console->frame->number);
+}
+
+/*
+ * Gets the audio samples produced during the last frame.
+ */
+const float *ndb_get_audio(ndb_console *console, size_t *num_samples) {
+  return console->audio->GetSamples(num_samples);
+}
+
+/*
+ * Saves the state of the console into the given buffer, if it fits.
+ * Returns the size of the state, or zero if it could not be allocated.
+ */
+size_t ndb_save_state(ndb_console *console, void *buffer, size_t size) {
+  try {
+    StateWriter state;
+    console->console->SaveState(&state);
+    if ((buffer != NULL) && (state.GetSize() <= size)) {
+      memcpy(buffer, state.GetData(), state.GetSize());
+    }
+    return state.GetSize();
+  } catch (const std::bad_alloc&) {
+    return 0;
+  }
+}
+
+/*
+ * Loads the given state into the console. Returns nonzero if the state
+ * was invalid, in which case the console is unchanged.
+ */
+int ndb_load_state(ndb_console *console, const void *state, size_t size) {
+  if (state == NULL) { return -1; }
+  StateReader reader(state, size);
+  return console->console->LoadState(&reader) ? 0 : -1;
+}
+
+/*
+ * Creates a pool of forks sized for the given console.
+ */
+ndb_pool *ndb_pool_create(ndb_console *console, size_t num_slots) {
+  ndb_pool *handle = new (std::nothrow) ndb_pool();
+  if (handle == NULL) { return NULL; }
+  StatePool *pool;
+  try {
+    pool = StatePool::Create(console->console, num_slots);
+  } catch (const std::bad_alloc&) {
+    pool = NULL;
+  }
+  if (pool == NULL) {
+    delete handle;
+    return NULL;
+  }
+  handle->pool = pool;
+  return handle;
+}
+
+/*
+ * Frees the given pool.
+ */
+void ndb_pool_destroy(ndb_pool *pool) {
+  if (pool == NULL) { return; }
+  delete pool->pool;
+  delete pool;
+  return;
+}
+
+/*
+ * Forks the state of the given console into the pool. Returns the slot of
+ * the fork, or -1 if the pool is full.
+ *
+ * The slots are sized to hold any state, so a fork only allocates if the
+ * state outgrows its slot. The slot is freed again if that fails.
+ */
+long ndb_pool_fork(ndb_pool *pool, ndb_console *console) {
+  size_t slot = 0;
+  try {
+    if (!pool->pool->Fork(console->console, &slot)) { return -1; }
+  } catch (const std::bad_alloc&) {
+    pool->pool->Release(slot);
+    return -1;
+  }
+  return static_cast<long>(slot);
+}
+
+/*
+ * Restores a fork into the given console. Returns nonzero if the slot holds
+ * no fork, which includes the -1 returned by a failed fork, or if the
+ * console runs another rom.
+ */
+int ndb_pool_restore(ndb_pool *pool, long slot, ndb_console *console) {
+  if (slot < 0) { return -1; }
+  return pool->pool->Restore(static_cast<size_t>(slot), console->console)
+       ? 0 : -1;
+}
+
+/*
+ * Frees the given slot of the pool. Returns nonzero if the slot holds no
+ * fork.
+ */
+int ndb_pool_release(ndb_pool *pool, long slot) {
+  if (slot < 0) { return -1; }
+  return pool->pool->Release(static_cast<size_t>(slot)) ? 0 : -1;
+}
+
+/*
+ * Loads the given rom image into a new environment, whose uninitialized
+ * memory is filled from the given seed.
+ *
+ * Returns NULL if the rom could not be loaded.
+ */
+ndb_env *ndb_env_create(const void *rom, size_t rom_size, unsigned int seed) {
+  if ((rom == NULL) || (rom_size == 0)) { return NULL; }
+
+  RandSeed(seed);
+  ndb_env *handle = new (std::nothrow) ndb_env();
+  if (handle == NULL) { return NULL; }
+  RlEnvironment *env;
+  try {
+    env = RlEnvironment::Create(static_cast<const DataWord*>(rom), rom_size);
+  } catch (const std::bad_alloc&) {
+    env = NULL;
+  }
+  if (env == NULL) {
+    delete handle;
+    return NULL;
+  }
+
+  handle->env = env;
+  return handle;
+}
+
+/*
+ * Frees the given environment.
+ */
+void ndb_env_destroy(ndb_env *env) {
+  if (env == NULL) { return; }
+  delete env->env;
+  delete env;
+  return;
+}
+
+/*
+ * Sets the function used to score each frame.
+ */
+void ndb_env_set_reward(ndb_env *env, ndb_reward_fn reward, void *user) {
+  env->env->SetRewardHook(reward, user);
+  return;
+}
+
+/*
+ * Loads the given state and stores it as the reset state, or stores the
+ * current state if none is given. Returns nonzero if the state was invalid,
+ * or could not be stored.
+ */
+int ndb_env_set_reset_state(ndb_env *env, const void *state, size_t size) {
+  try {
+    if (state == NULL) {
+      env->env->StoreResetState();
+      return 0;
+    }
+    StateReader reader(state, size);
+    return env->env->LoadResetState(&reader) ? 0 : -1;
+  } catch (const std::bad_alloc&) {
+    return -1;
+  }
+}
+
+/*
+ * Restores the reset state of the environment.
+ */
+void ndb_env_reset(ndb_env *env) {
+  env->env->Reset();
+  return;
+}
+
+/*
+ * Runs a step of the environment, returning its reward.
+ */
+float ndb_env_step(ndb_env *env, uint8_t action, unsigned int frames,
+                   int *done) {
+  bool ended = false;
+  float reward = env->env->Step(action, frames, &ended);
+  if (done != NULL) { *done = (ended) ? 1 : 0; }
+  return reward;
+}
+
+/*
+ * Gets the NES colors of the last frame of the environment.
+ */
+const uint8_t *ndb_env_get_frame(ndb_env *env) {
+  return env->env->GetFrame()->pixels;
+}
+
+/*
+ * Gets the system ram of the environment.
+ */
+const uint8_t *ndb_env_get_ram(ndb_env *env) {
+  return env->env->GetRam();
+}
+
+/*
+ * Gets the last frame of the environment in greyscale.
+ */
+const uint8_t *ndb_env_get_greyscale(ndb_env *env, unsigned int block) {
+  return env->env->GetGreyscale(block);
+}
@@ -0,0 +1,158 @@
+#ifndef _NES_LIBNDB
+#define _NES_LIBNDB
+
+/*
+ * The C interface of libndb, which embeds the emulation core of ndb without
+ * SDL. Each console is independent, and any number may be run at once, but
+ * a single console must only be used by one thread at a time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The dimensions of the frames produced by a console.
+#define NDB_FRAME_WIDTH 256
+#define NDB_FRAME_HEIGHT 240
+
+// The size of the system ram of a console, in bytes.
+#define NDB_RAM_SIZE 2048
+
+// The rate audio samples are produced at, in Hz.
+#define NDB_AUDIO_RATE 48000
+
+// The bits of each button in the input given to a console.
+#define NDB_BUTTON_A 0x01U
+#define NDB_BUTTON_B 0x02U
+#define NDB_BUTTON_SELECT 0x04U
+#define NDB_BUTTON_START 0x08U
+#define NDB_BUTTON_UP 0x10U
+#define NDB_BUTTON_DOWN 0x20U
+#define NDB_BUTTON_LEFT 0x40U
+#define NDB_BUTTON_RIGHT 0x80U
+
+// An emulated console.
+typedef struct ndb_console ndb_console;
+
+// Loads the given rom image into a new console. Uninitialized memory is
+// filled from the given seed, so consoles with the same rom and seed run
+// identically. Returns NULL if the rom could not be loaded, or if memory
+// could not be allocated.
+ndb_console *ndb_create(const void *rom, size_t rom_size, unsigned int seed);
+
+// Frees the given console.
+void ndb_destroy(ndb_console *console);
+
+// Sets the buttons held on the first controller, as NDB_BUTTON bits.
+void ndb_set_input(ndb_console *console, uint8_t buttons);
+
+// Runs the console until it completes its next frame.
+void ndb_step_frame(ndb_console *console);
+
+// Gets the last frame completed by the console, as one 6-bit NES color per
+// pixel, stored one row after another. Black before the first frame.
+// Remains valid until the next call to ndb_step_frame().
+const uint8_t *ndb_get_frame(ndb_console *console);
+
+// Gets the value of PPUMASK each row of the last frame was drawn with.
+// The high bits select the color emphasis and greyscale of the row.
+const uint8_t *ndb_get_frame_masks(ndb_console *console);
+
+// Gets a 64-bit hash of the last frame, and the number of frames completed.
+uint64_t ndb_get_frame_hash(ndb_console *console);
+uint64_t ndb_get_frame_number(ndb_console *console);
+
+// Gets the audio samples produced during the last call to ndb_step_frame().
+// Remains valid until the next call to ndb_step_frame().
+const float *ndb_get_audio(ndb_console *console, size_t *num_samples);
+
+// Saves the state of the console into the given buffer, if it is large
+// enough. Returns the size of the state, which may be larger than the buffer,
+// or zero if memory could not be allocated.
+size_t ndb_save_state(ndb_console *console, void *buffer, size_t size);
+
+// Loads a state saved from a console running the same rom. Returns zero on
+// success, and nonzero if the state is invalid, in which case the console
+// is unchanged.
+int ndb_load_state(ndb_console *console, const void *state, size_t size);
+
+// A fixed pool of forked console states, for restoring the same states
+// many times without allocating.
+typedef struct ndb_pool ndb_pool;
+
+// Creates a pool with the given number of slots, each of which can hold a
+// fork of any console running the same rom as the given one. Returns NULL
+// if no slots are asked for, or if memory could not be allocated.
+ndb_pool *ndb_pool_create(ndb_console *console, size_t num_slots);
+
+// Frees the given pool, and every fork in it.
+void ndb_pool_destroy(ndb_pool *pool);
+
+// Forks the state of the given console into a free slot of the pool, and
+// returns the slot. Returns -1 if every slot is in use.
+long ndb_pool_fork(ndb_pool *pool, ndb_console *console);
+
+// Restores the fork in the given slot into a console running the same rom.
+// The fork remains in the slot. Returns zero on success, and nonzero if the
+// slot holds no fork or the console runs another rom.
+int ndb_pool_restore(ndb_pool *pool, long slot, ndb_console *console);
+
+// Frees the given slot for another fork. Returns zero on success, and
+// nonzero if the slot holds no fork.
+int ndb_pool_release(ndb_pool *pool, long slot);
+
+// A reinforcement learning environment, which runs a console without audio.
+typedef struct ndb_env ndb_env;
+
+// Scores the console after each frame of a step, by reading its system ram.
+// May set done to a nonzero value to end the episode. The user pointer is
+// the one given with the function.
+typedef float (*ndb_reward_fn)(const uint8_t *ram, int *done, void *user);
+
+// Loads the given rom image into a new environment, as ndb_create() does.
+// The power on state of the console is the initial reset state.
+ndb_env *ndb_env_create(const void *rom, size_t rom_size, unsigned int seed);
+
+// Frees the given environment.
+void ndb_env_destroy(ndb_env *env);
+
+// Sets the function used to score each frame. May be NULL, in which case
+// every reward is zero.
+void ndb_env_set_reward(ndb_env *env, ndb_reward_fn reward, void *user);
+
+// Stores the given state as the reset state, after loading it into the
+// console. If the state is NULL, the current state is stored. Returns zero
+// on success, and nonzero if the state is invalid or could not be stored.
+int ndb_env_set_reset_state(ndb_env *env, const void *state, size_t size);
+
+// Restores the reset state.
+void ndb_env_reset(ndb_env *env);
+
+// Holds the given buttons for the given number of frames, at least one, and
+// returns the sum of their rewards. Sets done if the episode has ended,
+// which may end the step early. Done may be NULL.
+float ndb_env_step(ndb_env *env, uint8_t action, unsigned int frames,
+                   int *done);
+
+// Gets the last frame, as ndb_get_frame() does. Remains valid until the
+// next step or reset.
+const uint8_t *ndb_env_get_frame(ndb_env *env);
+
+// Gets the NDB_RAM_SIZE bytes of system ram. The pointer stays valid for
+// the life of the environment, and its contents are updated by each step.
+const uint8_t *ndb_env_get_ram(ndb_env *env);
+
+// Gets the last frame in greyscale, averaged over square blocks of the given
+// size, giving (NDB_FRAME_WIDTH / block) by (NDB_FRAME_HEIGHT / block) bytes.
+// Returns NULL if the block size does not divide both dimensions. Remains
+// valid until the next call.
+const uint8_t *ndb_env_get_greyscale(ndb_env *env, unsigned int block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Checks the behaviour of the C interface of libndb, by running the given
+ * rom image through it.
+ *
+ * A console is stepped and saved, then run on and loaded again. Loading
+ * must restore the state exactly, and running from it must repeat the same
+ * frames. A truncated state must be refused.
+ *
+ * Built by "make lib", and run as: ndb-libtest <rom>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./libndb.h"
+
+// The seed used to fill the memory of the console.
+#define TEST_SEED 1U
+
+// The number of frames run before the state is saved, and after it.
+#define TEST_LEAD_FRAMES 60U
+#define TEST_RUN_FRAMES 120U
+
+/*
+ * Reads the given file into a new buffer, and sets its size.
+ *
+ * Returns NULL if the file could not be read.
+ */
+static void *ReadFile(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) { return NULL; }
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  void *data = (length > 0) ? malloc((size_t) length) : NULL;
+  if ((data != NULL) && (fread(data, 1, (size_t) length, file)
+                         != (size_t) length)) {
+    free(data);
+    data = NULL;
+  }
+  fclose(file);
+
+  *size = (size_t) length;
+  return data;
+}
+
+/*
+ * Runs the given number of frames, pressing a different set of buttons on
+ * each, and returns a hash of the frames and the audio produced.
+ */
+static uint64_t RunFrames(ndb_console *console, unsigned int frames) {
+  uint64_t hash = 0;
+  for (unsigned int i = 0; i < frames; i++) {
+    ndb_set_input(console, (uint8_t) ((i * 37U) & 0xFFU));
+    ndb_step_frame(console);
+
+    size_t num_samples;
+    const float *samples = ndb_get_audio(console, &num_samples);
+    hash = hash * 31U + ndb_get_frame_hash(console);
+    for (size_t j = 0; j < num_samples; j++) {
+      hash = hash * 31U + (uint64_t) (samples[j] * 32768.0f);
+    }
+  }
+  return hash;
+}
+
+/*
+ * Saves the state of the given console into a new buffer, and sets its
+ * size.
+ *
+ * Returns NULL if the state could not be saved.
+ */
+static void *SaveState(ndb_console *console, size_t *size) {
+  *size = ndb_save_state(console, NULL, 0);
+  if (*size == 0) { return NULL; }
+  void *state = malloc(*size);
+  if ((state != NULL) && (ndb_save_state(console, state, *size) != *size)) {
+    free(state);
+    state = NULL;
+  }
+  return state;
+}
+
+/*
+ * Steps, saves, and loads a console running the given rom.
+ *
+ * Returns the number of checks which failed.
+ */
+static int CheckConsole(const void *rom, size_t rom_size) {
+  ndb_console *console = ndb_create(rom, rom_size, TEST_SEED);
+  if (console == NULL) {
+    fprintf(stderr, "Error: Could not create a console from the rom.\n");
+    return 1;
+  }
+
+  int failed = 0;
+  RunFrames(console, TEST_LEAD_FRAMES);
+  if (ndb_get_frame_number(console) != TEST_LEAD_FRAMES) {
+    fprintf(stderr, "Error: Stepped %u frames, but completed %llu.\n",
+            TEST_LEAD_FRAMES,
+            (unsigned long long) ndb_get_frame_number(console));
+    failed++;
+  }
+
+  size_t state_size;
+  void *state = SaveState(console, &state_size);
+  if (state == NULL) {
+    fprintf(stderr, "Error: Could not save the state of the console.\n");
+    ndb_destroy(console);
+    return failed + 1;
+  }
+  uint64_t expected = RunFrames(console, TEST_RUN_FRAMES);
+
+  // Loading the state must restore the console exactly.
+  if (ndb_load_state(console, state, state_size) != 0) {
+    fprintf(stderr, "Error: Could not load a saved state.\n");
+    failed++;
+  } else {
+    size_t loaded_size;
+    void *loaded = SaveState(console, &loaded_size);
+    if ((loaded == NULL) || (loaded_size != state_size)
+                         || (memcmp(loaded, state, state_size) != 0)) {
+      fprintf(stderr, "Error: A loaded state differs from the saved one.\n");
+      failed++;
+    }
+    free(loaded);
+
+    if (RunFrames(console, TEST_RUN_FRAMES) != expected) {
+      fprintf(stderr, "Error: Frames run from a loaded state differ.\n");
+      failed++;
+    }
+  }
+
+  // A truncated state must be refused, leaving the console unchanged.
+  if (ndb_load_state(console, state, state_size / 2) == 0) {
+    fprintf(stderr, "Error: A truncated state was loaded.\n");
+    failed++;
+  }
+
+  free(state);
+  ndb_destroy(console);
+  return failed;
+}
+
+/*
+ * Checks the interface with the rom given as the only argument.
+ */
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <rom>\n", argv[0]);
+    return 2;
+  }
+
+  size_t rom_size;
+  void *rom = ReadFile(argv[1], &rom_size);
+  if (rom == NULL) {
+    fprintf(stderr, "Error: Could not read %s.\n", argv[1]);
+    return 2;
+  }
+
+  int failed = CheckConsole(rom, rom_size);
+  free(rom);
+  if (failed > 0) {
+    fprintf(stderr, "%d checks failed.\n", failed);
+    return 1;
+  }
+  printf("All checks passed.\n");
+  return 0;
+}
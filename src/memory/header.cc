@@ -19,7 +19,6 @@
 
 #include "../util/util.h"
 #include "../util/data.h"
-#include "../util/contracts.h"
 
 /* Defined constants */
 
@@ -59,43 +58,37 @@
 /* Global constants */
 
 // The first four bytes of all NES files should be this string.
-static const char *kInesPreface = "NES\x1A";
+static const DataWord kInesPreface[PREFACE_SIZE] = { 'N', 'E', 'S', 0x1A };
 
 /* Function definitions. */
-static NesHeaderType GetHeaderType(char *file_header, size_t rom_size);
-static void DecodeArchaicInes(RomHeader *header, char *file_header);
-static size_t GetInesPrgRomSize(char *file_header);
-static size_t GetInesChrRomSize(char *file_header);
-static void DecodeFlag6(RomHeader *header, char *file_header);
-static void DecodeInes(RomHeader *header, char *file_header);
-static NesMapperType GetInesMapper(char *file_header);
-static size_t GetInesPrgRamSize(char *file_header);
-static void DecodeInesBools(RomHeader *header, char *file_header);
-static void DecodeNes2(RomHeader *header, char *file_header);
-static size_t GetNes2PrgRomSize(char *file_header);
-static size_t GetNes2ChrRomSize(char *file_header);
+static NesHeaderType GetHeaderType(const DataWord *file_header,
+                                   size_t rom_size);
+static void DecodeArchaicInes(RomHeader *header, const DataWord *file_header);
+static size_t GetInesPrgRomSize(const DataWord *file_header);
+static size_t GetInesChrRomSize(const DataWord *file_header);
+static void DecodeFlag6(RomHeader *header, const DataWord *file_header);
+static void DecodeInes(RomHeader *header, const DataWord *file_header);
+static NesMapperType GetInesMapper(const DataWord *file_header);
+static size_t GetInesPrgRamSize(const DataWord *file_header);
+static void DecodeInesBools(RomHeader *header, const DataWord *file_header);
+static void DecodeNes2(RomHeader *header, const DataWord *file_header);
+static size_t GetNes2PrgRomSize(const DataWord *file_header);
+static size_t GetNes2ChrRomSize(const DataWord *file_header);
 static size_t GetNes2RomSectionSize(DataWord lsb, DataWord msb,
                                     size_t unit_size);
 
 /*
- * Takes in a rom file and returns the corresponding header structure.
- *
- * Assumes the rom file is open and valid.
+ * Takes in a rom image and returns the corresponding header structure.
  *
  * Returns a header structure on success and NULL otherwise.
- * Fails if the header is invalid.
+ * Fails if the header is invalid, or if the image is too small to hold the
+ * memory the header describes.
  */
-RomHeader *DecodeHeader(FILE *rom_file) {
-  // Read the header in from the file.
-  fseek(rom_file, 0, SEEK_SET);
-  char *file_header = new char[HEADER_SIZE];
-  for (size_t i = 0; i < HEADER_SIZE; i++) { file_header[i] = fgetc(rom_file); }
-
-  // Calculate the size of the rom file.
-  size_t rom_size = GetFileSize(rom_file);
-
+RomHeader *DecodeHeader(const DataWord *rom, size_t rom_size) {
   // Verify that the header is correct.
-  if (strncmp(file_header, kInesPreface, PREFACE_SIZE)) {
+  const DataWord *file_header = rom;
+  if ((rom_size < HEADER_SIZE)
+      || (memcmp(file_header, kInesPreface, PREFACE_SIZE) != 0)) {
     fprintf(stderr, "Error: the provided file is not an NES file\n");
     return NULL;
   }
@@ -118,9 +111,20 @@ RomHeader *DecodeHeader(FILE *rom_file) {
       break;
   }
 
-  // Clean up and exit
-  delete[] file_header;
-  CONTRACT((header->prg_rom_size + header->chr_rom_size + 16) == rom_size);
+  // Verify that the image holds all of the rom the header asks for. Any
+  // data after the rom is ignored.
+  if (header->prg_rom_size == 0) {
+    fprintf(stderr, "Error: the provided rom has no program memory\n");
+    delete header;
+    return NULL;
+  } else if ((HEADER_SIZE + header->prg_rom_size + header->chr_rom_size)
+             > rom_size) {
+    fprintf(stderr, "Error: the provided rom is smaller than its header "
+                    "requires\n");
+    delete header;
+    return NULL;
+  }
+
   return header;
 }
 
@@ -130,7 +134,8 @@ RomHeader *DecodeHeader(FILE *rom_file) {
  *
  * Assumes the header is non-null.
  */
-static NesHeaderType GetHeaderType(char *file_header, size_t rom_size) {
+static NesHeaderType GetHeaderType(const DataWord *file_header,
+                                   size_t rom_size) {
   /*
    * Byte 7, bits 2 and 3, of a nes file header contain an
    * indicator for whether or not the header is in the NES 2.0 format.
@@ -168,7 +173,7 @@ static NesHeaderType GetHeaderType(char *file_header, size_t rom_size) {
  * the archaic INES format.
  * Assumes the header structure is non-null.
  */
-static void DecodeArchaicInes(RomHeader *header, char *file_header) {
+static void DecodeArchaicInes(RomHeader *header, const DataWord *file_header) {
   // Gets the ram sizes using the INES standard.
   header->prg_rom_size = GetInesPrgRomSize(file_header);
   header->chr_rom_size = GetInesChrRomSize(file_header);
@@ -194,7 +199,7 @@ static void DecodeArchaicInes(RomHeader *header, char *file_header) {
  *
  * Assumes the header is non-null, 16 bytes long, and in an INES format.
  */
-static size_t GetInesPrgRomSize(char *file_header) {
+static size_t GetInesPrgRomSize(const DataWord *file_header) {
   return (static_cast<size_t>(file_header[PRG_ROM_SIZE_LSB]))
                             * PRG_ROM_CHUNKSIZE;
 }
@@ -204,7 +209,7 @@ static size_t GetInesPrgRomSize(char *file_header) {
  *
  * Assumes the header is non-null, 16 bytes long, and in an INES format.
  */
-static size_t GetInesChrRomSize(char *file_header) {
+static size_t GetInesChrRomSize(const DataWord *file_header) {
   return (static_cast<size_t>(file_header[CHR_ROM_SIZE_LSB]))
                             * CHR_ROM_CHUNKSIZE;
 }
@@ -215,7 +220,7 @@ static size_t GetInesChrRomSize(char *file_header) {
  *
  * Assumes the header is non-null and 16 bytes long.
  */
-static void DecodeFlag6(RomHeader *header, char *file_header) {
+static void DecodeFlag6(RomHeader *header, const DataWord *file_header) {
   header->mirror = static_cast<bool>(file_header[FLAG_6] & 0x01);
   header->battery = static_cast<bool>(file_header[FLAG_6] & 0x02);
   header->trainer = static_cast<bool>(file_header[FLAG_6] & 0x04);
@@ -229,7 +234,7 @@ static void DecodeFlag6(RomHeader *header, char *file_header) {
  * Assumes the file header is non-null, 16 bytes long, and in the INES format.
  * Assumes the header structure is non-null.
  */
-static void DecodeInes(RomHeader *header, char *file_header) {
+static void DecodeInes(RomHeader *header, const DataWord *file_header) {
   // Get the ram sizes using the INES standard.
   header->prg_rom_size = GetInesPrgRomSize(file_header);
   header->chr_rom_size = GetInesChrRomSize(file_header);
@@ -260,7 +265,7 @@ static void DecodeInes(RomHeader *header, char *file_header) {
  *
  * Assumes the file header is non-null, 16 bytes long, and in the INES format.
  */
-static NesMapperType GetInesMapper(char *file_header) {
+static NesMapperType GetInesMapper(const DataWord *file_header) {
   return static_cast<NesMapperType>((file_header[FLAG_7] & 0xf0U)
            | ((static_cast<DataWord>(file_header[FLAG_6])) >> 4));
 }
@@ -270,7 +275,7 @@ static NesMapperType GetInesMapper(char *file_header) {
  *
  * Assumes the file header is non-null, 16 bytes long, and in the INES format.
  */
-static size_t GetInesPrgRamSize(char *file_header) {
+static size_t GetInesPrgRamSize(const DataWord *file_header) {
   if ((static_cast<size_t>(file_header[INES_PRG_RAM_SIZE])) == 0) {
     // For compatibility reasons, 8KB of ram is always given to the rom, even
     // in mappers where it did not actually exist (like UxROM).
@@ -286,7 +291,7 @@ static size_t GetInesPrgRamSize(char *file_header) {
  *
  * Assumes the file header is non-null, 16 bytes long, and in the INES format.
  */
-static void DecodeInesBools(RomHeader *header, char *file_header) {
+static void DecodeInesBools(RomHeader *header, const DataWord *file_header) {
   // Convert the VS bool to the header enum.
   if (file_header[FLAG_7] & 0x01) {
     header->console_type = VS;
@@ -311,7 +316,7 @@ static void DecodeInesBools(RomHeader *header, char *file_header) {
  * NES 2.0 format.
  * Assumes the structure is non-null.
  */
-static void DecodeNes2(RomHeader *header, char *file_header) {
+static void DecodeNes2(RomHeader *header, const DataWord *file_header) {
   // TODO: Implement NES 2.0 header decoding.
   fprintf(stderr,
           "Warning: NES 2.0 headers are not implemented. Decoding as INES\n");
@@ -325,7 +330,7 @@ static void DecodeNes2(RomHeader *header, char *file_header) {
  *
  * Assumes the header is non-null, 16 bytes long, and in the NES 2.0 format.
  */
-static size_t GetNes2PrgRomSize(char *file_header) {
+static size_t GetNes2PrgRomSize(const DataWord *file_header) {
   DataWord prg_lsb = static_cast<DataWord>(file_header[PRG_ROM_SIZE_LSB]);
   DataWord prg_msb = static_cast<DataWord>(file_header[9] & 0x0fU);
   return GetNes2RomSectionSize(prg_lsb, prg_msb, PRG_ROM_CHUNKSIZE);
@@ -336,7 +341,7 @@ static size_t GetNes2PrgRomSize(char *file_header) {
  *
  * Assumes the header is non-null, 16 bytes long, and in the NES 2.0 format.
  */
-static size_t GetNes2ChrRomSize(char *file_header) {
+static size_t GetNes2ChrRomSize(const DataWord *file_header) {
   DataWord chr_lsb = static_cast<DataWord>(file_header[CHR_ROM_SIZE_LSB]);
   DataWord chr_msb = (static_cast<DataWord>(file_header[9])) >> 4;
   return GetNes2RomSectionSize(chr_lsb, chr_msb, CHR_ROM_CHUNKSIZE);
@@ -353,7 +358,8 @@ static size_t GetNes2RomSectionSize(DataWord lsb, DataWord msb,
   if (msb == 0xfU) {
     // If the msb is 0xf, then the size follows the formula 2^E * (MM * 2 + 1),
     // where E is the high 6 bits of the lsb and MM is the lower 2 bits.
-    return (1 << (lsb & 0xFC)) * (((lsb & 0x03) << 1) + 1);
+    return (static_cast<size_t>(1) << (lsb >> 2U))
+         * ((static_cast<size_t>(lsb & 0x03U) << 1U) + 1U);
   } else {
     // Otherwise, the msb and lsb are considered as one number and multiplied
     // by the given unit size.
@@ -1,7 +1,9 @@
 #ifndef _NES_INES
 #define _NES_INES
 
-#include <cstdio>
+#include <cstdlib>
+
+#include "../util/data.h"
 
 // Total size of any NES header in bytes.
 #define HEADER_SIZE 16U
@@ -9,8 +11,9 @@
 // Encodes the type of header which the structure was created from.
 typedef enum {INES, ARCHAIC_INES, NES2} NesHeaderType;
 
-// The mapper which should be used by the memory system.
-typedef enum {NROM = 0, SXROM = 1, UXROM = 2} NesMapperType;
+// The mapper which should be used by the memory system. Any mapper number
+// can be decoded from a header, so the type holds every 8-bit value.
+typedef enum : DataWord {NROM = 0, SXROM = 1, UXROM = 2} NesMapperType;
 
 // Encodes the console we need to emulate.
 typedef enum {NES, VS, PC10, EXT} NesConsoleType;
@@ -70,7 +73,8 @@ typedef struct {
   size_t num_misc_roms;
 } RomHeader;
 
-// Decodes a 16-byte header into a header structure.
-RomHeader *DecodeHeader(FILE *rom_file);
+// Decodes the 16-byte header of a rom image into a header structure.
+// Returns NULL if the header is invalid, or does not match the image.
+RomHeader *DecodeHeader(const DataWord *rom, size_t rom_size);
 
 #endif
@@ -14,10 +14,12 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 #include "../../util/util.h"
 #include "../../util/data.h"
-#include "../../config/config.h"
+#include "../../util/state.h"
+#include "../../util/arena.h"
 #include "../../io/controller.h"
 #include "../../cpu/cpu.h"
 #include "../../ppu/ppu.h"
@@ -42,25 +44,51 @@
 #define PATTERN_TABLE_MASK 0x1FFFU
 
 /*
- * Uses the provided rom file and header to initialize the StdBanked class.
+ * Creates a StdBanked object for the given rom image and header, taking
+ * ownership of the header.
+ *
+ * Returns NULL if the header asks for more memory than the mapper can
+ * address, in which case the header is freed.
+ */
+Memory *StdBanked::Create(const DataWord *rom, RomHeader *header,
+                          Arena *arena) {
+  StdBanked *mem = new StdBanked(header, arena);
+  if (!mem->Load(rom, arena)) {
+    delete mem;
+    return NULL;
+  }
+  return mem;
+}
+
+/*
+ * Stores the provided header. The mapper is not usable until its memory
+ * has been loaded.
+ */
+StdBanked::StdBanked(RomHeader *header, Arena *arena)
+         : Memory(header, arena) {
+  return;
+}
+
+/*
+ * Allocates the ram of the cartridge from the given arena, and loads the
+ * given rom image, which is kept on the heap.
+ *
+ * Returns false if the rom cannot be addressed by the mapper.
  *
- * Assumes the provided rom file is non-null and points to a valid NES rom.
  * Assumes the provided header was created from the rom and is valid.
  */
-StdBanked::StdBanked(FILE *rom_file, RomHeader *header, Config *config)
-         : Memory(header, config) {
+bool StdBanked::Load(const DataWord *rom, Arena *arena) {
   // Setup the ram space.
-  ram_ = RandNew(RAM_SIZE);
-  bat_ = RandNew(BAT_SIZE);
+  ram_ = arena->NewRand(RAM_SIZE);
+  bat_ = arena->NewRand(BAT_SIZE);
 
   // Load the rom data into memory.
-  header_ = header;
-  LoadPrg(rom_file);
-  LoadChr(rom_file);
+  if (!LoadPrg(rom)) { return false; }
+  LoadChr(rom, arena);
 
   // Setup the nametable in vram.
-  nametable_[0] = RandNew(NAMETABLE_SIZE);
-  nametable_[3] = RandNew(NAMETABLE_SIZE);
+  nametable_[0] = arena->NewRand(NAMETABLE_SIZE);
+  nametable_[3] = arena->NewRand(NAMETABLE_SIZE);
   if (header_->mirror) {
     // Vertical (horizontal arrangement) mirroring.
     nametable_[1] = nametable_[3];
@@ -71,31 +99,37 @@ StdBanked::StdBanked(FILE *rom_file, RomHeader *header, Config *config)
     nametable_[2] = nametable_[3];
   }
 
-  return;
+  return true;
 }
 
 /*
- * Loads the program rom data into the calling StdBanked class during contruction.
+ * Loads the program rom data into the calling StdBanked class during
+ * creation. Banks which can be selected but are not in the rom mirror the
+ * banks which are.
+ *
+ * Returns false if the rom has more banks than the mapper can address.
  *
- * Assumes the provided rom file is non-null and points to a valid NES rom.
+ * Assumes the provided rom image holds all of the memory in its header.
  * Assumes the header field of the class is valid and matches the rom.
  */
-void StdBanked::LoadPrg(FILE *rom_file) {
+bool StdBanked::LoadPrg(const DataWord *rom) {
   // Calculate and verify the number of PRG-ROM banks.
   size_t num_banks = static_cast<size_t>(header_->prg_rom_size / BANK_SIZE);
-  if ((header_->mapper == NROM) && (num_banks > 2)) {
+  size_t max_banks = (header_->mapper == NROM) ? 2U : UXROM_MAX_BANKS;
+  if ((num_banks == 0) || (num_banks > max_banks)) {
     fprintf(stderr, "Error: The ROM file requested an invalid amount of "
                     "program memory for its mapper.\n");
-    abort();
+    return false;
   }
 
   // Load the rom into memory.
-  fseek(rom_file, HEADER_SIZE, SEEK_SET);
+  num_banks_ = num_banks;
   for (size_t i = 0; i < num_banks; i++) {
     cart_[i] = new DataWord[BANK_SIZE];
-    for (size_t j = 0; j < BANK_SIZE; j++) {
-      cart_[i][j] = fgetc(rom_file);
-    }
+    memcpy(cart_[i], &(rom[HEADER_SIZE + i * BANK_SIZE]), BANK_SIZE);
+  }
+  for (size_t i = num_banks; i < UXROM_MAX_BANKS; i++) {
+    cart_[i] = cart_[i % num_banks];
   }
 
   // Setup the default banks and max banks.
@@ -106,31 +140,29 @@ void StdBanked::LoadPrg(FILE *rom_file) {
                ? UOROM_BANK_MASK : UNROM_BANK_MASK;
   }
 
-  return;
+  return true;
 }
 
 /*
- * Loads the CHR ROM data into the calling StdBanked class during construction.
+ * Loads the CHR ROM data into the calling StdBanked class during creation.
  *
- * Assumes the provided rom file is non-null and points to a valid NES rom.
+ * Assumes the provided rom image holds all of the memory in its header.
  * Assumes the header field of the class is valid and matches the rom.
  */
-void StdBanked::LoadChr(FILE *rom_file) {
+void StdBanked::LoadChr(const DataWord *rom, Arena *arena) {
   // Check if the rom is using chr-ram, and allocate it if so.
   if (header_->chr_ram_size > 0) {
     is_chr_ram_ = true;
-    pattern_table_ = RandNew(CHR_RAM_SIZE);
+    pattern_table_ = arena->NewRand(CHR_RAM_SIZE);
     return;
   }
 
   // Otherwise, the rom uses chr-rom and the data needs to be copied
-  // from the rom file.
+  // from the rom image. Only the first table can be addressed.
   is_chr_ram_ = false;
-  pattern_table_ = new DataWord[header_->chr_rom_size];
-  fseek(rom_file, HEADER_SIZE + header_->prg_rom_size, SEEK_SET);
-  for (size_t i = 0; i < PATTERN_TABLE_SIZE; i++) {
-    pattern_table_[i] = fgetc(rom_file);
-  }
+  pattern_table_ = new DataWord[PATTERN_TABLE_SIZE];
+  memcpy(pattern_table_, &(rom[HEADER_SIZE + header_->prg_rom_size]),
+         PATTERN_TABLE_SIZE);
 
   return;
 }
@@ -175,14 +207,45 @@ DataWord StdBanked::Read(DoubleWord addr) {
 }
 
 /*
- * TODO
+ * Reads a value from the given address without side effects. Reads from the
+ * switchable bank use the given bank, if it is not negative. MMIO cannot be
+ * read without side effects, so the last value on the bus is given instead.
  */
 DataWord StdBanked::Inspect(DoubleWord addr, int sel) {
-  (void)addr;
-  (void)sel;
+  if (addr < PPU_OFFSET) {
+    return ram_[addr & RAM_MASK];
+  } else if ((BAT_OFFSET <= addr) && (addr < BANK_OFFSET)) {
+    return bat_[addr & BAT_MASK];
+  } else if ((BANK_OFFSET <= addr) && (addr < FIXED_BANK_OFFSET)) {
+    size_t bank = (sel < 0) ? current_bank_
+                            : static_cast<size_t>(sel) % num_banks_;
+    return cart_[bank][addr & BANK_ADDR_MASK];
+  } else if (addr >= FIXED_BANK_OFFSET) {
+    return cart_[fixed_bank_][addr & BANK_ADDR_MASK];
+  }
+  return bus_;
+}
+
+/*
+ * Gets the bank of cart memory mapped to the given address.
+ */
+size_t StdBanked::GetPrgBank(DoubleWord addr) {
+  if ((BANK_OFFSET <= addr) && (addr < FIXED_BANK_OFFSET)) {
+    return current_bank_ % num_banks_;
+  } else if (addr >= FIXED_BANK_OFFSET) {
+    return fixed_bank_;
+  }
   return 0;
 }
 
+/*
+ * Exposes the system ram to the caller. The exposed data must not be
+ * modified.
+ */
+const DataWord *StdBanked::RamExpose(void) {
+  return const_cast<const DataWord*>(ram_);
+}
+
 /*
  * Writes a value to the given address, accounting for MMIO.
  *
@@ -285,24 +348,52 @@ void StdBanked::VramWrite(DoubleWord addr, DataWord val) {
 }
 
 /*
- * Deletes the calling StdBanked object.
- *
- * Assumes that the fixed bank is the final allocated bank.
+ * Writes the system ram, battery ram, nametables, CHR-RAM, and the selected
+ * bank to the given state. CHR-ROM is not saved, as it cannot change.
+ */
+void StdBanked::SaveState(StateWriter *state) {
+  Memory::SaveState(state);
+  state->Put(bus_);
+  state->Write(ram_, RAM_SIZE);
+  state->Write(bat_, BAT_SIZE);
+  state->Write(nametable_[0], NAMETABLE_SIZE);
+  state->Write(nametable_[3], NAMETABLE_SIZE);
+  if (is_chr_ram_) { state->Write(pattern_table_, CHR_RAM_SIZE); }
+  state->Put(current_bank_);
+  return;
+}
+
+/*
+ * Restores the memory and selected bank of the mapper from the given state.
+ * Returns false if the state was too short, or selected a bank which does
+ * not exist.
+ */
+bool StdBanked::LoadState(StateReader *state) {
+  bool valid = Memory::LoadState(state);
+  state->Get(&bus_);
+  state->Read(ram_, RAM_SIZE);
+  state->Read(bat_, BAT_SIZE);
+  state->Read(nametable_[0], NAMETABLE_SIZE);
+  state->Read(nametable_[3], NAMETABLE_SIZE);
+  if (is_chr_ram_) { state->Read(pattern_table_, CHR_RAM_SIZE); }
+  state->Get(&current_bank_);
+
+  // Fall back to the first bank if the selected bank does not exist.
+  valid = valid && !state->HasFailed() && (current_bank_ <= fixed_bank_);
+  if (current_bank_ > fixed_bank_) { current_bank_ = 0; }
+  return valid;
+}
+
+/*
+ * Deletes the calling StdBanked object. The ram and nametables belong to the
+ * arena of the console, and are freed with it.
  */
 StdBanked::~StdBanked(void) {
-  // Free the CPU memory arrays.
-  delete[] ram_;
-  delete[] bat_;
-
-  // Free the VRAM data.
-  delete[] nametable_[0];
-  delete[] nametable_[3];
-  delete[] pattern_table_;
-
-  // Frees each bank of CPU memory.
-  for (size_t i = 0; i < (fixed_bank_ + 1U); i++) {
-    delete[] cart_[i];
-  }
+  // Free the CHR-ROM data.
+  if (!is_chr_ram_) { delete[] pattern_table_; }
+
+  // Frees each bank of CPU memory. The remaining banks are mirrors.
+  for (size_t i = 0; i < num_banks_; i++) { delete[] cart_[i]; }
 
   return;
 }
@@ -5,7 +5,8 @@
 #include <cstdint>
 
 #include "../../util/data.h"
-#include "../../config/config.h"
+#include "../../util/state.h"
+#include "../../util/arena.h"
 #include "../memory.h"
 #include "../header.h"
 
@@ -27,6 +28,7 @@ class StdBanked : public Memory {
     // Cart memory.
     DataWord *bat_;
     DataWord *cart_[UXROM_MAX_BANKS];
+    size_t num_banks_ = 0;
     DataWord current_bank_ = 0;
     // Should always be fixed to the final bank used.
     DataWord fixed_bank_;
@@ -34,24 +36,36 @@ class StdBanked : public Memory {
 
     // PPU memory.
     DataWord *pattern_table_;
-    bool is_chr_ram_;
+    bool is_chr_ram_ = true;
     DataWord *nametable_[UXROM_MAX_SCREENS];
 
+    // Stores the header of the mapper. Its memory is loaded by Create().
+    StdBanked(RomHeader *header, Arena *arena);
+
     // Helper functions for this class.
-    void LoadPrg(FILE *rom_file);
-    void LoadChr(FILE *rom_file);
+    bool Load(const DataWord *rom, Arena *arena);
+    bool LoadPrg(const DataWord *rom);
+    void LoadChr(const DataWord *rom, Arena *arena);
 
   public:
     // Functions implemented for the abstract class Memory.
     DataWord Read(DoubleWord addr);
     DataWord Inspect(DoubleWord addr, int sel = -1);
+    size_t GetPrgBank(DoubleWord addr);
+    const DataWord *RamExpose(void);
     void Write(DoubleWord addr, DataWord val);
     bool CheckRead(DoubleWord addr);
     bool CheckWrite(DoubleWord addr);
     DataWord VramRead(DoubleWord addr);
     void VramWrite(DoubleWord addr, DataWord val);
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
+    // Loads the given rom image into a new mapper, which owns the given
+    // header. Returns NULL if the rom cannot be addressed by the mapper.
+    static Memory *Create(const DataWord *rom, RomHeader *header,
+                          Arena *arena);
 
-    StdBanked(FILE *rom_file, RomHeader *header, Config *config);
     ~StdBanked(void);
 };
 
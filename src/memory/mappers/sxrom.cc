@@ -15,10 +15,12 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 #include "../../util/util.h"
 #include "../../util/data.h"
-#include "../../config/config.h"
+#include "../../util/state.h"
+#include "../../util/arena.h"
 #include "../../cpu/cpu.h"
 #include "../../ppu/ppu.h"
 #include "../../apu/apu.h"
@@ -66,53 +68,88 @@
 #define PATTERN_TABLE_MASK 0x0FFFU
 
 /*
- * Uses the provided rom file and header to initialize and create an
- * Sxrom class.
+ * Creates an Sxrom object for the given rom image and header, taking
+ * ownership of the header.
  *
- * Assumes the provided rom file and header are valid.
+ * Returns NULL if the header asks for more memory than the mapper can
+ * address, in which case the header is freed.
  */
-Sxrom::Sxrom(FILE *rom_file, RomHeader *header, Config *config)
-     : Memory(header, config) {
+Memory *Sxrom::Create(const DataWord *rom, RomHeader *header, Arena *arena) {
+  Sxrom *mem = new Sxrom(header, arena);
+  if (!mem->Load(rom, arena)) {
+    delete mem;
+    return NULL;
+  }
+  return mem;
+}
+
+/*
+ * Stores the provided header. The mapper is not usable until its memory
+ * has been loaded.
+ */
+Sxrom::Sxrom(RomHeader *header, Arena *arena) : Memory(header, arena) {
+  return;
+}
+
+/*
+ * Allocates the ram of the console and cartridge from the given arena, and
+ * loads the given rom image, which is kept on the heap.
+ *
+ * Returns false if the memory in the header cannot be addressed by the
+ * mapper.
+ *
+ * Assumes the provided rom image holds all of the memory in its header.
+ */
+bool Sxrom::Load(const DataWord *rom, Arena *arena) {
   // Setup the NES ram space.
-  ram_ = RandNew(RAM_SIZE);
+  ram_ = arena->NewRand(RAM_SIZE);
 
   // Load the rom data into memory.
-  LoadPrgRom(rom_file);
-  LoadChr(rom_file);
+  if (!LoadPrgRom(rom) || !LoadChr(rom, arena)) { return false; }
 
   // Set up the cart ram space.
-  LoadPrgRam();
+  if (!LoadPrgRam(arena)) { return false; }
 
   // Setup the nametable in vram. The header mirroring bit is ignored in
   // this mapper, so we set the mirrored banks to a default value for now.
-  nametable_bank_a_ = RandNew(SCREEN_SIZE);
-  nametable_bank_b_ = RandNew(SCREEN_SIZE);
+  nametable_bank_a_ = arena->NewRand(SCREEN_SIZE);
+  nametable_bank_b_ = arena->NewRand(SCREEN_SIZE);
   nametable_[0] = nametable_bank_a_;
   nametable_[1] = nametable_bank_a_;
   nametable_[2] = nametable_bank_a_;
   nametable_[3] = nametable_bank_a_;
 
-  return;
+  return true;
 }
 
 /*
- * Loads the given rom file into the sxrom memory object.
+ * Loads the given rom image into the sxrom memory object. Banks which can be
+ * selected but are not in the rom mirror the banks which are.
  * Note that while this implementation assumes the banks will boot in mode 3,
  * with the upper half of rom fixed to the last bank and the lower half on bank
  * 0, this is not specified in original hardware.
  *
- * Assumes the provided rom_file is valid.
+ * Returns false if the rom has more banks than the mapper can address.
+ *
+ * Assumes the provided rom image holds all of the memory in its header.
  * Assumes the object was initialized with a valid header structure.
  */
-void Sxrom::LoadPrgRom(FILE *rom_file) {
-  // Get the number of PRG-ROM banks, then load the rom into memory.
-  num_prg_rom_banks_ = header_->prg_rom_size / ROM_BANK_SIZE;
-  fseek(rom_file, HEADER_SIZE, SEEK_SET);
+bool Sxrom::LoadPrgRom(const DataWord *rom) {
+  // Verify the number of PRG-ROM banks, then load the rom into memory.
+  size_t num_banks = header_->prg_rom_size / ROM_BANK_SIZE;
+  if ((num_banks == 0) || (num_banks > SXROM_MAX_ROM_BANKS)) {
+    fprintf(stderr, "Error: The ROM file requested an invalid amount of "
+                    "program memory for its mapper.\n");
+    return false;
+  }
+  num_prg_rom_banks_ = static_cast<DataWord>(num_banks);
   for (size_t i = 0; i < num_prg_rom_banks_; i++) {
     prg_rom_[i] = new DataWord[ROM_BANK_SIZE];
-    for (size_t j = 0; j < ROM_BANK_SIZE; j++) {
-      prg_rom_[i][j] = fgetc(rom_file);
-    }
+    memcpy(prg_rom_[i], &(rom[HEADER_SIZE + i * ROM_BANK_SIZE]),
+           ROM_BANK_SIZE);
+  }
+  for (size_t i = num_prg_rom_banks_; i < SXROM_MAX_ROM_BANKS; i++) {
+    prg_rom_[i] = prg_rom_[i % num_prg_rom_banks_];
   }
 
   // Determine if the requested PRG-ROM size needs a fifth selection bit.
@@ -125,39 +162,47 @@ void Sxrom::LoadPrgRom(FILE *rom_file) {
   // Setup the default bank mode.
   prg_rom_bank_b_ = num_prg_rom_banks_ - 1;
 
-  return;
+  return true;
 }
 
 /*
  * Determines if the given rom is using CHR-ROM or CHR-RAM, then creates
  * the necessary banks. Loads in the CHR data if the board is using CHR-ROM.
- * Creates a mask for accessing the CHR control register.
+ * Creates a mask for accessing the CHR control register. Banks which can be
+ * selected but do not exist mirror the banks which do.
  *
- * This function aborts if the created mask conflicts with the PRG-ROM mask.
+ * Returns false if the number of banks cannot be addressed, or if the
+ * created mask conflicts with the PRG-ROM mask.
  *
- * Assumes the provided rom file is valid.
+ * Assumes the provided rom image holds all of the memory in its header.
  * Assumes that the calling object has had its PRG-ROM initialized.
  */
-void Sxrom::LoadChr(FILE *rom_file) {
-  // Check if the rom is using CHR-RAM, and allocate it if so.
-  if (header_->chr_ram_size > 0) {
-    is_chr_ram_ = true;
-    num_chr_banks_ = header_->chr_ram_size / CHR_BANK_SIZE;
-    for (size_t i = 0; i < num_chr_banks_; i++) {
-      pattern_table_[i] = RandNew(CHR_BANK_SIZE);
-    }
-  } else {
-    // Otherwise, the rom is using CHR-ROM and we must load it into the mapper.
-    is_chr_ram_ = false;
-    num_chr_banks_ = header_->chr_rom_size / CHR_BANK_SIZE;
-    fseek(rom_file, HEADER_SIZE + header_->prg_rom_size, SEEK_SET);
-    for (size_t i = 0; i < num_chr_banks_; i++) {
+bool Sxrom::LoadChr(const DataWord *rom, Arena *arena) {
+  // Verify the number of CHR banks.
+  is_chr_ram_ = (header_->chr_ram_size > 0);
+  size_t num_banks = (is_chr_ram_ ? header_->chr_ram_size
+                                  : header_->chr_rom_size) / CHR_BANK_SIZE;
+  if ((num_banks == 0) || (num_banks > SXROM_MAX_CHR_BANKS)) {
+    fprintf(stderr, "Error: The ROM file requested an invalid amount of "
+                    "CHR memory for its mapper.\n");
+    return false;
+  }
+
+  // Allocate the CHR-RAM if the rom uses it. Otherwise, the rom is using
+  // CHR-ROM and we must load it into the mapper.
+  num_chr_banks_ = static_cast<DataWord>(num_banks);
+  for (size_t i = 0; i < num_chr_banks_; i++) {
+    if (is_chr_ram_) {
+      pattern_table_[i] = arena->NewRand(CHR_BANK_SIZE);
+    } else {
       pattern_table_[i] = new DataWord[CHR_BANK_SIZE];
-      for (size_t j = 0; j < CHR_BANK_SIZE; j++) {
-        pattern_table_[i][j] = fgetc(rom_file);
-      }
+      memcpy(pattern_table_[i], &(rom[HEADER_SIZE + header_->prg_rom_size
+                                    + i * CHR_BANK_SIZE]), CHR_BANK_SIZE);
     }
   }
+  for (size_t i = num_chr_banks_; i < SXROM_MAX_CHR_BANKS; i++) {
+    pattern_table_[i] = pattern_table_[i % num_chr_banks_];
+  }
 
   // Calculate the mask to be used to select the CHR banks in the CHR control
   // register.
@@ -168,10 +213,10 @@ void Sxrom::LoadChr(FILE *rom_file) {
   if (chr_bank_mask_ & prg_rom_high_mask_) {
     fprintf(stderr, "Error: The requested amount of PRG-ROM cannot be "
                     "addressed with the given CHR size.\n");
-    abort();
+    return false;
   }
 
-  return;
+  return true;
 }
 
 /*
@@ -189,17 +234,18 @@ DataWord Sxrom::CreateMask(DataWord items) {
 }
 
 /*
- * Creates a ram space with the amount of memory requested by the mapper.
+ * Creates a ram space with the amount of memory requested by the mapper,
+ * allocated from the given arena.
  * If an INES header is used, the size is not defined and is created
  * based on the number of free bits in the CHR bank mask.
  *
- * If a NES2.0 header is specified, and the requested amount of PRG-RAM
- * conflicts with the CHR bank mask, this function aborts.
+ * Returns false if a NES2.0 header requests more PRG-RAM than the mapper
+ * can address, or an amount which conflicts with the CHR bank mask.
  *
  * Assumes the calling object was provided a valid header during initialization.
  * Assumes CHR data has been initialized for the calling object.
  */
-void Sxrom::LoadPrgRam(void) {
+bool Sxrom::LoadPrgRam(Arena *arena) {
   // Determine if the rom supplied a valid PRG-RAM size.
   if (header_->header_type != NES2) {
     // Determine the max amount of ram that can be given to the rom from
@@ -213,7 +259,13 @@ void Sxrom::LoadPrgRam(void) {
     }
   } else {
     // The mapper is NES 2.0, so we can use the specified PRG-RAM size.
-    num_prg_ram_banks_ = header_->prg_ram_size / RAM_BANK_SIZE;
+    size_t num_banks = header_->prg_ram_size / RAM_BANK_SIZE;
+    if (num_banks > SXROM_MAX_RAM_BANKS) {
+      fprintf(stderr, "Error: The ROM file requested an invalid amount of "
+                      "PRG-RAM for its mapper.\n");
+      return false;
+    }
+    num_prg_ram_banks_ = static_cast<DataWord>(num_banks);
   }
 
   // Create the bank mask/shift from the number of banks.
@@ -226,15 +278,20 @@ void Sxrom::LoadPrgRam(void) {
   if (prg_ram_bank_mask_ & chr_bank_mask_) {
     fprintf(stderr, "Error: the requested amount of PRG-RAM cannot be"
                     " addressed with the given CHR size.\n");
-    abort();
+    return false;
   }
 
-  // Allocate the PRG-RAM banks.
+  // Allocate the PRG-RAM banks. Banks which can be selected but do not
+  // exist mirror the banks which do.
   for (size_t i = 0; i < num_prg_ram_banks_; i++) {
-    prg_ram_[i] = RandNew(RAM_BANK_SIZE);
+    prg_ram_[i] = arena->NewRand(RAM_BANK_SIZE);
+  }
+  for (size_t i = num_prg_ram_banks_; (num_prg_ram_banks_ > 0)
+                                   && (i < SXROM_MAX_RAM_BANKS); i++) {
+    prg_ram_[i] = prg_ram_[i % num_prg_ram_banks_];
   }
 
-  return;
+  return true;
 }
 
 /*
@@ -280,14 +337,46 @@ DataWord Sxrom::Read(DoubleWord addr) {
 }
 
 /*
- * TODO
+ * Reads a value from the given address without side effects. Reads from
+ * PRG-ROM use the given bank for either half, if it is not negative. MMIO
+ * cannot be read without side effects, so the last value on the bus is
+ * given instead.
  */
 DataWord Sxrom::Inspect(DoubleWord addr, int sel) {
-  (void)addr;
-  (void)sel;
+  if (addr < PPU_OFFSET) {
+    return ram_[addr & RAM_MASK];
+  } else if ((PRG_RAM_OFFSET <= addr) && (addr < PRG_ROM_A_OFFSET)
+                                      && (num_prg_ram_banks_ > 0)
+                                      && !(prg_reg_ & FLAG_PRG_RAM_DISABLE)) {
+    return prg_ram_[prg_ram_bank_][addr & PRG_RAM_MASK];
+  } else if (addr >= PRG_ROM_A_OFFSET) {
+    size_t bank = (sel >= 0) ? static_cast<size_t>(sel) % num_prg_rom_banks_
+                             : GetPrgBank(addr);
+    return prg_rom_[bank][addr & PRG_ROM_MASK];
+  }
+  return bus_;
+}
+
+/*
+ * Gets the bank of PRG-ROM mapped to the given address.
+ */
+size_t Sxrom::GetPrgBank(DoubleWord addr) {
+  if ((PRG_ROM_A_OFFSET <= addr) && (addr < PRG_ROM_B_OFFSET)) {
+    return prg_rom_bank_a_ % num_prg_rom_banks_;
+  } else if (addr >= PRG_ROM_B_OFFSET) {
+    return prg_rom_bank_b_ % num_prg_rom_banks_;
+  }
   return 0;
 }
 
+/*
+ * Exposes the system ram to the caller. The exposed data must not be
+ * modified.
+ */
+const DataWord *Sxrom::RamExpose(void) {
+  return const_cast<const DataWord*>(ram_);
+}
+
 /*
  * Attempts to write the given value to requested address, updating
  * the controlling registers if PRG-ROM was written to.
@@ -487,6 +576,64 @@ void Sxrom::UpdateChrBanks(void) {
   return;
 }
 
+/*
+ * Writes the system ram, cart ram, nametables, CHR-RAM, and the mapper
+ * registers to the given state. ROM is not saved, as it cannot change.
+ */
+void Sxrom::SaveState(StateWriter *state) {
+  Memory::SaveState(state);
+  state->Put(bus_);
+  state->Write(ram_, RAM_SIZE);
+  for (size_t i = 0; i < num_prg_ram_banks_; i++) {
+    state->Write(prg_ram_[i], RAM_BANK_SIZE);
+  }
+  for (size_t i = 0; is_chr_ram_ && (i < num_chr_banks_); i++) {
+    state->Write(pattern_table_[i], CHR_BANK_SIZE);
+  }
+  state->Write(nametable_bank_a_, SCREEN_SIZE);
+  state->Write(nametable_bank_b_, SCREEN_SIZE);
+  state->Put(shift_reg_);
+  state->Put(control_reg_);
+  state->Put(chr_a_reg_);
+  state->Put(chr_b_reg_);
+  state->Put(prg_reg_);
+  state->Put(prg_ram_bank_);
+  return;
+}
+
+/*
+ * Restores the memory and registers of the mapper from the given state.
+ * The bank selections and nametable mirroring are recalculated from the
+ * registers. Returns false if the state was too short, or selected a cart
+ * ram bank which does not exist.
+ */
+bool Sxrom::LoadState(StateReader *state) {
+  bool valid = Memory::LoadState(state);
+  state->Get(&bus_);
+  state->Read(ram_, RAM_SIZE);
+  for (size_t i = 0; i < num_prg_ram_banks_; i++) {
+    state->Read(prg_ram_[i], RAM_BANK_SIZE);
+  }
+  for (size_t i = 0; is_chr_ram_ && (i < num_chr_banks_); i++) {
+    state->Read(pattern_table_[i], CHR_BANK_SIZE);
+  }
+  state->Read(nametable_bank_a_, SCREEN_SIZE);
+  state->Read(nametable_bank_b_, SCREEN_SIZE);
+  state->Get(&shift_reg_);
+  state->Get(&control_reg_);
+  state->Get(&chr_a_reg_);
+  state->Get(&chr_b_reg_);
+  state->Get(&prg_reg_);
+  state->Get(&prg_ram_bank_);
+
+  // Recalculate the banks from the registers, just as a write would.
+  UpdateControl(control_reg_);
+  valid = valid && !state->HasFailed()
+       && (prg_ram_bank_ < MAX(num_prg_ram_banks_, 1U));
+  if (prg_ram_bank_ >= MAX(num_prg_ram_banks_, 1U)) { prg_ram_bank_ = 0; }
+  return valid;
+}
+
 /*
  * Reads a word from VRAM using the bank selection registers.
  */
@@ -537,22 +684,17 @@ void Sxrom::VramWrite(DoubleWord addr, DataWord val) {
 }
 
 /*
- * Deletes the calling Sxrom object.
+ * Deletes the calling Sxrom object. The ram and nametables belong to the
+ * arena of the console, and are freed with it.
  */
 Sxrom::~Sxrom(void) {
-  // Free the CPU memory array.
-  delete[] ram_;
-
-  // Free the cartridge rom and ram.
+  // Free the cartridge rom.
   for (size_t i = 0; i < num_prg_rom_banks_; i++) { delete[] prg_rom_[i]; }
-  for (size_t i = 0; i < num_prg_ram_banks_; i++) { delete[] prg_ram_[i]; }
-
-  // Free the nametables.
-  delete[] nametable_bank_a_;
-  delete[] nametable_bank_b_;
 
-  // Free the CHR data.
-  for (size_t i = 0; i < num_chr_banks_; i++) { delete[] pattern_table_[i]; }
+  // Free the CHR-ROM data.
+  if (!is_chr_ram_) {
+    for (size_t i = 0; i < num_chr_banks_; i++) { delete[] pattern_table_[i]; }
+  }
 
   return;
 }
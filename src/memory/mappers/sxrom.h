@@ -5,7 +5,8 @@
 #include <cstdint>
 
 #include "../../util/data.h"
-#include "../../config/config.h"
+#include "../../util/state.h"
+#include "../../util/arena.h"
 #include "../memory.h"
 #include "../header.h"
 
@@ -30,13 +31,13 @@ class Sxrom : public Memory {
     // Cartridge memory space for this mapper.
     DataWord *prg_rom_[SXROM_MAX_ROM_BANKS];
     DataWord *prg_ram_[SXROM_MAX_RAM_BANKS];
-    DataWord num_prg_ram_banks_;
-    DataWord num_prg_rom_banks_;
+    DataWord num_prg_ram_banks_ = 0;
+    DataWord num_prg_rom_banks_ = 0;
 
     // PPU memory space.
     DataWord *pattern_table_[SXROM_MAX_CHR_BANKS];
-    DataWord num_chr_banks_;
-    bool is_chr_ram_;
+    DataWord num_chr_banks_ = 0;
+    bool is_chr_ram_ = true;
     DataWord *nametable_bank_a_;
     DataWord *nametable_bank_b_;
     DataWord *nametable_[SXROM_MAX_SCREENS];
@@ -62,10 +63,14 @@ class Sxrom : public Memory {
     DataWord prg_ram_bank_shift_;
     DataWord prg_rom_high_mask_;
 
+    // Stores the header of the mapper. Its memory is loaded by Create().
+    Sxrom(RomHeader *header, Arena *arena);
+
     // Helper functions for this mapper.
-    void LoadPrgRam(void);
-    void LoadPrgRom(FILE *rom_file);
-    void LoadChr(FILE *rom_file);
+    bool Load(const DataWord *rom, Arena *arena);
+    bool LoadPrgRam(Arena *arena);
+    bool LoadPrgRom(const DataWord *rom);
+    bool LoadChr(const DataWord *rom, Arena *arena);
     DataWord CreateMask(DataWord items);
     void UpdateRegisters(DoubleWord addr, DataWord val);
     void UpdateControl(DataWord update);
@@ -76,13 +81,21 @@ class Sxrom : public Memory {
     // Functions implemented for the abstract class Memory.
     DataWord Read(DoubleWord addr);
     DataWord Inspect(DoubleWord addr, int sel = -1);
+    size_t GetPrgBank(DoubleWord addr);
+    const DataWord *RamExpose(void);
     void Write(DoubleWord addr, DataWord val);
     bool CheckRead(DoubleWord addr);
     bool CheckWrite(DoubleWord addr);
     DataWord VramRead(DoubleWord addr);
     void VramWrite(DoubleWord addr, DataWord val);
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
+    // Loads the given rom image into a new mapper, which owns the given
+    // header. Returns NULL if the rom cannot be addressed by the mapper.
+    static Memory *Create(const DataWord *rom, RomHeader *header,
+                          Arena *arena);
 
-    Sxrom(FILE *rom_file, RomHeader *header, Config *config);
     ~Sxrom(void);
 };
 
@@ -22,6 +22,7 @@
 
 #include "../util/util.h"
 #include "../util/data.h"
+#include "../util/state.h"
 #include "../ppu/ppu.h"
 #include "../cpu/cpu.h"
 #include "../io/controller.h"
@@ -32,28 +33,33 @@
 #include "./mappers/sxrom.h"
 
 /*
- * Decodes the header of the provided rom file, and creates the appropriate
- * memory class for it.
+ * Decodes the header of the provided rom image, and creates the appropriate
+ * memory class for it. The image is copied, and need not outlive the
+ * returned object.
  *
  * On success, the returned value is a memory mapper object cast to Memory.
  * On failure, returns NULL.
  *
- * Assumes the provided rom file is non-null and a valid NES rom.
+ * The ram of the mapper is allocated from the given arena, which must
+ * outlive the returned object.
+ *
+ * Assumes the provided rom image is non-null.
  */
-Memory *Memory::Create(FILE *rom_file, Config *config) {
-  // Use the provided rom file to create a decoded rom header.
-  RomHeader *header = DecodeHeader(rom_file);
+Memory *Memory::Create(const DataWord *rom, size_t rom_size, Arena *arena) {
+  // Use the provided rom image to create a decoded rom header.
+  RomHeader *header = DecodeHeader(rom, rom_size);
   if (header == NULL) { return NULL; }
 
   // Use the decoded header to decide which memory structure should be created.
+  // The memory structure takes ownership of the header, even on failure.
   Memory *mem = NULL;
   switch(header->mapper) {
     case NROM:
     case UXROM:
-      mem = new StdBanked(rom_file, header, config);
+      mem = StdBanked::Create(rom, header, arena);
       break;
     case SXROM:
-      mem = new Sxrom(rom_file, header, config);
+      mem = Sxrom::Create(rom, header, arena);
       break;
     default:
       fprintf(stderr, "Error: Rom requires unimplemented mapper: %d\n",
@@ -69,14 +75,10 @@ Memory *Memory::Create(FILE *rom_file, Config *config) {
 /*
  * Stores the provided header and allocates the palette array.
  */
-Memory::Memory(RomHeader *header, Config *config) {
-  // Load in the header and setup the palette data arrays.
+Memory::Memory(RomHeader *header, Arena *arena) {
+  // Load in the header and setup the palette data array.
   header_ = header;
-  pixels_ = new PixelPalette();
-
-  // Create a palette structure using the given configuration.
-  palette_ = new NesPalette(config->Get(kPaletteFileKey));
-
+  pixels_ = arena->New<PixelPalette>();
   return;
 }
 
@@ -89,9 +91,16 @@ DataWord Memory::PaletteRead(DoubleWord addr) {
 }
 
 /*
- * Writes the given value to the palette data array, then decodes the value
- * and writes it to the pixel data array. If the value is at a mirrored
- * address, then it is written again to the mirrored position in both arrays.
+ * Reads from PPU memory without side effects. By default, this is the same
+ * as a vram read, as most mappers do not respond to vram reads.
+ */
+DataWord Memory::VramInspect(DoubleWord addr) {
+  return VramRead(addr);
+}
+
+/*
+ * Writes the given value to the palette data array. If the value is at a
+ * mirrored address, then it is written again to the mirrored position.
  *
  * Assumes that the palette has been initialized.
  */
@@ -100,38 +109,33 @@ void Memory::PaletteWrite(DoubleWord addr, DataWord val) {
   const DoubleWord kPaletteMirrorAccessMask = 0x03U;
   const DoubleWord kPaletteMirrorBit = 0x10U;
 
-  // Update the palette and pixel arrays.
+  // Update the palette array. Palette memory only holds 6-bit colors.
   addr &= PALETTE_ADDR_MASK;
-  Pixel pixel_val = palette_->Decode(val);
+  val &= PIXEL_MASK;
   pixels_->nes[addr] = val;
-  pixels_->emu[addr] = pixel_val;
 
   // Check if the address is mirrored, and update its mirror if it is.
   // Values whose low 2 bits are zero are mirrored.
   if ((addr & kPaletteMirrorAccessMask) == 0) {
     addr ^= kPaletteMirrorBit;
     pixels_->nes[addr] = val;
-    pixels_->emu[addr] = pixel_val;
   }
 
   return;
 }
 
 /*
- * Updates the mask selection of the palette, then refreshes the pixel data.
- *
- * Assumes the palette has been initialized.
+ * Gets the cpu/ppu timing expected by the loaded rom, as given in its header.
  */
-void Memory::PaletteUpdate(DataWord mask) {
-  // Updates the palette mask.
-  palette_->UpdateMask(mask);
-
-  // Update each entry in the pixel array.
-  for (size_t i = 0; i < ACTIVE_PALETTE_SIZE; i++) {
-    pixels_->emu[i] = palette_->Decode(pixels_->nes[i]);
-  }
+NesTimingType Memory::GetTimingMode(void) {
+  return header_->timing_mode;
+}
 
-  return;
+/*
+ * Gets the size of the PRG-ROM of the loaded rom, in bytes.
+ */
+size_t Memory::GetPrgRomSize(void) {
+  return header_->prg_rom_size;
 }
 
 /*
@@ -159,7 +163,7 @@ void Memory::Connect(Cpu *cpu, Ppu *ppu, Apu *apu) {
 /*
  * Uses the given input to create a controller object for this memory object.
  */
-void Memory::AddController(Input *input) {
+void Memory::AddController(InputSource *input) {
   // Remove the connected controller, if it exists.
   if (controller_ != NULL)  {
     delete controller_;
@@ -171,14 +175,47 @@ void Memory::AddController(Input *input) {
   return;
 }
 
+/*
+ * Connects the given input to the second port of the added controller.
+ *
+ * Assumes a controller has been added.
+ */
+void Memory::AddSecondInput(InputSource *input) {
+  controller_->SetSecondInput(input);
+  return;
+}
+
+/*
+ * Writes palette memory and the state of the controller to the given state.
+ *
+ * Assumes a controller has been added.
+ */
+void Memory::SaveState(StateWriter *state) {
+  state->Write(pixels_->nes, sizeof(pixels_->nes));
+  controller_->SaveState(state);
+  return;
+}
+
+/*
+ * Restores palette memory and the state of the controller from the given
+ * state. Returns false if the state was too short.
+ *
+ * Assumes a controller has been added.
+ */
+bool Memory::LoadState(StateReader *state) {
+  // Palette memory only holds 6-bit colors.
+  state->Read(pixels_->nes, sizeof(pixels_->nes));
+  for (size_t i = 0; i < ACTIVE_PALETTE_SIZE; i++) {
+    pixels_->nes[i] &= PIXEL_MASK;
+  }
+  return controller_->LoadState(state);
+}
 
 /*
  * Frees the structures and objects associated with this class.
  */
 Memory::~Memory(void) {
   delete header_;
-  delete pixels_;
-  delete palette_;
   if (controller_ != NULL) { delete controller_; }
   return;
 }
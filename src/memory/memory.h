@@ -5,9 +5,10 @@
 #include <cstdint>
 
 #include "../util/data.h"
-#include "../sdl/input.h"
+#include "../util/state.h"
+#include "../util/arena.h"
+#include "../io/input_source.h"
 #include "../io/controller.h"
-#include "../config/config.h"
 #include "./palette.h"
 #include "./header.h"
 
@@ -32,6 +33,11 @@
 // CPU memory size values.
 #define RAM_SIZE 0x800U
 
+// PRG-ROM is mapped to CPU memory from here on, in banks of this size as
+// numbered by GetPrgBank().
+#define PRG_ROM_OFFSET 0x8000U
+#define PRG_BANK_SIZE 0x4000U
+
 // PPU memory map offsets.
 #define NAMETABLE_OFFSET 0x2000U
 #define PALETTE_OFFSET 0x3F00U
@@ -62,8 +68,8 @@ class Apu;
  *
  * The read and write functions allow access to the CPU's memory.
  * The vram functions allow access to the PPU's memory.
- * As an optimization, each mapper must fill a palette array that allows the
- * PPU to retrieve the xRGB color associated with any color in palette memory.
+ * Palette memory is managed by this class, and exposed to the PPU so that it
+ * can look up the NES color of each pixel it draws.
  *
  * All memory classes are given access to the header structure associated with
  * the loaded rom, should they require it in their implementation.
@@ -73,13 +79,8 @@ class Apu;
  */
 class Memory {
   private:
-    // The decoded palette, which is used to convert NES pixels to pixel format
-    // used by the emulation.
-    NesPalette *palette_;
-
     // The palette array holds the NES representation of the palette, exposed
-    // to the emulated software. The pixel data array mirrors the palette
-    // in the pixel format of the emulator.
+    // to the emulated software and the PPU.
     PixelPalette *pixels_;
 
   protected:
@@ -95,8 +96,9 @@ class Memory {
     // The controller connected to this memory object.
     Controller *controller_ = NULL;
 
-    // Stores the rom header and allocates the palette data array.
-    Memory(RomHeader *header, Config *config);
+    // Stores the rom header and allocates the palette data array from the
+    // given arena.
+    Memory(RomHeader *header, Arena *arena);
 
     // All implementations of memory should access the palette only through
     // these helper functions.
@@ -112,15 +114,31 @@ class Memory {
     virtual bool CheckRead(DoubleWord addr) = 0;
     virtual bool CheckWrite(DoubleWord addr) = 0;
 
-    // Provides a way to read from CPU memory without side effects.
+    // Provides a way to read from CPU memory without side effects. Reads
+    // from switchable PRG-ROM use the given bank, unless it is negative.
     virtual DataWord Inspect(DoubleWord addr, int sel = -1) = 0;
 
+    // Gets the PRG-ROM bank mapped to the given CPU address, numbered as
+    // Inspect() selects them. Addresses outside of PRG-ROM are in bank 0.
+    virtual size_t GetPrgBank(DoubleWord addr) = 0;
+
+    // Exposes the system ram of the CPU, which holds RAM_SIZE bytes.
+    // The exposed data must not be modified.
+    virtual const DataWord *RamExpose(void) = 0;
+
     // Provides access to PPU memory.
     virtual DataWord VramRead(DoubleWord addr) = 0;
     virtual void VramWrite(DoubleWord addr, DataWord val) = 0;
 
-    // Allows the PPU to update the current mask setting of the palette.
-    void PaletteUpdate(DataWord mask);
+    // Provides a way to read from PPU memory without side effects.
+    // Mappers whose vram reads have side effects must override this.
+    virtual DataWord VramInspect(DoubleWord addr);
+
+    // Gets the cpu/ppu timing expected by the loaded rom.
+    NesTimingType GetTimingMode(void);
+
+    // Gets the size of the PRG-ROM of the loaded rom, in bytes.
+    size_t GetPrgRomSize(void);
 
     // Exposes the decoded palette to the PPU.
     // The exposed data must not be modified.
@@ -132,13 +150,24 @@ class Memory {
 
     // Uses the given input class to create and connect a controller
     // to the memory object. Must be called before using r/w functions.
-    void AddController(Input *input);
+    void AddController(InputSource *input);
+
+    // Connects the given input to the second port of the controller.
+    // Must be called after AddController().
+    void AddSecondInput(InputSource *input);
+
+    // Saves or restores the palette and controller. Mappers must extend
+    // these to save their ram and bank registers. Loading returns false if
+    // the state was invalid.
+    virtual void SaveState(StateWriter *state);
+    virtual bool LoadState(StateReader *state);
 
     // Creates a derived memory object for the mapper of the given
-    // rom file. Returns NULL on failure.
-    static Memory *Create(FILE *rom_file, Config *config);
+    // rom image, whose ram is allocated from the given arena. Returns NULL
+    // if the rom is invalid or uses an unsupported mapper.
+    static Memory *Create(const DataWord *rom, size_t rom_size, Arena *arena);
 
-    // Frees the rom header and palette data array.
+    // Frees the rom header. The palette data array is freed with the arena.
     virtual ~Memory(void);
 };
 
@@ -1,18 +1,18 @@
 /*
- * The NesPalette class provides a way for the PPU/Memory to easily
- * convert NES pixels to RGB colors. Each Memory instance has its own
- * associated NesPalette, and each NesPalette has 8 color palettes.
+ * The NesPalette class provides a way for the renderers to easily
+ * convert NES pixels to RGB colors. Each palette file has 8 color palettes.
  * These 8 palettes represent the different color tint modes supported
- * by the NES. The PPU emulation can change the palette in use
- * through calls to UpdateMask().
+ * by the NES, which are selected using the value of PPUMASK.
  *
- * Additionally, the NesPalette is used by memory to decode NES pixels
- * into RGB colors that can be passed to the renderer by the PPU. The system
- * is as follows: The PPU writes an NES pixel to memory, memory takes the pixel
- * and uses the palette associated with its PPU to convert the pixel to RGB.
- * This RGB pixel can then be read back by the PPU during rendering, when it
- * is drawing pixels to the screen. The PPU then sends the pixel to the
- * renderer, which displays it.
+ * When a palette is loaded, it is expanded into 16 tables, one for each
+ * combination of tint and greyscale. The greyscale tables hold the grey
+ * color in place of each color. A row of colors can then be decoded with
+ * one lookup per color, using the table selected by the mask of the row.
+ *
+ * The PPU draws frames of NES colors, recording the value of PPUMASK used
+ * by each row. The renderer then uses the palette to decode each row into
+ * RGB colors when the frame is presented. Since decoding does not modify
+ * the palette, this can be done on a different thread than the emulation.
  *
  * Note that the user can load in a custom NES palette. However, if the palette
  * is invalid, or none is provided, a default will be used.
@@ -42,6 +42,10 @@
 #define FLAG_COLOR_TINT 0xE0U
 #define COLOR_TINT_SHIFT 5U
 
+// The tint selects a pair of tables, and the greyscale bit selects a table
+// within that pair.
+#define MASK_TINT_SHIFT 4U
+
 // Used to force a given color to grayscale.
 #define GRAYSCALE_MASK 0x30U
 
@@ -65,25 +69,36 @@ NesPalette::NesPalette(const char *file) {
     }
   }
 
-  // Load the palette file into the decoded palette array.
-  decoded_palette_ = new Pixel[PALETTE_SIZE * PALETTE_DIMS]();
-  uint32_t red, green, blue;
+  // Read the file the user provided in one pass, or use the default if it
+  // was invalid (or not provided).
+  DataWord file_data[PALETTE_FILE_SIZE];
+  const DataWord *pal_data = _binary_bins_nes_palette_bin_start;
   if (pal_file != NULL) {
-    // Load the file the user provided.
     fseek(pal_file, 0, SEEK_SET);
-    for (size_t i = 0; i < (PALETTE_SIZE * PALETTE_DIMS); i++) {
-      red = static_cast<DataWord>(fgetc(pal_file));
-      green = static_cast<DataWord>(fgetc(pal_file));
-      blue = static_cast<DataWord>(fgetc(pal_file));
-      decoded_palette_[i] = (red << 16) | (green << 8) | blue;
+    if (fread(file_data, 1, PALETTE_FILE_SIZE, pal_file)
+        == PALETTE_FILE_SIZE) {
+      pal_data = file_data;
+    } else {
+      fprintf(stderr, "WARNING: Could not read the specified palette file\n");
     }
-  } else {
-    // If the file was invalid (or not provided), load the default instead.
-    for (size_t i = 0; i < (PALETTE_SIZE * PALETTE_DIMS); i++) {
-      red = _binary_bins_nes_palette_bin_start[3 * i + 0];
-      green = _binary_bins_nes_palette_bin_start[3 * i + 1];
-      blue = _binary_bins_nes_palette_bin_start[3 * i + 2];
-      decoded_palette_[i] = (red << 16) | (green << 8) | blue;
+  }
+
+  // Load the palette data into the decoded palette array.
+  Pixel decoded_palette[PALETTE_SIZE * PALETTE_DIMS];
+  for (size_t i = 0; i < (PALETTE_SIZE * PALETTE_DIMS); i++) {
+    uint32_t red = pal_data[3 * i + 0];
+    uint32_t green = pal_data[3 * i + 1];
+    uint32_t blue = pal_data[3 * i + 2];
+    decoded_palette[i] = (red << 16) | (green << 8) | blue;
+  }
+
+  // Expand the palettes into a table for every tint and greyscale setting.
+  for (size_t mask = 0; mask < NUM_MASK_TABLES; mask++) {
+    size_t tint = mask >> 1;
+    DataWord color_mask = (mask & FLAG_GRAYSCALE) ? GRAYSCALE_MASK : PIXEL_MASK;
+    for (size_t color = 0; color < MASK_TABLE_SIZE; color++) {
+      mask_tables_[mask][color] = decoded_palette[tint * PALETTE_SIZE
+                                                + (color & color_mask)];
     }
   }
 
@@ -101,29 +116,31 @@ bool NesPalette::Invalid(FILE *pal_file) {
 }
 
 /*
- * Decodes an NES color into an RGB color using the current color
- * tint settings.
+ * Gets the index of the table holding the colors of the given PPU mask.
  */
-uint32_t NesPalette::Decode(DataWord color) {
-  color = (grayscale_colors_) ? (color & GRAYSCALE_MASK) : (color & PIXEL_MASK);
-  return decoded_palette_[(color_tint_ * PALETTE_SIZE) + color];
+size_t NesPalette::MaskIndex(DataWord mask) {
+  return ((mask & FLAG_COLOR_TINT) >> MASK_TINT_SHIFT)
+       | (mask & FLAG_GRAYSCALE);
 }
 
 /*
- * Updates the settings of the palette color tint using the given
- * value of PPUMASK.
+ * Decodes a row of NES colors which were drawn with the given PPU mask.
+ *
+ * Assumes each color is 6 bits.
  */
-void NesPalette::UpdateMask(DataWord mask) {
-  // Update the palette settings.
-  grayscale_colors_ = mask & FLAG_GRAYSCALE;
-  color_tint_ = (mask & FLAG_COLOR_TINT) >> COLOR_TINT_SHIFT;
+void NesPalette::DecodeRow(const DataWord *colors, DataWord mask,
+                           Pixel *pixels, size_t num) const {
+  // The mask is constant across the row, so its table is selected once.
+  const Pixel *table = mask_tables_[MaskIndex(mask)];
+  for (size_t i = 0; i < num; i++) {
+    pixels[i] = table[colors[i]];
+  }
   return;
 }
 
 /*
- * Frees the decoded palette.
+ * Frees the palette.
  */
 NesPalette::~NesPalette(void) {
-  delete[] decoded_palette_;
   return;
 }
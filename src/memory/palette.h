@@ -14,53 +14,56 @@
 #define PALETTE_BMASK 0x000000FFU
 #define PIXEL_MASK 0x3FU
 
+// Each combination of the emphasis and greyscale bits of PPUMASK has its own
+// table of decoded colors.
+#define NUM_MASK_TABLES 16U
+#define MASK_TABLE_SIZE 0x40U
+#define MASK_TABLE_ALIGN 64U
+
 // Abstract the format of pixels away from the emulation.
 typedef uint32_t Pixel;
 
 /*
- * Contains both the current implementation of pixels and
- * the associated NES pixels. Used internally by rendering to
- * manage pixels and sent to rendering to enable different
- * implementations.
+ * Contains the NES colors currently held in palette memory. Used by the PPU
+ * to look up the color of each pixel it draws. Colors are always 6 bits.
  */
 struct PixelPalette {
   DataWord nes[ACTIVE_PALETTE_SIZE];
-  Pixel emu[ACTIVE_PALETTE_SIZE];
 };
 
 /*
  * Uses the provided file as an NES palette, allowing colors to be decoded
  * into RGB colors.
  *
- * Color tints can be selected by providing a PPU mask value through the
- * UpdateMask function.
+ * Color tints and greyscale are selected by the PPU mask value given with each
+ * row. Decoding does not modify the palette, and so it can be done from any
+ * thread.
  */
 class NesPalette {
   private:
     // Checks if the loaded palette file was valid.
     bool Invalid(FILE *pal_file);
 
-    // Holds the color emphasis and grayscale value, which reflect
-    // the settings in PPUMASK.
-    DataWord color_tint_ = 0;
-    bool grayscale_colors_ = false;
-
-    // Stores the decoded paletter, where each index holds its
-    // corresponding color.
-    Pixel *decoded_palette_;
+    // Stores the decoded colors for each PPU mask, with greyscale already
+    // applied, so that decoding a color is a single lookup. Aligned so that
+    // each table occupies whole cache lines.
+    alignas(MASK_TABLE_ALIGN) Pixel mask_tables_[NUM_MASK_TABLES]
+                                                [MASK_TABLE_SIZE];
 
   public:
     // Loads in the given palette file for use in decoding colors.
     // If the file is NULL or invalid, a default is used.
     NesPalette(const char *file);
 
-    // Decodes an NES color into an RGB color.
-    Pixel Decode(DataWord color);
+    // Gets the table index used by the given PPU mask. Masks with the same
+    // index decode colors identically.
+    static size_t MaskIndex(DataWord mask);
 
-    // Updates the mask settings of the palette.
-    void UpdateMask(DataWord mask);
+    // Decodes a row of 6-bit NES colors drawn with the given PPU mask.
+    void DecodeRow(const DataWord *colors, DataWord mask,
+                   Pixel *pixels, size_t num) const;
 
-    // Frees the decoded palette.
+    // Frees the palette.
     ~NesPalette(void);
 };
 
@@ -24,7 +24,25 @@ int main(int argc, char *argv[]) {
     { "surface", 0, NULL, 's' },
     { "hardware", 0, NULL, 'h' },
     { "file", 1, NULL, 'f' },
-    { "palette", 1, NULL, 'p' }
+    { "palette", 1, NULL, 'p' },
+    { "capture", 1, NULL, 'c' },
+    { "capture-path", 1, NULL, 'o' },
+    { "capture-frames", 1, NULL, 'n' },
+    { "hash-log", 1, NULL, 'l' },
+    { "hash-golden", 1, NULL, 'g' },
+    { "ppu-viewer", 0, NULL, 'v' },
+    { "trace", 1, NULL, 't' },
+    { "disassembly", 1, NULL, 'd' },
+    { "gdb", 1, NULL, 'G' },
+    { "interactive", 0, NULL, 'i' },
+    { "net-local", 1, NULL, 'L' },
+    { "net-remote", 1, NULL, 'R' },
+    { "net-player", 1, NULL, 'P' },
+    { "net-delay", 1, NULL, 'D' },
+    { "net-latency", 1, NULL, 'T' },
+    { "net-jitter", 1, NULL, 'J' },
+    { "net-loss", 1, NULL, 'X' },
+    { NULL, 0, NULL, 0 }
   };
 
   // Prepares the configuration object, which can be modified by the
@@ -38,22 +56,78 @@ int main(int argc, char *argv[]) {
   // Parses the users command line input.
   char *rom_file = NULL;
   signed char opt;
-  while ((opt = getopt_long(argc, argv, "hf:p:s", long_opts, NULL)) != -1) {
+  const char *short_opts = "hf:p:sc:o:n:l:g:vt:d:G:iL:R:P:D:T:J:X:";
+  while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
     switch (opt) {
       case 'f':
         rom_file = optarg;
         break;
       case 'p':
-        config->Set(kPaletteFileKey, optarg);
+        config->Override(kPaletteFileKey, optarg);
         break;
       case 's':
-        config->Set(kRendererTypeKey, kRendererSurfaceVal);
+        config->Override(kRendererTypeKey, kRendererSurfaceVal);
         break;
       case 'h':
-        config->Set(kRendererTypeKey, kRendererHardwareVal);
+        config->Override(kRendererTypeKey, kRendererHardwareVal);
+        break;
+      case 'c':
+        config->Set(kCaptureFormatKey, optarg, false);
+        break;
+      case 'o':
+        config->Set(kCapturePathKey, optarg, false);
+        break;
+      case 'n':
+        config->Set(kCaptureFramesKey, optarg, false);
+        break;
+      case 'l':
+        config->Set(kHashLogKey, optarg, false);
+        break;
+      case 'g':
+        config->Set(kHashGoldenKey, optarg, false);
+        break;
+      case 'v':
+        config->Set(kPpuViewerKey, kPpuViewerOnVal, false);
+        break;
+      case 't':
+        config->Set(kTraceLogKey, optarg, false);
+        break;
+      case 'd':
+        config->Set(kDisasExportKey, optarg, false);
+        break;
+      case 'G':
+        config->Set(kDebuggerKey, optarg, false);
+        break;
+      case 'i':
+        config->Set(kTermDebuggerKey, kTermDebuggerOnVal, false);
+        break;
+      case 'L':
+        config->Set(kNetLocalKey, optarg, false);
+        break;
+      case 'R':
+        config->Set(kNetRemoteKey, optarg, false);
+        break;
+      case 'P':
+        config->Set(kNetPlayerKey, optarg, false);
+        break;
+      case 'D':
+        config->Set(kNetDelayKey, optarg, false);
+        break;
+      case 'T':
+        config->Set(kNetLatencyKey, optarg, false);
+        break;
+      case 'J':
+        config->Set(kNetJitterKey, optarg, false);
+        break;
+      case 'X':
+        config->Set(kNetLossKey, optarg, false);
         break;
       default:
-        printf("Usage: ndb -f <FILE>\n");
+        printf("Usage: ndb -f <FILE> [-c <ppm|png|raw|y4m> [-o <PATH>] "
+               "[-n <FRAMES>]] [-l <LOG>] [-g <GOLDEN>] [-v] [-t <TRACE>] "
+               "[-d <DISASSEMBLY>] [-G <ADDR>] [-i] [-L <ADDR> -R <ADDR> "
+               "[-P <1|2>] [-D <FRAMES>] [-T <MS>] [-J <MS>] "
+               "[-X <PERCENT>]]\n");
         delete config;
         exit(0);
     }
@@ -79,12 +153,17 @@ int main(int argc, char *argv[]) {
 
   // Close the rom file.
   fclose(rom);
+  if (emu == NULL) {
+    delete config;
+    return 1;
+  }
 
   // Register the signal handlers that will be used to control the emulation.
   RegisterSignalHandlers();
 
   // Main emulation loop.
   emu->Run();
+  int status = (emu->HasDiverged()) ? 1 : 0;
 
   // Saves any changes the user made to the config.
   config->Save();
@@ -93,5 +172,5 @@ int main(int argc, char *argv[]) {
   delete emu;
   delete config;
 
-  return 0;
+  return status;
 }
@@ -0,0 +1,79 @@
+/*
+ * Runs a manifest of headless emulation jobs across every core of the host.
+ * See batch/batch_runner.cc for the format of the manifest.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <getopt.h>
+
+#include "./batch/batch_runner.h"
+
+/*
+ * Prints the usage of the batch runner.
+ */
+static void PrintUsage(void) {
+  printf("Usage: ndb-batch -m <MANIFEST> [-j <THREADS>] [-l <LOG DIR>] "
+         "[-L <LANES>]\n");
+  return;
+}
+
+/*
+ * Parses the arguments of the user, then runs their manifest. Exits with
+ * status 1 if any job failed or diverged.
+ */
+int main(int argc, char *argv[]) {
+  // Global variables needed for getopt.
+  extern char *optarg;
+
+  // Long option array, used to parse input.
+  struct option long_opts[] = {
+    { "manifest", 1, NULL, 'm' },
+    { "jobs", 1, NULL, 'j' },
+    { "hash-logs", 1, NULL, 'l' },
+    { "lanes", 1, NULL, 'L' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  // Parses the users command line input.
+  const char *manifest = NULL;
+  const char *log_dir = NULL;
+  size_t num_workers = 0;
+  size_t lanes = 1;
+  signed char opt;
+  const char *short_opts = "m:j:l:L:";
+  while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'm':
+        manifest = optarg;
+        break;
+      case 'j':
+        num_workers = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        log_dir = optarg;
+        break;
+      case 'L':
+        lanes = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        PrintUsage();
+        return 2;
+    }
+  }
+
+  if (manifest == NULL) {
+    PrintUsage();
+    return 2;
+  }
+
+  // Run the jobs of the manifest, reporting their results on stdout.
+  BatchRunner *runner = BatchRunner::Create(manifest, log_dir, num_workers,
+                                            lanes);
+  if (runner == NULL) { return 2; }
+  bool passed = runner->Run(stdout);
+  delete runner;
+
+  return (passed) ? 0 : 1;
+}
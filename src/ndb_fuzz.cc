@@ -0,0 +1,58 @@
+/*
+ * Drives the rom fuzzer without libFuzzer. Each file given on the command
+ * line is run once, which replays crashes found by a fuzzer. With no files,
+ * a single input is read from stdin, as AFL provides it. When compiled by
+ * AFL with persistent mode, inputs are run in a loop within one process.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include "./fuzz/rom_fuzzer.h"
+#include "./util/data.h"
+
+// The largest input read from stdin. Larger than any rom the mappers can
+// address.
+#define FUZZ_MAX_INPUT 0x100000U
+
+// The number of inputs run by each process in persistent mode.
+#define FUZZ_PERSISTENT_RUNS 1000U
+
+/*
+ * Runs each given file through the fuzzer, or the inputs given on stdin.
+ * Exits with status 1 if a file could not be opened.
+ */
+int main(int argc, char *argv[]) {
+  DataWord *buffer = new DataWord[FUZZ_MAX_INPUT];
+  int status = 0;
+
+  if (argc <= 1) {
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+    while (__AFL_LOOP(FUZZ_PERSISTENT_RUNS)) {
+      clearerr(stdin);
+      size_t size = fread(buffer, 1, FUZZ_MAX_INPUT, stdin);
+      LLVMFuzzerTestOneInput(buffer, size);
+    }
+#else
+    size_t size = fread(buffer, 1, FUZZ_MAX_INPUT, stdin);
+    LLVMFuzzerTestOneInput(buffer, size);
+#endif
+  }
+
+  for (int i = 1; i < argc; i++) {
+    FILE *file = fopen(argv[i], "rb");
+    if (file == NULL) {
+      fprintf(stderr, "Error: Failed to open %s\n", argv[i]);
+      status = 1;
+      continue;
+    }
+    size_t size = fread(buffer, 1, FUZZ_MAX_INPUT, file);
+    fclose(file);
+    printf("Running %s (%zu bytes)\n", argv[i], size);
+    LLVMFuzzerTestOneInput(buffer, size);
+  }
+
+  delete[] buffer;
+  return status;
+}
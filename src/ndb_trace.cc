@@ -0,0 +1,62 @@
+/*
+ * Prints an instruction trace written by ndb with "-t" as text, one line per
+ * instruction. Each line holds the cycle, the bank and address, the bytes
+ * and disassembly of the instruction, the registers it started with, and
+ * the scanline and dot of the PPU when it was fetched.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include "./cpu/trace_log.h"
+#include "./debug/disas.h"
+#include "./util/data.h"
+
+// The size of the buffer each instruction is disassembled into.
+#define TRACE_DISAS_SIZE 32U
+
+/*
+ * Prints a single instruction of the trace. Only the bytes the instruction
+ * uses are shown.
+ */
+static void PrintEntry(const TraceEntry *entry) {
+  char disas[TRACE_DISAS_SIZE];
+  size_t size = DisassembleBytes(entry->bytes, entry->pc, disas,
+                                 sizeof(disas));
+
+  char bytes[3 * TRACE_INST_BYTES + 1];
+  for (size_t i = 0; i < TRACE_INST_BYTES; i++) {
+    if (i < size) {
+      snprintf(&(bytes[3 * i]), 4, "%02x ", entry->bytes[i]);
+    } else {
+      snprintf(&(bytes[3 * i]), 4, "   ");
+    }
+  }
+
+  printf("%12llu  %02x:%04x  %s %-16s A:%02x X:%02x Y:%02x P:%02x S:%02x"
+         "  SL:%3u DOT:%3u\n",
+         static_cast<unsigned long long>(entry->cycle), entry->bank,
+         entry->pc, bytes, disas, entry->a, entry->x, entry->y, entry->p,
+         entry->s, entry->scanline, entry->dot);
+  return;
+}
+
+/*
+ * Prints the trace given on the command line. Exits with status 1 if the
+ * trace could not be opened.
+ */
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    printf("Usage: ndb-trace <TRACE>\n");
+    return 1;
+  }
+
+  TraceReader *reader = TraceReader::Create(argv[1]);
+  if (reader == NULL) { return 1; }
+
+  TraceEntry entry;
+  while (reader->Next(&entry)) { PrintEntry(&entry); }
+  delete reader;
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * The net transport carries netplay packets between two emulators over a
+ * datagram socket. Sockets never block, so the emulation thread can poll
+ * for packets once a frame without waiting on the network.
+ *
+ * To make netplay testable on one host, the transport can hold back each
+ * packet it sends by a fixed latency plus random jitter, and drop a share
+ * of them, imitating a slower and less reliable network than loopback.
+ */
+
+#include "./net_transport.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "../util/data.h"
+#include "../util/socket_addr.h"
+
+// The number of nanoseconds in a millisecond and in a second.
+#define NSECS_PER_MSEC 1000000L
+#define NSECS_PER_SEC 1000000000L
+
+/*
+ * Creates a datagram socket bound to the local address, which sends packets
+ * to the remote address. Both addresses must be of the same kind. A UDP
+ * address may leave out its host, as in ":7000", to bind to every local
+ * address.
+ *
+ * Returns NULL if either address is invalid or the socket cannot be bound.
+ */
+NetTransport *NetTransport::Create(const char *local, const char *remote,
+                                   const NetConditions *conditions) {
+  struct sockaddr_storage local_addr, remote_addr;
+  socklen_t local_size, remote_size;
+  if (!ResolveSocketAddr(local, SOCK_DGRAM, true, "netplay", &local_addr,
+                         &local_size)
+      || !ResolveSocketAddr(remote, SOCK_DGRAM, false, "netplay",
+                            &remote_addr, &remote_size)) {
+    return NULL;
+  }
+  if (local_addr.ss_family != remote_addr.ss_family) {
+    fprintf(stderr, "Error: netplay addresses %s and %s are not of the same "
+                    "kind.\n", local, remote);
+    return NULL;
+  }
+
+  // Open the socket, claiming the path of a UNIX socket.
+  int sock = socket(local_addr.ss_family, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    fprintf(stderr, "Error: failed to open a netplay socket.\n");
+    return NULL;
+  }
+  char *unix_path = ClaimUnixPath(local);
+  if ((bind(sock, reinterpret_cast<struct sockaddr*>(&local_addr),
+            local_size) != 0)
+      || (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0)) {
+    fprintf(stderr, "Error: failed to bind a netplay socket to %s.\n", local);
+    close(sock);
+    delete[] unix_path;
+    return NULL;
+  }
+
+  NetConditions perfect = { 0, 0, 0 };
+  if (conditions == NULL) { conditions = &perfect; }
+  return new NetTransport(sock, &remote_addr, remote_size, unix_path,
+                          conditions);
+}
+
+/*
+ * Stores the given socket, peer, and conditions.
+ */
+NetTransport::NetTransport(int socket, const struct sockaddr_storage *remote,
+                           socklen_t remote_size, char *unix_path,
+                           const NetConditions *conditions) {
+  socket_ = socket;
+  memcpy(&remote_, remote, sizeof(remote_));
+  remote_size_ = remote_size;
+  unix_path_ = unix_path;
+  conditions_ = *conditions;
+  return;
+}
+
+/*
+ * Gets the current time in nanoseconds, from a monotonic clock.
+ */
+int64_t NetTransport::TimeNow(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return static_cast<int64_t>(time.tv_sec) * NSECS_PER_SEC + time.tv_nsec;
+}
+
+/*
+ * Sends the given packet to the peer. Packets which the socket cannot take,
+ * such as those sent before the peer has bound its socket, are dropped.
+ */
+void NetTransport::SendNow(const DataWord *data, size_t size) {
+  ssize_t sent = sendto(socket_, data, size, 0,
+                        reinterpret_cast<struct sockaddr*>(&remote_),
+                        remote_size_);
+  (void)sent;
+  return;
+}
+
+/*
+ * Sends the delayed packets whose injected delay has passed.
+ */
+void NetTransport::Flush(void) {
+  int64_t now = TimeNow();
+  size_t i = 0;
+  while (i < delayed_.size()) {
+    if (delayed_[i].due_ns <= now) {
+      SendNow(delayed_[i].data, delayed_[i].size);
+      delayed_.erase(delayed_.begin() + static_cast<ptrdiff_t>(i));
+    } else {
+      i++;
+    }
+  }
+  return;
+}
+
+/*
+ * Sends the given packet, applying the conditions of the transport.
+ * Packets larger than NET_MAX_PACKET are dropped.
+ */
+void NetTransport::Send(const DataWord *data, size_t size) {
+  Flush();
+  if (size > NET_MAX_PACKET) { return; }
+
+  // Drop the packet, if the injected loss calls for it.
+  if ((conditions_.loss_percent > 0)
+      && ((rand_() % 100U) < conditions_.loss_percent)) {
+    return;
+  }
+
+  // Send the packet now, unless it must be held back.
+  size_t delay_ms = conditions_.latency_ms;
+  if (conditions_.jitter_ms > 0) {
+    delay_ms += rand_() % (conditions_.jitter_ms + 1);
+  }
+  if (delay_ms == 0) {
+    SendNow(data, size);
+    return;
+  }
+
+  DelayedPacket packet;
+  packet.due_ns = TimeNow() + static_cast<int64_t>(delay_ms) * NSECS_PER_MSEC;
+  packet.size = size;
+  memcpy(packet.data, data, size);
+  delayed_.push_back(packet);
+  return;
+}
+
+/*
+ * Receives the next packet waiting on the socket, sending any delayed
+ * packets which have fallen due first.
+ *
+ * Returns the size of the packet, or zero if no packet is waiting.
+ */
+size_t NetTransport::Receive(DataWord *data) {
+  Flush();
+  ssize_t size;
+  do {
+    size = recv(socket_, data, NET_MAX_PACKET, 0);
+  } while (size == 0);
+  return (size > 0) ? static_cast<size_t>(size) : 0;
+}
+
+/*
+ * Closes the socket, and removes the path it was bound to.
+ */
+NetTransport::~NetTransport(void) {
+  close(socket_);
+  if (unix_path_ != NULL) {
+    unlink(unix_path_);
+    delete[] unix_path_;
+  }
+  return;
+}
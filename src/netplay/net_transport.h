@@ -0,0 +1,97 @@
+#ifndef _NES_NETTRANSPORT
+#define _NES_NETTRANSPORT
+
+#include <cstdlib>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "../util/data.h"
+
+// The largest packet which can be sent or received.
+#define NET_MAX_PACKET 512U
+
+/*
+ * Conditions added to every packet sent by a transport, so that netplay can
+ * be tested over a local socket as if it were run over a real network.
+ */
+struct NetConditions {
+  // The delay added to each packet, and the most extra delay which is
+  // chosen at random for each packet, in milliseconds. Jitter can reorder
+  // packets, as a real network may.
+  size_t latency_ms;
+  size_t jitter_ms;
+
+  // The percentage of packets which are dropped.
+  size_t loss_percent;
+};
+
+/*
+ * Exchanges packets with a single peer over a datagram socket, without
+ * blocking. Addresses are either "host:port", for UDP, or "unix:<path>",
+ * for a UNIX datagram socket bound to the given path.
+ *
+ * Packets may be lost, duplicated, or reordered, so the protocol run over
+ * the transport must tolerate all three.
+ */
+class NetTransport {
+  private:
+    // A packet held back by the latency injected into the transport.
+    struct DelayedPacket {
+      int64_t due_ns;
+      size_t size;
+      DataWord data[NET_MAX_PACKET];
+    };
+
+    // The socket, and the address of the peer packets are sent to.
+    int socket_;
+    struct sockaddr_storage remote_;
+    socklen_t remote_size_;
+
+    // The path the socket is bound to, which is removed when the transport
+    // is closed. NULL for UDP sockets.
+    char *unix_path_;
+
+    // The conditions injected into sent packets, the generator used to
+    // apply them, and the packets waiting to be sent.
+    NetConditions conditions_;
+    std::minstd_rand rand_;
+    std::vector<DelayedPacket> delayed_;
+
+    // Stores the socket created by the factory function.
+    NetTransport(int socket, const struct sockaddr_storage *remote,
+                 socklen_t remote_size, char *unix_path,
+                 const NetConditions *conditions);
+
+    // Gets the current time, in nanoseconds.
+    static int64_t TimeNow(void);
+
+    // Sends the given packet to the peer immediately.
+    void SendNow(const DataWord *data, size_t size);
+
+    // Sends any delayed packets which are now due.
+    void Flush(void);
+
+  public:
+    // Binds a socket to the local address, which sends packets to the
+    // remote address under the given conditions. The conditions may be
+    // NULL. Returns NULL on failure.
+    static NetTransport *Create(const char *local, const char *remote,
+                                const NetConditions *conditions);
+
+    // Sends the given packet to the peer, once its injected delay has
+    // passed. Packets which cannot be sent are dropped.
+    void Send(const DataWord *data, size_t size);
+
+    // Receives a packet from the peer into the given buffer, which must hold
+    // NET_MAX_PACKET words. Returns the size of the packet, or zero if no
+    // packet is waiting.
+    size_t Receive(DataWord *data);
+
+    // Closes the socket, dropping any delayed packets.
+    ~NetTransport(void);
+};
+
+#endif
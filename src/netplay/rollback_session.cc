@@ -0,0 +1,293 @@
+/*
+ * The rollback session runs netplay between two emulators in the style of
+ * GGPO. Neither side ever waits for the inputs of the other to arrive
+ * before running a frame; remote inputs are predicted, and the frames run
+ * with a wrong prediction are corrected once the real input arrives.
+ *
+ * Correcting a prediction means restoring the state from the start of the
+ * mispredicted frame and running every frame since then again, all within
+ * a single frame of real time. States are forked into a preallocated pool,
+ * and frames which are run again produce no output, which keeps rollbacks
+ * cheap enough to run several frames of them per frame.
+ *
+ * Packets carry every local input the peer has not acknowledged, so lost
+ * packets are covered by the next one that arrives.
+ */
+
+#include "./rollback_session.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../core/console.h"
+#include "../core/state_pool.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../util/data.h"
+#include "../util/state.h"
+#include "../util/util.h"
+#include "./net_transport.h"
+
+// Identifies the packets of a session.
+#define PACKET_MAGIC 0x504E444EU
+
+// The size of the fields written before the inputs of each packet.
+#define PACKET_HEADER_SIZE (4U * sizeof(uint32_t) + sizeof(int32_t))
+
+/*
+ * Powers on a console for the given rom from a fixed seed, so that it
+ * matches the console of the peer, and connects the given input to the
+ * port of the local player.
+ *
+ * Returns NULL on failure, in which case the transport is freed.
+ */
+RollbackSession *RollbackSession::Create(FILE *rom, InputSource *local_input,
+                                         AudioSink *audio,
+                                         NetTransport *transport,
+                                         size_t local_player,
+                                         size_t input_delay) {
+  if ((local_player > 1) || (input_delay > NETPLAY_MAX_DELAY)) {
+    fprintf(stderr, "Error: netplay needs a player of 1 or 2, and an input "
+                    "delay of at most %u frames.\n", NETPLAY_MAX_DELAY);
+    delete transport;
+    return NULL;
+  }
+
+  RandSeed(NETPLAY_SEED);
+  HeldInput *port1 = new HeldInput();
+  HeldInput *port2 = new HeldInput();
+  Console *console = Console::Create(rom, port1, audio);
+  if (console == NULL) {
+    delete port1;
+    delete port2;
+    delete transport;
+    return NULL;
+  }
+  console->SetSecondInput(port2);
+
+  StatePool *pool = StatePool::Create(console, kStateRingSize_);
+  return new RollbackSession(console, pool, transport, local_input, port1,
+                             port2, local_player, input_delay);
+}
+
+/*
+ * Stores the objects of the session. The inputs of the local player before
+ * the input delay has passed are left released.
+ */
+RollbackSession::RollbackSession(Console *console, StatePool *pool,
+                                 NetTransport *transport,
+                                 InputSource *local_input, HeldInput *port1,
+                                 HeldInput *port2, size_t local_player,
+                                 size_t input_delay) {
+  console_ = console;
+  pool_ = pool;
+  transport_ = transport;
+  local_input_ = local_input;
+  ports_[0] = port1;
+  ports_[1] = port2;
+  local_player_ = local_player;
+  local_end_ = input_delay;
+  for (size_t i = 0; i < kStateRingSize_; i++) { state_held_[i] = false; }
+  return;
+}
+
+/*
+ * Exchanges inputs with the peer, and runs the next frame unless the
+ * session must wait for the peer. Any misprediction is rolled back first,
+ * so that the frame is run from a corrected state.
+ *
+ * The session waits when the remote inputs are so far behind that another
+ * frame could not be rolled back, when the peer has not acknowledged enough
+ * local inputs to free room for another, or when this side is running ahead
+ * of the peer.
+ */
+bool RollbackSession::AdvanceFrame(void) {
+  ReceiveInputs();
+
+  bool advance = false;
+  if (wait_frames_ > 0) {
+    wait_frames_--;
+  } else {
+    advance = (frame_ < remote_end_ + kMaxRollback_)
+           && (local_end_ - MIN(peer_ack_, local_end_) < kInputRingSize_);
+  }
+
+  if (advance) {
+    Rollback();
+    local_inputs_[local_end_ % kInputRingSize_] = local_input_->Poll();
+    local_end_++;
+    RunFrame(frame_);
+    frame_++;
+    stats_.frames++;
+    SyncTime();
+  } else {
+    stats_.stalls++;
+  }
+
+  SendInputs();
+  return advance;
+}
+
+/*
+ * Reads every packet waiting on the transport. New remote inputs are
+ * confirmed in order, and any which differ from the input the console was
+ * run with mark their frame for rollback. Stale, duplicated, and malformed
+ * packets are ignored.
+ */
+void RollbackSession::ReceiveInputs(void) {
+  DataWord packet[NET_MAX_PACKET];
+  size_t size;
+  while ((size = transport_->Receive(packet)) > 0) {
+    StateReader reader(packet, size);
+    uint32_t magic, frame, ack, start;
+    int32_t advantage;
+    reader.Get(&magic);
+    reader.Get(&frame);
+    reader.Get(&ack);
+    reader.Get(&advantage);
+    reader.Get(&start);
+    if (reader.HasFailed() || (magic != PACKET_MAGIC)) { continue; }
+
+    // Track the progress of the peer.
+    if (frame >= peer_frame_) {
+      peer_frame_ = frame;
+      peer_advantage_ = advantage;
+    }
+    peer_ack_ = MAX(peer_ack_, static_cast<size_t>(ack));
+
+    // Confirm the inputs which follow those already confirmed. Inputs too
+    // far ahead to fit in the ring are taken from a later packet.
+    const DataWord *inputs = &(packet[PACKET_HEADER_SIZE]);
+    size_t end = start + (size - PACKET_HEADER_SIZE);
+    size_t limit = frame_ + kInputRingSize_ - kStateRingSize_;
+    while ((remote_end_ >= start) && (remote_end_ < MIN(end, limit))) {
+      size_t index = remote_end_ % kInputRingSize_;
+      remote_inputs_[index] = inputs[remote_end_ - start];
+      if ((remote_end_ < frame_)
+          && (remote_inputs_[index] != used_inputs_[index])
+          && (!rollback_pending_ || (remote_end_ < rollback_frame_))) {
+        rollback_pending_ = true;
+        rollback_frame_ = remote_end_;
+      }
+      remote_end_++;
+    }
+  }
+  return;
+}
+
+/*
+ * Sends the local inputs the peer has not acknowledged, along with the
+ * progress of this side. The ring never holds more unacknowledged inputs
+ * than fit in a packet.
+ */
+void RollbackSession::SendInputs(void) {
+  DataWord packet[NET_MAX_PACKET];
+  StateWriter writer(packet, sizeof(packet));
+  size_t start = MIN(peer_ack_, local_end_);
+  int64_t advantage = static_cast<int64_t>(frame_)
+                    - static_cast<int64_t>(peer_frame_);
+  writer.Put(static_cast<uint32_t>(PACKET_MAGIC));
+  writer.Put(static_cast<uint32_t>(frame_));
+  writer.Put(static_cast<uint32_t>(remote_end_));
+  writer.Put(static_cast<int32_t>(advantage));
+  writer.Put(static_cast<uint32_t>(start));
+  for (size_t frame = start; frame < local_end_; frame++) {
+    writer.Put(local_inputs_[frame % kInputRingSize_]);
+  }
+  transport_->Send(writer.GetData(), writer.GetSize());
+  return;
+}
+
+/*
+ * Restores the state from the start of the earliest mispredicted frame,
+ * then runs every frame up to the current one again without output, using
+ * the corrected inputs. The states of those frames are replaced as they
+ * are run.
+ */
+void RollbackSession::Rollback(void) {
+  if (!rollback_pending_) { return; }
+  rollback_pending_ = false;
+
+  pool_->Restore(state_slots_[rollback_frame_ % kStateRingSize_], console_);
+  console_->SetOutput(false);
+  for (size_t frame = rollback_frame_; frame < frame_; frame++) {
+    RunFrame(frame);
+    stats_.frames_resimulated++;
+  }
+  console_->SetOutput(true);
+  stats_.rollbacks++;
+  return;
+}
+
+/*
+ * Forks the state at the start of the given frame into its slot of the
+ * ring, then runs the frame. Remote inputs which have not been confirmed
+ * are predicted to repeat the last confirmed input, and the input used is
+ * kept so that it can be checked once the real one arrives.
+ */
+void RollbackSession::RunFrame(size_t frame) {
+  size_t slot_index = frame % kStateRingSize_;
+  if (state_held_[slot_index]) { pool_->Release(state_slots_[slot_index]); }
+  state_held_[slot_index] = pool_->Fork(console_, &(state_slots_[slot_index]));
+
+  size_t index = frame % kInputRingSize_;
+  DataWord remote = 0;
+  if (frame < remote_end_) {
+    remote = remote_inputs_[index];
+  } else if (remote_end_ > 0) {
+    remote = remote_inputs_[(remote_end_ - 1) % kInputRingSize_];
+  }
+  used_inputs_[index] = remote;
+
+  ports_[local_player_]->Set(local_inputs_[index]);
+  ports_[1 - local_player_]->Set(remote);
+  console_->StepFrame();
+  return;
+}
+
+/*
+ * Periodically compares how far each side believes it is ahead of the
+ * other. Latency adds equally to both beliefs, so half their difference is
+ * how far this side is truly ahead, which it skips to let the peer catch up.
+ * Without this, the side which started first would stay ahead, and would
+ * roll back far more often than its peer.
+ */
+void RollbackSession::SyncTime(void) {
+  if (((frame_ % kTimeSyncInterval_) != 0) || (remote_end_ == 0)) { return; }
+  int64_t advantage = static_cast<int64_t>(frame_)
+                    - static_cast<int64_t>(peer_frame_);
+  int64_t ahead = (advantage - peer_advantage_) / 2;
+  if (ahead > 0) {
+    wait_frames_ = MIN(static_cast<size_t>(ahead), kMaxRollback_);
+  }
+  return;
+}
+
+/*
+ * Gets the console played by the session.
+ */
+Console *RollbackSession::GetConsole(void) {
+  return console_;
+}
+
+/*
+ * Copies the statistics of the session to the given structure.
+ */
+void RollbackSession::GetStats(NetplayStats *stats) {
+  *stats = stats_;
+  return;
+}
+
+/*
+ * Frees the console before the inputs connected to it.
+ */
+RollbackSession::~RollbackSession(void) {
+  delete console_;
+  delete pool_;
+  delete ports_[0];
+  delete ports_[1];
+  delete transport_;
+  return;
+}
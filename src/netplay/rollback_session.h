@@ -0,0 +1,158 @@
+#ifndef _NES_ROLLBACK
+#define _NES_ROLLBACK
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../core/console.h"
+#include "../core/state_pool.h"
+#include "../io/input_source.h"
+#include "../apu/audio_sink.h"
+#include "../util/data.h"
+#include "./net_transport.h"
+
+// The seed used to power on both consoles of a session, so that their
+// undefined power on state matches.
+#define NETPLAY_SEED 0x4E4450U
+
+// The most frames of input delay a session can be given.
+#define NETPLAY_MAX_DELAY 30U
+
+/*
+ * Counts of the work done by a session to hide the latency of its peer.
+ */
+struct NetplayStats {
+  // The number of frames run, and the number of frames which were run
+  // again after a remote input was mispredicted.
+  size_t frames;
+  size_t frames_resimulated;
+
+  // The number of mispredictions which were rolled back.
+  size_t rollbacks;
+
+  // The number of frames skipped while waiting for the peer, either because
+  // its inputs were too far behind, or to let it catch up.
+  size_t stalls;
+};
+
+/*
+ * Plays a console with a peer on another emulator, each controlling one of
+ * its controllers, using rollback to hide the latency between them.
+ *
+ * Each frame, the local input is sent to the peer, and the console runs
+ * ahead using a prediction of the remote input: the last input which was
+ * received. A fork of the state is kept from the start of each frame which
+ * is not yet confirmed. When an input arrives which differs from what was
+ * predicted, the console is restored to the start of that frame and the
+ * frames since are simulated again, without output, with the corrected
+ * input. Both consoles then see the same inputs on every frame, and so
+ * stay in sync.
+ */
+class RollbackSession {
+  private:
+    // The number of frames of input kept by the session. Bounds how far
+    // either peer can run ahead of the inputs the other has received.
+    static const size_t kInputRingSize_ = 128;
+
+    // The most frames which can be run ahead of the last confirmed remote
+    // input, and so the number of states kept for rolling back.
+    static const size_t kMaxRollback_ = 12;
+    static const size_t kStateRingSize_ = kMaxRollback_ + 1;
+
+    // The number of frames between each check on whether this side is
+    // running ahead of its peer.
+    static const size_t kTimeSyncInterval_ = 30;
+
+    // The console, and the pool of states kept from the start of each
+    // unconfirmed frame.
+    Console *console_;
+    StatePool *pool_;
+    size_t state_slots_[kStateRingSize_];
+    bool state_held_[kStateRingSize_];
+
+    // The transport to the peer, the source of the local input, and the
+    // inputs connected to each controller port.
+    NetTransport *transport_;
+    InputSource *local_input_;
+    HeldInput *ports_[2];
+    size_t local_player_;
+
+    // The local inputs, the confirmed remote inputs, and the remote inputs
+    // which were used to run each frame, indexed by frame modulo the size of
+    // the ring.
+    DataWord local_inputs_[kInputRingSize_] = { 0 };
+    DataWord remote_inputs_[kInputRingSize_] = { 0 };
+    DataWord used_inputs_[kInputRingSize_] = { 0 };
+
+    // The next frame to be run. Local inputs are known for every frame
+    // before local_end_, which runs ahead of the frame by the input delay.
+    // Remote inputs are confirmed for every frame before remote_end_.
+    size_t frame_ = 0;
+    size_t local_end_;
+    size_t remote_end_ = 0;
+
+    // The first local frame the peer has not received, the last frame the
+    // peer reported running, and how far ahead of this side it believed
+    // itself to be.
+    size_t peer_ack_ = 0;
+    size_t peer_frame_ = 0;
+    int64_t peer_advantage_ = 0;
+
+    // The earliest frame whose remote input was mispredicted, if any.
+    bool rollback_pending_ = false;
+    size_t rollback_frame_ = 0;
+
+    // The number of frames still to be skipped to let the peer catch up.
+    size_t wait_frames_ = 0;
+
+    NetplayStats stats_ = { 0, 0, 0, 0 };
+
+    // Stores the objects created by the factory function.
+    RollbackSession(Console *console, StatePool *pool,
+                    NetTransport *transport, InputSource *local_input,
+                    HeldInput *port1, HeldInput *port2, size_t local_player,
+                    size_t input_delay);
+
+    // Reads every waiting packet, confirming the remote inputs it holds.
+    void ReceiveInputs(void);
+
+    // Sends the local inputs the peer has not yet received.
+    void SendInputs(void);
+
+    // Restores the console to the earliest mispredicted frame, and runs it
+    // again up to the current frame.
+    void Rollback(void);
+
+    // Saves the state at the start of the given frame, then runs it with
+    // the best inputs known for it.
+    void RunFrame(size_t frame);
+
+    // Decides whether to skip frames to let the peer catch up.
+    void SyncTime(void);
+
+  public:
+    // Powers on a console for the given rom, controlled by the given input
+    // on the given player's port, 0 or 1, and by the peer on the other.
+    // Local inputs are applied after the given number of frames. Takes
+    // ownership of the transport. Returns NULL on failure.
+    static RollbackSession *Create(FILE *rom, InputSource *local_input,
+                                   AudioSink *audio, NetTransport *transport,
+                                   size_t local_player, size_t input_delay);
+
+    // Exchanges inputs with the peer, then runs the next frame, rolling back
+    // first if a remote input was mispredicted. Returns false if the frame
+    // could not be run because the session is waiting on the peer.
+    bool AdvanceFrame(void);
+
+    // Gets the console played by the session.
+    Console *GetConsole(void);
+
+    // Gets the counts of frames run, rolled back, and skipped.
+    void GetStats(NetplayStats *stats);
+
+    // Frees the console, its states, and the transport.
+    ~RollbackSession(void);
+};
+
+#endif
@@ -28,8 +28,10 @@
 #include "../util/data.h"
 #include "../util/util.h"
 #include "../util/contracts.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 #include "../cpu/cpu.h"
-#include "../sdl/renderer.h"
+#include "../video/frame_buffer.h"
 #include "../memory/memory.h"
 #include "../memory/palette.h"
 
@@ -154,14 +156,15 @@
 #define FLAG_SOAM_BUFFER_PATTERN 0x03U
 
 /*
- * Initializes the buffers used by the PPU during rendering.
+ * Initializes the buffers used by the PPU during rendering, allocating them
+ * from the given arena.
  */
-Ppu::Ppu(void) {
+Ppu::Ppu(Arena *arena) {
   // Allocate the renderering buffers.
-  primary_oam_ = new DataWord[PRIMARY_OAM_SIZE]();
-  soam_buffer_[0] = new DataWord[SOAM_BUFFER_SIZE]();
-  soam_buffer_[1] = new DataWord[SOAM_BUFFER_SIZE]();
-  tile_buffer_ = new DataWord[kTileBufferSize_]();
+  primary_oam_ = arena->NewArray<DataWord>(PRIMARY_OAM_SIZE);
+  soam_buffer_[0] = arena->NewArray<DataWord>(SOAM_BUFFER_SIZE);
+  soam_buffer_[1] = arena->NewArray<DataWord>(SOAM_BUFFER_SIZE);
+  tile_buffer_ = arena->NewArray<DataWord>(kTileBufferSize_);
 
   return;
 }
@@ -170,14 +173,35 @@ Ppu::Ppu(void) {
  * Connects the PPU to the rest of the emulated system. This function
  * must be called after initialization to put the PPU in a valid state.
  */
-void Ppu::Connect(Memory *memory, Renderer *render, bool *nmi_line) {
+void Ppu::Connect(Memory *memory, FrameBuffer *frame_buffer, bool *nmi_line) {
   // Store the given objects.
   memory_ = memory;
-  renderer_ = render;
+  palette_ = memory->PaletteExpose();
+  frame_buffer_ = frame_buffer;
+  frame_ = frame_buffer->GetDrawFrame();
   nmi_line_ = nmi_line;
   return;
 }
 
+/*
+ * Sets the recorder completed frames are sent to. The recorder may be NULL,
+ * in which case frames are not recorded.
+ */
+void Ppu::SetFrameRecorder(FrameRecorder *recorder) {
+  recorder_ = recorder;
+  return;
+}
+
+/*
+ * Sets whether completed frames are passed to the frame buffer. While they
+ * are not, the next frame is drawn over the completed one, and the frame
+ * buffer is left holding the last frame which was output.
+ */
+void Ppu::SetFrameOutput(bool enabled) {
+  frame_output_ = enabled;
+  return;
+}
+
 /*
  * Determines how many cycles can be executed before the ppu will attempt
  * an action which will effect the state of another chip. This corresponds to
@@ -343,7 +367,30 @@ void Ppu::DrawBackground(size_t delta) {
   // Render the background.
   DataWord tiles[kScreenWidth_];
   for (size_t i = 0; i < num_pixels; i++) { tiles[i] = color_addr; }
-  renderer_->DrawPixels(screen_y, screen_x, tiles, num_pixels);
+  DrawPixels(screen_y, screen_x, tiles, num_pixels);
+
+  return;
+}
+
+/*
+ * Draws the given palette entries to the given location in the current
+ * frame, recording the mask used to draw the row.
+ *
+ * Assumes the row and column are in range of the frame size.
+ * Assumes the number of pixels will fit within the bounds of the specified
+ * location.
+ */
+void Ppu::DrawPixels(size_t row, size_t col, DataWord *tiles, size_t num) {
+  CONTRACT(row < static_cast<size_t>(NES_HEIGHT));
+  CONTRACT(col < static_cast<size_t>(NES_WIDTH));
+  CONTRACT((row * NES_WIDTH + col + num) <= (NES_WIDTH * NES_HEIGHT));
+
+  // Convert the palette entries to NES colors as they are drawn.
+  DataWord *frame_row = &(frame_->pixels[row * NES_WIDTH + col]);
+  for (size_t i = 0; i < num; i++) {
+    frame_row[i] = palette_->nes[tiles[i]];
+  }
+  frame_->masks[row] = mask_;
 
   return;
 }
@@ -637,7 +684,7 @@ void Ppu::RenderDrawPixels(size_t delta) {
   }
 
   // Render the pixels to the screen.
-  renderer_->DrawPixels(screen_y, screen_x, line_buf, num_pixels);
+  DrawPixels(screen_y, screen_x, line_buf, num_pixels);
 
   return;
 }
@@ -718,7 +765,8 @@ void Ppu::RenderBlank(size_t delta) {
                                  && ((current_cycle_ + delta) > 1)) {
     // TODO: Implement special case timing.
     status_ |= FLAG_VBLANK;
-    renderer_->DrawFrame();
+    if (recorder_ != NULL) { recorder_->Record(frame_); }
+    if (frame_output_) { frame_ = frame_buffer_->SwapDrawFrame(); }
   }
   return;
 }
@@ -992,15 +1040,14 @@ void Ppu::Write(DoubleWord reg_addr, DataWord val) {
 }
 
 /*
- * Updates the mask register and palette. Clears the sprite/tile buffers if
+ * Updates the mask register. Clears the sprite/tile buffers if
  * rendering for either has been disabled. Doing this makes the assumption
  * that the shift registers continued to empty when rendering was disabled
  * in original hardware. TODO: Confirm this is the case.
  */
 void Ppu::MmioMaskWrite(DataWord val) {
-  // Update the mask value and palette.
+  // Update the mask value.
   mask_ = val;
-  memory_->PaletteUpdate(val);
 
   // Clear the tile and sprite buffers if either has now been disabled.
   if (!(mask_ & FLAG_RENDER_BG)) {
@@ -1130,6 +1177,132 @@ DataWord Ppu::Read(DoubleWord reg_addr) {
   return bus_;
 }
 
+/*
+ * Copies the registers and primary OAM of the PPU into the given state.
+ * Does not change the state of the PPU.
+ */
+void Ppu::Inspect(PpuState *state) {
+  state->ctrl = ctrl_;
+  state->mask = mask_;
+  state->scroll_addr = temp_vram_addr_;
+  state->fine_x = fine_x_;
+  for (size_t i = 0; i < PPU_OAM_SIZE; i++) {
+    state->oam[i] = primary_oam_[i];
+  }
+  return;
+}
+
+/*
+ * Gets the scanline and dot the PPU will run next. Scanline 261 is the
+ * pre-render line.
+ */
+void Ppu::GetPosition(size_t *scanline, size_t *dot) {
+  *scanline = current_scanline_;
+  *dot = current_cycle_;
+  return;
+}
+
+/*
+ * Gets the number of rows of the frame being drawn which have been started.
+ * The frame is swapped for a new one at the start of vblank, so no rows of
+ * it have been drawn until the next frame begins.
+ */
+size_t Ppu::DrawnRows(void) {
+  size_t height = static_cast<size_t>(NES_HEIGHT);
+  if (current_scanline_ < height) { return current_scanline_ + 1; }
+  if ((current_scanline_ > 241)
+      || ((current_scanline_ == 241) && (current_cycle_ > 1))) {
+    return 0;
+  }
+  return height;
+}
+
+/*
+ * Writes the registers, sprite memory, and rendering state of the PPU to
+ * the given state. The rows of the frame which have been drawn are
+ * included, so that a state loaded in the middle of a frame completes the
+ * same picture. Every row is redrawn each frame, so the others are skipped.
+ */
+void Ppu::SaveState(StateWriter *state) {
+  state->Put(vram_addr_);
+  state->Put(temp_vram_addr_);
+  state->Put(write_toggle_);
+  state->Put(fine_x_);
+  state->Put(bus_);
+  state->Put(vram_buf_);
+  state->Put(ctrl_);
+  state->Put(mask_);
+  state->Put(status_);
+  state->Put(oam_addr_);
+  state->Write(primary_oam_, PRIMARY_OAM_SIZE);
+  state->Put(soam_render_buf_);
+  for (size_t i = 0; i < kNumSoamBuffers_; i++) {
+    state->Write(soam_buffer_[i], SOAM_BUFFER_SIZE);
+  }
+  state->Write(tile_buffer_, kTileBufferSize_);
+  state->Write(next_tile_, sizeof(next_tile_));
+  state->Put(next_palette_);
+  state->Put(mdr_);
+  state->Put(mdr_write_);
+  state->Put(current_scanline_);
+  state->Put(current_cycle_);
+  state->Put(frame_odd_);
+  state->Put(next_current_scanline_);
+  state->Put(next_current_cycle_);
+  state->Put(next_frame_odd_);
+  size_t rows = DrawnRows();
+  state->Write(frame_->pixels, rows * static_cast<size_t>(NES_WIDTH));
+  state->Write(frame_->masks, rows);
+  return;
+}
+
+/*
+ * Restores the registers, sprite memory, and rendering state of the PPU
+ * from the given state. Returns false if the state was too short, or left
+ * the PPU outside of a frame.
+ */
+bool Ppu::LoadState(StateReader *state) {
+  state->Get(&vram_addr_);
+  state->Get(&temp_vram_addr_);
+  state->Get(&write_toggle_);
+  state->Get(&fine_x_);
+  state->Get(&bus_);
+  state->Get(&vram_buf_);
+  state->Get(&ctrl_);
+  state->Get(&mask_);
+  state->Get(&status_);
+  state->Get(&oam_addr_);
+  state->Read(primary_oam_, PRIMARY_OAM_SIZE);
+  state->Get(&soam_render_buf_);
+  for (size_t i = 0; i < kNumSoamBuffers_; i++) {
+    state->Read(soam_buffer_[i], SOAM_BUFFER_SIZE);
+  }
+  state->Read(tile_buffer_, kTileBufferSize_);
+  state->Read(next_tile_, sizeof(next_tile_));
+  state->Get(&next_palette_);
+  state->Get(&mdr_);
+  state->Get(&mdr_write_);
+  state->Get(&current_scanline_);
+  state->Get(&current_cycle_);
+  state->Get(&frame_odd_);
+  state->Get(&next_current_scanline_);
+  state->Get(&next_current_cycle_);
+  state->Get(&next_frame_odd_);
+  size_t rows = DrawnRows();
+  state->Read(frame_->pixels, rows * static_cast<size_t>(NES_WIDTH));
+  state->Read(frame_->masks, rows);
+
+  // Return the PPU to the start of a frame if the state was invalid.
+  bool valid = !state->HasFailed() && (soam_render_buf_ < kNumSoamBuffers_)
+            && (current_scanline_ <= 261) && (current_cycle_ <= 340);
+  if (!valid) {
+    soam_render_buf_ = 0;
+    current_scanline_ = 261;
+    current_cycle_ = 0;
+  }
+  return valid;
+}
+
 /*
  * Directly writes the given value to OAM, incrementing the OAM address.
  */
@@ -1147,14 +1320,9 @@ void Ppu::OamDma(DataWord val) {
 }
 
 /*
- * Deletes the given PPU class.
+ * Deletes the given PPU class. Its buffers belong to the arena of the
+ * console, and are freed with it.
  */
 Ppu::~Ppu() {
-  // Free the ppu structures.
-  delete[] primary_oam_;
-  delete[] soam_buffer_[0];
-  delete[] soam_buffer_[1];
-  delete[] tile_buffer_;
-
   return;
 }
@@ -4,9 +4,32 @@
 #include <cstdlib>
 
 #include "../util/data.h"
+#include "../util/state.h"
+#include "../util/arena.h"
 #include "../memory/palette.h"
 #include "../memory/memory.h"
-#include "../sdl/renderer.h"
+#include "../video/frame_buffer.h"
+
+// The number of bytes of sprite memory held by the PPU.
+#define PPU_OAM_SIZE 256U
+
+/*
+ * A copy of the PPU registers and sprite memory, used to inspect the PPU
+ * without affecting it.
+ */
+struct PpuState {
+  // The control and mask registers.
+  DataWord ctrl;
+  DataWord mask;
+
+  // The scroll position the next frame will start at, held in the
+  // temporary vram address, and the fine x scroll.
+  DoubleWord scroll_addr;
+  DataWord fine_x;
+
+  // The contents of primary OAM.
+  DataWord oam[PPU_OAM_SIZE];
+};
 
 /*
  * Emulates the graphics chip of the NES, executing a clock cycle whenever
@@ -62,8 +85,20 @@ class Ppu {
     // Holds the Memory class to be used to access VRAM.
     Memory *memory_;
 
-    // Holds the Renderer class to be used to draw pixels to the screen.
-    Renderer *renderer_;
+    // Holds the palette memory, used to find the color of each drawn pixel.
+    const PixelPalette *palette_;
+
+    // Holds the frame buffer completed frames are sent to, and the frame
+    // currently being drawn.
+    FrameBuffer *frame_buffer_;
+    NesFrame *frame_;
+
+    // Records each completed frame, if frames are being recorded.
+    FrameRecorder *recorder_ = NULL;
+
+    // Cleared while the console is run without output, in which case
+    // completed frames are drawn over rather than sent to the frame buffer.
+    bool frame_output_ = true;
 
     // Holds the NMI line used to communicate with the CPU.
     bool *nmi_line_;
@@ -74,6 +109,7 @@ class Ppu {
     void UpdateCounters(void);
     void Disabled(size_t delta);
     void DrawBackground(size_t delta);
+    void DrawPixels(size_t row, size_t col, DataWord *tiles, size_t num);
     void Render(size_t delta);
     void RenderVisible(size_t delta);
     void RenderUpdateFrame(size_t delta, bool output);
@@ -101,13 +137,21 @@ class Ppu {
     void MmioScrollWrite(DataWord val);
     void MmioAddrWrite(DataWord val);
     void MmioVramAddrInc(void);
+    size_t DrawnRows(void);
 
   public:
-    // Creates a PPU object.
-    Ppu(void);
+    // Creates a PPU object, whose buffers live in the given arena.
+    Ppu(Arena *arena);
 
     // Connects the PPU to the rest of the emulation.
-    void Connect(Memory *memory, Renderer *render, bool *nmi_line);
+    void Connect(Memory *memory, FrameBuffer *frame_buffer, bool *nmi_line);
+
+    // Sends each completed frame to the given recorder before it is
+    // presented. The recorder may be NULL.
+    void SetFrameRecorder(FrameRecorder *recorder);
+
+    // Sets whether completed frames are sent to the frame buffer.
+    void SetFrameOutput(bool enabled);
 
     // Determines how many cycles can be run before the execution will
     // update the state of another chip. Used to schedule emulator execution.
@@ -123,6 +167,19 @@ class Ppu {
     // Writes to a memory mapper PPU register.
     void Write(DoubleWord reg_addr, DataWord val);
 
+    // Copies the registers and sprite memory of the PPU into the given
+    // state, without side effects.
+    void Inspect(PpuState *state);
+
+    // Gets the scanline and dot the PPU will run next.
+    void GetPosition(size_t *scanline, size_t *dot);
+
+    // Saves or restores the registers, sprite memory, and rendering state
+    // of the PPU, including the rows of the frame drawn so far. Loading
+    // returns false if the state was invalid.
+    void SaveState(StateWriter *state);
+    bool LoadState(StateReader *state);
+
     // Directly writes to OAM with the given value.
     // The current OAM address is incremented by this operation.
     void OamDma(DataWord val);
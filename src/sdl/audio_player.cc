@@ -13,6 +13,11 @@
  * emulation is running; however, it also adds a slight delay to playback
  * (about 21 ms).
  *
+ * When the emulation is paced to the display instead of the console, it runs
+ * slightly faster or slower than the console would. Samples are then
+ * linearly resampled by the same ratio, so the pitch of the audio is
+ * unchanged and the device queue neither grows nor drains.
+ *
  * While more than one audio player object can be created at one time,
  * this will cause SDL to use more than one audio device and is, thus,
  * not an intended use of this class.
@@ -22,6 +27,7 @@
 
 #include <new>
 #include <cstdlib>
+#include <atomic>
 
 #include <SDL2/SDL.h>
 
@@ -31,6 +37,11 @@
 // Must be a power of 2.
 #define BUFFER_SIZE 1024U
 
+// The most audio, in bytes, which can be waiting to be played. Buffers are
+// discarded past this point, which happens only when the emulation runs
+// faster than the console.
+#define MAX_QUEUED_BYTES (sizeof(float) * BUFFER_SIZE * 16U)
+
 /*
  * Creates an AudioPlayer by opening an audio device and using it to
  * construct an AudioPlayer.
@@ -75,19 +86,61 @@ AudioPlayer::AudioPlayer(SDL_AudioDeviceID device) {
   return;
 }
 
+/*
+ * Resamples the given sample, and adds the resulting samples to the
+ * audio buffer.
+ */
+void AudioPlayer::AddSample(float sample) {
+  // Emit each output sample due between the last input sample and this one,
+  // interpolating between the two.
+  sample *= volume_.load(std::memory_order_relaxed);
+  double step = resample_step_.load(std::memory_order_relaxed);
+  while (resample_time_ <= 1.0) {
+    float t = static_cast<float>(resample_time_);
+    QueueSample(last_sample_ + t * (sample - last_sample_));
+    resample_time_ += step;
+  }
+  resample_time_ -= 1.0;
+  last_sample_ = sample;
+  return;
+}
+
+/*
+ * Sets the speed of the emulation relative to the console. Faster speeds
+ * produce more input samples than the device plays, so each output sample
+ * covers more of them.
+ */
+void AudioPlayer::SetSpeed(double speed) {
+  resample_step_ = speed;
+  return;
+}
+
+/*
+ * Sets the factor samples are scaled by, which takes effect from the next
+ * sample added.
+ */
+void AudioPlayer::SetVolume(float volume) {
+  volume_ = volume;
+  return;
+}
+
 /*
  * Adds a sample to the audio buffer.
  * If this sample fills the buffer, the buffer is queued to the audio device.
  */
-void AudioPlayer::AddSample(float sample) {
+void AudioPlayer::QueueSample(float sample) {
   // Add the sample to the buffer.
   audio_buffer_[buffer_slot_] = sample;
   buffer_slot_++;
 
-  // If the buffer has filled, we queue it to the device.
+  // If the buffer has filled, we queue it to the device. If the device is
+  // already too far behind, the buffer is discarded instead.
   if (buffer_slot_ >= BUFFER_SIZE) {
     buffer_slot_ = 0;
-    SDL_QueueAudio(audio_device_, audio_buffer_, sizeof(float) * BUFFER_SIZE);
+    if (SDL_GetQueuedAudioSize(audio_device_) < MAX_QUEUED_BYTES) {
+      SDL_QueueAudio(audio_device_, audio_buffer_,
+                     sizeof(float) * BUFFER_SIZE);
+    }
   }
 
   return;
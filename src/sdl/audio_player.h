@@ -2,22 +2,40 @@
 #define _NES_AUDIO
 
 #include <cstdlib>
+#include <atomic>
 
 #include <SDL2/SDL.h>
 
+#include "../apu/audio_sink.h"
+
 /*
  * Allows samples to be sent to an SDL audio device and played back to
  * the user. Filters any output sound as the NES would.
  *
  * Used to play samples created by the APU during the emulation.
  */
-class AudioPlayer {
+class AudioPlayer : public AudioSink {
   private:
     // Sample are added to a buffer, which is queued to the device when
     // it becomes full.
     float *audio_buffer_;
     size_t buffer_slot_ = 0;
 
+    // Used to resample the audio when the emulation is not running at the
+    // speed of the console. The step is the number of input samples per
+    // output sample, and the time is when the next output sample is due,
+    // relative to the previous input sample. The step can be changed by
+    // another thread while samples are being added.
+    std::atomic<double> resample_step_{1.0};
+    double resample_time_ = 1.0;
+    float last_sample_ = 0.0f;
+
+    // The factor each sample is scaled by. Changed by the presenter thread.
+    std::atomic<float> volume_{1.0f};
+
+    // Adds a resampled sample to the buffer, queuing the buffer when full.
+    void QueueSample(float sample);
+
     // Audio samples are sent to this device, which is picked
     // during construction.
     SDL_AudioDeviceID audio_device_;
@@ -33,6 +51,13 @@ class AudioPlayer {
     // Adds a sample to the sample buffer.
     void AddSample(float sample);
 
+    // Sets the speed of the emulation relative to the console, so that
+    // samples are resampled to play back at the correct pitch.
+    void SetSpeed(double speed);
+
+    // Sets the volume of the audio, from 0 to 1.
+    void SetVolume(float volume);
+
     // Closes the audio device and frees the buffer.
     ~AudioPlayer(void);
 };
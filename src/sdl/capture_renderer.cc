@@ -0,0 +1,166 @@
+/*
+ * Implements a renderer class which captures frames instead of drawing them
+ * to the window. Captured frames are written as images or as a video stream,
+ * as selected in the configuration, which allows runs of the emulation to be
+ * recorded without a display.
+ *
+ * Frames are only decoded on the calling thread. They are then queued for a
+ * writer thread, which performs all encoding and I/O, so that slow disks or
+ * pipes do not delay presentation. If the queue is full, the renderer waits
+ * for the writer rather than losing frames.
+ */
+
+#include "./capture_renderer.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <SDL2/SDL.h>
+
+#include "./renderer.h"
+#include "../config/settings.h"
+#include "../memory/palette.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_writer.h"
+#include "../emulation/signals.h"
+
+/*
+ * Attempts to create a capture rendering object, using the capture format,
+ * path, and frame limit in the given settings.
+ *
+ * Returns NULL on failure.
+ */
+CaptureRenderer *CaptureRenderer::Create(SDL_Window *window, size_t width,
+                                         size_t height,
+                                         const Settings *settings) {
+  // Create the writer, which captures the part of each frame shown on a tv.
+  size_t scale = height / NES_HEIGHT;
+  FrameWriter *writer = FrameWriter::Create(settings->capture_format,
+                        settings->capture_path, width,
+                        NES_TRUE_HEIGHT * scale);
+  if (writer == NULL) { return NULL; }
+
+  return new CaptureRenderer(window, width, height, writer,
+                             settings->capture_frames);
+}
+
+/*
+ * Creates a CaptureRenderer object using the given writer, then starts
+ * the writer thread.
+ *
+ * Assumes the window and writer are valid.
+ */
+CaptureRenderer::CaptureRenderer(SDL_Window *window, size_t width,
+                                 size_t height, FrameWriter *writer,
+                                 size_t frame_limit)
+                               : Renderer(window, width, height) {
+  writer_ = writer;
+  frame_limit_ = frame_limit;
+  for (size_t i = 0; i < kNumBuffers_; i++) {
+    buffers_[i] = new Pixel[frame_width_ * frame_height_];
+  }
+  writer_thread_ = std::thread(&CaptureRenderer::RunWriter, this);
+  return;
+}
+
+/*
+ * Gives the frame rate to the writer, which stamps it on streams that hold
+ * one. Must be called before the first frame is drawn.
+ */
+void CaptureRenderer::SetFrameRate(uint32_t num, uint32_t den) {
+  std::lock_guard<std::mutex> guard(lock_);
+  writer_->SetFrameRate(num, den);
+  return;
+}
+
+/*
+ * Decodes the given frame and queues it to be written. Frames which have
+ * already been captured, or which were never drawn, are skipped.
+ *
+ * Closes the program once the frame limit has been reached.
+ */
+void CaptureRenderer::DrawFrame(const NesFrame *frame) {
+  if ((frame->number == 0) || (frame->number == last_frame_number_)) {
+    return;
+  }
+  last_frame_number_ = frame->number;
+
+  // Wait for a free buffer. The buffer at the end of the queue is only
+  // accessed by this thread until it is queued.
+  std::unique_lock<std::mutex> guard(lock_);
+  queue_signal_.wait(guard, [this] { return queue_size_ < kNumBuffers_; });
+  Pixel *buffer = buffers_[(queue_head_ + queue_size_) % kNumBuffers_];
+  guard.unlock();
+
+  // Decode the frame, then hand it to the writer.
+  DecodeFrame(frame, buffer, frame_width_);
+  guard.lock();
+  queue_size_++;
+  guard.unlock();
+  queue_signal_.notify_all();
+
+  // Stop the emulation once enough frames have been captured.
+  frames_captured_++;
+  if ((frame_limit_ > 0) && (frames_captured_ >= frame_limit_)) {
+    ndb_running = false;
+  }
+
+  return;
+}
+
+/*
+ * Writes each queued frame in order. Returns once the renderer is closing
+ * and every queued frame has been written.
+ *
+ * If a frame cannot be written, the program is closed and the remaining
+ * frames are discarded.
+ */
+void CaptureRenderer::RunWriter(void) {
+  bool failed = false;
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    // Wait for a frame to be queued.
+    queue_signal_.wait(guard, [this] { return (queue_size_ > 0) || closing_; });
+    if (queue_size_ == 0) { break; }
+
+    // Write the frame at the start of the queue without holding the lock.
+    Pixel *buffer = buffers_[queue_head_];
+    guard.unlock();
+    Pixel *shown = &(buffer[static_cast<size_t>(frame_rect_.y) * frame_width_]);
+    if (!failed && !writer_->Write(shown)) {
+      fprintf(stderr, "Error: Failed to write a captured frame.\n");
+      ndb_running = false;
+      failed = true;
+    }
+    guard.lock();
+
+    // Free the buffer for the renderer.
+    queue_head_ = (queue_head_ + 1) % kNumBuffers_;
+    queue_size_--;
+    queue_signal_.notify_all();
+  }
+
+  return;
+}
+
+/*
+ * Waits for the writer to finish any queued frames, then frees the writer
+ * and frame buffers.
+ */
+CaptureRenderer::~CaptureRenderer(void) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    closing_ = true;
+  }
+  queue_signal_.notify_all();
+  writer_thread_.join();
+
+  delete writer_;
+  for (size_t i = 0; i < kNumBuffers_; i++) { delete[] buffers_[i]; }
+  return;
+}
@@ -0,0 +1,71 @@
+#ifndef _NES_CAPRENDER
+#define _NES_CAPRENDER
+
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <SDL2/SDL.h>
+
+#include "./renderer.h"
+#include "../config/settings.h"
+#include "../memory/palette.h"
+#include "../video/frame_writer.h"
+
+/*
+ * Capture implementation of a Render class. Writes each frame to a file or
+ * stream instead of the window.
+ */
+class CaptureRenderer : public Renderer {
+  private:
+    // The number of decoded frames which can wait to be written.
+    static const size_t kNumBuffers_ = 4;
+
+    // Encodes and writes the decoded frames.
+    FrameWriter *writer_;
+
+    // Decoded frames waiting to be written, stored as a queue.
+    Pixel *buffers_[kNumBuffers_];
+    size_t queue_head_ = 0;
+    size_t queue_size_ = 0;
+
+    // The number of the last frame captured, used to skip repeated frames.
+    size_t last_frame_number_ = 0;
+
+    // The number of frames to capture before closing the program.
+    // Zero if the capture should not end.
+    size_t frame_limit_;
+    size_t frames_captured_ = 0;
+
+    // Guards the queue, which is shared with the writer thread.
+    std::mutex lock_;
+    std::condition_variable queue_signal_;
+    bool closing_ = false;
+    std::thread writer_thread_;
+
+    // Uses the provided writer to create a CaptureRenderer object.
+    CaptureRenderer(SDL_Window *window, size_t width, size_t height,
+                    FrameWriter *writer, size_t frame_limit);
+
+    // Writes queued frames until the renderer is deleted.
+    void RunWriter(void);
+
+  public:
+    // Functions implemented from the abstract class.
+    void DrawFrame(const NesFrame *frame);
+    void SetFrameRate(uint32_t num, uint32_t den);
+
+    // Attempts to create a CaptureRenderer object for frames of the given
+    // size, using the given capture settings.
+    // Returns NULL on failure.
+    static CaptureRenderer *Create(SDL_Window *window, size_t width,
+                                   size_t height,
+                                   const Settings *settings);
+
+    // Writes any queued frames, then frees the writer and buffers.
+    ~CaptureRenderer(void);
+};
+
+#endif
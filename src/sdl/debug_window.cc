@@ -0,0 +1,133 @@
+/*
+ * The debug window shows the views of PPU memory drawn by a PPU viewer. The
+ * nametables fill the left side of the window, and the pattern tables,
+ * palette, and sprites are stacked on the right.
+ *
+ * Each view has its own streaming texture. Views are drawn on the viewer's
+ * thread, and are only uploaded and shown here once they have changed, so
+ * the window costs nothing while the PPU memory is static.
+ */
+
+#include "./debug_window.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+
+#include <SDL2/SDL.h>
+
+#include "../memory/palette.h"
+#include "../debug/ppu_viewer.h"
+#include "../util/util.h"
+
+// The title and size of the window.
+#define DEBUG_WINDOW_TITLE "NES PPU Viewer"
+#define DEBUG_WINDOW_WIDTH 768
+#define DEBUG_WINDOW_HEIGHT 480
+
+// Where each view is drawn in the window. Sprites are drawn at twice
+// their size.
+static const SDL_Rect kViewRects[NUM_VIEWS] = {
+  { 512, 0, 256, 128 },
+  { 0, 0, 512, 480 },
+  { 576, 176, 128, 256 },
+  { 512, 136, 256, 32 }
+};
+
+/*
+ * Attempts to open a debug window, and a renderer for it.
+ *
+ * Returns NULL on failure.
+ */
+DebugWindow *DebugWindow::Create(PpuViewer *viewer) {
+  SDL_Window *window = SDL_CreateWindow(DEBUG_WINDOW_TITLE,
+                                        SDL_WINDOWPOS_UNDEFINED,
+                                        SDL_WINDOWPOS_UNDEFINED,
+                                        DEBUG_WINDOW_WIDTH,
+                                        DEBUG_WINDOW_HEIGHT, 0);
+  if (window == NULL) { return NULL; }
+
+  SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+  if (renderer == NULL) {
+    SDL_DestroyWindow(window);
+    return NULL;
+  }
+
+  return new DebugWindow(window, renderer, viewer);
+}
+
+/*
+ * Creates a texture for each view of the given viewer.
+ *
+ * Assumes the window and renderer are valid.
+ */
+DebugWindow::DebugWindow(SDL_Window *window, SDL_Renderer *renderer,
+                         PpuViewer *viewer) {
+  window_ = window;
+  renderer_ = renderer;
+  viewer_ = viewer;
+
+  size_t buffer_size = 0;
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    PpuViewType view = static_cast<PpuViewType>(i);
+    size_t width = PpuViewer::GetViewWidth(view);
+    size_t height = PpuViewer::GetViewHeight(view);
+    textures_[i] = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGB888,
+                                     SDL_TEXTUREACCESS_STREAMING,
+                                     static_cast<int>(width),
+                                     static_cast<int>(height));
+    view_rects_[i] = kViewRects[i];
+    buffer_size = MAX(buffer_size, width * height);
+  }
+  upload_buffer_ = new Pixel[buffer_size];
+
+  return;
+}
+
+/*
+ * Gets the SDL id of the debug window.
+ */
+Uint32 DebugWindow::GetId(void) {
+  return SDL_GetWindowID(window_);
+}
+
+/*
+ * Uploads each view which the viewer has redrawn to its texture. If any
+ * were redrawn, the window is redrawn with every view.
+ */
+void DebugWindow::Draw(void) {
+  // Take the views which have changed.
+  bool changed = false;
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    PpuViewType view = static_cast<PpuViewType>(i);
+    size_t width = PpuViewer::GetViewWidth(view);
+    if (!viewer_->TakeView(view, upload_buffer_, width)) { continue; }
+    SDL_UpdateTexture(textures_[i], NULL, upload_buffer_,
+                      static_cast<int>(width * sizeof(Pixel)));
+    changed = true;
+  }
+  if (!changed) { return; }
+
+  // Redraw the window.
+  SDL_SetRenderDrawColor(renderer_, 0, 0, 0, 0);
+  SDL_RenderClear(renderer_);
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    SDL_RenderCopy(renderer_, textures_[i], NULL, &(view_rects_[i]));
+  }
+  SDL_RenderPresent(renderer_);
+
+  return;
+}
+
+/*
+ * Destroys the textures, renderer, and window.
+ */
+DebugWindow::~DebugWindow(void) {
+  for (size_t i = 0; i < NUM_VIEWS; i++) {
+    if (textures_[i] != NULL) { SDL_DestroyTexture(textures_[i]); }
+  }
+  SDL_DestroyRenderer(renderer_);
+  SDL_DestroyWindow(window_);
+  delete[] upload_buffer_;
+  return;
+}
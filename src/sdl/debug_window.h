@@ -0,0 +1,50 @@
+#ifndef _NES_DEBUGWINDOW
+#define _NES_DEBUGWINDOW
+
+#include <cstdlib>
+
+#include <SDL2/SDL.h>
+
+#include "../memory/palette.h"
+#include "../debug/ppu_viewer.h"
+
+/*
+ * A second SDL window which shows the views drawn by a PPU viewer, each
+ * in its own texture. Must be used from the thread which created the
+ * main window.
+ */
+class DebugWindow {
+  private:
+    // The window, and the renderer and textures used to draw to it.
+    SDL_Window *window_;
+    SDL_Renderer *renderer_;
+    SDL_Texture *textures_[NUM_VIEWS];
+
+    // Where each view is drawn in the window.
+    SDL_Rect view_rects_[NUM_VIEWS];
+
+    // The viewer which draws the views, and a buffer each changed view is
+    // copied to before it is uploaded to its texture.
+    PpuViewer *viewer_;
+    Pixel *upload_buffer_;
+
+    DebugWindow(SDL_Window *window, SDL_Renderer *renderer,
+                PpuViewer *viewer);
+
+  public:
+    // Attempts to open a debug window for the given viewer.
+    // Returns NULL on failure.
+    static DebugWindow *Create(PpuViewer *viewer);
+
+    // Gets the SDL id of the window, used to route its events.
+    Uint32 GetId(void);
+
+    // Uploads any views which have been redrawn, and redraws the window
+    // if there were any.
+    void Draw(void);
+
+    // Closes the window. Does not delete the viewer.
+    ~DebugWindow(void);
+};
+
+#endif
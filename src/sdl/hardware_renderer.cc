@@ -19,12 +19,12 @@
 
 #include "./window.h"
 #include "./renderer.h"
-#include "../util/contracts.h"
 
 /*
  * Attempts to create a hardware rendering object. Returns NULL on failure.
  */
-HardwareRenderer *HardwareRenderer::Create(SDL_Window *window) {
+HardwareRenderer *HardwareRenderer::Create(SDL_Window *window,
+                                           size_t width, size_t height) {
   // Ensure that the provided window is non-null.
   if (window == NULL) { return NULL; }
 
@@ -36,54 +36,36 @@ HardwareRenderer *HardwareRenderer::Create(SDL_Window *window) {
   if (renderer == NULL) { return NULL; }
 
   // Return the HardwareRenderer object.
-  return new HardwareRenderer(window, renderer);
+  return new HardwareRenderer(window, width, height, renderer);
 }
 
 /*
  * Uses the provided SDL renderer to create a hardware rendering object.
  */
-HardwareRenderer::HardwareRenderer(SDL_Window *window, SDL_Renderer *renderer)
-                : Renderer(window) {
+HardwareRenderer::HardwareRenderer(SDL_Window *window, size_t width,
+                                   size_t height, SDL_Renderer *renderer)
+                : Renderer(window, width, height) {
   // Store the provided renderer.
   renderer_ = renderer;
 
-  // Allocate the rendering buffers.
-  pixel_buffer_ = new uint32_t[NES_WIDTH * NES_HEIGHT]();
-  frame_texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGB888,
-                   SDL_TEXTUREACCESS_STREAMING, NES_WIDTH, NES_HEIGHT);
-
-  return;
-}
-
-/*
- * Draws the given array of pixels to the given location in the pixel
- * buffer.
- *
- * Assumes the row and column are in range of the buffer size.
- * Assumes the number of pixels will fit within the bounds of the specified
- * location.
- */
-void HardwareRenderer::DrawPixels(size_t row, size_t col,
-                                  DataWord *tiles, size_t num) {
-  CONTRACT(row < static_cast<size_t>(NES_HEIGHT));
-  CONTRACT(col < static_cast<size_t>(NES_WIDTH));
-  CONTRACT((row * NES_WIDTH + col + num) < (NES_WIDTH * NES_HEIGHT));
-
-  // Draw the given pixels to the given location.
-  size_t index = row * NES_WIDTH + col;
-  for (size_t i = 0; i < num; i++) {
-    pixel_buffer_[index + i] = pixels_->emu[tiles[i]];
+  // Allocate the streaming textures.
+  for (size_t i = 0; i < kNumFrameTextures_; i++) {
+    frame_textures_[i] = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGB888,
+                         SDL_TEXTUREACCESS_STREAMING,
+                         static_cast<int>(frame_width_),
+                         static_cast<int>(frame_height_));
   }
 
   return;
 }
 
 /*
- * Renders the pixel buffer to the screen using hardware accelaration.
+ * Decodes the given frame into the next frame texture, then renders it to
+ * the screen using hardware accelaration.
  *
  * Assumes that the window provided during initialization was valid.
  */
-void HardwareRenderer::DrawFrame(void) {
+void HardwareRenderer::DrawFrame(const NesFrame *frame) {
   // Recalculate the window rect if the window has been resized.
   // Clear the window on resize.
   if (!window_size_valid_) {
@@ -93,32 +75,34 @@ void HardwareRenderer::DrawFrame(void) {
     SDL_RenderClear(renderer_);
   }
 
-  // Update the texture with the latest pixel data.
-  void *texture_pixels;
+  // Decode the frame directly into the next texture, respecting its pitch.
+  // The textures alternate so that a texture in use by the GPU is not locked.
+  frame_texture_index_ = (frame_texture_index_ + 1) % kNumFrameTextures_;
+  SDL_Texture *frame_texture = frame_textures_[frame_texture_index_];
+  void *pixels;
   int pitch;
-  SDL_LockTexture(frame_texture_, NULL, &texture_pixels, &pitch);
-  for (int i = 0; i < (NES_WIDTH * NES_HEIGHT); i++) {
-    (static_cast<uint32_t*>(texture_pixels))[i] = pixel_buffer_[i];
+  if (SDL_LockTexture(frame_texture, NULL, &pixels, &pitch) == 0) {
+    DecodeFrame(frame, static_cast<Pixel*>(pixels),
+                static_cast<size_t>(pitch) / sizeof(Pixel));
+    SDL_UnlockTexture(frame_texture);
   }
-  SDL_UnlockTexture(frame_texture_);
 
-  // Copy the render surface to the window surface.
-  SDL_RenderCopy(renderer_, frame_texture_, &kFrameRect_, &window_rect_);
-
-  // Update the window.
+  // Copy the frame to the window, and update it.
+  SDL_RenderCopy(renderer_, frame_texture, &frame_rect_, &window_rect_);
   SDL_RenderPresent(renderer_);
 
   return;
 }
 
 /*
- * Frees the pixel buffer, frame texture, and renderer used for hardware
- * accelerated rendering.
+ * Frees the frame textures and renderer used for hardware accelerated
+ * rendering.
  */
 HardwareRenderer::~HardwareRenderer(void) {
-  // Free all hardware rendering structures and buffers.
-  delete[] pixel_buffer_;
-  SDL_DestroyTexture(frame_texture_);
+  // Free all hardware rendering structures.
+  for (size_t i = 0; i < kNumFrameTextures_; i++) {
+    SDL_DestroyTexture(frame_textures_[i]);
+  }
   SDL_DestroyRenderer(renderer_);
   return;
 }
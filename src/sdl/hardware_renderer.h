@@ -13,25 +13,30 @@
  */
 class HardwareRenderer : public Renderer {
   private:
-    // Holds the next frame of pixel data to be streamed to the texture.
-    uint32_t *pixel_buffer_;
+    // The number of streaming textures frames are cycled through.
+    static const size_t kNumFrameTextures_ = 2;
 
-    // Used to stream pixel changes to the window renderer.
-    SDL_Texture *frame_texture_;
+    // Used to stream frames to the window renderer. Frames are decoded
+    // directly into a locked texture, and the textures are swapped each
+    // frame so that a texture in use by the GPU is never locked.
+    SDL_Texture *frame_textures_[kNumFrameTextures_];
+    size_t frame_texture_index_ = 0;
 
     // The SDL hardware renderer tied to the window.
     SDL_Renderer *renderer_;
 
     // Uses the provided renderer to create a HardwareRenderer object.
-    HardwareRenderer(SDL_Window *window, SDL_Renderer *renderer);
+    HardwareRenderer(SDL_Window *window, size_t width, size_t height,
+                     SDL_Renderer *renderer);
 
   public:
     // Functions implemented from the abstract class.
-    void DrawPixels(size_t row, size_t col, DataWord *tiles, size_t num);
-    void DrawFrame(void);
+    void DrawFrame(const NesFrame *frame);
 
-    // Attempts to create a HardwareRenderer object. Returns NULL on failure.
-    static HardwareRenderer *Create(SDL_Window *window);
+    // Attempts to create a HardwareRenderer object for frames of the given
+    // size. Returns NULL on failure.
+    static HardwareRenderer *Create(SDL_Window *window, size_t width,
+                                    size_t height);
 
     // Frees the structures and buffers related to this class.
     ~HardwareRenderer(void);
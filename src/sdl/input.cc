@@ -24,7 +24,7 @@
 #include "../util/util.h"
 #include "../util/contracts.h"
 #include "../util/data.h"
-#include "../config/config.h"
+#include "../config/settings.h"
 
 // Map array access constants.
 #define MAP_A 0
@@ -51,12 +51,26 @@
  * Loads the input mapping, allowing for key presses and releases to be used
  * for emulation.
  */
-Input::Input(Config *config) {
-  // Load the button mapping from the provided config file.
-  for (int i = 0; i < NUM_BUTTONS; i++) {
-    button_map_[i] = SDL_GetKeyFromName(config->Get(kButtonNames_[i],
-                     SDL_GetKeyName(kDefaultButtonMap_[i])));
+Input::Input(const Settings *settings) {
+  SetButtonMap(settings);
+  return;
+}
+
+/*
+ * Maps each button to the key named for it in the given settings. Buttons
+ * held under the old mapping are released, as their keys may no longer be
+ * mapped when they are let go.
+ *
+ * Must be called from the thread which processes events.
+ */
+void Input::SetButtonMap(const Settings *settings) {
+  for (size_t i = 0; i < NUM_BUTTONS; i++) {
+    button_map_[i] = SDL_GetKeyFromName(settings->button_keys[i]);
+    if (button_map_[i] == SDLK_UNKNOWN) {
+      fprintf(stderr, "Warning: Unknown key %s.\n", settings->button_keys[i]);
+    }
   }
+  input_status_ = 0;
   return;
 }
 
@@ -130,32 +144,32 @@ void Input::Release(SDL_Keycode key) {
   // Otherwise, we update the released button in the input status.
   switch(button) {
     case MAP_A:
-      input_status_ &= ~FLAG_A;
+      input_status_ &= static_cast<DataWord>(~FLAG_A);
       break;
     case MAP_B:
-      input_status_ &= ~FLAG_B;
+      input_status_ &= static_cast<DataWord>(~FLAG_B);
       break;
     case MAP_SELECT:
-      input_status_ &= ~FLAG_SELECT;
+      input_status_ &= static_cast<DataWord>(~FLAG_SELECT);
       break;
     case MAP_START:
-      input_status_ &= ~FLAG_START;
+      input_status_ &= static_cast<DataWord>(~FLAG_START);
       break;
     case MAP_UP:
       dpad_priority_up_ = false;
-      input_status_ &= ~FLAG_UP;
+      input_status_ &= static_cast<DataWord>(~FLAG_UP);
       break;
     case MAP_DOWN:
       dpad_priority_up_ = true;
-      input_status_ &= ~FLAG_DOWN;
+      input_status_ &= static_cast<DataWord>(~FLAG_DOWN);
       break;
     case MAP_LEFT:
       dpad_priority_left_ = false;
-      input_status_ &= ~FLAG_LEFT;
+      input_status_ &= static_cast<DataWord>(~FLAG_LEFT);
       break;
     case MAP_RIGHT:
       dpad_priority_left_ = true;
-      input_status_ &= ~FLAG_RIGHT;
+      input_status_ &= static_cast<DataWord>(~FLAG_RIGHT);
       break;
     default:
       break;
@@ -1,9 +1,10 @@
 /*
  * The renderer abstract class define an interface which can be used
- * by the PPU emulation to draw pixels to the main window. It abstracts
- * window resizing, scaling, and the use of SDL away from the emulation.
- * This allows for code that is clean and clear, and enables the rendering
- * method to be changed without changing the PPU emulation itself.
+ * by the presenter to draw the frames completed by the PPU emulation to the
+ * main window. It abstracts palette decoding, window resizing, scaling, and
+ * the use of SDL away from the emulation. This allows for code that is clean
+ * and clear, and enables the rendering method to be changed without changing
+ * the PPU emulation itself.
  *
  * Note that the SDL event manager, defined in the file sdl/window.cc, must
  * signal the renderer object whenever the window size changes, or else
@@ -21,34 +22,138 @@
 
 #include <SDL2/SDL.h>
 
-#include "../config/config.h"
+#include "../config/settings.h"
 #include "../util/util.h"
+#include "../util/contracts.h"
 #include "./window.h"
 #include "./hardware_renderer.h"
 #include "./software_renderer.h"
+#include "./capture_renderer.h"
 
 /*
- * Attempts to create the requested rendering system.
+ * Attempts to create the rendering system selected by the given settings.
  *
  * Returns NULL on failure.
  */
-Renderer *Renderer::Create(SDL_Window *window, Config *config) {
+Renderer *Renderer::Create(SDL_Window *window, const Settings *settings) {
+  // Frames are decoded at a higher resolution when the NTSC filter is used.
+  bool ntsc = settings->ntsc;
+  size_t decode_width = ntsc ? NTSC_WIDTH : NES_WIDTH;
+
+  // Decoded frames can then be upscaled. The filter and upscaler share
+  // a pool of workers, which is only kept if one of them is used.
+  WorkerPool *workers = new WorkerPool();
+  Upscaler *upscaler = Upscaler::Create(settings->upscaler, workers);
+  size_t scale = (upscaler != NULL) ? upscaler->GetScale() : 1U;
+  if (!ntsc && (upscaler == NULL)) {
+    delete workers;
+    workers = NULL;
+  }
+  size_t width = decode_width * scale;
+  size_t height = NES_HEIGHT * scale;
+
   // Calls the creation function for the appropriate derived class.
-  const char *type = config->Get(kRendererTypeKey, kRendererHardwareVal);
-  if (StrEq(type, kRendererSurfaceVal)) {
-    return SoftwareRenderer::Create(window);
-  } else if (StrEq(type, kRendererHardwareVal)) {
-    return HardwareRenderer::Create(window);
+  // Capturing replaces drawing to the window.
+  Renderer *renderer = NULL;
+  if (settings->capture_format != NULL) {
+    renderer = CaptureRenderer::Create(window, width, height, settings);
+  } else if (settings->renderer == RENDERER_SURFACE) {
+    renderer = SoftwareRenderer::Create(window, width, height);
   } else {
+    renderer = HardwareRenderer::Create(window, width, height);
+  }
+
+  // Clean up on failure.
+  if (renderer == NULL) {
+    if (upscaler != NULL) { delete upscaler; }
+    if (workers != NULL) { delete workers; }
     return NULL;
   }
+
+  // Load the palette or filter the renderer will use to decode frames,
+  // and give it the upscaler.
+  renderer->palette_ = new NesPalette(settings->palette_file);
+  if (ntsc) { renderer->ntsc_ = new NtscFilter(workers); }
+  renderer->decode_width_ = decode_width;
+  if (upscaler != NULL) {
+    renderer->upscaler_ = upscaler;
+    renderer->decode_buffer_ = new Pixel[decode_width * NES_HEIGHT];
+  }
+  renderer->workers_ = workers;
+
+  return renderer;
 }
 
 /*
  * Initializes the base rendering variables.
  */
-Renderer::Renderer(SDL_Window *window) {
+Renderer::Renderer(SDL_Window *window, size_t frame_width,
+                   size_t frame_height) {
   window_ = window;
+  frame_width_ = frame_width;
+  frame_height_ = frame_height;
+
+  // Only the rows shown on a tv are drawn to the window.
+  size_t scale = frame_height / NES_HEIGHT;
+  frame_rect_ = { NES_WIDTH_OFFSET,
+                  static_cast<int>(NES_HEIGHT_OFFSET * scale),
+                  static_cast<int>(frame_width),
+                  static_cast<int>(NES_TRUE_HEIGHT * scale) };
+  return;
+}
+
+/*
+ * Decodes the rows of the given frame which are displayed in the window into
+ * the given pixel buffer, using either the palette or the NTSC filter, then
+ * upscales them if an upscaler was selected. Rows are placed at the same
+ * location they hold in the frame, using the given pitch.
+ *
+ * Assumes the frame and pixel buffer are non-null.
+ * Assumes the pitch is at least the width of the frame.
+ */
+void Renderer::DecodeFrame(const NesFrame *frame, Pixel *pixels,
+                           size_t pitch) {
+  CONTRACT(pitch >= frame_width_);
+
+  // Frames which will be upscaled are decoded into the decode buffer.
+  Pixel *decoded = (upscaler_ != NULL) ? decode_buffer_ : pixels;
+  size_t decoded_pitch = (upscaler_ != NULL) ? decode_width_ : pitch;
+
+  DecodeRows(frame, NES_HEIGHT_OFFSET, NES_TRUE_HEIGHT, decoded, decoded_pitch);
+
+  // Scale the decoded rows into the pixel buffer.
+  if (upscaler_ != NULL) {
+    size_t scale = upscaler_->GetScale();
+    upscaler_->Scale(&(decode_buffer_[NES_HEIGHT_OFFSET * decode_width_]),
+                     decode_width_, decode_width_, NES_TRUE_HEIGHT,
+                     &(pixels[NES_HEIGHT_OFFSET * scale * pitch]), pitch);
+  }
+
+  return;
+}
+
+/*
+ * Decodes the given rows of the frame into the given pixel buffer, using
+ * either the palette or the NTSC filter. Rows are placed at the same location
+ * they hold in the frame, using the given pitch. Rows are never upscaled.
+ *
+ * Assumes the frame and pixel buffer are non-null.
+ * Assumes the rows are within the frame.
+ */
+void Renderer::DecodeRows(const NesFrame *frame, size_t first_row,
+                          size_t num_rows, Pixel *pixels, size_t pitch) {
+  CONTRACT(first_row + num_rows <= static_cast<size_t>(NES_HEIGHT));
+
+  // The NTSC filter decodes the rows at once, across its workers.
+  if (ntsc_ != NULL) {
+    ntsc_->Filter(frame, first_row, num_rows, pixels, pitch);
+  } else {
+    for (size_t row = first_row; row < first_row + num_rows; row++) {
+      palette_->DecodeRow(&(frame->pixels[row * NES_WIDTH]), frame->masks[row],
+                          &(pixels[row * pitch]), NES_WIDTH);
+    }
+  }
+
   return;
 }
 
@@ -82,25 +187,32 @@ void Renderer::GetWindowRect(void) {
 }
 
 /*
- * Sets the value of window_size_valid_ to false.
- * Called from the SDL event manager to invalidate the window.
+ * Ignores the frame rate, which only matters to renderers which record the
+ * frames.
  */
-void Renderer::InvalidateWindowSurface(void) {
-  window_size_valid_ = false;
+void Renderer::SetFrameRate(uint32_t num, uint32_t den) {
+  (void)num;
+  (void)den;
   return;
 }
 
 /*
- * Sets the pixel palette to the one provided.
+ * Sets the value of window_size_valid_ to false.
+ * Called from the SDL event manager to invalidate the window.
  */
-void Renderer::SetPalette(const PixelPalette *palette) {
-  pixels_ = palette;
+void Renderer::InvalidateWindowSurface(void) {
+  window_size_valid_ = false;
   return;
 }
 
 /*
- * Prevents issues with freeing an object of type Render.
+ * Frees the palette, filter, and upscaler of the renderer.
  */
 Renderer::~Renderer(void) {
+  if (palette_ != NULL) { delete palette_; }
+  if (ntsc_ != NULL) { delete ntsc_; }
+  if (upscaler_ != NULL) { delete upscaler_; }
+  if (decode_buffer_ != NULL) { delete[] decode_buffer_; }
+  if (workers_ != NULL) { delete workers_; }
   return;
 }
@@ -5,8 +5,12 @@
 
 #include <SDL2/SDL.h>
 
-#include "../config/config.h"
+#include "../config/settings.h"
 #include "../memory/palette.h"
+#include "../video/frame_buffer.h"
+#include "../video/ntsc_filter.h"
+#include "../video/upscaler.h"
+#include "../video/worker_pool.h"
 
 /*
  * The NES draws a 256x240 pictures, which is padded to 280x240. Most tvs
@@ -15,8 +19,6 @@
  * this information about the NES.
  */
 #define NES_WIDTH_OFFSET 0
-#define NES_WIDTH 256
-#define NES_HEIGHT 240
 #define NES_HEIGHT_OFFSET 8
 #define NES_TRUE_HEIGHT 224
 #define NES_TRUE_WIDTH_RATIO (256.0 / 280.0)
@@ -25,21 +27,37 @@
 #define NES_TRUE_H_TO_W (224.0 / 280.0)
 
 /*
- * Abstract rendering class, used by the emulation to draw the game to
- * the window.
+ * Abstract rendering class, used by the presenter to draw the frames
+ * produced by the emulation to the window.
  */
 class Renderer {
   protected:
+    // The dimensions of each frame drawn by the renderer, which are larger
+    // than the NES picture when it is filtered or upscaled.
+    size_t frame_width_;
+    size_t frame_height_;
+
     // Used to scale the output to the window.
-    const SDL_Rect kFrameRect_ = { NES_WIDTH_OFFSET, NES_HEIGHT_OFFSET,
-                                   NES_WIDTH, NES_TRUE_HEIGHT };
+    SDL_Rect frame_rect_;
     SDL_Rect window_rect_;
 
     // Holds a pointer to the current SDL window.
     SDL_Window *window_;
 
-    // Holds a pointer to the current pixel palette.
-    const PixelPalette *pixels_;
+    // Holds the palette used to decode the NES colors in each frame.
+    NesPalette *palette_ = NULL;
+
+    // Used in place of the palette when NTSC video is selected.
+    NtscFilter *ntsc_ = NULL;
+
+    // Upscales each decoded frame, if an upscaler is selected. Frames are
+    // decoded into the decode buffer before they are upscaled.
+    Upscaler *upscaler_ = NULL;
+    Pixel *decode_buffer_ = NULL;
+    size_t decode_width_ = NES_WIDTH;
+
+    // Shared by the filter and upscaler to split their work across threads.
+    WorkerPool *workers_ = NULL;
 
     // Set by the event manager when the size of the window changes.
     bool window_size_valid_ = false;
@@ -48,29 +66,34 @@ class Renderer {
     // of the NES picture.
     void GetWindowRect(void);
 
-    Renderer(SDL_Window *window);
+    // Decodes, and upscales, the rows of the frame shown in the window into
+    // a pixel buffer of frame_width_ by frame_height_ with the given pitch.
+    void DecodeFrame(const NesFrame *frame, Pixel *pixels, size_t pitch);
+
+    // Decodes the given rows of the frame into a pixel buffer with the given
+    // pitch, without upscaling them. Rows keep their location in the frame.
+    void DecodeRows(const NesFrame *frame, size_t first_row, size_t num_rows,
+                    Pixel *pixels, size_t pitch);
+
+    Renderer(SDL_Window *window, size_t frame_width, size_t frame_height);
 
   public:
     // Creates the specified renderer, and returns it cast to a Render class.
-    static Renderer *Create(SDL_Window *window, Config *config);
+    static Renderer *Create(SDL_Window *window, const Settings *settings);
 
-    // Draws a pixel to the window. The pixel will not be shown until Frame()
-    // is called.
-    virtual void DrawPixels(size_t row, size_t col,
-                            DataWord *tiles, size_t len) = 0;
+    // Decodes the given frame and draws it to the main window.
+    virtual void DrawFrame(const NesFrame *frame) = 0;
 
-    // Renders any pixel changes to the main window.
-    virtual void DrawFrame(void) = 0;
+    // Tells the renderer the rate frames are drawn at, as a fraction. Only
+    // used by renderers which record the frames.
+    virtual void SetFrameRate(uint32_t num, uint32_t den);
 
     // Signals that the window surface must be obtained again.
     void InvalidateWindowSurface(void);
 
-    // Provides the renderer with a palette to use during rendering.
-    // Must be called before frames/pixels can be drawn.
-    void SetPalette(const PixelPalette *palette);
-
-    // Declared as virtual to allows the derived renderers destructor to be
-    // called when this object is deleted.
+    // Frees the palette, filter, and upscaler. Declared as virtual to allows
+    // the derived renderers destructor to be called when this object is
+    // deleted.
     virtual ~Renderer(void) = 0;
 };
 
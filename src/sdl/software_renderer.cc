@@ -1,11 +1,17 @@
 /*
  * This is a software renderering implementation of the abstract renderer
- * class. It is implemented using and SDL surface to buffer the next frame
- * to. This surface is blitted to the screen whenever it is filled, and the
- * display is then updated.
+ * class. It is implemented using and SDL surface, which each frame is decoded
+ * into. This surface is then blitted to the screen, and the display is
+ * updated.
  *
  * This implementation of rendering is faster on hardware with poor OpenGL
  * support.
+ *
+ * Only the rows which change between frames are decoded, scaled, and
+ * updated on the window. Each row is hashed and compared against the hash
+ * of the row on the screen, and runs of changed rows are drawn as bands.
+ * When most of the frame changes, the whole frame is drawn at once instead,
+ * which is cheaper than drawing many bands.
  */
 
 #include "./software_renderer.h"
@@ -16,19 +22,31 @@
 
 #include <SDL2/SDL.h>
 
-#include "../util/contracts.h"
 #include "../memory/palette.h"
+#include "../video/frame_buffer.h"
+#include "../video/frame_hash.h"
+#include "../util/util.h"
 #include "./window.h"
 #include "./renderer.h"
 
+// The number of rows around each row which affect how it is upscaled.
+// Changing a row changes this many of its neighbors once upscaled.
+#define UPSCALE_CONTEXT_ROWS 2U
+
+// Once this fraction of the rows have changed, the whole frame is drawn.
+#define FULL_DRAW_NUM 3U
+#define FULL_DRAW_DEN 4U
+
 /*
  * Attempts to create a software rendering object.
  *
  * Returns NULL on failure.
  */
-SoftwareRenderer *SoftwareRenderer::Create(SDL_Window *window) {
+SoftwareRenderer *SoftwareRenderer::Create(SDL_Window *window,
+                                           size_t width, size_t height) {
   // Create and verify the surface.
-  SDL_Surface *render_surface = SDL_CreateRGBSurface(0, NES_WIDTH, NES_HEIGHT,
+  SDL_Surface *render_surface = SDL_CreateRGBSurface(0,
+                                static_cast<int>(width), static_cast<int>(height),
                                 PALETTE_DEPTH, PALETTE_RMASK, PALETTE_GMASK,
                                 PALETTE_BMASK, 0);
   if (render_surface == NULL) { return NULL; }
@@ -37,7 +55,7 @@ SoftwareRenderer *SoftwareRenderer::Create(SDL_Window *window) {
   SDL_SetSurfaceRLE(render_surface, 0);
 
   // Use the rendering surface to create a SoftwareRenderer object.
-  return new SoftwareRenderer(window, render_surface);
+  return new SoftwareRenderer(window, width, height, render_surface);
 }
 
 /*
@@ -46,50 +64,154 @@ SoftwareRenderer *SoftwareRenderer::Create(SDL_Window *window) {
  *
  * Assumes the window and rendering surface are valid.
  */
-SoftwareRenderer::SoftwareRenderer(SDL_Window *window, SDL_Surface *surface)
-                                                         : Renderer(window) {
+SoftwareRenderer::SoftwareRenderer(SDL_Window *window, size_t width,
+                                   size_t height, SDL_Surface *surface)
+                                 : Renderer(window, width, height) {
   render_surface_ = surface;
   return;
 }
 
 /*
- * Draws the given pixel to the rendering surface.
+ * Decodes the rows of the given frame which have changed into the rendering
+ * surface, then copies them to the window.
  *
- * Assumes the SDL window and rendering surface are valid.
- * Assumes that the row and column are in range of the surface size.
+ * Assumes that the SDL window is valid.
  */
-void SoftwareRenderer::DrawPixels(size_t row, size_t col,
-                                  DataWord *tiles, size_t num) {
-  CONTRACT(row < static_cast<size_t>(NES_HEIGHT));
-  CONTRACT(col < static_cast<size_t>(NES_WIDTH));
-  CONTRACT((row * NES_WIDTH + col + num) < (NES_WIDTH * NES_HEIGHT));
-
-  // Draw the pixels to the given location in the rendering surface.
-  size_t index = row * NES_WIDTH + col;
-  uint32_t *pixel_surface = static_cast<uint32_t*>(render_surface_->pixels);
-  for (size_t i = 0; i < num; i++) {
-    pixel_surface[index + i] = pixels_->emu[tiles[i]];
+void SoftwareRenderer::DrawFrame(const NesFrame *frame) {
+  // Get the window surface, and recalculate the rect, if the surface is invalid.
+  if (!window_size_valid_) {
+    window_surface_ = SDL_GetWindowSurface(window_);
+    GetWindowRect();
+    SDL_FillRect(window_surface_, NULL, 0);
+    window_size_valid_ = true;
+    row_hashes_valid_ = false;
   }
 
+  // Only redraw the frame if it has changed, and only redraw the rows of it
+  // which have changed if there are few enough of them.
+  size_t num_dirty = FindDirtyRows(frame);
+  if (num_dirty == 0) { return; }
+  if (!row_hashes_valid_
+      || ((num_dirty * FULL_DRAW_DEN) >= (NES_TRUE_HEIGHT * FULL_DRAW_NUM))) {
+    DrawAllRows(frame);
+  } else {
+    DrawDirtyRows(frame);
+  }
+  row_hashes_valid_ = true;
+
   return;
 }
 
 /*
- * Copies the rendering surface to the window.
+ * Hashes the given row of the frame with the mask it was drawn with. When the
+ * NTSC filter is used, the phase of the frame is included, as it changes the
+ * colors of every row.
+ */
+uint64_t SoftwareRenderer::HashRow(const NesFrame *frame, size_t row) {
+  uint64_t seed = frame->masks[row];
+  if (ntsc_ != NULL) { seed |= static_cast<uint64_t>(frame->number & 1U) << 8; }
+  return HashBytes(&(frame->pixels[row * NES_WIDTH]), NES_WIDTH, seed);
+}
+
+/*
+ * Hashes each row shown in the window, marking the rows whose hash differs
+ * from that of the row on the screen. The stored hashes are then replaced.
+ * When an upscaler is used, the neighbors of each changed row are also
+ * marked, as they are upscaled differently.
  *
- * Assumes that the SDL window is valid.
+ * Returns the number of rows marked.
  */
-void SoftwareRenderer::DrawFrame(void) {
-  // Get the window surface, and recalculate the rect, if the surface is invalid.
-  if (!window_size_valid_) {
-    window_surface_ = SDL_GetWindowSurface(window_);
-    GetWindowRect();
-    SDL_FillRect(window_surface_, NULL, 0);
-    window_size_valid_ = true;
+size_t SoftwareRenderer::FindDirtyRows(const NesFrame *frame) {
+  const size_t first = NES_HEIGHT_OFFSET;
+  const size_t end = NES_HEIGHT_OFFSET + NES_TRUE_HEIGHT;
+
+  // Compare the hash of each row to the screen.
+  bool changed[NES_HEIGHT];
+  for (size_t row = first; row < end; row++) {
+    uint64_t hash = HashRow(frame, row);
+    changed[row] = !row_hashes_valid_ || (hash != row_hashes_[row]);
+    row_hashes_[row] = hash;
+  }
+
+  // Mark the changed rows, and their neighbors if they will be upscaled.
+  size_t context = (upscaler_ != NULL) ? UPSCALE_CONTEXT_ROWS : 0;
+  size_t num_dirty = 0;
+  for (size_t row = first; row < end; row++) {
+    size_t near_first = (row >= first + context) ? (row - context) : first;
+    size_t near_end = MIN(row + context + 1U, end);
+    dirty_rows_[row] = false;
+    for (size_t near = near_first; near < near_end; near++) {
+      dirty_rows_[row] = dirty_rows_[row] || changed[near];
+    }
+    if (dirty_rows_[row]) { num_dirty++; }
   }
 
+  return num_dirty;
+}
+
+/*
+ * Decodes each band of dirty rows into the render surface, then scales
+ * those bands to the window and updates only the areas they cover.
+ *
+ * Upscaled frames are always decoded in full, as the upscaler treats the
+ * edges of each band as the edges of the picture.
+ */
+void SoftwareRenderer::DrawDirtyRows(const NesFrame *frame) {
+  Pixel *pixels = static_cast<Pixel*>(render_surface_->pixels);
+  size_t pitch = static_cast<size_t>(render_surface_->pitch) / sizeof(Pixel);
+  if (upscaler_ != NULL) { DecodeFrame(frame, pixels, pitch); }
+
+  // Find each band of dirty rows, and draw it to the window.
+  size_t scale = frame_height_ / NES_HEIGHT;
+  size_t end = NES_HEIGHT_OFFSET + NES_TRUE_HEIGHT;
+  int num_rects = 0;
+  size_t row = NES_HEIGHT_OFFSET;
+  while (row < end) {
+    if (!dirty_rows_[row]) {
+      row++;
+      continue;
+    }
+    size_t band_first = row;
+    while ((row < end) && dirty_rows_[row]) { row++; }
+    size_t band_rows = row - band_first;
+    if (upscaler_ == NULL) {
+      DecodeRows(frame, band_first, band_rows, pixels, pitch);
+    }
+
+    // Map the band onto the window. Bands are mapped from the picture
+    // rather than the frame so that adjacent bands meet exactly.
+    size_t top = band_first - NES_HEIGHT_OFFSET;
+    int win_h = window_rect_.h;
+    int win_top = static_cast<int>(top) * win_h / NES_TRUE_HEIGHT;
+    int win_bottom = static_cast<int>(top + band_rows) * win_h
+                   / NES_TRUE_HEIGHT;
+    SDL_Rect src = { frame_rect_.x, static_cast<int>(band_first * scale),
+                     frame_rect_.w, static_cast<int>(band_rows * scale) };
+    SDL_Rect *dst = &(update_rects_[num_rects]);
+    *dst = { window_rect_.x, window_rect_.y + win_top,
+             window_rect_.w, win_bottom - win_top };
+    if (dst->h <= 0) { continue; }
+    SDL_BlitScaled(render_surface_, &src, window_surface_, dst);
+    num_rects++;
+  }
+
+  // Draw the changed areas to the window.
+  SDL_UpdateWindowSurfaceRects(window_, update_rects_, num_rects);
+
+  return;
+}
+
+/*
+ * Decodes the entire frame into the rendering surface, then copies it to
+ * the window.
+ */
+void SoftwareRenderer::DrawAllRows(const NesFrame *frame) {
+  // Decode the frame into the render surface, respecting its pitch.
+  DecodeFrame(frame, static_cast<Pixel*>(render_surface_->pixels),
+              static_cast<size_t>(render_surface_->pitch) / sizeof(Pixel));
+
   // Copy the render surface to the window surface.
-  SDL_BlitScaled(render_surface_, &kFrameRect_, window_surface_, &window_rect_);
+  SDL_BlitScaled(render_surface_, &frame_rect_, window_surface_, &window_rect_);
 
   // Draw the frame to the window.
   SDL_UpdateWindowSurface(window_);
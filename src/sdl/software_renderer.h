@@ -8,28 +8,57 @@
 
 #include "./renderer.h"
 #include "../memory/palette.h"
+#include "../video/frame_buffer.h"
 
 /*
  * Software rendering implementation of a Render class.
  */
 class SoftwareRenderer : public Renderer {
   private:
-    // Holds the next frame to be drawn to the screen.
+    // Holds the decoded frame to be drawn to the screen.
     SDL_Surface *render_surface_;
 
     // Used to draw the next frame to the screen.
     SDL_Surface *window_surface_;
 
+    // The hash of each row of the frame on the screen, used to find the rows
+    // which change between frames. Only valid once a frame has been drawn
+    // to the current window surface.
+    uint64_t row_hashes_[NES_HEIGHT];
+    bool row_hashes_valid_ = false;
+
+    // Marks the rows of the current frame which differ from the screen.
+    bool dirty_rows_[NES_HEIGHT];
+
+    // The areas of the window updated by the current frame.
+    SDL_Rect update_rects_[NES_TRUE_HEIGHT];
+
+    // Hashes the given row of the frame, including any state which changes
+    // how the row is decoded.
+    uint64_t HashRow(const NesFrame *frame, size_t row);
+
+    // Finds the rows of the frame which differ from the screen, and returns
+    // how many there are.
+    size_t FindDirtyRows(const NesFrame *frame);
+
+    // Draws only the rows of the frame which differ from the screen.
+    void DrawDirtyRows(const NesFrame *frame);
+
+    // Draws every row of the frame.
+    void DrawAllRows(const NesFrame *frame);
+
     // Uses the provided surface to create a SoftwareRenderer object.
-    SoftwareRenderer(SDL_Window *window, SDL_Surface *surface);
+    SoftwareRenderer(SDL_Window *window, size_t width, size_t height,
+                     SDL_Surface *surface);
 
   public:
     // Functions implemented from the abstract class.
-    void DrawPixels(size_t row, size_t col, DataWord *tiles, size_t num);
-    void DrawFrame(void);
+    void DrawFrame(const NesFrame *frame);
 
-    // Attempts to create a SoftwareRenderer object. Returns NULL on failure.
-    static SoftwareRenderer *Create(SDL_Window *window);
+    // Attempts to create a SoftwareRenderer object for frames of the given
+    // size. Returns NULL on failure.
+    static SoftwareRenderer *Create(SDL_Window *window, size_t width,
+                                    size_t height);
 
     // Frees the surface used for software rendering.
     ~SoftwareRenderer(void);
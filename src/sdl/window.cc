@@ -21,6 +21,7 @@
 #include "./window.h"
 
 #include <new>
+#include <cstdlib>
 #include <cstdio>
 #include <cstdint>
 
@@ -29,13 +30,13 @@
 #include "./input.h"
 #include "./renderer.h"
 #include "./audio_player.h"
+#include "./debug_window.h"
+#include "../debug/ppu_viewer.h"
 #include "../util/util.h"
 #include "../emulation/signals.h"
-#include "../config/config.h"
+#include "../config/settings.h"
 
 // Window size constants
-#define NES_WIDTH 256
-#define NES_HEIGHT 240
 #define WINDOW_WIDTH 560
 #define WINDOW_HEIGHT 448
 #define MAX_TITLE_SIZE 256
@@ -47,7 +48,14 @@ const char *kWindowName = "NES, I guess?";
  * Attempts to create a Window object. Returns NULL and cleans any data already
  * created on failure.
  */
-Window *Window::Create(Config *config) {
+Window *Window::Create(const Settings *settings) {
+  // Capturing frames does not require a display or audio device, so SDL's
+  // dummy drivers are used unless others have been selected by the user.
+  if (settings->capture_format != NULL) {
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+  }
+
   // Init SDL's video system.
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) != 0) {
     fprintf(stderr, "Failed to initialize SDL.\n");
@@ -76,7 +84,7 @@ Window *Window::Create(Config *config) {
   }
 
   // Attempt to create a renderer; error on failure.
-  Renderer *renderer = Renderer::Create(window, config);
+  Renderer *renderer = Renderer::Create(window, settings);
   if (renderer == NULL) {
     fprintf(stderr, "Failed to create a renderer for the SDL window.\n");
     SDL_DestroyWindow(window);
@@ -93,9 +101,10 @@ Window *Window::Create(Config *config) {
     SDL_Quit();
     return NULL;
   }
+  audio->SetVolume(settings->volume);
 
-  // Open the input config file and setup input.
-  Input *input = new Input(config);
+  // Setup input with the key mapping from the settings.
+  Input *input = new Input(settings);
 
   // Create a Window object and return it to the caller.
   return new Window(window, renderer, audio, input);
@@ -115,6 +124,39 @@ Window::Window(SDL_Window *window, Renderer *renderer,
   return;
 }
 
+/*
+ * Applies reloaded settings to the interfaces of the window. A window can
+ * only hold one renderer at a time, so the old renderer is freed before the
+ * new one is created. If the new one cannot be created, the old settings
+ * are restored. The capture renderer is never recreated, as doing so would
+ * restart the capture.
+ *
+ * Must be called from the thread which created the window.
+ */
+void Window::ApplySettings(const Settings *settings, const Settings *old) {
+  if (!settings->SameVideo(old)) {
+    if (old->capture_format != NULL) {
+      fprintf(stderr, "Warning: Video settings cannot change while frames "
+                      "are captured.\n");
+    } else {
+      delete renderer_;
+      renderer_ = Renderer::Create(window_, settings);
+      if (renderer_ == NULL) {
+        fprintf(stderr, "Warning: Failed to apply the new video settings.\n");
+        renderer_ = Renderer::Create(window_, old);
+      }
+      if (renderer_ == NULL) {
+        fprintf(stderr, "Error: Failed to restore the renderer.\n");
+        abort();
+      }
+    }
+  }
+
+  input_->SetButtonMap(settings);
+  audio_->SetVolume(settings->volume);
+  return;
+}
+
 /*
  * Processes all events on the SDL event queue.
  */
@@ -147,6 +189,16 @@ void Window::ProcessEvents(void) {
  * Assumes that the event holds a window event.
  */
 void Window::ProcessWindowEvent(SDL_Event *event) {
+  // Closing the debug window only closes that window.
+  if ((debug_window_ != NULL)
+      && (event->window.windowID == debug_window_->GetId())) {
+    if (event->window.event == SDL_WINDOWEVENT_CLOSE) {
+      delete debug_window_;
+      debug_window_ = NULL;
+    }
+    return;
+  }
+
   // Determine which window event is being thrown.
   switch (event->window.event) {
     case SDL_WINDOWEVENT_CLOSE:
@@ -165,15 +217,51 @@ void Window::ProcessWindowEvent(SDL_Event *event) {
 }
 
 /*
- * Displays the current fps of the emulation in the window title.
+ * Opens a debug window which shows the views drawn by the given viewer.
+ * The viewer is not owned by the window.
+ *
+ * Returns false if the window could not be opened.
  */
-void Window::DisplayFps(double fps) {
+bool Window::OpenDebugWindow(PpuViewer *viewer) {
+  if (debug_window_ != NULL) { delete debug_window_; }
+  debug_window_ = DebugWindow::Create(viewer);
+  return debug_window_ != NULL;
+}
+
+/*
+ * Draws the views which have changed to the debug window, if it is open.
+ */
+void Window::DrawDebugWindow(void) {
+  if (debug_window_ != NULL) { debug_window_->Draw(); }
+  return;
+}
+
+/*
+ * Displays the current fps of the emulation in the window title, along with
+ * the frames dropped and repeated and the pacing jitter since the last update.
+ */
+void Window::DisplayStats(const FrameStats *stats) {
   char buf[MAX_TITLE_SIZE];
-  sprintf(buf, "%s | FPS: %.1f", kWindowName, fps);
+  snprintf(buf, MAX_TITLE_SIZE, "%s | FPS: %.1f | Dropped: %zu | Repeated: %zu"
+           " | Jitter: %.0f/%.0f us", kWindowName, stats->fps, stats->dropped,
+           stats->repeated, stats->mean_jitter_us, stats->max_jitter_us);
   SDL_SetWindowTitle(window_, buf);
   return;
 }
 
+/*
+ * Gets the refresh rate of the display the window is on.
+ * Returns zero if the refresh rate could not be determined.
+ */
+double Window::GetRefreshRate(void) {
+  SDL_DisplayMode mode;
+  int display = SDL_GetWindowDisplayIndex(window_);
+  if ((display < 0) || (SDL_GetCurrentDisplayMode(display, &mode) != 0)) {
+    return 0.0;
+  }
+  return static_cast<double>(mode.refresh_rate);
+}
+
 /*
  * Exposes the created renderer object to the caller.
  */
@@ -201,6 +289,7 @@ Input *Window::GetInput(void) {
  */
 Window::~Window(void) {
   // Free all the interface objects.
+  if (debug_window_ != NULL) { delete debug_window_; }
   delete renderer_;
   delete audio_;
   delete input_;
@@ -3,10 +3,29 @@
 
 #include <SDL2/SDL.h>
 
-#include "../config/config.h"
+#include "../config/settings.h"
 #include "./renderer.h"
 #include "./audio_player.h"
 #include "./input.h"
+#include "./debug_window.h"
+#include "../debug/ppu_viewer.h"
+
+/*
+ * Statistics on the frames presented in the window, which are shown in
+ * its title.
+ */
+struct FrameStats {
+  // The frame rate of the emulation.
+  double fps;
+
+  // The frames dropped and repeated by the presenter.
+  size_t dropped;
+  size_t repeated;
+
+  // How late the emulation started each frame, in microseconds.
+  double mean_jitter_us;
+  double max_jitter_us;
+};
 
 /*
  * Maintains all of the data necessary to interact with SDL.
@@ -23,6 +42,9 @@ class Window {
     AudioPlayer *audio_;
     Input *input_;
 
+    // The window showing the PPU viewer, if it is open.
+    DebugWindow *debug_window_ = NULL;
+
     // Processes the window events stored in a given SDL event.
     void ProcessWindowEvent(SDL_Event *event);
 
@@ -31,13 +53,29 @@ class Window {
 
   public:
     // Attempts to create a Window object. Returns NULL on failure.
-    static Window *Create(Config *config);
+    static Window *Create(const Settings *settings);
+
+    // Applies the given settings, which replace the old settings, to the
+    // renderer, input, and audio. The renderer is only recreated if the
+    // video settings changed.
+    void ApplySettings(const Settings *settings, const Settings *old);
 
     // Processes all relevent events on the SDL event queue.
     void ProcessEvents(void);
 
-    // Displays the given FPS in the main window title.
-    void DisplayFps(double fps);
+    // Opens a debug window showing the views of the given viewer.
+    // Returns false if the window could not be opened.
+    bool OpenDebugWindow(PpuViewer *viewer);
+
+    // Draws any changed views to the debug window, if it is open.
+    void DrawDebugWindow(void);
+
+    // Displays the given frame statistics in the main window title.
+    void DisplayStats(const FrameStats *stats);
+
+    // Gets the refresh rate of the display holding the window, in Hz.
+    // Returns zero if it is unknown.
+    double GetRefreshRate(void);
 
     // Provides the caller with a copy of the respective sub-interface.
     Renderer *GetRenderer(void);
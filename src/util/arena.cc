@@ -0,0 +1,98 @@
+/*
+ * The arena is a bump allocator for the mutable state of a console.
+ *
+ * A console allocates its ram, registers, and buffers once, when it is
+ * created, and frees them all when it is destroyed. Taking them from an
+ * arena packs that state into a few cache-line aligned blocks, instead of
+ * scattering dozens of small allocations across the heap, and frees them
+ * with a single pass over the blocks.
+ */
+
+#include "./arena.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#include "./data.h"
+#include "./util.h"
+
+// The space reserved for the header at the start of each block, which keeps
+// the memory after it aligned.
+#define ARENA_HEADER_SIZE \
+    ((sizeof(Block) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/*
+ * Creates an arena, allocating its first block.
+ */
+Arena::Arena(size_t block_size) {
+  block_size_ = block_size;
+  head_ = NewBlock(block_size_, NULL);
+  return;
+}
+
+/*
+ * Allocates a block of at least the given size, which is linked to the
+ * given block.
+ */
+Arena::Block *Arena::NewBlock(size_t size, Block *next) {
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  void *memory = operator new(ARENA_HEADER_SIZE + size,
+                              std::align_val_t(ARENA_ALIGN));
+  Block *block = static_cast<Block*>(memory);
+  block->next = next;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+/*
+ * Allocates the given number of bytes from the current block, starting a new
+ * block if it is full. The memory is zeroed, as the memory returned by new
+ * with an initializer would be.
+ */
+void *Arena::Alloc(size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  if ((head_->size - head_->used) < size) {
+    head_ = NewBlock(MAX(size, block_size_), head_);
+  }
+
+  DataWord *memory = reinterpret_cast<DataWord*>(head_) + ARENA_HEADER_SIZE
+                                                        + head_->used;
+  head_->used += size;
+  memset(memory, 0, size);
+  return memory;
+}
+
+/*
+ * Allocates an array filled with random words.
+ */
+DataWord *Arena::NewRand(size_t size) {
+  DataWord *data = static_cast<DataWord*>(Alloc(size));
+  RandFill(data, size);
+  return data;
+}
+
+/*
+ * Sums the bytes handed out from each block.
+ */
+size_t Arena::GetUsed(void) {
+  size_t used = 0;
+  for (Block *block = head_; block != NULL; block = block->next) {
+    used += block->used;
+  }
+  return used;
+}
+
+/*
+ * Frees each block of the arena.
+ */
+Arena::~Arena(void) {
+  while (head_ != NULL) {
+    Block *next = head_->next;
+    operator delete(head_, std::align_val_t(ARENA_ALIGN));
+    head_ = next;
+  }
+  return;
+}
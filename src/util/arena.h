@@ -0,0 +1,76 @@
+#ifndef _NES_ARENA
+#define _NES_ARENA
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include "./data.h"
+
+// Every allocation from an arena starts on its own cache line.
+#define ARENA_ALIGN 64U
+
+/*
+ * Allocates the mutable state of a console from a few large blocks, so that
+ * the state used by the emulation is packed together in memory, and can be
+ * freed all at once.
+ *
+ * Objects allocated from an arena are never freed individually, and their
+ * destructors are not run, so only trivially destructible types may be
+ * allocated with New() and NewArray().
+ */
+class Arena {
+  private:
+    // Each block begins with this header, padded to a cache line, followed
+    // by the memory it hands out.
+    struct Block {
+      Block *next;
+      size_t size;
+      size_t used;
+    };
+
+    // The block allocations are taken from, which links to the blocks
+    // filled before it, and the size of each new block.
+    Block *head_;
+    size_t block_size_;
+
+    // Allocates a block with room for at least the given number of bytes.
+    static Block *NewBlock(size_t size, Block *next);
+
+  public:
+    // Creates an arena whose first block holds the given number of bytes.
+    // Larger arenas add more blocks as they fill.
+    Arena(size_t block_size);
+
+    // Allocates the given number of zeroed bytes, aligned to a cache line.
+    void *Alloc(size_t size);
+
+    // Allocates and value-initializes an object.
+    template<typename T> T *New(void) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "Arena objects must be trivially destructible");
+      return new (Alloc(sizeof(T))) T();
+    }
+
+    // Allocates and value-initializes an array of objects.
+    template<typename T> T *NewArray(size_t num) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "Arena objects must be trivially destructible");
+      T *array = static_cast<T*>(Alloc(sizeof(T) * num));
+      for (size_t i = 0; i < num; i++) { new (&(array[i])) T(); }
+      return array;
+    }
+
+    // Allocates an array of words filled by RandFill(), which
+    // is used for memory whose power up state is undefined.
+    DataWord *NewRand(size_t size);
+
+    // Gets the number of bytes handed out by the arena, including padding.
+    size_t GetUsed(void);
+
+    // Frees every block, and so everything allocated from the arena.
+    ~Arena(void);
+};
+
+#endif
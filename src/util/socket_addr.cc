@@ -0,0 +1,97 @@
+/*
+ * Sockets are named by the user with a single string, which is either a
+ * "host:port" pair or "unix:" followed by the path of a UNIX socket. The
+ * host may be a name or an address of either IP version, and may be left
+ * out of an address which is bound, as in ":2345", to use every local
+ * address.
+ */
+
+#include "./socket_addr.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Resolves a "host:port" or "unix:<path>" address into a socket address for
+ * sockets of the given type. Passive addresses are resolved to be bound,
+ * rather than connected or sent to.
+ *
+ * Returns false, after printing an error, if the address cannot be resolved.
+ */
+bool ResolveSocketAddr(const char *addr, int sock_type, bool passive,
+                       const char *use, struct sockaddr_storage *res,
+                       socklen_t *res_size) {
+  memset(res, 0, sizeof(*res));
+
+  // UNIX socket addresses hold their path directly.
+  size_t prefix_size = strlen(UNIX_ADDR_PREFIX);
+  if (strncmp(addr, UNIX_ADDR_PREFIX, prefix_size) == 0) {
+    struct sockaddr_un *unix_addr = reinterpret_cast<struct sockaddr_un*>(res);
+    const char *path = addr + prefix_size;
+    if ((*path == '\0') || (strlen(path) >= sizeof(unix_addr->sun_path))) {
+      fprintf(stderr, "Error: invalid %s socket path %s.\n", use, path);
+      return false;
+    }
+    unix_addr->sun_family = AF_UNIX;
+    strcpy(unix_addr->sun_path, path);
+    *res_size = sizeof(*unix_addr);
+    return true;
+  }
+
+  // Otherwise, the host and port are split at the last colon, so that
+  // the host may be an IPv6 address.
+  const char *port = strrchr(addr, ':');
+  if ((port == NULL) || (port[1] == '\0')) {
+    fprintf(stderr, "Error: %s address %s has no port.\n", use, addr);
+    return false;
+  }
+  size_t host_size = static_cast<size_t>(port - addr);
+  char *host = new char[host_size + 1];
+  memcpy(host, addr, host_size);
+  host[host_size] = '\0';
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = sock_type;
+  hints.ai_flags = AI_NUMERICSERV | (passive ? AI_PASSIVE : 0);
+  struct addrinfo *info = NULL;
+  int status = getaddrinfo((host_size > 0) ? host : NULL, port + 1, &hints,
+                           &info);
+  delete[] host;
+  if ((status != 0) || (info == NULL)) {
+    fprintf(stderr, "Error: failed to resolve %s address %s.\n", use, addr);
+    return false;
+  }
+
+  memcpy(res, info->ai_addr, info->ai_addrlen);
+  *res_size = info->ai_addrlen;
+  freeaddrinfo(info);
+  return true;
+}
+
+/*
+ * Gets the path of the UNIX socket named by the given address. A socket
+ * left behind at the path by a previous run is removed, as it would
+ * otherwise stop the path from being bound again.
+ *
+ * Returns NULL if the address does not name a UNIX socket. Otherwise, the
+ * returned path must be deleted after use.
+ */
+char *ClaimUnixPath(const char *addr) {
+  size_t prefix_size = strlen(UNIX_ADDR_PREFIX);
+  if (strncmp(addr, UNIX_ADDR_PREFIX, prefix_size) != 0) { return NULL; }
+  const char *path = addr + prefix_size;
+  char *unix_path = new char[strlen(path) + 1];
+  strcpy(unix_path, path);
+  unlink(unix_path);
+  return unix_path;
+}
@@ -0,0 +1,24 @@
+#ifndef _NES_SOCKADDR
+#define _NES_SOCKADDR
+
+#include <cstdlib>
+
+#include <sys/socket.h>
+
+// The prefix of addresses which name a UNIX socket.
+#define UNIX_ADDR_PREFIX "unix:"
+
+// Resolves a "host:port" or "unix:<path>" address into a socket address for
+// sockets of the given type. Passive addresses are resolved to be bound,
+// rather than connected or sent to. The use names the socket in errors.
+// Returns false, after printing an error, if the address is invalid.
+bool ResolveSocketAddr(const char *addr, int sock_type, bool passive,
+                       const char *use, struct sockaddr_storage *res,
+                       socklen_t *res_size);
+
+// Gets the path of the UNIX socket named by the given address, after
+// removing any socket left at it, so that it can be bound again. Returns
+// NULL for other addresses. The path must be deleted after use.
+char *ClaimUnixPath(const char *addr);
+
+#endif
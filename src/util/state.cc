@@ -0,0 +1,128 @@
+/*
+ * Implements the byte buffers used to save and load the state of the
+ * emulation. The emulated chips decide what is written; these classes only
+ * manage the storage and check that reads stay within the state.
+ */
+
+#include "./state.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#include "./data.h"
+
+// The initial size of a state buffer. Large enough to hold the state of a
+// console with 8KB of CHR-RAM without growing.
+#define STATE_INITIAL_CAPACITY 0x8000U
+
+/*
+ * Allocates the initial buffer of the writer.
+ */
+StateWriter::StateWriter(void) {
+  capacity_ = STATE_INITIAL_CAPACITY;
+  data_ = new DataWord[capacity_];
+  return;
+}
+
+/*
+ * Uses the given buffer to hold the state, without taking ownership of it.
+ */
+StateWriter::StateWriter(DataWord *buffer, size_t capacity) {
+  data_ = buffer;
+  capacity_ = capacity;
+  owned_ = false;
+  return;
+}
+
+/*
+ * Appends the given bytes to the state, doubling the size of the buffer
+ * as needed.
+ */
+void StateWriter::Write(const void *data, size_t size) {
+  // Grow the buffer, if necessary.
+  if (size_ + size > capacity_) {
+    size_t capacity = (capacity_ > 0) ? capacity_ : STATE_INITIAL_CAPACITY;
+    while (size_ + size > capacity) { capacity *= 2; }
+    DataWord *grown = new DataWord[capacity];
+    memcpy(grown, data_, size_);
+    if (owned_) { delete[] data_; }
+    data_ = grown;
+    capacity_ = capacity;
+    owned_ = true;
+  }
+
+  memcpy(&(data_[size_]), data, size);
+  size_ += size;
+  return;
+}
+
+/*
+ * Empties the state, so that the writer can be reused without allocating.
+ */
+void StateWriter::Clear(void) {
+  size_ = 0;
+  return;
+}
+
+/*
+ * Gets the bytes written to the state so far.
+ */
+const DataWord *StateWriter::GetData(void) {
+  return data_;
+}
+
+/*
+ * Gets the number of bytes written to the state so far.
+ */
+size_t StateWriter::GetSize(void) {
+  return size_;
+}
+
+/*
+ * Frees the state buffer, if it belongs to the writer.
+ */
+StateWriter::~StateWriter(void) {
+  if (owned_) { delete[] data_; }
+  return;
+}
+
+/*
+ * Creates a reader for the given state.
+ */
+StateReader::StateReader(const void *data, size_t size) {
+  data_ = static_cast<const DataWord*>(data);
+  size_ = size;
+  return;
+}
+
+/*
+ * Copies the next bytes of the state into the given buffer. If the state
+ * is too short, the buffer is zeroed and the reader is marked as failed.
+ */
+bool StateReader::Read(void *data, size_t size) {
+  if (failed_ || (size > size_ - pos_)) {
+    memset(data, 0, size);
+    failed_ = true;
+    return false;
+  }
+
+  memcpy(data, &(data_[pos_]), size);
+  pos_ += size;
+  return true;
+}
+
+/*
+ * Checks if any read from the state has failed.
+ */
+bool StateReader::HasFailed(void) {
+  return failed_;
+}
+
+/*
+ * Checks if every byte of the state has been read, without failure.
+ */
+bool StateReader::IsDone(void) {
+  return !failed_ && (pos_ == size_);
+}
@@ -0,0 +1,92 @@
+#ifndef _NES_STATE
+#define _NES_STATE
+
+#include <cstdlib>
+#include <cstdint>
+#include <type_traits>
+
+#include "./data.h"
+
+/*
+ * Serializes the state of the emulation into a growing byte buffer. Each
+ * emulated chip writes its fields in a fixed order, which the reader must
+ * read back in the same order.
+ *
+ * States are only meant to be loaded by the same build of the emulator on
+ * the same host, so fields are written in host byte order.
+ */
+class StateWriter {
+  private:
+    // The bytes written so far, and the size of the allocation holding them.
+    // The allocation is borrowed from the creator of the writer until the
+    // writer outgrows it.
+    DataWord *data_;
+    size_t size_ = 0;
+    size_t capacity_;
+    bool owned_ = true;
+
+  public:
+    // Creates an empty writer.
+    StateWriter(void);
+
+    // Creates an empty writer which writes into the given buffer, which must
+    // outlive it. The writer only allocates if the buffer is outgrown.
+    StateWriter(DataWord *buffer, size_t capacity);
+
+    // Appends the given bytes to the state.
+    void Write(const void *data, size_t size);
+
+    // Appends a single plain value to the state.
+    template<typename T> void Put(const T &val) {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "State values must be trivially copyable");
+      Write(&val, sizeof(T));
+      return;
+    }
+
+    // Discards the bytes written so far, keeping the buffer for reuse.
+    void Clear(void);
+
+    // Gets the bytes written so far. Remains valid until the next write.
+    const DataWord *GetData(void);
+    size_t GetSize(void);
+
+    // Frees the state buffer, unless it was borrowed.
+    ~StateWriter(void);
+};
+
+/*
+ * Reads back a state created by a state writer. Reading past the end of the
+ * state marks the reader as failed, and produces zeros.
+ */
+class StateReader {
+  private:
+    // The state being read, and the position of the next read.
+    const DataWord *data_;
+    size_t size_;
+    size_t pos_ = 0;
+
+    // Set once a read has gone past the end of the state.
+    bool failed_ = false;
+
+  public:
+    // Reads from the given bytes, which must outlive the reader.
+    StateReader(const void *data, size_t size);
+
+    // Copies the next bytes of the state into the given buffer.
+    // Returns false if the state did not hold enough bytes.
+    bool Read(void *data, size_t size);
+
+    // Reads a single plain value from the state.
+    template<typename T> bool Get(T *val) {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "State values must be trivially copyable");
+      return Read(val, sizeof(T));
+    }
+
+    // Checks if a read has failed, or if the state was not read entirely.
+    bool HasFailed(void);
+    bool IsDone(void);
+};
+
+#endif
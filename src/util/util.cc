@@ -22,6 +22,7 @@
 #include <new>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 #include <ctime>
 #include <cstring>
 #include <cerrno>
@@ -45,29 +46,49 @@
 /* Helper function declarations */
 bool CreateFolder(const char *path);
 
+// The state of the generator used by RandNew(). Each thread has its own
+// generator, so that consoles created on different threads do not affect
+// each other. Zero until the generator has been seeded.
+static thread_local uint32_t rand_state = 0;
+
 /*
  * Allocates the requested number of words using new, then randomizes the
  * resulting array.
  */
 DataWord *RandNew(size_t size) {
-  // On the first call, rand is seeded with the current system time.
-  static bool seeded = false;
-  if (!seeded) {
-    srand(static_cast<unsigned int>(time(NULL)));
-    seeded = true;
-  }
-
-  // Allocate the requested data.
   DataWord *res = new DataWord[size];
+  RandFill(res, size);
+  return res;
+}
+
+/*
+ * Randomizes the contents of the given array.
+ */
+void RandFill(DataWord *data, size_t size) {
+  // On the first call, the generator is seeded with the current system time.
+  if (rand_state == 0) { RandSeed(static_cast<unsigned int>(time(NULL))); }
 
-  // Randomize the contents of the requested data.
+  // Randomize the contents of the requested data with a xorshift generator.
+  // The low bits of the generator are the least random, and so the high
+  // bits are used.
   for (size_t i = 0; i < size; i++) {
-    // On some platforms, the high bits of rand are more random than the low
-    // bits. As such, the higher bits are shifted down to increase randomness.
-    res[i] = static_cast<DataWord>(rand() >> 8);
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    data[i] = static_cast<DataWord>(rand_state >> 24);
   }
 
-  return res;
+  return;
+}
+
+/*
+ * Seeds the generator of the calling thread with the given value, preventing
+ * RandFill() from seeding it with the system time.
+ */
+void RandSeed(unsigned int seed) {
+  // The generator never leaves the zero state, so it is not a valid seed.
+  rand_state = (seed != 0) ? static_cast<uint32_t>(seed) : 1U;
+  return;
 }
 
 /*
@@ -23,6 +23,14 @@ const char kSlash = '/';
 // and must be free'd with delete.
 DataWord *RandNew(size_t size);
 
+// Fills the given array with the generator used by RandNew().
+void RandFill(DataWord *data, size_t size);
+
+// Seeds the generator used by RandNew() on the calling thread, so that the
+// data it returns is the same on every run. Must be called before the first
+// call to RandNew() on that thread.
+void RandSeed(unsigned int seed);
+
 // Returns the size of the given file.
 size_t GetFileSize(FILE *file);
 
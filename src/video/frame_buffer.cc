@@ -0,0 +1,140 @@
+/*
+ * The frame buffer is used to hand completed frames from the PPU emulation
+ * to the presenter, which converts and displays them on its own thread.
+ * This prevents display stalls, such as those caused by vsync or the window
+ * compositor, from delaying the emulation.
+ *
+ * Three frames are used. The PPU draws into the draw frame, the presenter
+ * reads from the present frame, and the ready frame holds the most recently
+ * completed frame. Completing a frame swaps the draw and ready frames, and
+ * taking a frame swaps the ready and present frames. Both swaps only exchange
+ * indices under a lock, so neither thread waits on the other's work.
+ *
+ * When the emulation completes a frame before the presenter has taken the
+ * previous one, the previous frame is replaced and counted as dropped. While
+ * frames are captured, dropping them would leave gaps in the recording, and
+ * so the buffer can be made to block the emulation until the presenter
+ * takes the frame instead.
+ */
+
+#include "./frame_buffer.h"
+
+#include <new>
+#include <cstdlib>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+/*
+ * Allocates the frames of the buffer. Frames start out black.
+ */
+FrameBuffer::FrameBuffer(void) {
+  frames_ = new NesFrame[kNumFrames_]();
+  return;
+}
+
+/*
+ * Gets the frame the emulation should draw its next picture to.
+ * This frame is only ever accessed by the emulation thread.
+ */
+NesFrame *FrameBuffer::GetDrawFrame(void) {
+  return &(frames_[draw_index_]);
+}
+
+/*
+ * Marks the current draw frame as completed, replacing the ready frame
+ * with it. If the ready frame was never taken by the presenter, it is
+ * counted as dropped, unless the buffer is blocking, in which case this
+ * waits for the presenter to take it.
+ *
+ * Returns the new draw frame.
+ */
+NesFrame *FrameBuffer::SwapDrawFrame(void) {
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    if (blocking_ && ready_fresh_) {
+      taken_signal_.wait(guard, [this] { return !ready_fresh_ || !blocking_; });
+    }
+
+    // Number the completed frame and exchange it with the ready frame.
+    frames_[draw_index_].number = ++frames_completed_;
+    if (ready_fresh_) { frames_dropped_++; }
+    size_t completed_index = draw_index_;
+    draw_index_ = ready_index_;
+    ready_index_ = completed_index;
+    ready_fresh_ = true;
+  }
+
+  // Wake the presenter, if it is waiting for a frame.
+  ready_signal_.notify_one();
+  return &(frames_[draw_index_]);
+}
+
+/*
+ * Waits for the emulation to complete a frame, then makes it the present
+ * frame. Returns immediately if a completed frame is already waiting.
+ *
+ * Returns the new present frame, or NULL if no frame was completed before
+ * the timeout expired.
+ */
+const NesFrame *FrameBuffer::SwapPresentFrame(size_t timeout_ms) {
+  std::unique_lock<std::mutex> guard(lock_);
+
+  // Wait for a new frame to become ready. A zero timeout only checks for
+  // one, as even a zero length wait can be a costly system call.
+  if (!ready_fresh_ && ((timeout_ms == 0)
+      || !ready_signal_.wait_for(guard, std::chrono::milliseconds(timeout_ms),
+                                 [this] { return ready_fresh_; }))) {
+    return NULL;
+  }
+
+  // Exchange the ready frame with the present frame.
+  size_t ready_index = ready_index_;
+  ready_index_ = present_index_;
+  present_index_ = ready_index;
+  ready_fresh_ = false;
+  guard.unlock();
+
+  // Wake the emulation, if it is waiting for the frame to be taken.
+  taken_signal_.notify_one();
+  return &(frames_[present_index_]);
+}
+
+/*
+ * Sets whether the emulation waits for the presenter to take each frame.
+ * Clearing it wakes the emulation, so that it can be stopped once the
+ * presenter no longer takes frames.
+ */
+void FrameBuffer::SetBlocking(bool blocking) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    blocking_ = blocking;
+  }
+  taken_signal_.notify_all();
+  return;
+}
+
+/*
+ * Gets the frame most recently taken by the presenter.
+ * This frame is only ever accessed by the presenter thread.
+ */
+const NesFrame *FrameBuffer::GetPresentFrame(void) {
+  return &(frames_[present_index_]);
+}
+
+/*
+ * Gets the number of completed frames which were replaced before the
+ * presenter took them.
+ */
+size_t FrameBuffer::GetDroppedFrames(void) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return frames_dropped_;
+}
+
+/*
+ * Frees the frames of the buffer.
+ */
+FrameBuffer::~FrameBuffer(void) {
+  delete[] frames_;
+  return;
+}
@@ -0,0 +1,112 @@
+#ifndef _NES_FRAMEBUF
+#define _NES_FRAMEBUF
+
+#include <cstdlib>
+#include <mutex>
+#include <condition_variable>
+
+#include "../util/data.h"
+
+// The dimensions of the picture produced by the NES PPU.
+#define NES_WIDTH 256
+#define NES_HEIGHT 240
+
+/*
+ * Holds a single frame produced by the PPU. Pixels are stored as NES colors,
+ * and are converted to the pixel format of the emulator only when the frame
+ * is presented.
+ */
+struct NesFrame {
+  // The NES color of each pixel in the frame, stored one row after another.
+  DataWord pixels[NES_WIDTH * NES_HEIGHT];
+
+  // The value of PPUMASK when each row was drawn. Selects the emphasis and
+  // greyscale settings used to convert the row.
+  DataWord masks[NES_HEIGHT];
+
+  // The number of frames completed by the PPU, including this one.
+  // Zero if the frame has never been drawn.
+  size_t number;
+};
+
+/*
+ * Receives each frame completed by the PPU, before it is passed to the
+ * presenter. Used to log or check the output of the emulation.
+ */
+class FrameRecorder {
+  public:
+    // Records the given frame, which has just been completed.
+    virtual void Record(const NesFrame *frame) = 0;
+
+    virtual ~FrameRecorder(void) { return; }
+};
+
+/*
+ * Passes completed frames from the emulation to a presenter running on
+ * another thread, using three frames so that neither side waits on the other.
+ * While frames are captured, the emulation can be made to wait for the
+ * presenter instead, so that no frame is dropped.
+ *
+ * The emulation always owns the draw frame, and the presenter always owns
+ * the present frame. Completed frames are exchanged through the ready frame.
+ */
+class FrameBuffer {
+  private:
+    // The number of frames cycled through by the buffer.
+    static const size_t kNumFrames_ = 3;
+
+    // The frames managed by this buffer, and the roles they currently hold.
+    NesFrame *frames_;
+    size_t draw_index_ = 0;
+    size_t ready_index_ = 1;
+    size_t present_index_ = 2;
+
+    // Set when the ready frame holds a frame the presenter has not taken.
+    bool ready_fresh_ = false;
+
+    // Set while completing a frame waits for the presenter to take the
+    // ready frame, rather than replacing it.
+    bool blocking_ = false;
+
+    // The number of frames completed, and the number of completed frames
+    // which were replaced before they could be presented.
+    size_t frames_completed_ = 0;
+    size_t frames_dropped_ = 0;
+
+    // Guards the exchange of the ready frame between threads.
+    std::mutex lock_;
+    std::condition_variable ready_signal_;
+    std::condition_variable taken_signal_;
+
+  public:
+    // Allocates the frames of the buffer.
+    FrameBuffer(void);
+
+    // Gets the frame the emulation should draw the next picture to.
+    NesFrame *GetDrawFrame(void);
+
+    // Marks the draw frame as complete, making it available to the presenter.
+    // Only blocks on the presenter while the buffer is blocking. Returns the
+    // new draw frame.
+    NesFrame *SwapDrawFrame(void);
+
+    // Sets whether completing a frame waits for the presenter to take the
+    // last one, so that no frame is dropped. Clearing it releases an
+    // emulation which is waiting.
+    void SetBlocking(bool blocking);
+
+    // Waits up to the given number of milliseconds for a completed frame,
+    // and returns it. Returns NULL if no new frame was completed in time.
+    const NesFrame *SwapPresentFrame(size_t timeout_ms);
+
+    // Gets the frame most recently taken by the presenter.
+    const NesFrame *GetPresentFrame(void);
+
+    // Gets the number of completed frames which were never presented.
+    size_t GetDroppedFrames(void);
+
+    // Frees the frames of the buffer.
+    ~FrameBuffer(void);
+};
+
+#endif
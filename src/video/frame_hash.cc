@@ -0,0 +1,150 @@
+/*
+ * Provides a cheap fingerprint of the frames produced by the PPU, which is
+ * used to check that changes to the emulation do not change its output.
+ *
+ * Frames are hashed with xxHash64. The bulk of the input is consumed as four
+ * independent 64-bit lanes, which the compiler can keep in registers and
+ * vectorize, so an entire frame can be hashed in a few microseconds. Frames
+ * are hashed as NES colors rather than converted pixels, so the hash does
+ * not depend on the palette or renderer in use.
+ */
+
+#include "./frame_hash.h"
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "./frame_buffer.h"
+
+// The primes used by xxHash64.
+#define PRIME_1 0x9E3779B185EBCA87ULL
+#define PRIME_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME_3 0x165667B19E3779F9ULL
+#define PRIME_4 0x85EBCA77C2B2AE63ULL
+#define PRIME_5 0x27D4EB2F165667C5ULL
+
+// The number of bytes consumed by each step of the main hashing loop.
+#define STRIPE_SIZE 32U
+
+/* Helper function declarations */
+static uint64_t Rotate(uint64_t val, int bits);
+static uint64_t Read64(const uint8_t *data);
+static uint32_t Read32(const uint8_t *data);
+static uint64_t Round(uint64_t acc, uint64_t input);
+static uint64_t MergeRound(uint64_t acc, uint64_t val);
+
+/*
+ * Hashes the given bytes using the 64-bit xxHash algorithm. The result
+ * matches the reference implementation for the same data and seed.
+ */
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  const uint8_t *end = bytes + size;
+  uint64_t hash;
+
+  if (size >= STRIPE_SIZE) {
+    // Consume the input as four independent lanes.
+    uint64_t lane1 = seed + PRIME_1 + PRIME_2;
+    uint64_t lane2 = seed + PRIME_2;
+    uint64_t lane3 = seed;
+    uint64_t lane4 = seed - PRIME_1;
+    const uint8_t *limit = end - STRIPE_SIZE;
+    do {
+      lane1 = Round(lane1, Read64(bytes));
+      lane2 = Round(lane2, Read64(bytes + 8));
+      lane3 = Round(lane3, Read64(bytes + 16));
+      lane4 = Round(lane4, Read64(bytes + 24));
+      bytes += STRIPE_SIZE;
+    } while (bytes <= limit);
+
+    // Combine the lanes.
+    hash = Rotate(lane1, 1) + Rotate(lane2, 7)
+         + Rotate(lane3, 12) + Rotate(lane4, 18);
+    hash = MergeRound(hash, lane1);
+    hash = MergeRound(hash, lane2);
+    hash = MergeRound(hash, lane3);
+    hash = MergeRound(hash, lane4);
+  } else {
+    hash = seed + PRIME_5;
+  }
+  hash += static_cast<uint64_t>(size);
+
+  // Consume the remaining bytes.
+  while ((bytes + 8) <= end) {
+    hash ^= Round(0, Read64(bytes));
+    hash = Rotate(hash, 27) * PRIME_1 + PRIME_4;
+    bytes += 8;
+  }
+  if ((bytes + 4) <= end) {
+    hash ^= static_cast<uint64_t>(Read32(bytes)) * PRIME_1;
+    hash = Rotate(hash, 23) * PRIME_2 + PRIME_3;
+    bytes += 4;
+  }
+  while (bytes < end) {
+    hash ^= (*bytes) * PRIME_5;
+    hash = Rotate(hash, 11) * PRIME_1;
+    bytes++;
+  }
+
+  // Mix the final bits of the hash.
+  hash ^= hash >> 33;
+  hash *= PRIME_2;
+  hash ^= hash >> 29;
+  hash *= PRIME_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+/*
+ * Hashes the pixels of the given frame, then the masks each row was drawn
+ * with. The frame number is not included, so identical pictures drawn on
+ * different frames hash to the same value.
+ */
+uint64_t HashFrame(const NesFrame *frame) {
+  uint64_t hash = HashBytes(frame->pixels, sizeof(frame->pixels));
+  return HashBytes(frame->masks, sizeof(frame->masks), hash);
+}
+
+/*
+ * Rotates the given value left by the given number of bits.
+ */
+static uint64_t Rotate(uint64_t val, int bits) {
+  return (val << bits) | (val >> (64 - bits));
+}
+
+/*
+ * Reads a little endian 64-bit word from the given bytes, which need not
+ * be aligned.
+ */
+static uint64_t Read64(const uint8_t *data) {
+  uint64_t val = 0;
+  for (int i = 7; i >= 0; i--) { val = (val << 8) | data[i]; }
+  return val;
+}
+
+/*
+ * Reads a little endian 32-bit word from the given bytes, which need not
+ * be aligned.
+ */
+static uint32_t Read32(const uint8_t *data) {
+  uint32_t val = 0;
+  for (int i = 3; i >= 0; i--) { val = (val << 8) | data[i]; }
+  return val;
+}
+
+/*
+ * Mixes the next eight bytes of input into one lane of the hash.
+ */
+static uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME_2;
+  acc = Rotate(acc, 31);
+  return acc * PRIME_1;
+}
+
+/*
+ * Mixes a finished lane into the combined hash.
+ */
+static uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= Round(0, val);
+  return acc * PRIME_1 + PRIME_4;
+}
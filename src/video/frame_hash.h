@@ -0,0 +1,16 @@
+#ifndef _NES_FRAMEHASH
+#define _NES_FRAMEHASH
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "./frame_buffer.h"
+
+// Hashes the given bytes with the 64-bit xxHash algorithm.
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// Fingerprints the pixels and row masks of the given frame. Frames which
+// would be presented identically produce the same hash.
+uint64_t HashFrame(const NesFrame *frame);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * The frame writer encodes frames of RGB pixels into one of several simple
+ * formats, allowing the emulation to be recorded without a display.
+ *
+ * Image formats (PPM and PNG) write each frame to its own numbered file.
+ * Stream formats (raw RGB24 and Y4M) write every frame to a single file or
+ * pipe, which is intended to be consumed by an external video encoder.
+ *
+ * PNG files are written with uncompressed deflate blocks, which keeps the
+ * writer free of any compression library while still producing valid files.
+ */
+
+#include "./frame_writer.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "../config/config.h"
+#include "../memory/palette.h"
+#include "../util/util.h"
+#include "../util/contracts.h"
+
+// The frame rate of the NTSC NES, as a fraction, which Y4M streams are
+// given unless another rate is set.
+#define Y4M_RATE_NUM 39375000U
+#define Y4M_RATE_DEN 655171U
+
+// The display aspect ratio of the picture, for Y4M streams. This gives
+// pixels an aspect ratio of 8:7 when the frame is 256x224.
+#define Y4M_ASPECT_NUM 64U
+#define Y4M_ASPECT_DEN 49U
+
+// The largest header any format places before its pixels.
+#define MAX_HEADER_SIZE 64U
+
+// The largest file name an image can be written to.
+#define MAX_FILE_NAME_SIZE 4096U
+
+// PNG and zlib format constants.
+#define PNG_SIGNATURE_SIZE 8U
+#define PNG_CHUNK_OVERHEAD 12U
+#define PNG_IHDR_SIZE 13U
+#define ZLIB_HEADER_SIZE 2U
+#define ZLIB_ADLER_SIZE 4U
+#define DEFLATE_BLOCK_MAX 65535U
+#define DEFLATE_BLOCK_HEADER_SIZE 5U
+#define ADLER_MOD 65521U
+
+// Holds the CRC32 of each byte value, used when writing PNG chunks.
+static uint32_t crc_table[256];
+
+/*
+ * Fills in the CRC32 table, if it has not been filled in already.
+ */
+static void InitCrcTable(void) {
+  if (crc_table[1] != 0) { return; }
+  for (uint32_t i = 0; i < 256U; i++) {
+    uint32_t crc = i;
+    for (size_t j = 0; j < 8U; j++) {
+      crc = (crc & 1U) ? (0xEDB88320U ^ (crc >> 1)) : (crc >> 1);
+    }
+    crc_table[i] = crc;
+  }
+  return;
+}
+
+/*
+ * Stores the given value in the buffer as a 32-bit big-endian number.
+ */
+static void StoreBe32(uint8_t *buf, uint32_t val) {
+  buf[0] = static_cast<uint8_t>(val >> 24);
+  buf[1] = static_cast<uint8_t>(val >> 16);
+  buf[2] = static_cast<uint8_t>(val >> 8);
+  buf[3] = static_cast<uint8_t>(val);
+  return;
+}
+
+/*
+ * Attempts to create a frame writer for the named format.
+ *
+ * Returns NULL if the format is unknown, or if the output stream could not
+ * be opened.
+ */
+FrameWriter *FrameWriter::Create(const char *format, const char *path,
+                                 size_t width, size_t height) {
+  // Determine the format of the writer.
+  CaptureFormat capture_format;
+  if (StrEq(format, kCapturePpmVal)) {
+    capture_format = CAPTURE_PPM;
+  } else if (StrEq(format, kCapturePngVal)) {
+    capture_format = CAPTURE_PNG;
+  } else if (StrEq(format, kCaptureRawVal)) {
+    capture_format = CAPTURE_RAW;
+  } else if (StrEq(format, kCaptureY4mVal)) {
+    capture_format = CAPTURE_Y4M;
+  } else {
+    fprintf(stderr, "Error: Unknown capture format %s\n", format);
+    return NULL;
+  }
+
+  // Image formats only need a file prefix.
+  if ((capture_format == CAPTURE_PPM) || (capture_format == CAPTURE_PNG)) {
+    if (path == NULL) { path = "frame_"; }
+    return new FrameWriter(capture_format, width, height, path, NULL);
+  }
+
+  // Stream formats write all of their frames to a single stream.
+  FILE *stream;
+  if (WritesToStdout(format, path)) {
+    stream = stdout;
+  } else {
+    stream = fopen(path, "wb");
+    if (stream == NULL) {
+      fprintf(stderr, "Error: Failed to open capture stream %s\n", path);
+      return NULL;
+    }
+  }
+
+  return new FrameWriter(capture_format, width, height, NULL, stream);
+}
+
+/*
+ * Checks if a writer for the given format and path writes its frames to
+ * stdout, which stream formats do when no path, or "-", is given.
+ */
+bool FrameWriter::WritesToStdout(const char *format, const char *path) {
+  bool stream = StrEq(format, kCaptureRawVal) || StrEq(format, kCaptureY4mVal);
+  return stream && ((path == NULL) || StrEq(path, "-"));
+}
+
+/*
+ * Creates a frame writer with an encoding buffer large enough for a
+ * single frame of the given format.
+ */
+FrameWriter::FrameWriter(CaptureFormat format, size_t width, size_t height,
+                         const char *prefix, FILE *stream) {
+  format_ = format;
+  width_ = width;
+  height_ = height;
+  prefix_ = (prefix != NULL) ? StrCpy(prefix) : NULL;
+  stream_ = stream;
+  rate_num_ = Y4M_RATE_NUM;
+  rate_den_ = Y4M_RATE_DEN;
+
+  // PNG files hold a filter byte at the start of each row, and are split
+  // into deflate blocks. The other formats hold only a header and pixels.
+  buffer_size_ = MAX_HEADER_SIZE + width * height * 3U;
+  if (format == CAPTURE_PNG) {
+    InitCrcTable();
+    size_t raw_size = height * (width * 3U + 1U);
+    size_t num_blocks = (raw_size + DEFLATE_BLOCK_MAX - 1U) / DEFLATE_BLOCK_MAX;
+    buffer_size_ = PNG_SIGNATURE_SIZE + 3U * PNG_CHUNK_OVERHEAD
+                 + PNG_IHDR_SIZE + ZLIB_HEADER_SIZE + ZLIB_ADLER_SIZE
+                 + num_blocks * DEFLATE_BLOCK_HEADER_SIZE + 2U * raw_size;
+  }
+  buffer_ = new uint8_t[buffer_size_];
+
+  return;
+}
+
+/*
+ * Sets the frame rate given to Y4M streams, as a fraction. The rate is
+ * written with the first frame, and so cannot change after it.
+ */
+void FrameWriter::SetFrameRate(uint32_t num, uint32_t den) {
+  rate_num_ = num;
+  rate_den_ = den;
+  return;
+}
+
+/*
+ * Encodes and writes out the given frame.
+ *
+ * Returns false if the frame could not be written.
+ */
+bool FrameWriter::Write(const Pixel *pixels) {
+  // Y4M streams begin with a header describing every frame, which is
+  // written with the first frame so that the frame rate can be set after
+  // the writer is created. The picture is always shown at the aspect ratio
+  // of a tv, so the aspect ratio of the pixels depends on the size of the
+  // frame.
+  if ((format_ == CAPTURE_Y4M) && (frames_written_ == 0)
+      && (fprintf(stream_, "YUV4MPEG2 W%zu H%zu F%u:%u Ip A%zu:%zu C444\n",
+                  width_, height_, rate_num_, rate_den_,
+                  Y4M_ASPECT_NUM * height_, Y4M_ASPECT_DEN * width_) < 0)) {
+    return false;
+  }
+
+  // Encode the frame.
+  size_t size = 0;
+  switch (format_) {
+    case CAPTURE_PPM:
+      size = EncodePpm(pixels);
+      break;
+    case CAPTURE_PNG:
+      size = EncodePng(pixels);
+      break;
+    case CAPTURE_RAW:
+      size = EncodeRaw(pixels);
+      break;
+    case CAPTURE_Y4M:
+      size = EncodeY4m(pixels);
+      break;
+  }
+  CONTRACT(size <= buffer_size_);
+
+  // Streams have every frame written to them in order.
+  frames_written_++;
+  if (stream_ != NULL) {
+    return (fwrite(buffer_, 1, size, stream_) == size)
+        && (fflush(stream_) == 0);
+  }
+
+  // Images are written to their own file.
+  char name[MAX_FILE_NAME_SIZE];
+  const char *ext = (format_ == CAPTURE_PNG) ? "png" : "ppm";
+  snprintf(name, MAX_FILE_NAME_SIZE, "%s%06zu.%s",
+           prefix_, frames_written_, ext);
+  FILE *image = fopen(name, "wb");
+  if (image == NULL) { return false; }
+  bool written = (fwrite(buffer_, 1, size, image) == size);
+  return (fclose(image) == 0) && written;
+}
+
+/*
+ * Encodes the given frame as a binary PPM image.
+ */
+size_t FrameWriter::EncodePpm(const Pixel *pixels) {
+  int header = snprintf(reinterpret_cast<char*>(buffer_), MAX_HEADER_SIZE,
+                        "P6\n%zu %zu\n255\n", width_, height_);
+  size_t size = static_cast<size_t>(header);
+  StoreRgb(pixels, width_ * height_, &(buffer_[size]));
+  return size + width_ * height_ * 3U;
+}
+
+/*
+ * Encodes the given frame as packed RGB24 pixels.
+ */
+size_t FrameWriter::EncodeRaw(const Pixel *pixels) {
+  StoreRgb(pixels, width_ * height_, buffer_);
+  return width_ * height_ * 3U;
+}
+
+/*
+ * Encodes the given frame as a Y4M frame, using 4:4:4 BT.601 YCbCr with
+ * the standard studio range.
+ */
+size_t FrameWriter::EncodeY4m(const Pixel *pixels) {
+  const char *header = "FRAME\n";
+  size_t header_size = strlen(header);
+  memcpy(buffer_, header, header_size);
+
+  // Each plane is stored in full, one after another.
+  size_t num_pixels = width_ * height_;
+  uint8_t *y_plane = &(buffer_[header_size]);
+  uint8_t *u_plane = &(y_plane[num_pixels]);
+  uint8_t *v_plane = &(u_plane[num_pixels]);
+  for (size_t i = 0; i < num_pixels; i++) {
+    int r = static_cast<int>((pixels[i] & PALETTE_RMASK) >> 16);
+    int g = static_cast<int>((pixels[i] & PALETTE_GMASK) >> 8);
+    int b = static_cast<int>(pixels[i] & PALETTE_BMASK);
+    y_plane[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8)
+                                      + 16);
+    u_plane[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8)
+                                      + 128);
+    v_plane[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8)
+                                      + 128);
+  }
+
+  return header_size + num_pixels * 3U;
+}
+
+/*
+ * Encodes the given frame as a PNG image, using uncompressed deflate blocks.
+ *
+ * The filtered rows of the image are built at the end of the buffer, and are
+ * then split into blocks at the start of the buffer. The buffer is sized so
+ * that the two never overlap.
+ */
+size_t FrameWriter::EncodePng(const Pixel *pixels) {
+  // Build the rows of the image, each of which starts with a filter byte.
+  size_t row_size = width_ * 3U + 1U;
+  size_t raw_size = height_ * row_size;
+  uint8_t *raw = &(buffer_[buffer_size_ - raw_size]);
+  for (size_t row = 0; row < height_; row++) {
+    raw[row * row_size] = 0;
+    StoreRgb(&(pixels[row * width_]), width_, &(raw[row * row_size + 1U]));
+  }
+
+  // Add the PNG signature and header.
+  const uint8_t signature[PNG_SIGNATURE_SIZE] = { 0x89, 'P', 'N', 'G',
+                                                  '\r', '\n', 0x1A, '\n' };
+  memcpy(buffer_, signature, PNG_SIGNATURE_SIZE);
+  uint8_t *ihdr = &(buffer_[PNG_SIGNATURE_SIZE + 8U]);
+  StoreBe32(&(ihdr[0]), static_cast<uint32_t>(width_));
+  StoreBe32(&(ihdr[4]), static_cast<uint32_t>(height_));
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  size_t offset = AddPngChunk(PNG_SIGNATURE_SIZE, "IHDR", PNG_IHDR_SIZE);
+
+  // Split the rows into a zlib stream of stored deflate blocks, while
+  // computing its checksum.
+  uint8_t *zlib = &(buffer_[offset + 8U]);
+  size_t zlib_size = 0;
+  zlib[zlib_size++] = 0x78;
+  zlib[zlib_size++] = 0x01;
+  uint32_t adler_a = 1;
+  uint32_t adler_b = 0;
+  for (size_t done = 0; done < raw_size;) {
+    size_t block_size = MIN(raw_size - done, DEFLATE_BLOCK_MAX);
+    zlib[zlib_size++] = (done + block_size == raw_size) ? 1 : 0;
+    zlib[zlib_size++] = static_cast<uint8_t>(block_size);
+    zlib[zlib_size++] = static_cast<uint8_t>(block_size >> 8);
+    zlib[zlib_size++] = static_cast<uint8_t>(~block_size);
+    zlib[zlib_size++] = static_cast<uint8_t>((~block_size) >> 8);
+    memcpy(&(zlib[zlib_size]), &(raw[done]), block_size);
+    for (size_t i = 0; i < block_size; i++) {
+      adler_a = (adler_a + raw[done + i]) % ADLER_MOD;
+      adler_b = (adler_b + adler_a) % ADLER_MOD;
+    }
+    zlib_size += block_size;
+    done += block_size;
+  }
+  StoreBe32(&(zlib[zlib_size]), (adler_b << 16) | adler_a);
+  zlib_size += ZLIB_ADLER_SIZE;
+  offset = AddPngChunk(offset, "IDAT", zlib_size);
+
+  // End the image.
+  return AddPngChunk(offset, "IEND", 0);
+}
+
+/*
+ * Completes a PNG chunk whose data has already been placed in the buffer,
+ * eight bytes after the given offset. Adds the size, type, and CRC of the
+ * chunk.
+ *
+ * Returns the offset following the chunk.
+ */
+size_t FrameWriter::AddPngChunk(size_t offset, const char *type, size_t size) {
+  uint8_t *chunk = &(buffer_[offset]);
+  StoreBe32(chunk, static_cast<uint32_t>(size));
+  memcpy(&(chunk[4]), type, 4U);
+
+  // The CRC covers the type and data of the chunk.
+  uint32_t crc = 0xFFFFFFFFU;
+  for (size_t i = 4U; i < size + 8U; i++) {
+    crc = crc_table[(crc ^ chunk[i]) & 0xFFU] ^ (crc >> 8);
+  }
+  StoreBe32(&(chunk[size + 8U]), crc ^ 0xFFFFFFFFU);
+
+  return offset + size + PNG_CHUNK_OVERHEAD;
+}
+
+/*
+ * Stores the given pixels in the buffer as packed RGB24.
+ */
+void FrameWriter::StoreRgb(const Pixel *pixels, size_t num, uint8_t *out) {
+  for (size_t i = 0; i < num; i++) {
+    out[3U * i] = static_cast<uint8_t>((pixels[i] & PALETTE_RMASK) >> 16);
+    out[3U * i + 1U] = static_cast<uint8_t>((pixels[i] & PALETTE_GMASK) >> 8);
+    out[3U * i + 2U] = static_cast<uint8_t>(pixels[i] & PALETTE_BMASK);
+  }
+  return;
+}
+
+/*
+ * Closes the stream of the writer, and frees its buffers.
+ */
+FrameWriter::~FrameWriter(void) {
+  if ((stream_ != NULL) && (stream_ != stdout)) { fclose(stream_); }
+  if (prefix_ != NULL) { delete[] prefix_; }
+  delete[] buffer_;
+  return;
+}
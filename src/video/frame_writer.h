@@ -0,0 +1,82 @@
+#ifndef _NES_FRAMEWRITER
+#define _NES_FRAMEWRITER
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include "../memory/palette.h"
+
+// The formats frames can be written in.
+typedef enum {CAPTURE_PPM, CAPTURE_PNG, CAPTURE_RAW, CAPTURE_Y4M} CaptureFormat;
+
+/*
+ * Encodes frames of RGB pixels and writes them out, either as one numbered
+ * image file per frame or as a single video stream to a file or pipe.
+ *
+ * Does not depend on SDL, and so can be used without a display.
+ */
+class FrameWriter {
+  private:
+    // The format frames are written in.
+    CaptureFormat format_;
+
+    // The dimensions of each frame.
+    size_t width_;
+    size_t height_;
+
+    // Image formats write each frame to a file starting with this prefix.
+    // Stream formats write every frame to the stream.
+    char *prefix_;
+    FILE *stream_;
+
+    // Holds each frame as it is encoded.
+    uint8_t *buffer_;
+    size_t buffer_size_;
+
+    // The number of frames written so far.
+    size_t frames_written_ = 0;
+
+    // The frame rate given to Y4M streams, as a fraction. Streams are given
+    // the rate of an NTSC console until told otherwise.
+    uint32_t rate_num_;
+    uint32_t rate_den_;
+
+    FrameWriter(CaptureFormat format, size_t width, size_t height,
+                const char *prefix, FILE *stream);
+
+    // Encode the given frame into the buffer, returning the encoded size.
+    size_t EncodePpm(const Pixel *pixels);
+    size_t EncodePng(const Pixel *pixels);
+    size_t EncodeRaw(const Pixel *pixels);
+    size_t EncodeY4m(const Pixel *pixels);
+
+    // Completes a PNG chunk whose data has already been placed in the buffer.
+    size_t AddPngChunk(size_t offset, const char *type, size_t size);
+
+    // Stores pixels as packed RGB24.
+    void StoreRgb(const Pixel *pixels, size_t num, uint8_t *out);
+
+  public:
+    // Creates a writer for the given format name. Image formats use the path
+    // as a file name prefix, and stream formats write to the path, or to
+    // stdout if the path is "-". Returns NULL on failure.
+    static FrameWriter *Create(const char *format, const char *path,
+                               size_t width, size_t height);
+
+    // Checks if a writer for the given format and path writes to stdout.
+    static bool WritesToStdout(const char *format, const char *path);
+
+    // Sets the frame rate of the stream, as a fraction. Must be called
+    // before the first frame is written to have any effect.
+    void SetFrameRate(uint32_t num, uint32_t den);
+
+    // Encodes and writes the given frame, whose rows are tightly packed.
+    // Returns false if the frame could not be written.
+    bool Write(const Pixel *pixels);
+
+    // Closes the stream of the writer, if it has one.
+    ~FrameWriter(void);
+};
+
+#endif
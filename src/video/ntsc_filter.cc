@@ -0,0 +1,267 @@
+/*
+ * The NTSC filter converts the NES colors in each frame into the composite
+ * signal the PPU would generate, then decodes that signal into RGB pixels.
+ *
+ * The PPU outputs a square wave for each pixel, which is sampled eight times
+ * per pixel here. The high and low levels of the wave are set by the
+ * brightness of the color, and its phase by the hue. Emphasis attenuates
+ * the signal during part of each carrier cycle. The signal levels for every
+ * color and phase are computed once, when the filter is created.
+ *
+ * The decoder averages the signal over one carrier cycle to find the luma,
+ * and averages the signal multiplied by the carrier to find the chroma.
+ * Running sums are built for each row, so each output pixel only takes a
+ * few subtractions regardless of the width of the window. Rows are split
+ * into bands, which are filtered on a pool of worker threads.
+ *
+ * Each row is filtered in passes which the compiler can vectorize. The
+ * level and carrier tables are repeated past a carrier cycle, so no pass
+ * wraps the phase, and the samples are written to flat arrays before the
+ * running sums are taken over them. Only the sums themselves are serial.
+ * The pixels at the edges of a row, whose windows are cut short, are
+ * decoded apart from the rest, so that the others share a fixed window.
+ *
+ * The signal levels are those measured from real hardware, as documented
+ * on the NESdev wiki.
+ */
+
+#include "./ntsc_filter.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "../memory/palette.h"
+#include "../util/util.h"
+#include "../util/contracts.h"
+#include "./frame_buffer.h"
+#include "./worker_pool.h"
+
+// PPU mask flags used in the conversion of colors.
+#define FLAG_GRAYSCALE 0x01U
+#define FLAG_COLOR_TINT 0xE0U
+#define GRAYSCALE_MASK 0x30U
+
+// The emphasis bits are moved above the 6-bit color when indexing
+// the signal levels.
+#define EMPHASIS_SHIFT 1U
+
+// Signal levels of the PPU, in volts, for each brightness of color.
+#define NUM_LEVELS 4U
+static const float kLowLevels[NUM_LEVELS] = { 0.350f, 0.518f, 0.962f, 1.550f };
+static const float kHighLevels[NUM_LEVELS] = { 1.094f, 1.506f, 1.962f, 1.962f };
+#define BLACK_LEVEL 0.518f
+#define WHITE_LEVEL 1.962f
+#define EMPHASIS_ATTENUATION 0.746f
+
+// The phase offset, in samples, of the carrier used for decoding.
+#define HUE_OFFSET 3.9
+
+// The number of samples the signal is averaged over to decode each pixel.
+#define DECODE_WINDOW NTSC_PHASES
+
+// The carrier phase advances by this much from one scanline to the next,
+// and from one frame to the next.
+#define ROW_PHASE_STEP 4U
+#define FRAME_PHASE_STEP 8U
+
+// The size of each set of running sums.
+#define SUM_SIZE (NTSC_ROW_SAMPLES + 1U)
+
+// The number of signal samples for each output pixel.
+#define SAMPLES_PER_OUT (NTSC_SAMPLES_PER_PIXEL / NTSC_SCALE)
+
+// The output pixels whose window lies entirely within the row, from the
+// first to one past the last.
+#define FIRST_FULL_OUT ((DECODE_WINDOW / 2U + SAMPLES_PER_OUT - 1U\
+                       - SAMPLES_PER_OUT / 2U) / SAMPLES_PER_OUT)
+#define END_FULL_OUT ((NTSC_ROW_SAMPLES - DECODE_WINDOW / 2U\
+                     - SAMPLES_PER_OUT / 2U) / SAMPLES_PER_OUT + 1U)
+
+/*
+ * Checks if the given hue is in phase with the carrier, and so produces
+ * the high level of its wave.
+ */
+static bool InColorPhase(size_t hue, size_t phase) {
+  return ((hue + phase) % NTSC_PHASES) < (NTSC_PHASES / 2U);
+}
+
+/*
+ * Converts a decoded YIQ color to an RGB pixel, clamping each channel to
+ * range.
+ */
+static Pixel ToPixel(float y, float i, float q) {
+  float r = (y + 0.946882f * i + 0.623557f * q) * 255.0f;
+  float g = (y - 0.274788f * i - 0.635691f * q) * 255.0f;
+  float b = (y - 1.108545f * i + 1.709007f * q) * 255.0f;
+  r = MIN(MAX(r, 0.0f), 255.0f);
+  g = MIN(MAX(g, 0.0f), 255.0f);
+  b = MIN(MAX(b, 0.0f), 255.0f);
+  return (static_cast<Pixel>(static_cast<int32_t>(r)) << 16)
+       | (static_cast<Pixel>(static_cast<int32_t>(g)) << 8)
+       | static_cast<Pixel>(static_cast<int32_t>(b));
+}
+
+/*
+ * Builds the signal level and carrier tables, and the running sums used by
+ * each of the given workers.
+ */
+NtscFilter::NtscFilter(WorkerPool *workers) {
+  for (size_t color = 0; color < NTSC_NUM_COLORS; color++) {
+    // Colors $xE and $xF are always black. Color $x0 is a flat wave at the
+    // high level, and colors $xD and above a flat wave at the low level.
+    size_t hue = color & 0x0FU;
+    size_t level = (hue > 0x0DU) ? 1U : ((color >> 4) & 0x03U);
+    float low = (hue == 0) ? kHighLevels[level] : kLowLevels[level];
+    float high = (hue > 0x0CU) ? kLowLevels[level] : kHighLevels[level];
+
+    // Emphasis attenuates the signal while the carrier is in the phase of
+    // red, green, or blue.
+    size_t emphasis = color >> 6;
+    for (size_t phase = 0; phase < NTSC_LEVEL_SPAN; phase++) {
+      float signal = InColorPhase(hue, phase) ? high : low;
+      if (((emphasis & 0x01U) && InColorPhase(0x00U, phase))
+          || ((emphasis & 0x02U) && InColorPhase(0x04U, phase))
+          || ((emphasis & 0x04U) && InColorPhase(0x08U, phase))) {
+        signal *= EMPHASIS_ATTENUATION;
+      }
+      signal_levels_[color][phase] = (signal - BLACK_LEVEL)
+                                   / (WHITE_LEVEL - BLACK_LEVEL);
+    }
+  }
+
+  // Build the carrier used to decode the chroma of the signal. The carrier
+  // is offset to match the hue of a television with default settings.
+  for (size_t phase = 0; phase < NTSC_CARRIER_SPAN; phase++) {
+    double carrier_phase = static_cast<double>(phase % NTSC_PHASES)
+                         + HUE_OFFSET;
+    float angle = static_cast<float>(M_PI * carrier_phase
+                / (static_cast<double>(NTSC_PHASES) / 2.0));
+    carrier_i_[phase] = cosf(angle);
+    carrier_q_[phase] = sinf(angle);
+  }
+
+  // Each band filters its rows with its own running sums.
+  workers_ = workers;
+  sums_ = new float[workers_->GetNumBands() * 3U * SUM_SIZE];
+
+  return;
+}
+
+/*
+ * Filters the given rows of the frame, splitting them across the workers.
+ *
+ * Assumes the rows are within the frame.
+ * Assumes the pitch is at least NTSC_WIDTH.
+ */
+void NtscFilter::Filter(const NesFrame *frame, size_t first_row,
+                        size_t num_rows, Pixel *pixels, size_t pitch) {
+  CONTRACT(first_row + num_rows <= static_cast<size_t>(NES_HEIGHT));
+  CONTRACT(pitch >= NTSC_WIDTH);
+
+  size_t num_bands = workers_->GetNumBands();
+  workers_->Run([=](size_t band) {
+    size_t start = first_row + (band * num_rows) / num_bands;
+    size_t end = first_row + ((band + 1U) * num_rows) / num_bands;
+    float *sums = &(sums_[band * 3U * SUM_SIZE]);
+    for (size_t row = start; row < end; row++) {
+      FilterRow(frame, row, &(pixels[row * pitch]), sums);
+    }
+  });
+
+  return;
+}
+
+/*
+ * Generates the signal for a single row of the frame, then decodes it into
+ * the given pixels.
+ */
+void NtscFilter::FilterRow(const NesFrame *frame, size_t row, Pixel *pixels,
+                           float *sums) {
+  // Determine how the mask of the row affects its colors.
+  DataWord mask = frame->masks[row];
+  size_t emphasis = static_cast<size_t>(mask & FLAG_COLOR_TINT)
+                  << EMPHASIS_SHIFT;
+  DataWord color_mask = (mask & FLAG_GRAYSCALE) ? GRAYSCALE_MASK : PIXEL_MASK;
+  size_t row_phase = (row * ROW_PHASE_STEP + (frame->number & 1U)
+                   * FRAME_PHASE_STEP) % NTSC_PHASES;
+
+  // Write the level of each sample of the signal after the first entry of
+  // the luma sums. Each pixel starts its samples at its own phase.
+  float *y_sums = sums;
+  float *i_sums = &(sums[SUM_SIZE]);
+  float *q_sums = &(sums[2U * SUM_SIZE]);
+  const DataWord *colors = &(frame->pixels[row * NES_WIDTH]);
+  size_t phase = row_phase;
+  for (size_t x = 0; x < NES_WIDTH; x++) {
+    const float *levels = &(signal_levels_[(colors[x] & color_mask)
+                                           | emphasis][phase]);
+    memcpy(&(y_sums[x * NTSC_SAMPLES_PER_PIXEL + 1U]), levels,
+           NTSC_SAMPLES_PER_PIXEL * sizeof(float));
+    phase = (phase + NTSC_SAMPLES_PER_PIXEL) % NTSC_PHASES;
+  }
+
+  // Demodulate the chroma of each sample.
+  const float *carrier_i = &(carrier_i_[row_phase]);
+  const float *carrier_q = &(carrier_q_[row_phase]);
+  for (size_t s = 0; s < NTSC_ROW_SAMPLES; s++) {
+    i_sums[s + 1U] = y_sums[s + 1U] * carrier_i[s];
+    q_sums[s + 1U] = y_sums[s + 1U] * carrier_q[s];
+  }
+
+  // Turn the samples into running sums.
+  y_sums[0] = 0.0f;
+  i_sums[0] = 0.0f;
+  q_sums[0] = 0.0f;
+  for (size_t s = 0; s < NTSC_ROW_SAMPLES; s++) {
+    y_sums[s + 1U] += y_sums[s];
+    i_sums[s + 1U] += i_sums[s];
+    q_sums[s + 1U] += q_sums[s];
+  }
+
+  // Decode each output pixel from the window of samples around its center.
+  // Every window but those at the edges holds the same number of samples.
+  const float scale = 1.0f / static_cast<float>(DECODE_WINDOW);
+  for (size_t x = FIRST_FULL_OUT; x < END_FULL_OUT; x++) {
+    size_t start = x * SAMPLES_PER_OUT + SAMPLES_PER_OUT / 2U
+                 - DECODE_WINDOW / 2U;
+    size_t end = start + DECODE_WINDOW;
+    pixels[x] = ToPixel((y_sums[end] - y_sums[start]) * scale,
+                        (i_sums[end] - i_sums[start]) * scale,
+                        (q_sums[end] - q_sums[start]) * scale);
+  }
+  for (size_t x = 0; x < FIRST_FULL_OUT; x++) {
+    pixels[x] = DecodeEdge(x, y_sums, i_sums, q_sums);
+  }
+  for (size_t x = END_FULL_OUT; x < NTSC_WIDTH; x++) {
+    pixels[x] = DecodeEdge(x, y_sums, i_sums, q_sums);
+  }
+
+  return;
+}
+
+/*
+ * Decodes the given output pixel from the running sums of its row, with its
+ * window of samples cut short by the edge of the row.
+ */
+Pixel NtscFilter::DecodeEdge(size_t x, const float *y_sums,
+                             const float *i_sums, const float *q_sums) {
+  size_t center = x * SAMPLES_PER_OUT + SAMPLES_PER_OUT / 2U;
+  size_t start = (center > DECODE_WINDOW / 2U)
+               ? (center - DECODE_WINDOW / 2U) : 0;
+  size_t end = MIN(center + DECODE_WINDOW / 2U, NTSC_ROW_SAMPLES);
+  float scale = 1.0f / static_cast<float>(end - start);
+  return ToPixel((y_sums[end] - y_sums[start]) * scale,
+                 (i_sums[end] - i_sums[start]) * scale,
+                 (q_sums[end] - q_sums[start]) * scale);
+}
+
+/*
+ * Frees the running sums.
+ */
+NtscFilter::~NtscFilter(void) {
+  delete[] sums_;
+  return;
+}
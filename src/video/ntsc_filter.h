@@ -0,0 +1,76 @@
+#ifndef _NES_NTSCFILTER
+#define _NES_NTSCFILTER
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "../memory/palette.h"
+#include "./frame_buffer.h"
+#include "./worker_pool.h"
+
+// The filter produces this many output pixels for each NES pixel.
+#define NTSC_SCALE 2U
+#define NTSC_WIDTH (NES_WIDTH * NTSC_SCALE)
+
+// The composite signal is sampled this many times for each NES pixel,
+// and its color carrier repeats every NTSC_PHASES samples.
+#define NTSC_SAMPLES_PER_PIXEL 8U
+#define NTSC_PHASES 12U
+#define NTSC_ROW_SAMPLES (NES_WIDTH * NTSC_SAMPLES_PER_PIXEL)
+
+// The number of distinct PPU outputs, including the emphasis bits.
+#define NTSC_NUM_COLORS 0x200U
+
+// The signal levels of each color are repeated past a full carrier cycle,
+// so that the samples of any pixel can be read without wrapping the phase.
+#define NTSC_LEVEL_SPAN (NTSC_PHASES + NTSC_SAMPLES_PER_PIXEL)
+
+// The carrier is repeated across a row from each starting phase, so that a
+// row can be demodulated without wrapping the phase.
+#define NTSC_CARRIER_SPAN (NTSC_PHASES + NTSC_ROW_SAMPLES)
+
+/*
+ * Simulates the composite video signal produced by the NES PPU, then
+ * decodes it as an NTSC television would. This reproduces the color
+ * artifacts and emphasis behavior of real hardware, which a palette
+ * lookup cannot.
+ */
+class NtscFilter {
+  private:
+    // The signal level of each PPU output at each phase of the carrier.
+    float signal_levels_[NTSC_NUM_COLORS][NTSC_LEVEL_SPAN];
+
+    // The carrier, used to demodulate the I and Q components of the signal.
+    float carrier_i_[NTSC_CARRIER_SPAN];
+    float carrier_q_[NTSC_CARRIER_SPAN];
+
+    // Splits the rows of each frame across threads.
+    WorkerPool *workers_;
+
+    // Running sums of the demodulated signal, one set for each band.
+    float *sums_;
+
+    // Filters a single row of the frame.
+    void FilterRow(const NesFrame *frame, size_t row, Pixel *pixels,
+                   float *sums);
+
+    // Decodes a single output pixel at the edge of a row, whose window of
+    // samples is cut short.
+    Pixel DecodeEdge(size_t x, const float *y_sums, const float *i_sums,
+                     const float *q_sums);
+
+  public:
+    // Builds the signal tables. Frames are filtered on the given workers.
+    NtscFilter(WorkerPool *workers);
+
+    // Filters the given rows of the frame into the pixel buffer, which has
+    // the given pitch in pixels. Rows are placed at the same location they
+    // hold in the frame. Each row is NTSC_WIDTH pixels wide.
+    void Filter(const NesFrame *frame, size_t first_row, size_t num_rows,
+                Pixel *pixels, size_t pitch);
+
+    // Frees the running sums of the filter.
+    ~NtscFilter(void);
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * The upscaler implements the scale2x and scale3x pixel art scalers, along
+ * with scale4x, which applies scale2x twice. These scalers copy the center
+ * pixel into each output pixel, unless its neighbors form a diagonal edge,
+ * in which case the edge is extended into the output. Since they only
+ * compare colors for equality, they work the same on palette decoded frames
+ * and NTSC filtered frames.
+ *
+ * Each pass splits the source rows into bands, which are scaled in parallel.
+ * Pixels outside of the picture are treated as copies of the nearest edge.
+ */
+
+#include "./upscaler.h"
+
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+
+#include "../config/config.h"
+#include "../memory/palette.h"
+#include "../util/util.h"
+#include "../util/contracts.h"
+#include "./worker_pool.h"
+
+/*
+ * Creates the named upscaler, returning NULL if it is unknown.
+ */
+Upscaler *Upscaler::Create(const char *name, WorkerPool *workers) {
+  if (StrEq(name, kUpscalerScale2xVal)) {
+    return new Upscaler(SCALE_2X, 2U, workers);
+  } else if (StrEq(name, kUpscalerScale3xVal)) {
+    return new Upscaler(SCALE_3X, 3U, workers);
+  } else if (StrEq(name, kUpscalerScale4xVal)) {
+    return new Upscaler(SCALE_4X, 4U, workers);
+  } else {
+    return NULL;
+  }
+}
+
+/*
+ * Creates an upscaler of the given type.
+ */
+Upscaler::Upscaler(ScalerType type, size_t scale, WorkerPool *workers) {
+  type_ = type;
+  scale_ = scale;
+  workers_ = workers;
+  return;
+}
+
+/*
+ * Gets the factor frames are scaled by.
+ */
+size_t Upscaler::GetScale(void) {
+  return scale_;
+}
+
+/*
+ * Scales the source picture into the destination.
+ *
+ * Assumes the destination is large enough to hold the scaled picture.
+ */
+void Upscaler::Scale(const Pixel *src, size_t src_pitch, size_t width,
+                     size_t height, Pixel *dst, size_t dst_pitch) {
+  CONTRACT(dst_pitch >= width * scale_);
+
+  switch (type_) {
+    case SCALE_2X:
+      RunScale2x(src, src_pitch, width, height, dst, dst_pitch);
+      break;
+    case SCALE_3X:
+      RunScale3x(src, src_pitch, width, height, dst, dst_pitch);
+      break;
+    case SCALE_4X:
+      // Scale4x scales the picture twice, through an intermediate buffer.
+      if (pass_buffer_size_ < 4U * width * height) {
+        if (pass_buffer_ != NULL) { delete[] pass_buffer_; }
+        pass_buffer_size_ = 4U * width * height;
+        pass_buffer_ = new Pixel[pass_buffer_size_];
+      }
+      RunScale2x(src, src_pitch, width, height, pass_buffer_, 2U * width);
+      RunScale2x(pass_buffer_, 2U * width, 2U * width, 2U * height,
+                 dst, dst_pitch);
+      break;
+  }
+
+  return;
+}
+
+/*
+ * Runs scale2x over the whole picture, split across the workers.
+ */
+void Upscaler::RunScale2x(const Pixel *src, size_t src_pitch, size_t width,
+                          size_t height, Pixel *dst, size_t dst_pitch) {
+  size_t num_bands = workers_->GetNumBands();
+  workers_->Run([=](size_t band) {
+    Scale2xRows(src, src_pitch, width, height, (band * height) / num_bands,
+                ((band + 1U) * height) / num_bands, dst, dst_pitch);
+  });
+  return;
+}
+
+/*
+ * Runs scale3x over the whole picture, split across the workers.
+ */
+void Upscaler::RunScale3x(const Pixel *src, size_t src_pitch, size_t width,
+                          size_t height, Pixel *dst, size_t dst_pitch) {
+  size_t num_bands = workers_->GetNumBands();
+  workers_->Run([=](size_t band) {
+    Scale3xRows(src, src_pitch, width, height, (band * height) / num_bands,
+                ((band + 1U) * height) / num_bands, dst, dst_pitch);
+  });
+  return;
+}
+
+/*
+ * Scales the given rows of the source using scale2x. The neighbors of
+ * each pixel are named as follows:
+ *   . B .
+ *   D E F
+ *   . H .
+ */
+void Upscaler::Scale2xRows(const Pixel *src, size_t src_pitch, size_t width,
+                           size_t height, size_t first, size_t end,
+                           Pixel *dst, size_t dst_pitch) {
+  for (size_t y = first; y < end; y++) {
+    const Pixel *above = &(src[((y > 0) ? (y - 1U) : y) * src_pitch]);
+    const Pixel *row = &(src[y * src_pitch]);
+    const Pixel *below = &(src[((y + 1U < height) ? (y + 1U) : y) * src_pitch]);
+    Pixel *out0 = &(dst[(2U * y) * dst_pitch]);
+    Pixel *out1 = &(dst[(2U * y + 1U) * dst_pitch]);
+    for (size_t x = 0; x < width; x++) {
+      size_t left = (x > 0) ? (x - 1U) : x;
+      size_t right = (x + 1U < width) ? (x + 1U) : x;
+      Pixel b = above[x];
+      Pixel d = row[left];
+      Pixel e = row[x];
+      Pixel f = row[right];
+      Pixel h = below[x];
+      if ((b != h) && (d != f)) {
+        out0[2U * x] = (d == b) ? d : e;
+        out0[2U * x + 1U] = (b == f) ? f : e;
+        out1[2U * x] = (d == h) ? d : e;
+        out1[2U * x + 1U] = (h == f) ? f : e;
+      } else {
+        out0[2U * x] = e;
+        out0[2U * x + 1U] = e;
+        out1[2U * x] = e;
+        out1[2U * x + 1U] = e;
+      }
+    }
+  }
+
+  return;
+}
+
+/*
+ * Scales the given rows of the source using scale3x. The neighbors of
+ * each pixel are named as follows:
+ *   A B C
+ *   D E F
+ *   G H I
+ */
+void Upscaler::Scale3xRows(const Pixel *src, size_t src_pitch, size_t width,
+                           size_t height, size_t first, size_t end,
+                           Pixel *dst, size_t dst_pitch) {
+  for (size_t y = first; y < end; y++) {
+    const Pixel *above = &(src[((y > 0) ? (y - 1U) : y) * src_pitch]);
+    const Pixel *row = &(src[y * src_pitch]);
+    const Pixel *below = &(src[((y + 1U < height) ? (y + 1U) : y) * src_pitch]);
+    Pixel *out0 = &(dst[(3U * y) * dst_pitch]);
+    Pixel *out1 = &(dst[(3U * y + 1U) * dst_pitch]);
+    Pixel *out2 = &(dst[(3U * y + 2U) * dst_pitch]);
+    for (size_t x = 0; x < width; x++) {
+      size_t left = (x > 0) ? (x - 1U) : x;
+      size_t right = (x + 1U < width) ? (x + 1U) : x;
+      Pixel a = above[left];
+      Pixel b = above[x];
+      Pixel c = above[right];
+      Pixel d = row[left];
+      Pixel e = row[x];
+      Pixel f = row[right];
+      Pixel g = below[left];
+      Pixel h = below[x];
+      Pixel i = below[right];
+      Pixel *out = &(out0[3U * x]);
+      if ((b != h) && (d != f)) {
+        out[0] = (d == b) ? d : e;
+        out[1] = (((d == b) && (e != c)) || ((b == f) && (e != a))) ? b : e;
+        out[2] = (b == f) ? f : e;
+        out = &(out1[3U * x]);
+        out[0] = (((d == b) && (e != g)) || ((d == h) && (e != a))) ? d : e;
+        out[1] = e;
+        out[2] = (((b == f) && (e != i)) || ((h == f) && (e != c))) ? f : e;
+        out = &(out2[3U * x]);
+        out[0] = (d == h) ? d : e;
+        out[1] = (((d == h) && (e != i)) || ((h == f) && (e != g))) ? h : e;
+        out[2] = (h == f) ? f : e;
+      } else {
+        out[0] = e;
+        out[1] = e;
+        out[2] = e;
+        out = &(out1[3U * x]);
+        out[0] = e;
+        out[1] = e;
+        out[2] = e;
+        out = &(out2[3U * x]);
+        out[0] = e;
+        out[1] = e;
+        out[2] = e;
+      }
+    }
+  }
+
+  return;
+}
+
+/*
+ * Frees the intermediate buffer of the upscaler.
+ */
+Upscaler::~Upscaler(void) {
+  if (pass_buffer_ != NULL) { delete[] pass_buffer_; }
+  return;
+}
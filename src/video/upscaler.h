@@ -0,0 +1,64 @@
+#ifndef _NES_UPSCALER
+#define _NES_UPSCALER
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "../memory/palette.h"
+#include "./worker_pool.h"
+
+// The pixel art scaling algorithms which can be used.
+typedef enum {SCALE_2X, SCALE_3X, SCALE_4X} ScalerType;
+
+/*
+ * Upscales decoded frames using the scaleNx family of pixel art scalers,
+ * which smooth diagonal edges without blurring the picture. The rows of
+ * each frame are split across a pool of workers.
+ */
+class Upscaler {
+  private:
+    // The scaler used, and the factor it scales by.
+    ScalerType type_;
+    size_t scale_;
+
+    // Splits the rows of each frame across threads.
+    WorkerPool *workers_;
+
+    // Holds the intermediate picture of scalers made of several passes.
+    Pixel *pass_buffer_ = NULL;
+    size_t pass_buffer_size_ = 0;
+
+    Upscaler(ScalerType type, size_t scale, WorkerPool *workers);
+
+    // Scales the given rows of the source using a single scaler.
+    void Scale2xRows(const Pixel *src, size_t src_pitch, size_t width,
+                     size_t height, size_t first, size_t end,
+                     Pixel *dst, size_t dst_pitch);
+    void Scale3xRows(const Pixel *src, size_t src_pitch, size_t width,
+                     size_t height, size_t first, size_t end,
+                     Pixel *dst, size_t dst_pitch);
+
+    // Runs the given scaler on the workers.
+    void RunScale2x(const Pixel *src, size_t src_pitch, size_t width,
+                    size_t height, Pixel *dst, size_t dst_pitch);
+    void RunScale3x(const Pixel *src, size_t src_pitch, size_t width,
+                    size_t height, Pixel *dst, size_t dst_pitch);
+
+  public:
+    // Creates the named upscaler, which runs on the given workers.
+    // Returns NULL if the name is unknown.
+    static Upscaler *Create(const char *name, WorkerPool *workers);
+
+    // Gets the factor frames are scaled by.
+    size_t GetScale(void);
+
+    // Scales the source picture into the destination, which must be
+    // GetScale() times larger in each dimension. Pitches are in pixels.
+    void Scale(const Pixel *src, size_t src_pitch, size_t width,
+               size_t height, Pixel *dst, size_t dst_pitch);
+
+    // Frees the intermediate buffer of the upscaler.
+    ~Upscaler(void);
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * The worker pool runs jobs split into bands, such as groups of scanlines,
+ * across several threads. It is used by the video filters, which are too
+ * expensive to run on the presenter thread alone.
+ *
+ * The emulation and presenter already occupy two threads, so the pool only
+ * creates workers for the remaining hardware threads, up to a small limit.
+ * On hosts with few threads, jobs simply run on the calling thread.
+ */
+
+#include "./worker_pool.h"
+
+#include <new>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "../util/util.h"
+
+// The number of threads reserved for the emulation and the presenter.
+#define RESERVED_THREADS 2U
+
+// The most workers a pool will create.
+#define MAX_WORKERS 3U
+
+/*
+ * Creates the worker threads of the pool.
+ */
+WorkerPool::WorkerPool(void) {
+  size_t host_threads = std::thread::hardware_concurrency();
+  num_workers_ = (host_threads > RESERVED_THREADS)
+               ? MIN(host_threads - RESERVED_THREADS, MAX_WORKERS) : 0;
+
+  // The calling thread runs band 0, so workers start at band 1.
+  workers_ = new std::thread[num_workers_];
+  for (size_t i = 0; i < num_workers_; i++) {
+    workers_[i] = std::thread(&WorkerPool::RunWorker, this, i + 1);
+  }
+
+  return;
+}
+
+/*
+ * Gets the number of bands jobs are split into, which is one for each
+ * worker and one for the calling thread.
+ */
+size_t WorkerPool::GetNumBands(void) {
+  return num_workers_ + 1;
+}
+
+/*
+ * Runs the given job on every band, then waits for all of them to finish.
+ */
+void WorkerPool::Run(const std::function<void(size_t)> &job) {
+  // Start the job on the workers.
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    job_ = &job;
+    bands_remaining_ = num_workers_;
+    generation_++;
+  }
+  work_signal_.notify_all();
+
+  // Run the first band on this thread, then wait for the others.
+  job(0);
+  std::unique_lock<std::mutex> guard(lock_);
+  done_signal_.wait(guard, [this] { return bands_remaining_ == 0; });
+  job_ = NULL;
+
+  return;
+}
+
+/*
+ * Waits for jobs, running the given band of each, until the pool closes.
+ */
+void WorkerPool::RunWorker(size_t band) {
+  size_t last_generation = 0;
+  std::unique_lock<std::mutex> guard(lock_);
+  while (true) {
+    work_signal_.wait(guard, [this, last_generation] {
+      return closing_ || (generation_ != last_generation);
+    });
+    if (closing_) { break; }
+    last_generation = generation_;
+
+    // Run the band without holding the lock.
+    const std::function<void(size_t)> *job = job_;
+    guard.unlock();
+    (*job)(band);
+    guard.lock();
+
+    // Wake the caller once every band is complete.
+    bands_remaining_--;
+    if (bands_remaining_ == 0) { done_signal_.notify_one(); }
+  }
+
+  return;
+}
+
+/*
+ * Stops and joins each worker.
+ */
+WorkerPool::~WorkerPool(void) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    closing_ = true;
+  }
+  work_signal_.notify_all();
+  for (size_t i = 0; i < num_workers_; i++) { workers_[i].join(); }
+  delete[] workers_;
+  return;
+}
@@ -0,0 +1,53 @@
+#ifndef _NES_WORKERPOOL
+#define _NES_WORKERPOOL
+
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+ * A small pool of threads used to split the work of a video filter into
+ * bands. The calling thread works on the first band, and waits for the
+ * workers to finish the others.
+ */
+class WorkerPool {
+  private:
+    // The worker threads of the pool.
+    std::thread *workers_;
+    size_t num_workers_;
+
+    // The job currently being run, and the number of bands still running.
+    const std::function<void(size_t)> *job_ = NULL;
+    size_t bands_remaining_ = 0;
+
+    // Incremented each time a job is started, so that workers can tell
+    // when new work is available.
+    size_t generation_ = 0;
+    bool closing_ = false;
+
+    // Guards the job state shared with the workers.
+    std::mutex lock_;
+    std::condition_variable work_signal_;
+    std::condition_variable done_signal_;
+
+    // Runs a band of each job until the pool is deleted.
+    void RunWorker(size_t band);
+
+  public:
+    // Creates a pool with a number of workers suited to the host.
+    WorkerPool(void);
+
+    // Gets the number of bands each job is split into.
+    size_t GetNumBands(void);
+
+    // Runs the given job once for each band, and returns when all bands
+    // have completed.
+    void Run(const std::function<void(size_t)> &job);
+
+    // Stops and joins the worker threads.
+    ~WorkerPool(void);
+};
+
+#endif